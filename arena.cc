@@ -0,0 +1,130 @@
+/**
+ * arena.cc - A bump allocator for short-lived strings.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <string.h>
+
+#include "arena.h"
+
+
+/**
+ * Constructor.
+ */
+CArena::CArena( size_t block )
+{
+    m_block    = block ? block : ARENA_BLOCK_SIZE;
+    m_capacity = 0;
+    m_next  = NULL;
+    m_left  = 0;
+    m_used  = 0;
+}
+
+
+/**
+ * Destructor.
+ */
+CArena::~CArena()
+{
+    std::vector<char *>::iterator it;
+    for (it = m_blocks.begin(); it != m_blocks.end(); ++it)
+        delete[] *it;
+}
+
+
+/**
+ * Start a new block.  Each is double the size of the last, so a large
+ * scan needs few of them.
+ */
+void CArena::grow( size_t len )
+{
+    if ( ! m_blocks.empty() )
+        m_block *= 2;
+    while( m_block < len )
+        m_block *= 2;
+
+    char *block = new char[m_block];
+    m_blocks.push_back( block );
+    m_capacity += m_block;
+    m_next = block;
+    m_left = m_block;
+}
+
+
+/**
+ * Allocate the given number of characters.
+ */
+char *CArena::alloc( size_t len )
+{
+    if ( len > m_left )
+        grow( len );
+
+    char *result = m_next;
+    m_next += len;
+    m_left -= len;
+    m_used += len;
+    return( result );
+}
+
+
+/**
+ * Copy a string into the arena.
+ */
+TStringRef CArena::copy( const TStringRef &str )
+{
+    char *p = alloc( str.size + 1 );
+    memcpy( p, str.data, str.size );
+    p[str.size] = '\0';
+    return( TStringRef( p, str.size ) );
+}
+
+
+/**
+ * Store the concatenation of two strings.
+ */
+TStringRef CArena::join( const TStringRef &a, const TStringRef &b )
+{
+    char *p = alloc( a.size + b.size + 1 );
+    memcpy( p, a.data, a.size );
+    memcpy( p + a.size, b.data, b.size );
+    p[a.size + b.size] = '\0';
+    return( TStringRef( p, a.size + b.size ) );
+}
+
+
+/**
+ * Discard everything.
+ *
+ * If we outgrew the first block then all are replaced by one as large as
+ * them all, so the next round of the same size fits in a single block.
+ */
+void CArena::reset()
+{
+    if ( m_blocks.size() > 1 )
+    {
+        std::vector<char *>::iterator it;
+        for (it = m_blocks.begin(); it != m_blocks.end(); ++it)
+            delete[] *it;
+        m_blocks.clear();
+
+        m_block = m_capacity;
+        m_blocks.push_back( new char[m_block] );
+    }
+
+    m_next = m_blocks.empty() ? NULL : m_blocks.back();
+    m_left = m_blocks.empty() ? 0 : m_block;
+    m_used = 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * arena.h - A bump allocator for short-lived strings.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _arena_h_
+#define _arena_h_ 1
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "stringref.h"
+
+
+/**
+ * The size of the first block an arena allocates.
+ */
+#define ARENA_BLOCK_SIZE ( 64 * 1024 )
+
+
+/**
+ * An arena of characters, for strings which all die at the same time:
+ * the paths found by one scan of a folder, for example.
+ *
+ * Allocation bumps a pointer within the current block, and nothing is
+ * freed individually.  Instead reset() discards everything at once, and
+ * keeps the memory for reuse, so an arena used once per scan stops
+ * calling malloc at all after the first.
+ */
+class CArena
+{
+
+public:
+
+    /**
+     * Constructor.  Nothing is allocated until it is needed.
+     */
+    CArena( size_t block = ARENA_BLOCK_SIZE );
+
+    /**
+     * Destructor.  Frees all blocks.
+     */
+    ~CArena();
+
+    /**
+     * Allocate the given number of characters.
+     */
+    char *alloc( size_t len );
+
+    /**
+     * Copy the given string into the arena, with a trailing NUL.
+     */
+    TStringRef copy( const TStringRef &str );
+
+    /**
+     * Store the concatenation of two strings, with a trailing NUL.
+     */
+    TStringRef join( const TStringRef &a, const TStringRef &b );
+
+    /**
+     * Discard everything allocated, keeping the memory.
+     */
+    void reset();
+
+    /**
+     * The number of characters handed out since the last reset.
+     */
+    size_t used() { return( m_used ); }
+
+    /**
+     * The number of blocks we hold.
+     */
+    size_t blocks() { return( m_blocks.size() ); }
+
+private:
+
+    /**
+     * Arenas aren't copied.
+     */
+    CArena( const CArena & );
+    CArena & operator=( const CArena & );
+
+    /**
+     * Start a new block with room for at least the given size.
+     */
+    void grow( size_t len );
+
+    /**
+     * Our blocks, their total size, the size of the last, and the free
+     * space in it.
+     */
+    std::vector<char *> m_blocks;
+    size_t m_capacity;
+    size_t m_block;
+    char *m_next;
+    size_t m_left;
+
+    /**
+     * Characters handed out since the last reset.
+     */
+    size_t m_used;
+
+};
+
+#endif /* _arena_h_ */
@@ -29,12 +29,23 @@
 #include <ncurses.h>
 #include <unistd.h>
 
+#include "eventloop.h"
 #include "file.h"
+#include "format.h"
 #include "maildir.h"
 #include "lang.h"
 #include "lua.h"
 #include "global.h"
+#include "headercache.h"
+#include "headerpool.h"
+#include "mimecache.h"
+#include "process.h"
 #include "screen.h"
+#include "searchindex.h"
+#include "query.h"
+#include "sort.h"
+#include "virtualfolders.h"
+#include "watcher.h"
 
 
 
@@ -155,12 +166,126 @@ int maildir_prefix(lua_State * L)
 }
 
 
+/**
+ * Get, or set, the number of bytes of parsed messages kept in memory.
+ */
+int mime_cache_limit(lua_State * L)
+{
+    const char *str = lua_tostring(L, -1);
+    if (str != NULL)
+    {
+        if ( atoll( str ) < 0 )
+            return luaL_error(L, "non-negative integer expected for mime_cache_limit(..)" );
+    }
+
+    int ret = get_set_string_variable(L, "mime_cache_limit" );
+
+    if (str != NULL)
+    {
+        CGlobal *global = CGlobal::Instance();
+        CMimeCache::Instance()->set_limit( global->get_mime_cache_limit() );
+    }
+    return ret;
+}
+
+
+/**
+ * Return the bytes of parsed messages held in memory, the number of
+ * messages, and the number evicted to stay within the limit.
+ */
+int mime_cache_stats(lua_State * L)
+{
+    CMimeCache *cache = CMimeCache::Instance();
+
+    lua_pushinteger(L, cache->resident() );
+    lua_pushinteger(L, cache->count() );
+    lua_pushinteger(L, cache->evictions() );
+    return 3;
+}
+
+
+/**
+ * Get, or set, the number of threads used to parse message headers.
+ */
+int parse_threads(lua_State * L)
+{
+    const char *str = lua_tostring(L, -1);
+    if (str != NULL)
+    {
+        if ( atoi( str ) < 0 )
+            return luaL_error(L, "non-negative integer expected for parse_threads(..)" );
+    }
+
+    int ret = get_set_string_variable(L, "parse_threads" );
+
+    if (str != NULL)
+    {
+        CGlobal *global = CGlobal::Instance();
+        CHeaderPool::Instance()->set_threads( global->get_parse_threads() );
+    }
+    return ret;
+}
+
+
+/**
+ * Get, or set, the number of threads used to scan the maildir-prefix.
+ */
+int scan_threads(lua_State * L)
+{
+    const char *str = lua_tostring(L, -1);
+    if (str != NULL)
+    {
+        if ( atoi( str ) < 1 )
+            return luaL_error(L, "positive integer expected for scan_threads(..)" );
+    }
+
+    return( get_set_string_variable(L, "scan_threads" ) );
+}
+
+
+/**
+ * Get, or set, the order in which messages are sorted.
+ */
+int sort_order(lua_State * L)
+{
+    const char *str = lua_tostring(L, -1);
+    if (str != NULL)
+    {
+        TSortOrder order;
+        if ( ! CSort::parse_order( str, &order ) )
+            return luaL_error(L, "unknown sort order: arrival, mtime, date, from, subject, or size expected" );
+    }
+
+    int ret = get_set_string_variable(L, "sort_order" );
+
+    /**
+     * Re-sort the selected messages.
+     */
+    if (str != NULL)
+    {
+        CGlobal *global = CGlobal::Instance();
+        global->update_messages();
+    }
+    return ret;
+}
+
+
 /**
  * Get, or set, the index-format
  */
 int index_format(lua_State * L)
 {
-    return( get_set_string_variable(L, "index_format" ) );
+    const char *str = lua_tostring(L, -1);
+
+    int ret = get_set_string_variable(L, "index_format" );
+
+    /**
+     * Any compiled formats are now stale.
+     */
+    if (str != NULL)
+        CFormat::clear_cache();
+
+    return ret;
 }
 
 
@@ -210,9 +335,20 @@ int maildir_limit(lua_State * L)
 
 /**
  * Get, or set, the index limit.
+ *
+ * A "query:" limit is compiled first, so that mistakes are reported
+ * rather than hiding every message.
  */
 int index_limit(lua_State * L)
 {
+    const char *str = lua_tostring(L, -1);
+    if (str != NULL)
+    {
+        CQuery *query = CQuery::compiled( str );
+        if ( query != NULL && ! query->error().empty() )
+            return luaL_error(L, "invalid index_limit: %s", query->error().c_str() );
+    }
+
     int ret =  get_set_string_variable( L, "index_limit" );
 
     /**
@@ -224,6 +360,33 @@ int index_limit(lua_State * L)
 }
 
 
+/**
+ * Get, or set, how the index is shown: "flat", or "threaded" to group
+ * replies beneath the message they answer.
+ */
+int index_view(lua_State * L)
+{
+    const char *str = lua_tostring(L, -1);
+    if (str != NULL)
+    {
+        if ( strcmp( str, "flat" ) != 0 && strcmp( str, "threaded" ) != 0 )
+            return luaL_error(L, "unknown index view: flat, or threaded expected" );
+    }
+
+    int ret = get_set_string_variable( L, "index_view" );
+
+    /**
+     * Re-draw the selected messages.
+     */
+    if (str != NULL)
+    {
+        CGlobal *global = CGlobal::Instance();
+        global->update_messages();
+    }
+    return ret;
+}
+
+
 /**
  * Get, or set, the default from address.
  */
@@ -269,6 +432,7 @@ int clear(lua_State * L)
         mvprintw( i, 0, "%s", blank.c_str() );
 
     refresh();
+    CScreen::invalidate();
     return 0;
 }
 
@@ -280,6 +444,7 @@ int refresh_display(lua_State * L)
 {
     clear();
     refresh();
+    CScreen::invalidate();
     return 0;
 }
 
@@ -298,6 +463,175 @@ int sleep(lua_State *L )
 }
 
 
+/**
+ * The Lua functions of the timers added by after() and every(), by id.
+ */
+static std::map<int, int> timer_refs;
+
+
+/**
+ * Release the function of a timer which has finished.
+ */
+static void release_timer( int ref )
+{
+    std::map<int, int>::iterator it;
+    for (it = timer_refs.begin(); it != timer_refs.end(); ++it)
+    {
+        if ( it->second == ref )
+        {
+            timer_refs.erase( it );
+            break;
+        }
+    }
+    CLua::Instance()->unref( ref );
+}
+
+
+/**
+ * Add a timer to call the given function, once or repeatedly.
+ */
+static int add_timer(lua_State * L, const char *name, bool repeat)
+{
+    if ( ! lua_isnumber(L, 1) || ! lua_isfunction(L, 2) )
+        return luaL_error(L, "%s(seconds, function) expected", name );
+
+    double seconds = lua_tonumber(L, 1);
+    if ( seconds < 0 || ( repeat && seconds <= 0 ) )
+        return luaL_error(L, "positive number of seconds expected for %s(..)", name );
+
+    CLua *lua = CLua::Instance();
+    int ref   = lua->ref_function( 2 );
+    int id;
+
+    if ( repeat )
+    {
+        id = CEventLoop::Instance()->add_timer( seconds, seconds, [ref]()
+        {
+            CLua::Instance()->call_ref( ref );
+        } );
+    }
+    else
+    {
+        id = CEventLoop::Instance()->add_timer( seconds, 0, [ref]()
+        {
+            CLua::Instance()->call_ref( ref );
+            release_timer( ref );
+        } );
+    }
+
+    /**
+     * Remember the function, so it is released if the timer is cancelled.
+     */
+    timer_refs[id] = ref;
+
+    lua_pushinteger(L, id );
+    return 1;
+}
+
+
+/**
+ * Call a function once, after the given number of seconds.
+ */
+int after(lua_State * L)
+{
+    return( add_timer( L, "after", false ) );
+}
+
+
+/**
+ * Call a function every given number of seconds.
+ */
+int every(lua_State * L)
+{
+    return( add_timer( L, "every", true ) );
+}
+
+
+/**
+ * Cancel a timer added by after() or every().
+ */
+int cancel_timer(lua_State * L)
+{
+    int id = lua_tointeger(L, 1);
+
+    bool found = CEventLoop::Instance()->cancel_timer( id );
+    if ( found && timer_refs.find( id ) != timer_refs.end() )
+        release_timer( timer_refs[id] );
+
+    lua_pushboolean(L, found );
+    return 1;
+}
+
+
+/**
+ * Run a command in the background, calling a function when it finishes,
+ * and, optionally, another with each line it writes.
+ */
+int spawn(lua_State * L)
+{
+    const char *cmd = lua_tostring(L, 1);
+    if (cmd == NULL)
+	return luaL_error(L, "Missing argument to spawn(..)");
+
+    if ( ! lua_isnoneornil(L, 2) && ! lua_isfunction(L, 2) )
+        return luaL_error(L, "spawn(cmd, on_exit [, on_output]) expected" );
+    if ( ! lua_isnoneornil(L, 3) && ! lua_isfunction(L, 3) )
+        return luaL_error(L, "spawn(cmd, on_exit [, on_output]) expected" );
+
+    CLua *lua      = CLua::Instance();
+    int exit_ref   = lua->ref_function( 2 );
+    int output_ref = lua->ref_function( 3 );
+
+    CProcess::TOutputFunction on_output;
+    if ( output_ref != LUA_NOREF )
+    {
+        on_output = [output_ref]( const std::string &line )
+        {
+            CLua::Instance()->call_ref( output_ref, line );
+        };
+    }
+
+    pid_t pid = CProcess::Instance()->spawn( cmd, on_output, [exit_ref, output_ref]( int code )
+    {
+        /**
+         * The command may well have changed our maildirs: pick up what
+         * it did now, rather than when the watcher next gets to it.
+         * Without inotify the selected folders are rescanned instead,
+         * which merges in only the messages which differ.
+         */
+        CWatcher *watcher = CWatcher::Instance();
+        CGlobal  *global  = CGlobal::Instance();
+
+        if ( watcher->fd() >= 0 )
+        {
+            if ( watcher->poll() )
+                global->changed();
+        }
+        else
+        {
+            global->update_messages();
+            global->changed();
+        }
+
+        CLua *lua = CLua::Instance();
+        lua->call_ref( exit_ref, code );
+        lua->unref( exit_ref );
+        lua->unref( output_ref );
+    } );
+
+    if ( pid < 0 )
+    {
+        lua->unref( exit_ref );
+        lua->unref( output_ref );
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushinteger(L, pid );
+    return 1;
+}
+
+
 /**
  * Exit the program.
  */
@@ -305,6 +639,9 @@ int exit(lua_State * L)
 {
     endwin();
 
+    CHeaderCache::Instance()->flush();
+    CSearchIndex::Instance()->flush();
+
     CLua *lua = CLua::Instance();
     lua->call_function("on_exit");
 
@@ -470,6 +807,10 @@ int prompt_maildir(lua_State * L)
     int selected = 0;
     int height = CScreen::height();
 
+    /**
+     * We draw over the whole screen.
+     */
+    CScreen::invalidate();
 
     while (true)
     {
@@ -1410,6 +1751,120 @@ int count_messages(lua_State * L)
 }
 
 
+/**
+ * Return the number of messages whose headers have been parsed in the
+ * background, and the number queued, since the parser was last idle.
+ */
+int parse_progress(lua_State * L)
+{
+    long done, total;
+    CHeaderPool::Instance()->progress( &done, &total );
+
+    lua_pushinteger(L, done );
+    lua_pushinteger(L, total );
+    return 2;
+}
+
+
+/**
+ * Return the paths of all messages containing every word of the query,
+ * from the full-text index.
+ */
+int search(lua_State * L)
+{
+    const char *str = lua_tostring(L, -1);
+    if (str == NULL)
+        return luaL_error(L, "Missing argument to search(..)");
+
+    std::vector<std::string> paths = CSearchIndex::Instance()->search( str );
+    std::vector<std::string>::iterator it;
+
+    lua_newtable(L);
+
+    int i = 1;
+    for (it = paths.begin(); it != paths.end(); ++it)
+    {
+        lua_pushnumber(L,i);
+        lua_pushstring(L,(*it).c_str());
+        lua_settable(L,-3);
+        i++;
+    }
+    return 1;
+}
+
+
+/**
+ * Queue every maildir for full-text indexing.  New messages are indexed
+ * while we're idle, and the number waiting is returned.
+ */
+int search_index(lua_State * L)
+{
+    CGlobal::Instance()->index_all_folders();
+
+    lua_pushinteger(L, CSearchIndex::Instance()->pending() );
+    return 1;
+}
+
+
+/**
+ * Return the number of messages in the full-text index, the number of
+ * distinct words, and the number of messages waiting to be indexed.
+ */
+int search_stats(lua_State * L)
+{
+    CSearchIndex *index = CSearchIndex::Instance();
+
+    lua_pushinteger(L, index->documents() );
+    lua_pushinteger(L, index->words() );
+    lua_pushinteger(L, index->pending() );
+    return 3;
+}
+
+
+/**
+ * Define a virtual folder, holding every message which matches a query:
+ *
+ *   virtual_folder( "unread", "flag:N" )
+ *
+ * An empty query removes the folder, and without one the current query
+ * is returned, or nil.
+ */
+int virtual_folder(lua_State * L)
+{
+    const char *name  = lua_tostring(L, 1);
+    const char *query = lua_tostring(L, 2);
+    if (name == NULL)
+        return luaL_error(L, "Missing argument to virtual_folder(..)");
+
+    CVirtualFolders *folders = CVirtualFolders::Instance();
+
+    if (query != NULL)
+    {
+        bool first = folders->names().empty();
+
+        std::string error = folders->define( name, query );
+        if ( ! error.empty() )
+            return luaL_error(L, "invalid query for virtual_folder: %s", error.c_str() );
+
+        /**
+         * Virtual folders are filled from the full-text index, so the
+         * first one needs every maildir indexed.
+         */
+        if ( *query && first )
+            CGlobal::Instance()->index_all_folders();
+
+        CWatcher::Instance()->watch_everything( ! folders->names().empty() );
+    }
+
+    std::string current = folders->query( name );
+    if ( current.empty() )
+        lua_pushnil(L);
+    else
+        lua_pushstring(L, current.c_str());
+    return 1;
+}
+
+
 /**
  * Compose a new mail.
  */
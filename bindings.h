@@ -82,9 +82,25 @@ int maildir_limit(lua_State * L);
 /* limit the display of messages. */
 int index_limit(lua_State * L);
 
+/* get/set whether the index is threaded. */
+int index_view(lua_State * L);
+
 /* get/set the global maildir-prefix */
 int maildir_prefix(lua_State * L);
 
+/* get/set the memory budget for parsed messages, and report its usage */
+int mime_cache_limit(lua_State * L);
+int mime_cache_stats(lua_State * L);
+
+/* get/set the number of threads used to parse message headers */
+int parse_threads(lua_State * L);
+
+/* get/set the number of threads used to scan the maildir-prefix */
+int scan_threads(lua_State * L);
+
+/* get/set the order in which messages are sorted */
+int sort_order(lua_State * L);
+
 /* get/set teh editor */
 int editor(lua_State *L);
 
@@ -153,6 +169,18 @@ int refresh_display(lua_State * L);
 /* sleep */
 int sleep(lua_State *L );
 
+/**
+ * Timers.
+ */
+int after(lua_State * L);
+int every(lua_State * L);
+int cancel_timer(lua_State * L);
+
+/**
+ * Background commands.
+ */
+int spawn(lua_State * L);
+
 /* get/set the default from address */
 int from(lua_State * L);
 
@@ -174,6 +202,19 @@ int add_selected_folder(lua_State * L);
 int toggle_selected_folder(lua_State * L);
 int set_selected_folder(lua_State * L);
 int count_messages(lua_State * L);
+int parse_progress(lua_State * L);
+
+/**
+ * Full-text search.
+ */
+int search(lua_State * L);
+int search_index(lua_State * L);
+int search_stats(lua_State * L);
+
+/**
+ * Virtual folders.
+ */
+int virtual_folder(lua_State * L);
 
 /**
  * Accessors for the screen dimensions.
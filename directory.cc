@@ -0,0 +1,157 @@
+/**
+ * directory.cc - Fast directory-scanning primitives.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+
+#include "directory.h"
+
+
+/**
+ * The record layout returned by the getdents64 system-call.
+ */
+struct linux_dirent64
+{
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+
+
+/**
+ * Open the directory with the given path.
+ */
+CDirectory::CDirectory( std::string path )
+{
+    m_fd     = open( path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    m_size   = 0;
+    m_offset = 0;
+}
+
+
+/**
+ * Destructor: close the descriptor.
+ */
+CDirectory::~CDirectory()
+{
+    if ( m_fd >= 0 )
+        close( m_fd );
+}
+
+
+/**
+ * Did we open the directory successfully?
+ */
+bool CDirectory::is_open()
+{
+    return( m_fd >= 0 );
+}
+
+
+/**
+ * Refill our buffer from the kernel.
+ */
+bool CDirectory::fill()
+{
+    if ( m_fd < 0 )
+        return false;
+
+    long n = syscall( SYS_getdents64, m_fd, m_buffer, sizeof(m_buffer) );
+    if ( n <= 0 )
+        return false;
+
+    m_size   = (int)n;
+    m_offset = 0;
+    return true;
+}
+
+
+/**
+ * Read the next entry, skipping "." and "..".
+ */
+bool CDirectory::next( const char **name, bool *is_dir )
+{
+    while( true )
+    {
+        if ( m_offset >= m_size )
+        {
+            if ( ! fill() )
+                return false;
+        }
+
+        struct linux_dirent64 *de = (struct linux_dirent64 *)( m_buffer + m_offset );
+        m_offset += de->d_reclen;
+
+        /**
+         * Skip the self/parent entries.
+         */
+        const char *n = de->d_name;
+        if ( ( n[0] == '.' ) &&
+             ( ( n[1] == '\0' ) || ( ( n[1] == '.' ) && ( n[2] == '\0' ) ) ) )
+            continue;
+
+        *name = n;
+
+        /**
+         * The common case: the kernel told us what this is.
+         *
+         * Symlinks are resolved so that we match stat(2) semantics.
+         */
+        if ( ( de->d_type != DT_UNKNOWN ) && ( de->d_type != DT_LNK ) )
+        {
+            *is_dir = ( de->d_type == DT_DIR );
+            return true;
+        }
+
+        struct stat sb;
+        if ( fstatat( m_fd, n, &sb, 0 ) == 0 )
+            *is_dir = S_ISDIR(sb.st_mode);
+        else
+            *is_dir = false;
+
+        return true;
+    }
+}
+
+
+/**
+ * Count the non-directory entries in the given directory.
+ */
+int CDirectory::count_files( std::string path )
+{
+    CDirectory dir( path );
+    int count = 0;
+
+    const char *name;
+    bool is_dir;
+    while( dir.next( &name, &is_dir ) )
+    {
+        if ( ! is_dir )
+            count += 1;
+    }
+    return( count );
+}
+
@@ -0,0 +1,100 @@
+/**
+ * directory.h - Fast directory-scanning primitives.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _directory_h_
+#define _directory_h_ 1
+
+#include <string>
+
+
+/**
+ * Size of the buffer we pass to getdents64.
+ */
+#ifndef DIRECTORY_READ_BUFFER
+# define DIRECTORY_READ_BUFFER 32768
+#endif
+
+
+/**
+ * A handle to an open directory, which is read via getdents64.
+ *
+ * Entries are returned with the type reported by the kernel, so the
+ * caller never needs to stat() them.  Only when the filesystem cannot
+ * tell us the type (DT_UNKNOWN), or the entry is a symlink, do we fall
+ * back to a single fstatat() relative to the directory descriptor.
+ */
+class CDirectory
+{
+
+public:
+
+    /**
+     * Open the directory with the given path.
+     */
+    CDirectory( std::string path );
+
+    /**
+     * Destructor: close the descriptor.
+     */
+    ~CDirectory();
+
+    /**
+     * Did we open the directory successfully?
+     */
+    bool is_open();
+
+    /**
+     * Read the next entry, skipping "." and "..".
+     *
+     * Returns false when the directory is exhausted.  The name is only
+     * valid until the next call.
+     */
+    bool next( const char **name, bool *is_dir );
+
+    /**
+     * Count the non-directory entries in the given directory.
+     */
+    static int count_files( std::string path );
+
+private:
+
+    /**
+     * Refill our buffer from the kernel.
+     */
+    bool fill();
+
+    /**
+     * The descriptor of the directory we're reading.
+     */
+    int m_fd;
+
+    /**
+     * Buffer of raw linux_dirent64 records, aligned for their 64-bit
+     * fields.
+     */
+    alignas(8) char m_buffer[DIRECTORY_READ_BUFFER];
+
+    /**
+     * The number of valid bytes in the buffer, and our offset into it.
+     */
+    int m_size;
+    int m_offset;
+
+};
+
+#endif /* _directory_h_ */
@@ -0,0 +1,347 @@
+/**
+ * eventloop.cc - Waiting for input, timers, signals, and descriptors.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "eventloop.h"
+
+
+/**
+ * Instance-handle.
+ */
+CEventLoop *CEventLoop::pinstance = NULL;
+
+
+/**
+ * The wake-up pipe, which doesn't exist until the loop does.
+ */
+int CEventLoop::m_wake[2] = { -1, -1 };
+
+
+/**
+ * Get access to our singleton-object.
+ */
+CEventLoop *CEventLoop::Instance()
+{
+    if (!pinstance)
+        pinstance = new CEventLoop;
+
+    return pinstance;
+}
+
+
+/**
+ * Constructor - This is private as this class is a singleton.
+ */
+CEventLoop::CEventLoop()
+{
+    m_next_timer = 1;
+
+    if ( pipe2( m_wake, O_NONBLOCK | O_CLOEXEC ) != 0 )
+    {
+        DEBUG_LOG( "Failed to create the wake-up pipe, signals will wait for a timer." );
+        m_wake[0] = m_wake[1] = -1;
+    }
+}
+
+
+/**
+ * The current time, in seconds.
+ */
+double CEventLoop::now()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( ts.tv_sec + ts.tv_nsec / 1000000000.0 );
+}
+
+
+/**
+ * Watch a descriptor.
+ */
+void CEventLoop::watch( int fd, TEventFunction fn )
+{
+    if ( fd >= 0 )
+        m_watches[fd] = fn;
+}
+
+
+/**
+ * Stop watching a descriptor.
+ */
+void CEventLoop::unwatch( int fd )
+{
+    m_watches.erase( fd );
+}
+
+
+/**
+ * Handle a signal in the loop.
+ */
+void CEventLoop::on_signal( int sig, TEventFunction fn )
+{
+    m_signals[sig] = fn;
+
+    /**
+     * No SA_RESTART, so that a blocking read is interrupted too.
+     */
+    struct sigaction sa;
+    memset( &sa, 0, sizeof(sa) );
+    sa.sa_handler = CEventLoop::signalled;
+    sigemptyset( &sa.sa_mask );
+    sigaction( sig, &sa, NULL );
+}
+
+
+/**
+ * Our signal handler: pass the signal down the pipe.
+ */
+void CEventLoop::signalled( int sig )
+{
+    int saved = errno;
+
+    unsigned char c = (unsigned char)sig;
+    if ( m_wake[1] >= 0 )
+    {
+        /**
+         * If the pipe is full the loop is already due to wake.
+         */
+        ssize_t written = write( m_wake[1], &c, 1 );
+        (void)written;
+    }
+
+    errno = saved;
+}
+
+
+/**
+ * Wake the loop.
+ */
+void CEventLoop::wake()
+{
+    signalled( 0 );
+}
+
+
+/**
+ * Add a timer.
+ */
+int CEventLoop::add_timer( double seconds, double interval, TEventFunction fn )
+{
+    TTimer timer;
+    timer.due      = now() + std::max( seconds, 0.0 );
+    timer.interval = interval;
+    timer.fn       = fn;
+
+    int id = m_next_timer++;
+    m_timers[id] = timer;
+    return( id );
+}
+
+
+/**
+ * Cancel a timer.
+ */
+bool CEventLoop::cancel_timer( int id )
+{
+    return( m_timers.erase( id ) > 0 );
+}
+
+
+/**
+ * Run the timers which are due.
+ *
+ * A timer may add, or cancel, timers - including itself - so we find
+ * those due first, and look each up again before running it.
+ */
+bool CEventLoop::run_timers()
+{
+    double t = now();
+
+    std::vector<int> due;
+    std::map<int, TTimer>::iterator it;
+    for (it = m_timers.begin(); it != m_timers.end(); ++it)
+    {
+        if ( it->second.due <= t )
+            due.push_back( it->first );
+    }
+
+    std::vector<int>::iterator dit;
+    for (dit = due.begin(); dit != due.end(); ++dit)
+    {
+        it = m_timers.find( *dit );
+        if ( it == m_timers.end() )
+            continue;
+
+        TEventFunction fn = it->second.fn;
+
+        /**
+         * A repeating timer keeps to its schedule, unless it has fallen a
+         * whole interval behind, when it skips those it missed.
+         */
+        if ( it->second.interval > 0 )
+        {
+            it->second.due += it->second.interval;
+            if ( it->second.due <= t )
+                it->second.due = t + it->second.interval;
+        }
+        else
+            m_timers.erase( it );
+
+        fn();
+    }
+
+    return( ! due.empty() );
+}
+
+
+/**
+ * Run the functions of the signals which have arrived.
+ */
+void CEventLoop::run_signals()
+{
+    unsigned char buf[64];
+    ssize_t len;
+
+    while( ( len = read( m_wake[0], buf, sizeof(buf) ) ) > 0 )
+    {
+        for( ssize_t i = 0; i < len; i++ )
+        {
+            std::unordered_map<int, TEventFunction>::iterator it = m_signals.find( buf[i] );
+            if ( buf[i] != 0 && it != m_signals.end() )
+            {
+                TEventFunction fn = it->second;
+                fn();
+            }
+        }
+    }
+}
+
+
+/**
+ * Wait for something to happen.
+ */
+bool CEventLoop::wait( int timeout )
+{
+    double deadline = now() + timeout / 1000.0;
+
+    std::vector<struct pollfd> fds;
+    std::vector<int> ready;
+
+    while( true )
+    {
+        /**
+         * Sleep no longer than the first timer, or the caller, wants.
+         */
+        int delay = timeout;
+        double t  = now();
+
+        if ( timeout >= 0 )
+            delay = std::max( 0, (int)ceil( ( deadline - t ) * 1000 ) );
+
+        std::map<int, TTimer>::iterator it;
+        for (it = m_timers.begin(); it != m_timers.end(); ++it)
+        {
+            int ms = std::max( 0, (int)ceil( ( it->second.due - t ) * 1000 ) );
+            if ( delay < 0 || ms < delay )
+                delay = ms;
+        }
+
+        /**
+         * stdin first, then the wake-up pipe, then everything else.
+         */
+        fds.clear();
+        struct pollfd in = { 0, POLLIN, 0 };
+        fds.push_back( in );
+
+        if ( m_wake[0] >= 0 )
+        {
+            struct pollfd w = { m_wake[0], POLLIN, 0 };
+            fds.push_back( w );
+        }
+
+        std::unordered_map<int, TEventFunction>::iterator wit;
+        for (wit = m_watches.begin(); wit != m_watches.end(); ++wit)
+        {
+            struct pollfd p = { wit->first, POLLIN, 0 };
+            fds.push_back( p );
+        }
+
+        int n = poll( &fds[0], fds.size(), delay );
+        if ( n < 0 && errno != EINTR )
+        {
+            DEBUG_LOG( std::string( "poll() failed: " ) + strerror( errno ) );
+            return false;
+        }
+
+        bool input      = ( n > 0 ) && ( fds[0].revents != 0 );
+        bool dispatched = run_timers();
+
+        if ( n > 0 )
+        {
+            /**
+             * Note which descriptors are ready before calling any of
+             * their functions, which may watch, or unwatch, others.
+             */
+            ready.clear();
+            for( size_t i = 1; i < fds.size(); i++ )
+            {
+                if ( fds[i].revents == 0 )
+                    continue;
+
+                if ( fds[i].fd == m_wake[0] )
+                {
+                    run_signals();
+                    dispatched = true;
+                }
+                else
+                    ready.push_back( fds[i].fd );
+            }
+
+            std::vector<int>::iterator rit;
+            for (rit = ready.begin(); rit != ready.end(); ++rit)
+            {
+                wit = m_watches.find( *rit );
+                if ( wit == m_watches.end() )
+                    continue;
+
+                TEventFunction fn = wit->second;
+                fn();
+                dispatched = true;
+            }
+        }
+
+        if ( input )
+            return true;
+
+        if ( dispatched || ( n < 0 ) )
+            return false;
+
+        if ( timeout >= 0 && now() >= deadline )
+            return false;
+    }
+}
@@ -0,0 +1,167 @@
+/**
+ * eventloop.h - Waiting for input, timers, signals, and descriptors.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _eventloop_h_
+#define _eventloop_h_ 1
+
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * The main loop: a single poll() over the keyboard, and everything else we
+ * wait upon, with timers run between.
+ *
+ * Keys are never kept waiting on anything else: wait() returns as soon as
+ * there is input, having dispatched only what was ready with it.
+ *
+ * Signals are turned into events with a pipe, written to by the handler,
+ * so that their functions run in the loop rather than in the handler.
+ */
+class CEventLoop
+{
+
+public:
+
+    /**
+     * Get access to the singleton instance.
+     */
+    static CEventLoop *Instance();
+
+    /**
+     * The functions we call.
+     */
+    typedef std::function<void()> TEventFunction;
+
+    /**
+     * Call the given function whenever the given descriptor is readable,
+     * or has been closed at the other end.
+     */
+    void watch( int fd, TEventFunction fn );
+
+    /**
+     * Stop watching the given descriptor.
+     */
+    void unwatch( int fd );
+
+    /**
+     * Call the given function, in the loop, whenever the given signal
+     * arrives.
+     */
+    void on_signal( int sig, TEventFunction fn );
+
+    /**
+     * Call the given function after the given number of seconds, and then
+     * every interval seconds if that is positive.  Returns an id for the
+     * timer.
+     */
+    int add_timer( double seconds, double interval, TEventFunction fn );
+
+    /**
+     * Cancel the given timer.  Returns false if there was no such timer.
+     */
+    bool cancel_timer( int id );
+
+    /**
+     * The number of timers pending.
+     */
+    size_t timers() { return( m_timers.size() ); }
+
+    /**
+     * Wait for at most the given number of milliseconds, or forever if it
+     * is negative, running timers and dispatching events as they happen.
+     *
+     * Returns true as soon as there is input on stdin, and false once an
+     * event has been dispatched, or the time is up.
+     */
+    bool wait( int timeout );
+
+    /**
+     * Wake the loop from wait().  Safe to call from a signal handler.
+     */
+    static void wake();
+
+protected:
+
+    /**
+     * Protected functions to allow our singleton implementation.
+     */
+    CEventLoop();
+    CEventLoop(const CEventLoop &);
+    CEventLoop & operator=(const CEventLoop &);
+
+private:
+
+    /**
+     * The single instance of this class.
+     */
+    static CEventLoop *pinstance;
+
+    /**
+     * The handler we install for signals passed to on_signal.
+     */
+    static void signalled( int sig );
+
+    /**
+     * The current time, in seconds, from a clock which never goes back.
+     */
+    static double now();
+
+    /**
+     * Run any timers which are due.  Returns true if any were.
+     */
+    bool run_timers();
+
+    /**
+     * Read the pipe signals are written to, and run their functions.
+     */
+    void run_signals();
+
+    /**
+     * The pipe written to by signal handlers, and by wake().  Static so
+     * that the handlers can get at it.
+     */
+    static int m_wake[2];
+
+    /**
+     * A timer.
+     */
+    struct TTimer
+    {
+        double due;
+        double interval;
+        TEventFunction fn;
+    };
+
+    /**
+     * Timers, by id, and the id we'll give the next.
+     */
+    std::map<int, TTimer> m_timers;
+    int m_next_timer;
+
+    /**
+     * Descriptors, and signals, and their functions.
+     */
+    std::unordered_map<int, TEventFunction> m_watches;
+    std::unordered_map<int, TEventFunction> m_signals;
+
+};
+
+#endif /* _eventloop_h_ */
@@ -0,0 +1,106 @@
+/**
+ * flags.cc - Maildir message flags, as a bitmask.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <string.h>
+
+#include "flags.h"
+
+
+constexpr const char *CFlags::LETTERS;
+
+
+/**
+ * Find the offset of the ":2," info-separator in the filename, or npos.
+ */
+static size_t info_offset( const TStringRef &path )
+{
+    size_t slash = path.rfind( '/' );
+    size_t start = ( slash == std::string::npos ) ? 0 : slash + 1;
+
+    for( size_t offset = path.find( ':', start ); offset != std::string::npos;
+         offset = path.find( ':', offset + 1 ) )
+    {
+        if ( offset + 3 <= path.size && path.data[offset + 1] == '2' && path.data[offset + 2] == ',' )
+            return( offset );
+    }
+    return( std::string::npos );
+}
+
+
+/**
+ * Parse the flags from the filename of the given message.
+ */
+uint64_t CFlags::parse( const TStringRef &path )
+{
+    uint64_t flags = 0;
+
+    size_t offset = info_offset( path );
+    if ( offset == std::string::npos )
+        return( flags );
+
+    for( size_t i = offset + 3; i < path.size; i++ )
+        flags |= bit( path.data[i] );
+
+    return( flags );
+}
+
+
+/**
+ * Is the given message in a new/ directory?
+ */
+bool CFlags::in_new( const TStringRef &path )
+{
+    size_t slash = path.rfind( '/' );
+    if ( slash == std::string::npos || slash < 3 )
+        return false;
+
+    return( memcmp( path.data + slash - 3, "new", 3 ) == 0 &&
+            ( slash == 3 || path.data[slash - 4] == '/' ) );
+}
+
+
+/**
+ * Append the given flags to the buffer, in ASCII order.
+ */
+void CFlags::render( uint64_t flags, std::string &out )
+{
+    for( int i = 0; flags != 0; i++, flags >>= 1 )
+    {
+        if ( flags & 1 )
+            out += LETTERS[i];
+    }
+}
+
+
+/**
+ * Return the path of the given message with its flags replaced.
+ */
+std::string CFlags::with_flags( const std::string &path, uint64_t flags )
+{
+    std::string result;
+
+    size_t offset = info_offset( path );
+    if ( offset == std::string::npos )
+        result = path;
+    else
+        result = path.substr( 0, offset );
+
+    result += ":2,";
+    render( flags, result );
+    return( result );
+}
@@ -0,0 +1,83 @@
+/**
+ * flags.h - Maildir message flags, as a bitmask.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _flags_h_
+#define _flags_h_ 1
+
+#include <stdint.h>
+#include <string>
+
+#include "stringref.h"
+
+
+/**
+ * The flags of a maildir message are the letters following ":2," in its
+ * filename.  The standard ones are upper-case: D(raft), F(lagged),
+ * P(assed), R(eplied), S(een) and T(rashed); lower-case letters are used
+ * for keywords by some clients.
+ *
+ * We hold them as a bitmask with one bit per letter, in ASCII order, so
+ * that rendering them in the order the specification requires is simply
+ * a walk over the bits.
+ */
+class CFlags
+{
+
+public:
+
+    /**
+     * The letters we can represent, in ASCII order.  The bit for each is
+     * its offset in this table.
+     */
+    static constexpr const char *LETTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+    /**
+     * The bit for the given letter, or zero if it isn't a valid flag.
+     */
+    static constexpr uint64_t bit( char c )
+    {
+        return( ( c >= 'A' && c <= 'Z' ) ? ( (uint64_t)1 << ( c - 'A' ) ) :
+                ( c >= 'a' && c <= 'z' ) ? ( (uint64_t)1 << ( c - 'a' + 26 ) ) : 0 );
+    }
+
+    /**
+     * Parse the flags from the filename of the given message.
+     */
+    static uint64_t parse( const TStringRef &path );
+
+    /**
+     * Is the given message in a new/ directory?
+     *
+     * This is reported as the pseudo-flag 'N', but it is a property of
+     * the location of the file rather than of its name.
+     */
+    static bool in_new( const TStringRef &path );
+
+    /**
+     * Append the given flags to the buffer, in ASCII order.
+     */
+    static void render( uint64_t flags, std::string &out );
+
+    /**
+     * Return the path of the given message with its flags replaced.
+     */
+    static std::string with_flags( const std::string &path, uint64_t flags );
+
+};
+
+#endif /* _flags_h_ */
@@ -0,0 +1,452 @@
+/**
+ * foldercache.cc - Persistent cache of the maildir folder-tree.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "directory.h"
+#include "file.h"
+#include "foldercache.h"
+#include "walker.h"
+
+
+/**
+ * The version-marker written at the head of the on-disk cache.
+ */
+#define FOLDER_CACHE_MAGIC "lumail-folder-cache 1"
+
+
+/**
+ * Instance-handle.
+ */
+CFolderCache *CFolderCache::pinstance = NULL;
+
+
+/**
+ * Get access to our singleton-object.
+ */
+CFolderCache *CFolderCache::Instance()
+{
+    if (!pinstance)
+        pinstance = new CFolderCache;
+
+    return pinstance;
+}
+
+
+/**
+ * Constructor - This is private as this class is a singleton.
+ */
+CFolderCache::CFolderCache()
+{
+    m_generation = 0;
+    m_version    = 0;
+    m_changed    = true;
+    m_dirty      = false;
+    m_loaded     = false;
+    m_walker     = NULL;
+}
+
+
+/**
+ * Destructor.
+ */
+CFolderCache::~CFolderCache()
+{
+    delete( m_walker );
+}
+
+
+/**
+ * Return the sorted list of maildirs beneath the given prefix.
+ */
+std::vector<std::string> CFolderCache::folders( std::string prefix, int threads )
+{
+    if ( prefix.empty() )
+        prefix = ".";
+
+    /**
+     * The first time through we try to load our saved state.
+     */
+    if ( ! m_loaded )
+    {
+        m_loaded = true;
+        m_prefix = prefix;
+        load();
+    }
+
+    /**
+     * If the prefix has changed then everything we know is stale.
+     */
+    if ( prefix != m_prefix )
+    {
+        m_nodes.clear();
+        m_prefix  = prefix;
+        m_changed = true;
+        m_dirty   = true;
+    }
+
+    /**
+     * Revalidate the tree.
+     */
+    m_generation += 1;
+
+    std::vector<std::string> found;
+
+    /**
+     * The walker's threads are kept between revalidations, and only
+     * replaced if the number wanted changes.
+     */
+    if ( m_walker == NULL || m_walker->threads() != std::max( 1, std::min( threads, WALKER_MAX_THREADS ) ) )
+    {
+        delete( m_walker );
+        m_walker = new CWalker( threads );
+    }
+
+    m_walker->walk( m_prefix, [&]( const std::string &dir, std::vector<std::string> &children )
+    {
+        visit( dir, ( dir == m_prefix ), children, found );
+    } );
+
+    /**
+     * Prune any directories which have vanished.
+     */
+    std::unordered_map<std::string, TFolderNode>::iterator it;
+    for (it = m_nodes.begin(); it != m_nodes.end(); )
+    {
+        if ( it->second.generation != m_generation )
+        {
+            it = m_nodes.erase( it );
+            m_changed = true;
+            m_dirty   = true;
+        }
+        else
+            ++it;
+    }
+
+    /**
+     * Only re-sort if something moved.
+     */
+    if ( m_changed )
+    {
+        std::sort( found.begin(), found.end() );
+        m_folders = found;
+        m_changed = false;
+        m_version += 1;
+    }
+
+    if ( m_dirty )
+        save();
+
+    return( m_folders );
+}
+
+
+/**
+ * Forget what we know about the given directory.
+ */
+void CFolderCache::invalidate( std::string path )
+{
+    std::unordered_map<std::string, TFolderNode>::iterator it = m_nodes.find( path );
+    if ( it != m_nodes.end() )
+    {
+        it->second.mtime      = 0;
+        it->second.mtime_nsec = 0;
+    }
+}
+
+
+/**
+ * Every directory we know of beneath the current prefix.
+ */
+std::vector<std::string> CFolderCache::directories()
+{
+    std::vector<std::string> result;
+
+    std::unordered_map<std::string, TFolderNode>::iterator it;
+    for (it = m_nodes.begin(); it != m_nodes.end(); ++it)
+        result.push_back( it->first );
+
+    return( result );
+}
+
+
+/**
+ * A counter which is bumped whenever the list of folders changes.
+ */
+unsigned int CFolderCache::version()
+{
+    return( m_version );
+}
+
+
+/**
+ * Revalidate the given directory, and queue its children.
+ */
+void CFolderCache::visit( const std::string &path, bool is_root,
+                          std::vector<std::string> &children, std::vector<std::string> &found )
+{
+    struct stat sb;
+    if ( lstat( path.c_str(), &sb ) != 0 )
+        return;
+
+    /**
+     * A link to a maildir is a maildir, but we don't walk through links
+     * to anything else, as they may lead back up the tree.
+     */
+    bool linked = S_ISLNK( sb.st_mode );
+    if ( linked && ( stat( path.c_str(), &sb ) != 0 ) )
+        return;
+
+    if ( ! S_ISDIR( sb.st_mode ) )
+        return;
+
+    /**
+     * Find our node; elements of an unordered_map are never moved by a
+     * rehash, so the pointer remains valid once we drop the lock.
+     */
+    TFolderNode *node = NULL;
+    bool stale = false;
+    {
+        std::lock_guard<std::mutex> guard( m_lock );
+        node  = &m_nodes[path];
+        stale = ( ( node->mtime != sb.st_mtim.tv_sec ) ||
+                  ( node->mtime_nsec != sb.st_mtim.tv_nsec ) );
+    }
+
+    /**
+     * Re-read the directory if it is new to us, or has changed.  The
+     * slow part happens without the lock held.
+     */
+    TFolderNode fresh;
+    if ( stale )
+    {
+        rescan( path, fresh );
+
+        /**
+         * If the directory changed within the last second a further
+         * change might share the same timestamp, so don't trust it.
+         */
+        if ( sb.st_mtim.tv_sec >= ( time(NULL) - 1 ) )
+        {
+            fresh.mtime      = 0;
+            fresh.mtime_nsec = 0;
+        }
+        else
+        {
+            fresh.mtime      = sb.st_mtim.tv_sec;
+            fresh.mtime_nsec = sb.st_mtim.tv_nsec;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard( m_lock );
+
+    if ( stale )
+    {
+        node->mtime      = fresh.mtime;
+        node->mtime_nsec = fresh.mtime_nsec;
+        node->is_maildir = fresh.is_maildir;
+        node->children.swap( fresh.children );
+
+        m_changed = true;
+        m_dirty   = true;
+    }
+    node->generation = m_generation;
+
+    /**
+     * Nested maildirs are not descended into, except at the top-level,
+     * where the prefix may itself be a Maildir++ style inbox.
+     */
+    if ( node->is_maildir )
+    {
+        found.push_back( path );
+        if ( ! is_root )
+            return;
+    }
+    else if ( linked && ! is_root )
+        return;
+
+    std::vector<std::string>::iterator it;
+    for (it = node->children.begin(); it != node->children.end(); ++it)
+    {
+        if ( node->is_maildir && ( *it == "cur" || *it == "new" || *it == "tmp" ) )
+            continue;
+
+        children.push_back( path + "/" + *it );
+    }
+}
+
+
+/**
+ * Re-read the entries of the given directory.
+ */
+void CFolderCache::rescan( const std::string &path, TFolderNode &node )
+{
+    node.children.clear();
+
+    bool cur = false;
+    bool tmp = false;
+    bool nw  = false;
+
+    CDirectory dir( path );
+
+    const char *name;
+    bool is_dir;
+    while( dir.next( &name, &is_dir ) )
+    {
+        if ( ! is_dir )
+            continue;
+
+        if ( strcmp( name, "cur" ) == 0 )
+            cur = true;
+        else if ( strcmp( name, "new" ) == 0 )
+            nw = true;
+        else if ( strcmp( name, "tmp" ) == 0 )
+            tmp = true;
+
+        node.children.push_back( name );
+    }
+
+    node.is_maildir = ( cur && nw && tmp );
+}
+
+
+/**
+ * The path to our on-disk cache, or "" if we're memory-only.
+ */
+std::string CFolderCache::cache_file()
+{
+    const char *home = getenv( "HOME" );
+    if ( home == NULL )
+        return "";
+
+    std::string dir = std::string( home ) + "/.lumail";
+    if ( ! CFile::is_directory( dir ) )
+        return "";
+
+    return( dir + "/folders.cache" );
+}
+
+
+/**
+ * Load the on-disk copy of the cache.
+ *
+ * Each line is tab-separated: mtime, nanoseconds, maildir-flag, path,
+ * and then the names of each sub-directory.
+ */
+void CFolderCache::load()
+{
+    std::string file = cache_file();
+    if ( file.empty() )
+        return;
+
+    std::ifstream in( file.c_str() );
+    if ( ! in.is_open() )
+        return;
+
+    std::string line;
+    if ( ! std::getline( in, line ) || line != FOLDER_CACHE_MAGIC )
+        return;
+
+    /**
+     * The cache is only valid for the prefix it was generated with.
+     */
+    if ( ! std::getline( in, line ) || line != m_prefix )
+        return;
+
+    while( std::getline( in, line ) )
+    {
+        std::vector<std::string> fields;
+        std::stringstream stream( line );
+        std::string field;
+        while( std::getline( stream, field, '\t' ) )
+            fields.push_back( field );
+
+        if ( fields.size() < 4 )
+            continue;
+
+        TFolderNode node;
+        node.mtime      = strtol( fields[0].c_str(), NULL, 10 );
+        node.mtime_nsec = strtol( fields[1].c_str(), NULL, 10 );
+        node.is_maildir = ( fields[2] == "1" );
+        node.generation = 0;
+        node.children.assign( fields.begin() + 4, fields.end() );
+
+        m_nodes[fields[3]] = node;
+    }
+
+    DEBUG_LOG( "Loaded folder cache: " + file );
+}
+
+
+/**
+ * Save the on-disk copy of the cache.
+ */
+void CFolderCache::save()
+{
+    m_dirty = false;
+
+    std::string file = cache_file();
+    if ( file.empty() )
+        return;
+
+    /**
+     * Write to a temporary file and rename, so a crash never leaves
+     * us with a truncated cache.
+     */
+    std::string tmp = file + ".tmp";
+    std::ofstream out( tmp.c_str(), std::ios::trunc );
+    if ( ! out.is_open() )
+        return;
+
+    out << FOLDER_CACHE_MAGIC << "\n";
+    out << m_prefix << "\n";
+
+    std::unordered_map<std::string, TFolderNode>::iterator it;
+    for (it = m_nodes.begin(); it != m_nodes.end(); ++it)
+    {
+        /**
+         * Names containing our separators are simply re-read next time.
+         */
+        if ( it->first.find_first_of( "\t\n" ) != std::string::npos )
+            continue;
+
+        TFolderNode &node = it->second;
+        out << node.mtime << "\t" << node.mtime_nsec << "\t"
+            << ( node.is_maildir ? "1" : "0" ) << "\t" << it->first;
+
+        std::vector<std::string>::iterator cit;
+        for (cit = node.children.begin(); cit != node.children.end(); ++cit)
+        {
+            if ( cit->find_first_of( "\t\n" ) == std::string::npos )
+                out << "\t" << *cit;
+        }
+        out << "\n";
+    }
+    out.close();
+
+    rename( tmp.c_str(), file.c_str() );
+}
@@ -0,0 +1,190 @@
+/**
+ * foldercache.h - Persistent cache of the maildir folder-tree.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _foldercache_h_
+#define _foldercache_h_ 1
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <time.h>
+
+class CWalker;
+
+
+/**
+ * A singleton which remembers the shape of the maildir hierarchy.
+ *
+ * For every directory beneath the prefix we record its modification
+ * time, whether it is a maildir, and the names of its sub-directories.
+ *
+ * Adding or removing a directory entry updates the mtime of the parent,
+ * so when revalidating we only need to stat() each known directory and
+ * re-read those whose mtime has changed.
+ *
+ * The cache is persisted to ~/.lumail/folders.cache, if that directory
+ * exists, so that startup doesn't require a full walk either.
+ *
+ * Revalidation is carried out by a CWalker, which we keep between calls,
+ * so directories are stat()ed and re-read concurrently.
+ */
+class CFolderCache
+{
+
+public:
+
+    /**
+     * Get access to the singleton instance.
+     */
+    static CFolderCache *Instance();
+
+    /**
+     * Destructor.  Stops the walker's threads.
+     */
+    ~CFolderCache();
+
+    /**
+     * Return the sorted list of maildirs beneath the given prefix,
+     * revalidating any directories which have changed, using the given
+     * number of threads.
+     */
+    std::vector<std::string> folders( std::string prefix, int threads = 1 );
+
+    /**
+     * Forget what we know about the given directory, forcing it to be
+     * re-read on the next revalidation.
+     */
+    void invalidate( std::string path );
+
+    /**
+     * Every directory we know of beneath the current prefix.
+     */
+    std::vector<std::string> directories();
+
+    /**
+     * A counter which is bumped whenever the list of folders changes.
+     */
+    unsigned int version();
+
+protected:
+
+    /**
+     * Protected functions to allow our singleton implementation.
+     */
+    CFolderCache();
+    CFolderCache(const CFolderCache &);
+    CFolderCache & operator=(const CFolderCache &);
+
+private:
+
+    /**
+     * The information we hold on each directory.
+     */
+    struct TFolderNode
+    {
+        time_t mtime;
+        long mtime_nsec;
+        bool is_maildir;
+        unsigned int generation;
+        std::vector<std::string> children;
+    };
+
+    /**
+     * Revalidate the given directory, appending any maildir we find and
+     * the sub-directories which should be visited next.
+     *
+     * This is called concurrently from the walker's threads.
+     */
+    void visit( const std::string &path, bool is_root,
+                std::vector<std::string> &children, std::vector<std::string> &found );
+
+    /**
+     * Re-read the entries of the given directory.
+     */
+    static void rescan( const std::string &path, TFolderNode &node );
+
+    /**
+     * Load/save the on-disk copy of the cache.
+     */
+    void load();
+    void save();
+
+    /**
+     * The path to our on-disk cache, or "" if we're memory-only.
+     */
+    std::string cache_file();
+
+    /**
+     * The single instance of this class.
+     */
+    static CFolderCache *pinstance;
+
+    /**
+     * The prefix the cached data refers to.
+     */
+    std::string m_prefix;
+
+    /**
+     * Directory path -> cached information.
+     */
+    std::unordered_map<std::string, TFolderNode> m_nodes;
+
+    /**
+     * Guards m_nodes and our flags during a parallel revalidation.
+     */
+    std::mutex m_lock;
+
+    /**
+     * The sorted maildirs found on the most recent revalidation.
+     */
+    std::vector<std::string> m_folders;
+
+    /**
+     * Bumped on every revalidation, so we can prune vanished entries.
+     */
+    unsigned int m_generation;
+
+    /**
+     * Bumped whenever m_folders is rebuilt.
+     */
+    unsigned int m_version;
+
+    /**
+     * Did the most recent revalidation change anything?
+     */
+    bool m_changed;
+
+    /**
+     * Do we have changes not yet written to disk?
+     */
+    bool m_dirty;
+
+    /**
+     * Have we attempted to load the on-disk cache?
+     */
+    bool m_loaded;
+
+    /**
+     * The walker we revalidate with, created when first needed.
+     */
+    CWalker *m_walker;
+
+};
+
+#endif /* _foldercache_h_ */
@@ -0,0 +1,247 @@
+/**
+ * format.cc - Compiled format-strings, as used by index_format.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+
+#include "format.h"
+#include "layout.h"
+
+
+/**
+ * The cache of compiled format-strings.
+ */
+static std::unordered_map<std::string, CFormat *> format_cache;
+
+
+/**
+ * Map a field-name to the field.
+ */
+static TFormatField field_for( const std::string &name )
+{
+    static const struct
+    {
+        const char *name;
+        TFormatField field;
+    } fields[] = {
+        { "FLAGS",   FIELD_FLAGS   },
+        { "FROM",    FIELD_FROM    },
+        { "TO",      FIELD_TO      },
+        { "SUBJECT", FIELD_SUBJECT },
+        { "DATE",    FIELD_DATE    },
+        { "YEAR",    FIELD_YEAR    },
+        { "MONTH",   FIELD_MONTH   },
+        { "DAY",     FIELD_DAY     },
+    };
+
+    for( size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++ )
+    {
+        if ( name == fields[i].name )
+            return( fields[i].field );
+    }
+    return( FIELD_LITERAL );
+}
+
+
+/**
+ * Is the given character part of a field-name?
+ */
+static bool is_name( char c )
+{
+    return( ( c >= 'A' && c <= 'Z' ) || ( c == '_' ) );
+}
+
+
+/**
+ * Compile the given format-string.
+ */
+CFormat::CFormat( const std::string &fmt )
+{
+    size_t i = 0;
+    size_t len = fmt.size();
+
+    while( i < len )
+    {
+        size_t dollar = fmt.find( '$', i );
+        if ( dollar == std::string::npos )
+        {
+            literal( fmt.substr( i ) );
+            break;
+        }
+
+        literal( fmt.substr( i, dollar - i ) );
+        i = dollar + 1;
+
+        /**
+         * "$$" -> "$"
+         */
+        if ( i < len && fmt[i] == '$' )
+        {
+            literal( "$" );
+            i += 1;
+            continue;
+        }
+
+        TFormatToken token;
+        token.width = 0;
+        token.right = false;
+
+        if ( i < len && fmt[i] == '{' )
+        {
+            size_t close = fmt.find( '}', i );
+            if ( close == std::string::npos )
+            {
+                literal( fmt.substr( dollar ) );
+                break;
+            }
+
+            std::string name = fmt.substr( i + 1, close - i - 1 );
+            std::string width;
+
+            size_t colon = name.find( ':' );
+            if ( colon != std::string::npos )
+            {
+                width = name.substr( colon + 1 );
+                name  = name.substr( 0, colon );
+            }
+            if ( ! width.empty() && width[0] == '>' )
+            {
+                token.right = true;
+                width = width.substr( 1 );
+            }
+            token.width = atoi( width.c_str() );
+            token.field = field_for( name );
+            i = close + 1;
+
+            if ( token.field == FIELD_LITERAL )
+            {
+                literal( fmt.substr( dollar, i - dollar ) );
+                continue;
+            }
+        }
+        else
+        {
+            size_t end = i;
+            while( end < len && is_name( fmt[end] ) )
+                end++;
+
+            token.field = field_for( fmt.substr( i, end - i ) );
+            if ( token.field == FIELD_LITERAL )
+            {
+                literal( "$" );
+                continue;
+            }
+            i = end;
+        }
+
+        m_tokens.push_back( token );
+    }
+}
+
+
+/**
+ * Add a literal to the token list, merging with any previous one.
+ */
+void CFormat::literal( const std::string &text )
+{
+    if ( text.empty() )
+        return;
+
+    if ( ! m_tokens.empty() && m_tokens.back().field == FIELD_LITERAL )
+    {
+        m_tokens.back().text += text;
+        return;
+    }
+
+    TFormatToken token;
+    token.field = FIELD_LITERAL;
+    token.text  = text;
+    token.width = 0;
+    token.right = false;
+    m_tokens.push_back( token );
+}
+
+
+/**
+ * Append the expansion of this format to the given buffer.
+ *
+ * Widths are measured in terminal columns, not bytes, so UTF-8 text is
+ * never truncated mid-character, and wide characters count twice.
+ */
+void CFormat::append( std::string &out, TFieldFunction value )
+{
+    std::vector<TFormatToken>::iterator it;
+    for (it = m_tokens.begin(); it != m_tokens.end(); ++it)
+    {
+        if ( it->field == FIELD_LITERAL )
+        {
+            out += it->text;
+            continue;
+        }
+
+        if ( it->width <= 0 )
+        {
+            value( it->field, out );
+            continue;
+        }
+
+        m_scratch.clear();
+        value( it->field, m_scratch );
+
+        /**
+         * Find the byte-offset of the last character which fits.
+         */
+        size_t used = 0;
+        size_t cut  = CLayout::prefix( m_scratch.data(), m_scratch.size(), it->width, &used );
+
+        if ( it->right )
+            out.append( it->width - used, ' ' );
+        out.append( m_scratch, 0, cut );
+        if ( ! it->right )
+            out.append( it->width - used, ' ' );
+    }
+}
+
+
+/**
+ * Get the compiled version of the given format-string.
+ */
+CFormat *CFormat::compiled( const std::string &fmt )
+{
+    std::unordered_map<std::string, CFormat *>::iterator it = format_cache.find( fmt );
+    if ( it != format_cache.end() )
+        return( it->second );
+
+    CFormat *f = new CFormat( fmt );
+    format_cache[fmt] = f;
+    return( f );
+}
+
+
+/**
+ * Forget all compiled format-strings.
+ */
+void CFormat::clear_cache()
+{
+    std::unordered_map<std::string, CFormat *>::iterator it;
+    for (it = format_cache.begin(); it != format_cache.end(); ++it)
+        delete( it->second );
+
+    format_cache.clear();
+}
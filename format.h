@@ -0,0 +1,113 @@
+/**
+ * format.h - Compiled format-strings, as used by index_format.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _format_h_
+#define _format_h_ 1
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+/**
+ * The fields a format-string may refer to.
+ */
+enum TFormatField
+{
+    FIELD_LITERAL,
+    FIELD_FLAGS,
+    FIELD_FROM,
+    FIELD_TO,
+    FIELD_SUBJECT,
+    FIELD_DATE,
+    FIELD_YEAR,
+    FIELD_MONTH,
+    FIELD_DAY
+};
+
+
+/**
+ * A format-string, compiled into a list of tokens.
+ *
+ * Fields are written as "$NAME" or "${NAME}".  The braced form also
+ * accepts a width: "${FROM:20}" pads, or truncates, the sender to twenty
+ * characters, and "${FROM:>20}" does the same but aligns to the right.
+ * "$$" is a literal dollar, and unknown fields are left as they are.
+ */
+class CFormat
+{
+
+public:
+
+    /**
+     * Called to append the value of a field to the output.
+     */
+    typedef std::function<void( TFormatField field, std::string &out )> TFieldFunction;
+
+    /**
+     * Compile the given format-string.
+     */
+    CFormat( const std::string &fmt );
+
+    /**
+     * Append the expansion of this format to the given buffer.
+     */
+    void append( std::string &out, TFieldFunction value );
+
+    /**
+     * Get the compiled version of the given format-string, compiling it
+     * the first time it is seen.
+     */
+    static CFormat *compiled( const std::string &fmt );
+
+    /**
+     * Forget all compiled format-strings.
+     */
+    static void clear_cache();
+
+private:
+
+    /**
+     * A single token: literal text, or a field with optional width.
+     */
+    struct TFormatToken
+    {
+        TFormatField field;
+        std::string text;
+        int width;
+        bool right;
+    };
+
+    /**
+     * Add a literal to the token list, merging with any previous one.
+     */
+    void literal( const std::string &text );
+
+    /**
+     * The compiled tokens.
+     */
+    std::vector<TFormatToken> m_tokens;
+
+    /**
+     * Scratch space used when expanding fields with a width.
+     */
+    std::string m_scratch;
+
+};
+
+#endif /* _format_h_ */
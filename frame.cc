@@ -0,0 +1,130 @@
+/**
+ * frame.cc - The rows of the screen, as we last drew them.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <algorithm>
+#include <ncurses.h>
+
+#include "frame.h"
+#include "layout.h"
+
+
+/**
+ * Constructor.
+ */
+CFrame::CFrame()
+{
+    m_width = 0;
+    m_dirty = false;
+}
+
+
+/**
+ * Start a frame.
+ */
+void CFrame::begin( int width, int height )
+{
+    width = std::max( 0, width );
+
+    /**
+     * At a new size every row must be laid out, and drawn, again.
+     */
+    size_t rows = std::max( 0, height - 1 );
+    if ( width != m_width || rows != m_rows.size() )
+        clear();
+
+    m_width = width;
+    m_rows.resize( rows );
+}
+
+
+/**
+ * Forget what is drawn.
+ */
+void CFrame::clear()
+{
+    std::vector<TFrameRow>::iterator it;
+    for (it = m_rows.begin(); it != m_rows.end(); ++it)
+    {
+        it->drawn = false;
+        it->text.clear();
+    }
+}
+
+
+/**
+ * Draw a single row, if it has changed.
+ */
+void CFrame::draw_row( int row, int col, const std::string &text, int attr, int columns )
+{
+    if ( row < 0 || row >= (int)m_rows.size() )
+        return;
+
+    if ( text.empty() && columns == 0 )
+        col = 0;
+
+    TFrameRow &cur = m_rows[row];
+    if ( cur.drawn && cur.col == col && cur.attr == attr &&
+         cur.columns == columns && cur.text == text )
+        return;
+
+    cur.drawn   = true;
+    cur.col     = col;
+    cur.attr    = attr;
+    cur.columns = columns;
+    cur.text    = text;
+    m_dirty     = true;
+
+    attrset( COLOR_PAIR(2) );
+    move( row, 0 );
+    clrtoeol();
+
+    int room = m_width - col;
+    if ( room <= 0 )
+        return;
+
+    /**
+     * Lay the text out by display width, so that multi-byte and wide
+     * characters neither overflow the row nor get split.
+     */
+    m_fitted.clear();
+    if ( columns > 0 )
+        CLayout::fit( text, std::min( columns, room ), m_fitted, true );
+    else
+        CLayout::fit( text, room, m_fitted, false );
+
+    if ( m_fitted.empty() )
+        return;
+
+    move( row, col );
+    attrset( attr );
+    addnstr( m_fitted.data(), m_fitted.size() );
+    attrset( COLOR_PAIR(2) );
+}
+
+
+/**
+ * Finish a frame.
+ */
+void CFrame::end()
+{
+    if ( ! m_dirty )
+        return;
+
+    refresh();
+    m_dirty = false;
+}
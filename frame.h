@@ -0,0 +1,108 @@
+/**
+ * frame.h - The rows of the screen, as we last drew them.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _frame_h_
+#define _frame_h_ 1
+
+#include <string>
+#include <vector>
+
+
+/**
+ * The rows of the screen, above the status-line, as we last drew them.
+ *
+ * Each frame is drawn at the size given to begin(), and a row is only
+ * written to the terminal if it differs from what we drew there before.
+ */
+class CFrame
+{
+
+public:
+
+    /**
+     * Constructor.  Nothing has been drawn.
+     */
+    CFrame();
+
+    /**
+     * Start a frame on a screen of the given size.  Rows are laid out to
+     * that width from here on, and if the size has changed every row is
+     * drawn again.
+     */
+    void begin( int width, int height );
+
+    /**
+     * Forget what every row shows, so that each is drawn again.
+     */
+    void clear();
+
+    /**
+     * The number of rows we draw.
+     */
+    int rows() { return( (int)m_rows.size() ); }
+
+    /**
+     * Draw the given text at the given row, starting at the given column,
+     * unless that row already shows exactly that.
+     *
+     * The text is cut short at the edge of the screen, or padded, or cut,
+     * to the given number of columns if that is not zero.
+     */
+    void draw_row( int row, int col, const std::string &text, int attr, int columns = 0 );
+
+    /**
+     * Finish a frame, sending any rows which were drawn to the terminal.
+     *
+     * Nothing else does that for us: we no longer wait in getch(), which
+     * used to, after each frame.
+     */
+    void end();
+
+private:
+
+    /**
+     * What we last drew on a row.
+     */
+    struct TFrameRow
+    {
+        bool drawn;
+        int col;
+        int attr;
+        int columns;
+        std::string text;
+    };
+
+    /**
+     * The rows, and the width they are laid out to.
+     */
+    std::vector<TFrameRow> m_rows;
+    int m_width;
+
+    /**
+     * Has a row been drawn since the terminal was last updated?
+     */
+    bool m_dirty;
+
+    /**
+     * A row, laid out to fit the screen, as it is written to the terminal.
+     */
+    std::string m_fitted;
+
+};
+
+#endif /* _frame_h_ */
@@ -23,10 +23,18 @@
 #include <cstdlib>
 #include <fstream>
 #include <string.h>
+#include <unordered_set>
 #include <stdlib.h>
 
 #include "debug.h"
+#include "foldercache.h"
 #include "global.h"
+#include "headercache.h"
+#include "headerpool.h"
+#include "lua.h"
+#include "mimecache.h"
+#include "searchindex.h"
+#include "watcher.h"
 
 /**
  * Instance-handle.
@@ -55,7 +63,29 @@ CGlobal::CGlobal()
     m_cur_folder     = 0;
     m_cur_message    = 0;
     m_msg_offset     = 0;
-    m_messages       = NULL;
+    m_version        = 0;
+    m_folders_version = 0;
+    m_virtual_version = 0;
+    m_virtual_time    = 0;
+    m_sort_order      = -1;
+    m_threaded        = false;
+
+    /**
+     * Keep the virtual folders up to date as the full-text index sees
+     * messages come, go, and change their flags.
+     */
+    CSearchIndex::Instance()->set_listener( []( const std::string &from, const std::string &to )
+    {
+        CVirtualFolders::Instance()->changed( from, to );
+    } );
+
+    /**
+     * Apply what the watcher sees.
+     */
+    CWatcher::Instance()->set_handler( [this]( TWatchChanges &changes )
+    {
+        watched( changes );
+    } );
 
     /**
      * Defaults as set in our variable hash-map.
@@ -64,10 +94,15 @@ CGlobal::CGlobal()
     set_variable( "global_mode",   new std::string("maildir"));
     set_variable( "index_format",  new std::string( "[$FLAGS] $FROM - $SUBJECT" ) );
     set_variable( "index_limit",   new std::string("all") );
+    set_variable( "index_view",    new std::string("flat") );
     set_variable( "maildir_format", new std::string( "$CHECK - $PATH" ) );
     set_variable( "message_filter", new std::string("") );
     set_variable( "maildir_limit", new std::string("all") );
+    set_variable( "mime_cache_limit", new std::string("33554432") );
+    set_variable( "parse_threads", new std::string("2") );
+    set_variable( "scan_threads", new std::string("4") );
     set_variable( "sendmail_path", new std::string( "/usr/lib/sendmail -t" ) );
+    set_variable( "sort_order", new std::string("mtime") );
 
 
     /**
@@ -101,8 +136,23 @@ std::vector<CMaildir> CGlobal::get_all_folders()
     CGlobal *global     = CGlobal::Instance();
     std::string *prefix = global->get_variable( "maildir_prefix" );
 
+    /**
+     * The folder cache only re-reads directories which have changed.
+     */
+    CFolderCache *cache = CFolderCache::Instance();
     std::vector<std::string> folders =
-	CMaildir::getFolders(*prefix);
+	cache->folders(*prefix, global->get_scan_threads());
+
+    /**
+     * If the tree changed then update the set of watched directories.
+     */
+    if ( cache->version() != m_folders_version )
+    {
+        m_folders_version = cache->version();
+
+        CWatcher *watcher = CWatcher::Instance();
+        watcher->watch_folders( folders, cache->directories() );
+    }
     std::vector < std::string >::iterator it;
     for (it = folders.begin(); it != folders.end(); ++it) {
 	maildirs.push_back(CMaildir(*it));
@@ -111,6 +161,65 @@ std::vector<CMaildir> CGlobal::get_all_folders()
     return (maildirs);
 }
 
+/**
+ * The number of threads to use when walking the maildir hierarchy.
+ */
+int CGlobal::get_scan_threads()
+{
+    std::string *threads = get_variable( "scan_threads" );
+    if ( threads == NULL )
+        return 1;
+
+    int count = atoi( threads->c_str() );
+    if ( count < 1 )
+        count = 1;
+    return( count );
+}
+
+/**
+ * The number of bytes of parsed MIME entities to keep in memory.
+ */
+size_t CGlobal::get_mime_cache_limit()
+{
+    std::string *limit = get_variable( "mime_cache_limit" );
+    if ( limit == NULL )
+        return MIME_CACHE_DEFAULT_LIMIT;
+
+    long long bytes = atoll( limit->c_str() );
+    if ( bytes < 0 )
+        bytes = 0;
+    return( (size_t)bytes );
+}
+
+/**
+ * The number of threads to use when parsing message headers.
+ */
+int CGlobal::get_parse_threads()
+{
+    std::string *threads = get_variable( "parse_threads" );
+    if ( threads == NULL )
+        return 0;
+
+    int count = atoi( threads->c_str() );
+    if ( count < 0 )
+        count = 0;
+    return( count );
+}
+
+/**
+ * The order in which the index is sorted.
+ */
+TSortOrder CGlobal::get_sort_order()
+{
+    TSortOrder order = SORT_MTIME;
+
+    std::string *name = get_variable( "sort_order" );
+    if ( name != NULL )
+        CSort::parse_order( *name, &order );
+
+    return( order );
+}
+
 /**
  * Get folders matching the current mode.
  */
@@ -121,6 +230,20 @@ std::vector < CMaildir > CGlobal::get_folders()
     std::vector<CMaildir> display;
     std::string * filter = global->get_variable("maildir_limit");
 
+    /**
+     * The virtual folders come first.
+     */
+    refresh_virtual_folders();
+
+    std::vector<std::string> names = CVirtualFolders::Instance()->names();
+    std::vector<std::string>::iterator nit;
+    for (nit = names.begin(); nit != names.end(); ++nit) {
+        CMaildir x( CVirtualFolders::path_of( *nit ) );
+
+        if ( x.matches_filter( filter ) )
+            display.push_back(x);
+    }
+
     /**
      * Filter the folders to those we can display
      */
@@ -136,103 +259,824 @@ std::vector < CMaildir > CGlobal::get_folders()
 }
 
 /**
- * My sort function: sort CMessages by most recent to oldest.
+ * Parse the headers of the given messages on the background pool, and
+ * wait for them all.
+ *
+ * Without a pool this does nothing, and the headers are read one at a
+ * time as they are required.
  */
-bool my_sort(CMessage *a, CMessage *b)
+void CGlobal::parse_headers( std::vector<uint32_t> &rows )
 {
-    /**
-     * Stat both files.
-     */
-    struct stat us;
-    struct stat them;
+    CHeaderPool *pool = CHeaderPool::Instance();
+    if ( pool->threads() == 0 )
+        return;
 
-    std::string us_path = a->path();
-    std::string them_path = b->path();
+    std::vector<uint32_t>::iterator it;
+    for (it = rows.begin(); it != rows.end(); ++it)
+        message( *it )->queue_headers();
 
-    if (stat(us_path.c_str(), &us) < 0)
-	return 0;
+    pool->wait();
+}
 
-    if (stat(them_path.c_str(), &them) < 0)
-	return 0;
 
-    return (us.st_mtime < them.st_mtime);
+/**
+ * Make sure the given rows have keys for the given order.
+ *
+ * Each key is computed once, and held in the message table, so sorting
+ * compares a few contiguous arrays and never touches the disk.
+ */
+void CGlobal::sort_keys( std::vector<uint32_t> &rows, TSortOrder order )
+{
+    std::vector<uint32_t>::iterator it;
+    for (it = rows.begin(); it != rows.end(); ++it)
+    {
+        if ( m_table.has_key( *it, order ) || m_table.file_key( *it, order ) )
+            continue;
 
+        CMessage *msg = message( *it );
+        switch( order )
+        {
+        case SORT_DATE:
+            m_table.set_key( *it, order, msg->date_epoch(), "" );
+            break;
+        case SORT_FROM:
+            m_table.set_key( *it, order, 0, CSort::fold( msg->from() ) );
+            break;
+        case SORT_SUBJECT:
+            m_table.set_key( *it, order, 0, CSort::subject( msg->subject() ) );
+            break;
+        default:
+            break;
+        }
+    }
 }
 
+
 /**
  * Get all messages from the currently selected folders.
  */
 std::vector<CMessage *>* CGlobal::get_messages()
 {
-    return( m_messages );
+    return( &m_messages );
+}
+
+
+/**
+ * Get the message held in the given row of our table.
+ *
+ * The objects are allocated in blocks, and live as long as we do: when a
+ * row is reused its object is reset.
+ */
+CMessage *CGlobal::message( uint32_t row )
+{
+    while( m_views.size() <= row )
+        m_views.emplace_back( &m_table, m_views.size() );
+
+    return( &m_views[row] );
+}
+
+
+/**
+ * Add the message in the given row to the threads.
+ */
+void CGlobal::thread_message( uint32_t row )
+{
+    CMessage *msg = message( row );
+    m_threader.add( row, msg->header_value( "Message-ID" ),
+                    msg->header_value( "References" ),
+                    msg->header_value( "In-Reply-To" ) );
+}
+
+
+/**
+ * The tree drawn before the visible message at the given offset.
+ */
+const std::string &CGlobal::get_thread_glyphs( size_t offset )
+{
+    static const std::string none;
+    return( offset < m_thread_glyphs.size() ? m_thread_glyphs[offset] : none );
 }
 
 
 /**
  * Update the list of global messages, using the index_limit string set by lua.
+ *
+ * We don't start from scratch: the selected folders are listed, and the
+ * result is compared against the messages we already hold.  Messages which
+ * are still present are kept, along with anything they've parsed, renamed
+ * messages have their path updated, and only new arrivals are added.
  */
 void CGlobal::update_messages()
 {
     /**
-     * If we have items already then free each of them.
+     * Get the selected maildirs.
+     */
+    std::vector<std::string> folders = get_selected_folders();
+    std::vector<std::string> maildirs;
+
+    /**
+     * The rows we've seen in this scan, and those which are new.
      */
-    if ( m_messages != NULL ) {
-        std::vector<CMessage *>::iterator it;
-        for (it = m_messages->begin(); it != m_messages->end(); ++it) {
-            delete( *it );
+    std::vector<bool> seen( m_table.rows(), false );
+    std::vector<uint32_t> added;
+
+    CVirtualFolders *vf = CVirtualFolders::Instance();
+    refresh_virtual_folders();
+
+    std::vector<std::string>::iterator it;
+    for (it = folders.begin(); it != folders.end(); ++it)
+    {
+        /**
+         * The paths live in our scan arena, which is emptied, but not
+         * freed, for each folder.
+         */
+        m_scan.reset();
+        m_scan_paths.clear();
+
+        bool is_virtual = CVirtualFolders::is_virtual( *it );
+        if ( is_virtual )
+        {
+            /**
+             * A virtual folder already holds its messages: there is
+             * nothing to read.
+             */
+            const std::unordered_set<std::string> *members =
+                vf->messages( CVirtualFolders::name_of( *it ) );
+            if ( members == NULL )
+                continue;
+
+            std::unordered_set<std::string>::const_iterator vit;
+            for (vit = members->begin(); vit != members->end(); ++vit)
+                m_scan_paths.push_back( TStringRef( vit->data(), vit->size() ) );
+        }
+        else
+        {
+            maildirs.push_back( *it );
+
+            CMaildir tmp = CMaildir(*it);
+            tmp.getMessagePaths( m_scan, m_scan_paths );
+
+            /**
+             * Forget cached headers for messages which have gone.
+             */
+            CHeaderCache::Instance()->prune( *it, m_scan_paths );
+
+            /**
+             * Queue any new arrivals for the full-text index.
+             */
+            CSearchIndex::Instance()->update_folder( *it, m_scan_paths );
+        }
+
+        std::vector<TStringRef>::iterator mit;
+        for (mit = m_scan_paths.begin(); mit != m_scan_paths.end(); ++mit)
+        {
+            /**
+             * A virtual folder may hold messages from a maildir which is
+             * also selected: show those once.
+             */
+            if ( is_virtual )
+            {
+                uint32_t row = m_table.find( *mit );
+                if ( row != MESSAGE_NO_ROW && row < seen.size() && seen[row] &&
+                     m_table.is_path( row, *mit ) )
+                    continue;
+            }
+
+            /**
+             * The same message in both new/ and cur/ is unusual, but
+             * possible: each file claims a row of its own.
+             */
+            uint32_t row = m_table.find( *mit, seen );
+            if ( row != MESSAGE_NO_ROW )
+            {
+                if ( ! m_table.is_path( row, *mit ) )
+                    m_table.rename( row, *mit );
+            }
+            else
+            {
+                row = m_table.add( *mit );
+                added.push_back( row );
+            }
+
+            if ( row >= seen.size() )
+                seen.resize( row + 1, false );
+            seen[row] = true;
         }
-        delete( m_messages );
     }
 
     /**
-     * create a new store.
+     * Anything we didn't see has gone away.
      */
-    m_messages = new std::vector<CMessage *>;
+    std::unordered_set<uint32_t> removed;
+    std::vector<uint32_t>::iterator rit;
+    for (rit = m_order.begin(); rit != m_order.end(); ++rit)
+    {
+        if ( ! seen[*rit] )
+            removed.insert( *rit );
+    }
 
+    merge_messages( added, removed );
+    m_virtual_version = vf->version();
 
     /**
-     * Get the selected maildirs.
+     * Track changes to the selected folders from now on.
      */
-    CGlobal *global = CGlobal::Instance();
-    std::vector<std::string> folders = global->get_selected_folders();
-    std::string * filter = global->get_variable("index_limit" );
+    CWatcher *watcher = CWatcher::Instance();
+    watcher->watch_selected( maildirs );
+}
+
+
+/**
+ * Fill any virtual folders which need it, from the list of every message
+ * the full-text index knows.
+ */
+void CGlobal::refresh_virtual_folders()
+{
+    CVirtualFolders *vf = CVirtualFolders::Instance();
+    vf->set_format( *get_variable( "index_format" ) );
+
+    if ( ! vf->stale() )
+        return;
+
+    std::vector<std::string> paths;
+    CSearchIndex::Instance()->paths( paths );
+    vf->refresh( paths );
+}
+
+
+/**
+ * Update the list of messages if a selected virtual folder changed.
+ *
+ * The messages of a maildir are kept up to date by CWatcher, but those of
+ * a virtual folder change as the full-text index does.
+ */
+void CGlobal::update_virtual_folders()
+{
+    CVirtualFolders *vf = CVirtualFolders::Instance();
+    if ( vf->names().empty() )
+        return;
 
+    refresh_virtual_folders();
+    if ( vf->version() == m_virtual_version )
+        return;
 
     /**
-     * For each selected maildir read the messages.
+     * While the index is being built almost every slice of it changes a
+     * folder, so rescan at most once a second until it is done.
      */
+    time_t now = time(NULL);
+    if ( CSearchIndex::Instance()->pending() && ( now == m_virtual_time ) )
+        return;
+
     std::vector<std::string>::iterator it;
-    for (it = folders.begin(); it != folders.end(); ++it) {
+    for (it = m_selected_folders.begin(); it != m_selected_folders.end(); ++it)
+    {
+        if ( CVirtualFolders::is_virtual( *it ) )
+        {
+            m_virtual_time = now;
+            update_messages();
+            return;
+        }
+    }
+    m_virtual_version = vf->version();
+}
 
-        /**
-         * get the messages from this folder.
-         */
-        CMaildir tmp = CMaildir(*it);
-        std::vector<CMessage *> contents = tmp.getMessages();
 
-        /**
-         * Append to the list of messages combined.
-         */
-        std::vector<CMessage *>::iterator mit;
-        for (mit = contents.begin(); mit != contents.end(); ++mit) {
-            if ( (*mit)->matches_filter( filter ) )
-                m_messages->push_back(*mit) ;
+/**
+ * Queue every message in every maildir for the full-text index.
+ */
+void CGlobal::index_all_folders()
+{
+    CSearchIndex *index = CSearchIndex::Instance();
+
+    std::vector<CMaildir> folders = get_all_folders();
+    std::vector<CMaildir>::iterator it;
+
+    CArena arena;
+    std::vector<TStringRef> paths;
+
+    for (it = folders.begin(); it != folders.end(); ++it)
+    {
+        arena.reset();
+        paths.clear();
+
+        it->getMessagePaths( arena, paths );
+        index->update_folder( it->path(), paths );
+    }
+}
+
+
+/**
+ * Apply a batch of changes seen by CWatcher.
+ */
+void CGlobal::watched( TWatchChanges &changes )
+{
+    /**
+     * The full-text index hears about the other folders directly.
+     */
+    CSearchIndex *index = CSearchIndex::Instance();
+    std::vector<std::pair<std::string, std::string> >::iterator rit;
+    for (rit = changes.other_renamed.begin(); rit != changes.other_renamed.end(); ++rit)
+        index->rename( rit->first, rit->second );
+
+    std::vector<std::string>::iterator oit;
+    for (oit = changes.other_removed.begin(); oit != changes.other_removed.end(); ++oit)
+        index->remove( *oit );
+    for (oit = changes.other_added.begin(); oit != changes.other_added.end(); ++oit)
+        index->add( *oit );
+
+    /**
+     * If the kernel dropped events we can't be incremental.
+     */
+    if ( changes.overflow )
+        update_messages();
+    else if ( ! changes.added.empty() || ! changes.removed.empty() || ! changes.renamed.empty() )
+        messages_changed( changes.added, changes.removed, changes.renamed );
+
+    /**
+     * Let the user know about new mail.
+     */
+    CLua *lua = CLua::Instance();
+    std::map<std::string, int>::iterator ait;
+    for (ait = changes.arrivals.begin(); ait != changes.arrivals.end(); ++ait)
+        lua->call_function( "on_new_mail", ait->first, ait->second );
+}
+
+
+/**
+ * Apply a set of changes to the list of messages.
+ *
+ * This is driven by CWatcher, and only touches the files which changed.
+ */
+void CGlobal::messages_changed( std::vector<std::string> &added,
+                                std::vector<std::string> &removed,
+                                std::vector<std::pair<std::string, std::string> > &renamed )
+{
+    std::vector<uint32_t> arrived;
+    std::unordered_set<uint32_t> gone;
+
+    /**
+     * Remember which message is selected.
+     */
+    CMessage *selected = NULL;
+    if ( ( m_cur_message >= 0 ) && ( m_cur_message < (int)m_messages.size() ) )
+        selected = m_messages[m_cur_message];
+
+    /**
+     * Renames keep the row, and whatever it has parsed.  If we never
+     * saw the source then treat it as a new arrival.
+     */
+    CSearchIndex *index = CSearchIndex::Instance();
+
+    std::vector<std::pair<std::string, std::string> >::iterator pit;
+    for (pit = renamed.begin(); pit != renamed.end(); ++pit)
+    {
+        uint32_t row = m_table.find( pit->first );
+        if ( row == MESSAGE_NO_ROW )
+        {
+            added.push_back( pit->second );
+            continue;
+        }
+        m_table.rename( row, pit->second );
+        index->rename( pit->first, pit->second );
+    }
+
+    /**
+     * Removed rows are only freed once we're done, so they're skipped
+     * rather than matched when looking for arrivals.
+     */
+    std::vector<bool> skip( m_table.rows(), false );
+
+    std::vector<std::string>::iterator it;
+    for (it = removed.begin(); it != removed.end(); ++it)
+    {
+        index->remove( *it );
+
+        uint32_t row = m_table.find( *it, skip );
+        if ( ( row != MESSAGE_NO_ROW ) && ( m_table.path( row ) == *it ) )
+        {
+            gone.insert( row );
+            skip[row] = true;
+        }
+    }
+
+    for (it = added.begin(); it != added.end(); ++it)
+    {
+        index->add( *it );
+
+        if ( m_table.find( *it, skip ) != MESSAGE_NO_ROW )
+            continue;
+
+        arrived.push_back( m_table.add( *it ) );
+    }
+
+    if ( arrived.empty() && gone.empty() && renamed.empty() )
+        return;
+
+    /**
+     * A removed row may be reused, so don't follow it.
+     */
+    std::unordered_set<uint32_t>::iterator git;
+    for (git = gone.begin(); git != gone.end(); ++git)
+    {
+        if ( message( *git ) == selected )
+            selected = NULL;
+    }
+
+    merge_messages( arrived, gone );
+
+    /**
+     * Keep the selection on the same message, if it is still visible.
+     */
+    if ( selected != NULL )
+    {
+        std::vector<CMessage *>::iterator pos =
+            std::find( m_messages.begin(), m_messages.end(), selected );
+        if ( pos != m_messages.end() )
+            m_cur_message = pos - m_messages.begin();
+    }
+    if ( m_cur_message >= (int)m_messages.size() )
+        m_cur_message = m_messages.empty() ? 0 : m_messages.size() - 1;
+}
+
+
+/**
+ * Remove the given rows, and merge new ones into the sorted list.
+ *
+ * The removed rows are freed, and the visible list is rebuilt.
+ */
+void CGlobal::merge_messages( std::vector<uint32_t> &added,
+                              std::unordered_set<uint32_t> &removed )
+{
+    std::vector<uint32_t>::iterator it;
+
+    TSortOrder order = get_sort_order();
+    auto compare = [this]( uint32_t a, uint32_t b )
+    {
+        return( m_table.less( a, b ) );
+    };
+
+    if ( ! removed.empty() )
+    {
+        std::vector<uint32_t> keep;
+        keep.reserve( m_order.size() );
+
+        for (it = m_order.begin(); it != m_order.end(); ++it)
+        {
+            if ( removed.find( *it ) == removed.end() )
+                keep.push_back( *it );
+        }
+        m_order.swap( keep );
+
+        std::unordered_set<uint32_t>::iterator rit;
+        for (rit = removed.begin(); rit != removed.end(); ++rit)
+        {
+            if ( m_threaded )
+                m_threader.remove( *rit );
+
+            message( *rit )->reset();
+            m_table.remove( *rit );
+        }
+    }
+
+    /**
+     * Ordering by header, or threading, needs every header: parse them
+     * in parallel first.
+     */
+    std::string * filter = get_variable("index_limit" );
+    bool threaded  = ( *get_variable( "index_view" ) == "threaded" );
+    bool by_header = ( order == SORT_DATE ) || ( order == SORT_FROM ) || ( order == SORT_SUBJECT );
+    bool by_search = ( filter->compare( 0, 7, "search:" ) == 0 );
+    bool by_format = ( *filter != "all" ) && ( *filter != "new" ) && ! by_search;
+
+    CQuery *query = by_format ? CQuery::compiled( *filter ) : NULL;
+    if ( query != NULL )
+        by_format = false;
+
+    if ( ( by_header && (int)order != m_sort_order ) || ( threaded && ! m_threaded ) )
+        parse_headers( m_order );
+    if ( by_header || threaded )
+        parse_headers( added );
+
+    /**
+     * If the order changed then everything is re-sorted.  Otherwise a
+     * handful of arrivals are inserted in place, or we sort them and
+     * merge the two runs.
+     */
+    if ( (int)order != m_sort_order )
+    {
+        m_order.insert( m_order.end(), added.begin(), added.end() );
+        sort_keys( m_order, order );
+        m_table.sort( m_order );
+        m_sort_order = (int)order;
+    }
+    else if ( added.size() < 16 )
+    {
+        sort_keys( added, order );
+        for (it = added.begin(); it != added.end(); ++it)
+        {
+            std::vector<uint32_t>::iterator pos =
+                std::upper_bound( m_order.begin(), m_order.end(), *it, compare );
+            m_order.insert( pos, *it );
+        }
+    }
+    else
+    {
+        sort_keys( added, order );
+        m_table.sort( added );
+
+        size_t middle = m_order.size();
+        m_order.insert( m_order.end(), added.begin(), added.end() );
+        std::inplace_merge( m_order.begin(),
+                            m_order.begin() + middle,
+                            m_order.end(), compare );
+    }
+
+    /**
+     * The threads are built once, when first wanted, and from then on
+     * only the arrivals are added.
+     */
+    if ( threaded && ! m_threaded )
+    {
+        m_threader.clear();
+        m_threader.reserve( m_order.size() );
+        for (it = m_order.begin(); it != m_order.end(); ++it)
+            thread_message( *it );
+        m_threaded = true;
+    }
+    else if ( threaded )
+    {
+        for (it = added.begin(); it != added.end(); ++it)
+            thread_message( *it );
+    }
+    else if ( m_threaded )
+    {
+        m_threader.clear();
+        m_threaded = false;
+    }
+
+    if ( threaded )
+        m_threader.flatten( m_order, m_thread_order, m_thread_depths );
+    else
+    {
+        m_thread_order.clear();
+        m_thread_depths.clear();
+    }
+
+    /**
+     * Now update the visible set.  The common limits only need the
+     * flags, which are scanned straight from the table.
+     */
+    bool all = ( *filter == "all" );
+    bool unread = ( *filter == "new" );
+
+    /**
+     * A full-text search is answered by the index, and the results
+     * found in the table.
+     */
+    std::vector<bool> found;
+    bool by_rows = by_search;
+    if ( by_search )
+    {
+        found.assign( m_table.rows(), false );
+
+        std::vector<std::string> paths = CSearchIndex::Instance()->search( filter->substr( 7 ) );
+        std::vector<std::string>::iterator pit;
+        for (pit = paths.begin(); pit != paths.end(); ++pit)
+        {
+            uint32_t row = m_table.find( *pit );
+            if ( row != MESSAGE_NO_ROW && m_table.is_path( row, *pit ) )
+                found[row] = true;
         }
     }
 
-    /*
-     * Sort?
+    /**
+     * A query, or a substring, is tested against each row once, and the
+     * verdict kept: only the rows which arrived, or were renamed, since
+     * the last refresh are tested again.
+     */
+    if ( query != NULL || by_format )
+    {
+        std::vector<uint32_t> stale;
+        limit_stale( *filter, stale );
+
+        if ( query != NULL )
+            query_rows( query, stale );
+        else if ( ! substring_rows( *filter, stale ) )
+        {
+            /**
+             * Too short for the trigram index, so each message is
+             * formatted and searched.
+             */
+            parse_headers( stale );
+            for (it = stale.begin(); it != stale.end(); ++it)
+                m_limit_match[*it] = message( *it )->matches_filter( filter );
+        }
+
+        for (it = stale.begin(); it != stale.end(); ++it)
+            m_limit_version[*it] = m_table.version( *it );
+
+        found   = m_limit_match;
+        by_rows = true;
+    }
+
+    std::vector<uint32_t> &shown = threaded ? m_thread_order : m_order;
+    std::vector<uint16_t> depths;
+
+    m_messages.clear();
+    for( size_t i = 0; i < shown.size(); i++ )
+    {
+        uint32_t row = shown[i];
+        if ( all || ( unread && m_table.is_new( row ) ) ||
+             ( by_rows && found[row] ) )
+        {
+            m_messages.push_back( message( row ) );
+            if ( threaded )
+                depths.push_back( m_thread_depths[i] );
+        }
+    }
+
+    /**
+     * The tree is drawn for the messages which are visible, so a limit
+     * leaves no gaps in it.
+     */
+    CThreader::glyphs( depths, m_thread_glyphs );
+
+    /**
+     * Parse the rest in the background, so the index fills in while
+     * the user reads it.
+     */
+    std::vector<CMessage *>::iterator mit;
+    for (mit = m_messages.begin(); mit != m_messages.end(); ++mit)
+        (*mit)->queue_headers();
+
+    m_version++;
+}
+
+
+/**
+ * Find the rows of the list whose verdict against the given limit is out
+ * of date: all of them if the limit, or the format it is tested against,
+ * changed, and otherwise those added or renamed since they were tested.
+ */
+void CGlobal::limit_stale( const std::string &filter, std::vector<uint32_t> &stale )
+{
+    std::string key = filter + "\n" + *get_variable( "index_format" );
+    if ( key != m_limit_key )
+    {
+        m_limit_match.clear();
+        m_limit_version.clear();
+        m_limit_key = key;
+    }
+    m_limit_match.resize( m_table.rows(), false );
+    m_limit_version.resize( m_table.rows(), 0 );
+
+    std::vector<uint32_t>::iterator it;
+    for (it = m_order.begin(); it != m_order.end(); ++it)
+    {
+        if ( m_limit_version[*it] != m_table.version( *it ) )
+            stale.push_back( *it );
+    }
+}
+
+
+/**
+ * Decide which of the given rows have a formatted line containing the
+ * given filter, using the trigram index.  Returns false if the filter is
+ * too short to be looked up.
+ *
+ * Rows are indexed the first time a filter needs them, and again once
+ * renamed, as the flags they show may have changed.  The candidates the
+ * index returns are formatted again, to be sure.
+ */
+bool CGlobal::substring_rows( const std::string &filter, std::vector<uint32_t> &rows )
+{
+    if ( filter.size() < 3 )
+        return false;
+
+    /**
+     * Start again if the format changed, or if most of what we hold
+     * is stale.
      */
-    std::sort(m_messages->begin(), m_messages->end(), my_sort);
+    std::string *format = get_variable( "index_format" );
+    if ( *format != m_trigram_format || m_trigrams.added() > 2 * m_table.size() + 1024 )
+    {
+        m_trigrams.clear();
+        m_trigram_version.clear();
+        m_trigram_format = *format;
+    }
+    m_trigram_version.resize( m_table.rows(), 0 );
+
+    std::vector<uint32_t> stale;
+    std::vector<uint32_t>::iterator it;
+    for (it = m_order.begin(); it != m_order.end(); ++it)
+    {
+        if ( m_trigram_version[*it] != m_table.version( *it ) )
+            stale.push_back( *it );
+    }
+
+    parse_headers( stale );
+
+    for (it = stale.begin(); it != stale.end(); ++it)
+    {
+        m_line.clear();
+        message( *it )->format( m_line, "" );
+        m_trigrams.add( *it, m_line );
+        m_trigram_version[*it] = m_table.version( *it );
+    }
+
+    if ( rows.empty() )
+        return true;
+
+    /**
+     * Only the candidates among the rows we were given need a look.
+     */
+    std::vector<bool> wanted( m_table.rows(), false );
+    for (it = rows.begin(); it != rows.end(); ++it)
+    {
+        wanted[*it] = true;
+        m_limit_match[*it] = false;
+    }
 
+    std::vector<uint32_t> candidates;
+    m_trigrams.candidates( filter, candidates );
+
+    for (it = candidates.begin(); it != candidates.end(); ++it)
+    {
+        if ( ! wanted[*it] || ! m_table.live( *it ) )
+            continue;
+
+        m_line.clear();
+        message( *it )->format( m_line, "" );
+        if ( strstr( m_line.c_str(), filter.c_str() ) != NULL )
+            m_limit_match[*it] = true;
+    }
+    return true;
+}
+
+
+/**
+ * Decide which of the given rows match the given query.
+ *
+ * Flags come straight from the table, and the headers, date, and size
+ * from the header-cache, so only a term matching the index line formats
+ * the message.  Headers are parsed in parallel first, if any are needed.
+ */
+void CGlobal::query_rows( CQuery *query, std::vector<uint32_t> &rows )
+{
+    if ( query->needs( QUERY_FROM ) || query->needs( QUERY_TO ) ||
+         query->needs( QUERY_SUBJECT ) || query->needs( QUERY_LINE ) ||
+         query->needs( QUERY_DATE ) )
+        parse_headers( rows );
+
+    uint32_t row = 0;
+    CMessage *msg = NULL;
+
+    auto text = [this, &msg]( TQueryField field ) -> const std::string &
+    {
+        switch( field ) {
+        case QUERY_FROM:    return( msg->header_value( "From" ) );
+        case QUERY_TO:      return( msg->header_value( "To" ) );
+        case QUERY_SUBJECT: return( msg->header_value( "Subject" ) );
+        default: break;
+        }
+        m_line.clear();
+        msg->format( m_line, "" );
+        return( m_line );
+    };
+    auto number = [this, &row, &msg]( TQueryField field ) -> int64_t
+    {
+        switch( field ) {
+        case QUERY_DATE: return( msg->date_epoch() );
+        case QUERY_SIZE: return( msg->size() );
+        default: break;
+        }
+        uint64_t flags = m_table.flags( row );
+        if ( m_table.in_new( row ) )
+            flags |= CFlags::bit( 'N' );
+        return( (int64_t)flags );
+    };
+
+    CQuery::TTextFunction text_function = text;
+    CQuery::TNumberFunction number_function = number;
+
+    std::vector<uint32_t>::iterator it;
+    for (it = rows.begin(); it != rows.end(); ++it)
+    {
+        row = *it;
+        msg = message( row );
+        m_limit_match[row] = query->matches( text_function, number_function );
+    }
 }
 
+
 /**
  * Remove all selected folders.
  */
 void CGlobal::unset_folders()
 {
     m_selected_folders.clear();
+    m_version++;
 }
 
 /**
@@ -241,6 +1085,7 @@ void CGlobal::unset_folders()
 void CGlobal::add_folder(std::string path)
 {
     m_selected_folders.push_back(path);
+    m_version++;
 }
 
 /**
@@ -260,6 +1105,7 @@ bool CGlobal::remove_folder(std::string path)
      */
     if (it != m_selected_folders.end()) {
 	m_selected_folders.erase(it);
+	m_version++;
 	return true;
     }
 
@@ -317,6 +1163,7 @@ void CGlobal::set_variable( std::string name, std::string *value )
      * Store new value.
      */
     m_variables[ name ] = value;
+    m_version++;
 
 
     std::string dm = "Set variable named '" ;
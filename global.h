@@ -19,11 +19,23 @@
 #ifndef _global_h_
 #define _global_h_ 1
 
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <vector>
+#include <time.h>
+#include "arena.h"
 #include "maildir.h"
 #include "message.h"
+#include "messagetable.h"
+#include "query.h"
+#include "sort.h"
+#include "threader.h"
+#include "trigramindex.h"
+#include "virtualfolders.h"
+
+struct TWatchChanges;
 
 /**
  * A singleton class to store global data.
@@ -53,6 +65,26 @@ class CGlobal
    */
   std::vector<std::string> get_selected_folders();
 
+  /**
+   * The number of threads to use when walking the maildir hierarchy.
+   */
+  int get_scan_threads();
+
+  /**
+   * The number of bytes of parsed MIME entities to keep in memory.
+   */
+  size_t get_mime_cache_limit();
+
+  /**
+   * The number of threads to use when parsing message headers.
+   */
+  int get_parse_threads();
+
+  /**
+   * The order in which the index is sorted, from `sort_order`.
+   */
+  TSortOrder get_sort_order();
+
   /**
    * Get all messages from the currently-selected folders.
    */
@@ -63,6 +95,35 @@ class CGlobal
    */
   void update_messages();
 
+  /**
+   * The tree drawn before the visible message at the given offset, when
+   * the index is threaded.
+   */
+  const std::string &get_thread_glyphs( size_t offset );
+
+  /**
+   * Update the list of messages if a selected virtual folder changed.
+   */
+  void update_virtual_folders();
+
+  /**
+   * Queue every message in every maildir for the full-text index.
+   */
+  void index_all_folders();
+
+  /**
+   * Apply a set of changes to the list of messages, without rescanning
+   * the selected folders.
+   */
+  void messages_changed( std::vector<std::string> &added,
+                         std::vector<std::string> &removed,
+                         std::vector<std::pair<std::string, std::string> > &renamed );
+
+  /**
+   * Apply a batch of changes seen by CWatcher.
+   */
+  void watched( TWatchChanges &changes );
+
   /**
    * Remove all selected folders.
    */
@@ -86,6 +147,7 @@ class CGlobal
   }
   void set_selected_folder(int offset) {
     m_cur_folder = offset;
+    m_version++;
   }
 
   /**
@@ -96,6 +158,7 @@ class CGlobal
   }
   void set_selected_message(int offset) {
     m_cur_message = offset;
+    m_version++;
   }
 
   /**
@@ -106,10 +169,26 @@ class CGlobal
   }
   void set_message_offset(int offset) {
     m_msg_offset = offset;
+    m_version++;
   }
 
 
 
+  /**
+   * A number which changes whenever anything we show may have changed:
+   * a setting, the selection, the messages, or any of their flags.
+   */
+  unsigned int version() {
+    return( m_version + m_table.last_version() );
+  }
+
+  /**
+   * Note a change made behind our back, such as to a maildir.
+   */
+  void changed() {
+    m_version++;
+  }
+
   /**
    * Get the value of an arbitrary setting.
    */
@@ -142,6 +221,54 @@ class CGlobal
    */
   static CGlobal *pinstance;
 
+  /**
+   * Remove the given rows, and merge new ones into the sorted list.
+   */
+  void merge_messages( std::vector<uint32_t> &added,
+                       std::unordered_set<uint32_t> &removed );
+
+  /**
+   * Parse the headers of the given rows, in parallel.
+   */
+  void parse_headers( std::vector<uint32_t> &rows );
+
+  /**
+   * Make sure the given rows have keys for the given order.
+   */
+  void sort_keys( std::vector<uint32_t> &rows, TSortOrder order );
+
+  /**
+   * Get the message held in the given row of our table.
+   */
+  CMessage *message( uint32_t row );
+
+  /**
+   * Add the message in the given row to the threads.
+   */
+  void thread_message( uint32_t row );
+
+  /**
+   * Find the rows of the list whose verdict against the given limit is
+   * out of date.
+   */
+  void limit_stale( const std::string &filter, std::vector<uint32_t> &stale );
+
+  /**
+   * Decide which of the given rows have a formatted line containing the
+   * given filter.
+   */
+  bool substring_rows( const std::string &filter, std::vector<uint32_t> &rows );
+
+  /**
+   * Decide which of the given rows match the given query.
+   */
+  void query_rows( CQuery *query, std::vector<uint32_t> &rows );
+
+  /**
+   * Fill any virtual folders which need it.
+   */
+  void refresh_virtual_folders();
+
   /**
    * The selected folder.
    */
@@ -159,15 +286,89 @@ class CGlobal
   int m_msg_offset;
 
 
+  /**
+   * Bumped by each change to the above, the settings, or the messages.
+   */
+  unsigned int m_version;
+
   /**
    * Currently selected folders.
    */
   std::vector < std::string > m_selected_folders;
 
   /**
-   * The list of currently visible messages.
+   * Every message in the selected folders, and the objects viewing
+   * each row.
+   */
+  CMessageTable m_table;
+  std::deque<CMessage> m_views;
+
+  /**
+   * The rows of m_table, sorted.
+   */
+  std::vector<uint32_t> m_order;
+
+  /**
+   * The list of currently visible messages, i.e. those from
+   * m_order which match the index_limit.
+   */
+  std::vector<CMessage*> m_messages;
+
+  /**
+   * The conversations, if the index is threaded, which are kept up to
+   * date as messages come and go.  Also m_order in thread order, the
+   * depth of each row in its thread, and the tree drawn before each
+   * visible message.
+   */
+  CThreader m_threader;
+  bool m_threaded;
+  std::vector<uint32_t> m_thread_order;
+  std::vector<uint16_t> m_thread_depths;
+  std::vector<std::string> m_thread_glyphs;
+
+  /**
+   * The paths found by a scan of the selected folders, which are only
+   * needed until it completes.
+   */
+  CArena m_scan;
+  std::vector<TStringRef> m_scan_paths;
+
+  /**
+   * The trigrams of the formatted line of each row, the version of each
+   * row when it was indexed, and the format used.
+   */
+  CTrigramIndex m_trigrams;
+  std::vector<uint32_t> m_trigram_version;
+  std::string m_trigram_format;
+  std::string m_line;
+
+  /**
+   * Whether each row matched the index_limit, the version of each row
+   * when it was tested, and the limit and format tested against.
+   */
+  std::vector<bool> m_limit_match;
+  std::vector<uint32_t> m_limit_version;
+  std::string m_limit_key;
+
+  /**
+   * The version of the folder-cache we last saw.
+   */
+  unsigned int m_folders_version;
+
+  /**
+   * The version of the virtual folders we last showed.
+   */
+  unsigned int m_virtual_version;
+
+  /**
+   * When we last rescanned because a virtual folder changed.
+   */
+  time_t m_virtual_time;
+
+  /**
+   * The order m_all_messages is sorted in, or -1.
    */
-  std::vector<CMessage*> *m_messages;
+  int m_sort_order;
 
   /**
    * The settings we hold.
@@ -0,0 +1,206 @@
+/**
+ * header.cc - Fast parsing of message headers.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "header.h"
+
+
+/**
+ * Lower-case a header name.
+ */
+static std::string lower( const std::string &name )
+{
+    std::string result = name;
+    for( size_t i = 0; i < result.size(); i++ )
+        result[i] = tolower( (unsigned char)result[i] );
+    return( result );
+}
+
+
+/**
+ * Constructor.  NOP.
+ */
+CHeader::CHeader()
+{
+}
+
+
+/**
+ * Read the headers from the given file.
+ *
+ * We read in small blocks, and stop as soon as we've seen the blank line
+ * which terminates the header.
+ */
+bool CHeader::load( const std::string &path )
+{
+    m_fields.clear();
+
+    int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+        return false;
+
+    std::string text;
+    char buf[4096];
+
+    while( text.size() < HEADER_MAX_SIZE )
+    {
+        ssize_t len = read( fd, buf, sizeof(buf) );
+        if ( len <= 0 )
+            break;
+
+        /**
+         * Only search the new data, plus enough of the old to catch a
+         * terminator which spans two reads.
+         */
+        size_t from = ( text.size() > 2 ) ? text.size() - 2 : 0;
+        text.append( buf, len );
+
+        if ( text.find( "\n\n", from ) != std::string::npos ||
+             text.find( "\n\r\n", from ) != std::string::npos )
+            break;
+    }
+    close( fd );
+
+    parse( text );
+    return true;
+}
+
+
+/**
+ * Parse the headers from the given text.
+ */
+void CHeader::parse( const std::string &text )
+{
+    m_fields.clear();
+
+    size_t offset = 0;
+    while( offset < text.size() )
+    {
+        size_t end = text.find( '\n', offset );
+        if ( end == std::string::npos )
+            end = text.size();
+
+        std::string line = text.substr( offset, end - offset );
+        offset = end + 1;
+
+        if ( ! line.empty() && line[line.size() - 1] == '\r' )
+            line.erase( line.size() - 1 );
+
+        /**
+         * A blank line ends the header.
+         */
+        if ( line.empty() )
+            break;
+
+        /**
+         * Continuation lines are appended to the previous header.
+         */
+        if ( line[0] == ' ' || line[0] == '\t' )
+        {
+            if ( ! m_fields.empty() )
+                m_fields.back().value += line;
+            continue;
+        }
+
+        size_t colon = line.find( ':' );
+        if ( colon == std::string::npos )
+            continue;
+
+        size_t name_end = colon;
+        while( name_end > 0 && isspace( (unsigned char)line[name_end - 1] ) )
+            name_end--;
+
+        size_t value = colon + 1;
+        while( value < line.size() && isspace( (unsigned char)line[value] ) )
+            value++;
+
+        TField field;
+        field.name  = lower( line.substr( 0, name_end ) );
+        field.value = line.substr( value );
+        m_fields.push_back( field );
+    }
+
+    /**
+     * Trim trailing whitespace from each value.
+     */
+    std::vector<TField>::iterator it;
+    for (it = m_fields.begin(); it != m_fields.end(); ++it)
+    {
+        std::string &v = it->value;
+        size_t end = v.size();
+        while( end > 0 && isspace( (unsigned char)v[end - 1] ) )
+            end--;
+        v.erase( end );
+    }
+}
+
+
+/**
+ * Is the given header present?
+ */
+bool CHeader::has( const std::string &name )
+{
+    std::string key = lower( name );
+
+    std::vector<TField>::iterator it;
+    for (it = m_fields.begin(); it != m_fields.end(); ++it)
+    {
+        if ( it->name == key )
+            return true;
+    }
+    return false;
+}
+
+
+/**
+ * Get the value of the given header.
+ */
+std::string CHeader::get( const std::string &name )
+{
+    const std::string *value = find( name );
+    return( value ? *value : "" );
+}
+
+
+/**
+ * Get the value of the given header without copying it.
+ */
+const std::string *CHeader::find( const std::string &name )
+{
+    std::string key = lower( name );
+
+    std::vector<TField>::iterator it;
+    for (it = m_fields.begin(); it != m_fields.end(); ++it)
+    {
+        if ( it->name == key )
+            return( &it->value );
+    }
+    return( NULL );
+}
+
+
+/**
+ * The number of headers.
+ */
+size_t CHeader::size()
+{
+    return( m_fields.size() );
+}
@@ -0,0 +1,106 @@
+/**
+ * header.h - Fast parsing of message headers.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _header_h_
+#define _header_h_ 1
+
+#include <string>
+#include <vector>
+
+
+/**
+ * The most we'll read while looking for the end of the headers.
+ */
+#define HEADER_MAX_SIZE ( 256 * 1024 )
+
+
+/**
+ * How much of a message we ask to be read ahead, when prefetching.
+ */
+#define HEADER_PREFETCH_SIZE ( 16 * 1024 )
+
+
+/**
+ * The header-block of a single message.
+ *
+ * Only the header is read from disk - we stop at the first blank line -
+ * so a message with a large attachment costs no more than any other.
+ * Folded headers are unfolded, and lookups are case-insensitive.
+ */
+class CHeader
+{
+
+public:
+
+    /**
+     * Constructor.  NOP.
+     */
+    CHeader();
+
+    /**
+     * Read the headers from the given file.
+     */
+    bool load( const std::string &path );
+
+    /**
+     * Parse the headers from the given text, which may include a body.
+     */
+    void parse( const std::string &text );
+
+    /**
+     * Is the given header present?
+     */
+    bool has( const std::string &name );
+
+    /**
+     * Get the value of the given header, or "" if it is absent.
+     *
+     * If the header is repeated the first value is returned.
+     */
+    std::string get( const std::string &name );
+
+    /**
+     * Get the value of the given header without copying it, or NULL if
+     * it is absent.  This is valid until the headers are next loaded.
+     */
+    const std::string *find( const std::string &name );
+
+    /**
+     * The number of headers.
+     */
+    size_t size();
+
+private:
+
+    /**
+     * A single header.  The name is stored lower-cased.
+     */
+    struct TField
+    {
+        std::string name;
+        std::string value;
+    };
+
+    /**
+     * The headers, in the order they appeared.
+     */
+    std::vector<TField> m_fields;
+
+};
+
+#endif /* _header_h_ */
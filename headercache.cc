@@ -0,0 +1,515 @@
+/**
+ * headercache.cc - Persistent cache of message headers.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "file.h"
+#include "header.h"
+#include "headercache.h"
+#include "sort.h"
+
+
+/**
+ * The first line of each cache file, changed whenever the format is.
+ */
+#define HEADER_CACHE_MAGIC "lumail-header-cache 1"
+
+
+/**
+ * Instance-handle.
+ */
+CHeaderCache *CHeaderCache::pinstance = NULL;
+
+
+/**
+ * Get access to our singleton-object.
+ */
+CHeaderCache *CHeaderCache::Instance()
+{
+    if (!pinstance)
+        pinstance = new CHeaderCache;
+
+    return pinstance;
+}
+
+
+/**
+ * Constructor - This is private as this class is a singleton.
+ *
+ * We default to ~/.lumail/cache, if ~/.lumail exists.
+ */
+CHeaderCache::CHeaderCache()
+{
+    const char *home = getenv( "HOME" );
+    if ( home == NULL )
+        return;
+
+    std::string dir = std::string( home ) + "/.lumail";
+    if ( ! CFile::is_directory( dir ) )
+        return;
+
+    dir += "/cache";
+    if ( ! CFile::is_directory( dir ) )
+        mkdir( dir.c_str(), 0700 );
+
+    if ( CFile::is_directory( dir ) )
+        m_directory = dir;
+}
+
+
+/**
+ * Set the directory the cache is stored in.
+ */
+void CHeaderCache::set_directory( std::string directory )
+{
+    std::lock_guard<std::mutex> guard( m_lock );
+
+    m_directory = directory;
+    m_folders.clear();
+}
+
+
+/**
+ * Escape a value so it fits on a single tab-separated line.
+ */
+static std::string escape( const std::string &value )
+{
+    std::string result;
+    result.reserve( value.size() );
+
+    for( size_t i = 0; i < value.size(); i++ )
+    {
+        switch( value[i] )
+        {
+        case '\\': result += "\\\\"; break;
+        case '\t': result += "\\t";  break;
+        case '\n': result += "\\n";  break;
+        case '\r': result += "\\r";  break;
+        default:   result += value[i];
+        }
+    }
+    return( result );
+}
+
+
+/**
+ * Reverse escape().
+ */
+static std::string unescape( const std::string &value )
+{
+    std::string result;
+    result.reserve( value.size() );
+
+    for( size_t i = 0; i < value.size(); i++ )
+    {
+        if ( value[i] != '\\' || i + 1 == value.size() )
+        {
+            result += value[i];
+            continue;
+        }
+
+        switch( value[++i] )
+        {
+        case 't': result += '\t'; break;
+        case 'n': result += '\n'; break;
+        case 'r': result += '\r'; break;
+        default:  result += value[i];
+        }
+    }
+    return( result );
+}
+
+
+/**
+ * Split a message path into its maildir, and its unique name.
+ *
+ * "/path/to/folder/cur/123.abc:2,S" -> "/path/to/folder", "123.abc"
+ */
+static void split_path( const std::string &path, std::string &folder, std::string &name )
+{
+    size_t slash = path.rfind( '/' );
+    if ( slash == std::string::npos )
+    {
+        folder = "";
+        name   = path;
+    }
+    else
+    {
+        name = path.substr( slash + 1 );
+
+        size_t parent = ( slash > 0 ) ? path.rfind( '/', slash - 1 ) : std::string::npos;
+        folder = ( parent == std::string::npos ) ? "" : path.substr( 0, parent );
+    }
+
+    size_t colon = name.find( ':' );
+    if ( colon != std::string::npos )
+        name = name.substr( 0, colon );
+}
+
+
+/**
+ * Order two names, for searching.
+ */
+static bool ref_less( const TStringRef &a, const TStringRef &b )
+{
+    int cmp = memcmp( a.data, b.data, std::min( a.size, b.size ) );
+    if ( cmp != 0 )
+        return( cmp < 0 );
+    return( a.size < b.size );
+}
+
+
+/**
+ * Get the cache for the folder holding the given message.
+ */
+CHeaderCache::TFolderCache &CHeaderCache::folder_for( const std::string &path, std::string &name )
+{
+    std::string dir;
+    split_path( path, dir, name );
+    return( folder( dir ) );
+}
+
+
+/**
+ * Get the cache for the given folder, loading it if required.
+ */
+CHeaderCache::TFolderCache &CHeaderCache::folder( const std::string &folder )
+{
+    std::unordered_map<std::string, TFolderCache>::iterator it = m_folders.find( folder );
+    if ( it != m_folders.end() )
+        return( it->second );
+
+    TFolderCache &cache = m_folders[folder];
+    cache.dirty = false;
+    load( folder, cache );
+    return( cache );
+}
+
+
+/**
+ * Look up the headers for the given message file.
+ */
+bool CHeaderCache::lookup( const std::string &path, const struct stat &sb, THeaderEntry &entry )
+{
+    std::lock_guard<std::mutex> guard( m_lock );
+
+    std::string name;
+    TFolderCache &cache = folder_for( path, name );
+
+    std::unordered_map<std::string, THeaderEntry>::iterator it = cache.entries.find( name );
+    if ( it == cache.entries.end() )
+        return false;
+
+    if ( ( it->second.size != (int64_t)sb.st_size ) ||
+         ( it->second.mtime != (int64_t)sb.st_mtime ) )
+        return false;
+
+    entry = it->second;
+    return true;
+}
+
+
+/**
+ * Record the headers for the given message file.
+ *
+ * The size and mtime of the file are filled in, in the caller's copy too.
+ */
+void CHeaderCache::store( const std::string &path, const struct stat &sb, THeaderEntry &entry )
+{
+    std::lock_guard<std::mutex> guard( m_lock );
+
+    std::string name;
+    TFolderCache &cache = folder_for( path, name );
+
+    entry.size  = (int64_t)sb.st_size;
+    entry.mtime = (int64_t)sb.st_mtime;
+    cache.entries[name] = entry;
+
+    cache.dirty = true;
+}
+
+
+/**
+ * Forget any entries for the given folder which aren't among the given
+ * message paths.
+ */
+void CHeaderCache::prune( const std::string &dir, const std::vector<std::string> &paths )
+{
+    std::vector<TStringRef> refs( paths.begin(), paths.end() );
+    prune( dir, refs );
+}
+
+
+/**
+ * Forget any entries which aren't among the given paths.
+ *
+ * The names present are sorted and searched, rather than copied into a
+ * set, so a scan of a large folder allocates only the one array.
+ */
+void CHeaderCache::prune( const std::string &dir, const std::vector<TStringRef> &paths )
+{
+    std::lock_guard<std::mutex> guard( m_lock );
+
+    TFolderCache &cache = folder( dir );
+    if ( cache.entries.empty() )
+        return;
+
+    std::vector<TStringRef> present;
+    present.reserve( paths.size() );
+
+    std::vector<TStringRef>::const_iterator it;
+    for (it = paths.begin(); it != paths.end(); ++it)
+    {
+        size_t slash = it->rfind( '/' );
+        size_t start = ( slash == std::string::npos ) ? 0 : slash + 1;
+        size_t colon = it->find( ':', start );
+        if ( colon == std::string::npos )
+            colon = it->size;
+
+        present.push_back( TStringRef( it->data + start, colon - start ) );
+    }
+
+    std::sort( present.begin(), present.end(), ref_less );
+
+    std::unordered_map<std::string, THeaderEntry>::iterator eit;
+    for (eit = cache.entries.begin(); eit != cache.entries.end(); )
+    {
+        if ( ! std::binary_search( present.begin(), present.end(), TStringRef( eit->first ), ref_less ) )
+        {
+            eit = cache.entries.erase( eit );
+            cache.dirty = true;
+        }
+        else
+            ++eit;
+    }
+}
+
+
+/**
+ * Write any modified folders to disk.
+ */
+void CHeaderCache::flush()
+{
+    std::lock_guard<std::mutex> guard( m_lock );
+
+    std::unordered_map<std::string, TFolderCache>::iterator it;
+    for (it = m_folders.begin(); it != m_folders.end(); ++it)
+    {
+        if ( it->second.dirty )
+            save( it->first, it->second );
+    }
+}
+
+
+/**
+ * Get the value of the named header from an entry, if it is cached.
+ */
+bool CHeaderCache::field( const THeaderEntry &entry, const std::string &name, std::string &value )
+{
+    const std::string *found = field( entry, name.c_str() );
+    if ( found == NULL )
+        return false;
+
+    value = *found;
+    return true;
+}
+
+
+/**
+ * Get the named header from an entry, without copying it, or NULL if
+ * it isn't one we cache.
+ */
+const std::string *CHeaderCache::field( const THeaderEntry &entry, const char *name )
+{
+    static const struct
+    {
+        const char *name;
+        std::string THeaderEntry::*field;
+    } fields[] = {
+        { "from",        &THeaderEntry::from        },
+        { "to",          &THeaderEntry::to          },
+        { "subject",     &THeaderEntry::subject     },
+        { "date",        &THeaderEntry::date        },
+        { "message-id",  &THeaderEntry::message_id  },
+        { "references",  &THeaderEntry::references  },
+        { "in-reply-to", &THeaderEntry::in_reply_to },
+    };
+
+    for( size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++ )
+    {
+        if ( strcasecmp( name, fields[i].name ) == 0 )
+            return( &( entry.*fields[i].field ) );
+    }
+    return( NULL );
+}
+
+
+/**
+ * Fill in an entry from a parsed header-block.
+ */
+void CHeaderCache::fill( CHeader &header, THeaderEntry &entry )
+{
+    entry.from        = header.get( "From" );
+    entry.to          = header.get( "To" );
+    entry.subject     = header.get( "Subject" );
+    entry.date        = header.get( "Date" );
+    entry.message_id  = header.get( "Message-ID" );
+    entry.references  = header.get( "References" );
+    entry.in_reply_to = header.get( "In-Reply-To" );
+
+    if ( ! CSort::parse_date( entry.date, &entry.date_epoch ) )
+        entry.date_epoch = 0;
+}
+
+
+/**
+ * The file in which the given folder is cached.
+ *
+ * This is named for a hash of the folder's path; the path itself is
+ * recorded inside the file in case of collisions.
+ */
+std::string CHeaderCache::cache_file( const std::string &folder )
+{
+    if ( m_directory.empty() )
+        return "";
+
+    uint64_t hash = 14695981039346656037ULL;
+    for( size_t i = 0; i < folder.size(); i++ )
+    {
+        hash ^= (unsigned char)folder[i];
+        hash *= 1099511628211ULL;
+    }
+
+    char name[32];
+    snprintf( name, sizeof(name), "%016llx", (unsigned long long)hash );
+    return( m_directory + "/" + name );
+}
+
+
+/**
+ * Load the on-disk copy of a folder.
+ *
+ * Each line is tab-separated: name, size, mtime, date-epoch, and then
+ * the escaped header values.
+ */
+void CHeaderCache::load( const std::string &folder, TFolderCache &cache )
+{
+    std::string file = cache_file( folder );
+    if ( file.empty() )
+        return;
+
+    std::ifstream in( file.c_str() );
+    if ( ! in.is_open() )
+        return;
+
+    std::string line;
+    if ( ! std::getline( in, line ) || line != HEADER_CACHE_MAGIC )
+        return;
+
+    if ( ! std::getline( in, line ) || unescape( line ) != folder )
+        return;
+
+    std::vector<std::string> fields;
+    while( std::getline( in, line ) )
+    {
+        fields.clear();
+
+        std::stringstream stream( line );
+        std::string field;
+        while( std::getline( stream, field, '\t' ) )
+            fields.push_back( field );
+
+        /**
+         * A trailing empty field isn't reported by getline().
+         */
+        if ( ! line.empty() && line[line.size() - 1] == '\t' )
+            fields.push_back( "" );
+
+        if ( fields.size() != 11 )
+            continue;
+
+        THeaderEntry &e = cache.entries[unescape( fields[0] )];
+        e.size        = strtoll( fields[1].c_str(), NULL, 10 );
+        e.mtime       = strtoll( fields[2].c_str(), NULL, 10 );
+        e.date_epoch  = strtoll( fields[3].c_str(), NULL, 10 );
+        e.from        = unescape( fields[4] );
+        e.to          = unescape( fields[5] );
+        e.subject     = unescape( fields[6] );
+        e.date        = unescape( fields[7] );
+        e.message_id  = unescape( fields[8] );
+        e.references  = unescape( fields[9] );
+        e.in_reply_to = unescape( fields[10] );
+    }
+}
+
+
+/**
+ * Save the on-disk copy of a folder.
+ */
+void CHeaderCache::save( const std::string &folder, TFolderCache &cache )
+{
+    cache.dirty = false;
+
+    std::string file = cache_file( folder );
+    if ( file.empty() )
+        return;
+
+    /**
+     * Write to a temporary file and rename, so a crash never leaves
+     * us with a truncated cache.
+     */
+    std::string tmp = file + ".tmp";
+    std::ofstream out( tmp.c_str(), std::ios::trunc );
+    if ( ! out.is_open() )
+        return;
+
+    out << HEADER_CACHE_MAGIC << "\n";
+    out << escape( folder ) << "\n";
+
+    std::unordered_map<std::string, THeaderEntry>::iterator it;
+    for (it = cache.entries.begin(); it != cache.entries.end(); ++it)
+    {
+        THeaderEntry &e = it->second;
+        out << escape( it->first ) << "\t"
+            << e.size << "\t" << e.mtime << "\t" << e.date_epoch << "\t"
+            << escape( e.from ) << "\t"
+            << escape( e.to ) << "\t"
+            << escape( e.subject ) << "\t"
+            << escape( e.date ) << "\t"
+            << escape( e.message_id ) << "\t"
+            << escape( e.references ) << "\t"
+            << escape( e.in_reply_to ) << "\n";
+    }
+    out.close();
+
+    /**
+     * If the write failed, perhaps because the disk is full, keep the
+     * cache we already had.
+     */
+    if ( ! out.good() || rename( tmp.c_str(), file.c_str() ) != 0 )
+        unlink( tmp.c_str() );
+}
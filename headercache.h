@@ -0,0 +1,189 @@
+/**
+ * headercache.h - Persistent cache of message headers.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _headercache_h_
+#define _headercache_h_ 1
+
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h>
+
+#include "stringref.h"
+
+
+class CHeader;
+
+
+/**
+ * The headers we cache for each message: those the index needs.
+ */
+struct THeaderEntry
+{
+    std::string from;
+    std::string to;
+    std::string subject;
+    std::string date;
+    std::string message_id;
+    std::string references;
+    std::string in_reply_to;
+
+    /**
+     * The Date: header as seconds past the epoch, or 0.
+     */
+    int64_t date_epoch;
+
+    /**
+     * The file this was read from.
+     */
+    int64_t size;
+    int64_t mtime;
+};
+
+
+/**
+ * A singleton which caches the headers of each message, in the style of
+ * mutt's hcache.
+ *
+ * Entries are keyed by the unique part of the maildir filename, so they
+ * survive flag changes and moves from new/ to cur/, and are only trusted
+ * if the size and mtime of the file still match.  A hit therefore costs
+ * a stat() rather than an open() and a read().
+ *
+ * There is one file per maildir beneath ~/.lumail/cache, which is read the
+ * first time a message from that folder is looked up.
+ *
+ * The cache may be used from several threads at once.
+ */
+class CHeaderCache
+{
+
+public:
+
+    /**
+     * Get access to the singleton instance.
+     */
+    static CHeaderCache *Instance();
+
+    /**
+     * Set the directory the cache is stored in, discarding anything held
+     * in memory.  An empty directory disables persistence.
+     */
+    void set_directory( std::string directory );
+
+    /**
+     * Look up the headers for the given message file.
+     */
+    bool lookup( const std::string &path, const struct stat &sb, THeaderEntry &entry );
+
+    /**
+     * Record the headers for the given message file.
+     */
+    void store( const std::string &path, const struct stat &sb, THeaderEntry &entry );
+
+    /**
+     * Forget any entries for the given folder which aren't among the
+     * given message paths.
+     */
+    void prune( const std::string &folder, const std::vector<TStringRef> &paths );
+    void prune( const std::string &folder, const std::vector<std::string> &paths );
+
+    /**
+     * Write any modified folders to disk.
+     */
+    void flush();
+
+    /**
+     * Get the value of the named header from an entry, if it is cached.
+     */
+    static bool field( const THeaderEntry &entry, const std::string &name, std::string &value );
+    static const std::string *field( const THeaderEntry &entry, const char *name );
+
+    /**
+     * Fill in an entry from a parsed header-block.
+     */
+    static void fill( CHeader &header, THeaderEntry &entry );
+
+protected:
+
+    /**
+     * Protected functions to allow our singleton implementation.
+     */
+    CHeaderCache();
+    CHeaderCache(const CHeaderCache &);
+    CHeaderCache & operator=(const CHeaderCache &);
+
+private:
+
+    /**
+     * The cached entries for a single maildir.
+     */
+    struct TFolderCache
+    {
+        bool dirty;
+        std::unordered_map<std::string, THeaderEntry> entries;
+    };
+
+    /**
+     * Get the cache for the folder holding the given message, loading
+     * it if required, and the unique name of the message.
+     */
+    TFolderCache &folder_for( const std::string &path, std::string &name );
+
+    /**
+     * Get the cache for the given folder, loading it if required.
+     */
+    TFolderCache &folder( const std::string &folder );
+
+    /**
+     * Load/save the on-disk copy of a folder.
+     */
+    void load( const std::string &folder, TFolderCache &cache );
+    void save( const std::string &folder, TFolderCache &cache );
+
+    /**
+     * The file in which the given folder is cached, or "".
+     */
+    std::string cache_file( const std::string &folder );
+
+    /**
+     * The single instance of this class.
+     */
+    static CHeaderCache *pinstance;
+
+    /**
+     * The directory we store our cache in, or "".
+     */
+    std::string m_directory;
+
+    /**
+     * The cache of each folder, by path.
+     */
+    std::unordered_map<std::string, TFolderCache> m_folders;
+
+    /**
+     * Protects all of the above.
+     */
+    std::mutex m_lock;
+
+};
+
+#endif /* _headercache_h_ */
@@ -0,0 +1,223 @@
+/**
+ * headerpool.cc - Parse message headers on background threads.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <thread>
+#include <sys/stat.h>
+
+#include "headerpool.h"
+
+
+/**
+ * Instance-handle.
+ */
+CHeaderPool *CHeaderPool::pinstance = NULL;
+
+
+/**
+ * Get access to our singleton-object.
+ */
+CHeaderPool *CHeaderPool::Instance()
+{
+    if (!pinstance)
+        pinstance = new CHeaderPool;
+
+    return pinstance;
+}
+
+
+/**
+ * Constructor - This is private as this class is a singleton.
+ */
+CHeaderPool::CHeaderPool()
+{
+    m_active  = 0;
+    m_target  = 0;
+    m_started = 0;
+    m_done    = 0;
+    m_total   = 0;
+}
+
+
+/**
+ * Set the number of worker threads.
+ *
+ * Threads are started as required, and never stopped: if the count is
+ * lowered the surplus threads simply stop taking work.
+ */
+void CHeaderPool::set_threads( int threads )
+{
+    if ( threads < 0 )
+        threads = 0;
+
+    /**
+     * Make sure the cache exists before any worker can race to create it.
+     */
+    CHeaderCache::Instance();
+
+    std::lock_guard<std::mutex> guard( m_lock );
+    m_target = threads;
+
+    while( m_started < threads )
+    {
+        std::thread( &CHeaderPool::worker, this, m_started ).detach();
+        m_started += 1;
+    }
+    m_work.notify_all();
+}
+
+
+/**
+ * The number of worker threads.
+ */
+int CHeaderPool::threads()
+{
+    return( m_target );
+}
+
+
+/**
+ * Queue a slot to be parsed.
+ */
+void CHeaderPool::submit( std::shared_ptr<THeaderSlot> slot, bool urgent )
+{
+    std::lock_guard<std::mutex> guard( m_lock );
+
+    /**
+     * Start counting afresh if we were idle.
+     */
+    if ( m_queue.empty() && m_active == 0 )
+    {
+        m_done  = 0;
+        m_total = 0;
+    }
+
+    if ( urgent )
+        m_queue.push_front( slot );
+    else
+        m_queue.push_back( slot );
+
+    m_total += 1;
+
+    /**
+     * Surplus workers ignore the wakeup, so make sure one that will
+     * take the work sees it.
+     */
+    m_work.notify_all();
+}
+
+
+/**
+ * Wait until every queued slot has been dealt with.
+ */
+void CHeaderPool::wait()
+{
+    std::unique_lock<std::mutex> lock( m_lock );
+    if ( m_target == 0 )
+        return;
+
+    m_idle.wait( lock, [this]() { return( m_queue.empty() && m_active == 0 ); } );
+}
+
+
+/**
+ * Is there work outstanding?
+ */
+bool CHeaderPool::busy()
+{
+    std::lock_guard<std::mutex> guard( m_lock );
+    return( m_target > 0 && ( ! m_queue.empty() || m_active > 0 ) );
+}
+
+
+/**
+ * Report our progress.
+ */
+void CHeaderPool::progress( long *done, long *total )
+{
+    *done  = m_done;
+    *total = m_total;
+}
+
+
+/**
+ * The main-loop of each thread.
+ */
+void CHeaderPool::worker( int id )
+{
+    while( true )
+    {
+        std::shared_ptr<THeaderSlot> slot;
+        {
+            std::unique_lock<std::mutex> lock( m_lock );
+            m_work.wait( lock, [this, id]() { return( id < m_target && ! m_queue.empty() ); } );
+
+            slot = m_queue.front();
+            m_queue.pop_front();
+            m_active += 1;
+        }
+
+        /**
+         * The slot may have been cancelled, or queued twice.
+         */
+        int expected = SLOT_PENDING;
+        if ( slot->state.compare_exchange_strong( expected, SLOT_BUSY ) )
+            parse( *slot );
+
+        {
+            std::lock_guard<std::mutex> guard( m_lock );
+            m_active -= 1;
+            m_done   += 1;
+
+            if ( m_queue.empty() && m_active == 0 )
+                m_idle.notify_all();
+        }
+    }
+}
+
+
+/**
+ * Parse a single slot, publishing the result.
+ */
+void CHeaderPool::parse( THeaderSlot &slot )
+{
+    struct stat sb;
+    if ( stat( slot.path.c_str(), &sb ) != 0 )
+    {
+        slot.state.store( SLOT_FAILED, std::memory_order_release );
+        return;
+    }
+
+    CHeaderCache *cache = CHeaderCache::Instance();
+    if ( cache->lookup( slot.path, sb, slot.entry ) )
+    {
+        slot.state.store( SLOT_READY, std::memory_order_release );
+        return;
+    }
+
+    if ( ! slot.header.load( slot.path ) )
+    {
+        slot.state.store( SLOT_FAILED, std::memory_order_release );
+        return;
+    }
+
+    CHeaderCache::fill( slot.header, slot.entry );
+    cache->store( slot.path, sb, slot.entry );
+
+    slot.parsed = true;
+    slot.state.store( SLOT_READY, std::memory_order_release );
+}
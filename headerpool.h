@@ -0,0 +1,174 @@
+/**
+ * headerpool.h - Parse message headers on background threads.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _headerpool_h_
+#define _headerpool_h_ 1
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "header.h"
+#include "headercache.h"
+
+
+/**
+ * The states a slot moves through.
+ */
+enum TSlotState { SLOT_PENDING, SLOT_BUSY, SLOT_READY, SLOT_FAILED, SLOT_CANCELLED };
+
+
+/**
+ * The result of parsing the headers of one message.
+ *
+ * A worker claims the slot by moving it from pending to busy, fills in
+ * the fields, and then publishes them by storing ready.  The main thread
+ * only reads the fields once it has seen ready, so no lock is needed.
+ */
+struct THeaderSlot
+{
+    THeaderSlot( const std::string &p ) : path( p ), state( SLOT_PENDING ), parsed( false ) { }
+
+    /**
+     * The message to parse.
+     */
+    std::string path;
+
+    /**
+     * One of TSlotState.
+     */
+    std::atomic<int> state;
+
+    /**
+     * The cached headers, which are always present once ready.
+     */
+    THeaderEntry entry;
+
+    /**
+     * The full header-block, if we had to read the file.
+     */
+    bool parsed;
+    CHeader header;
+};
+
+
+/**
+ * A singleton pool of threads which parse message headers.
+ *
+ * Only files and the header-cache are touched by the workers: the curses
+ * and Lua state belong to the main thread, which collects the results
+ * from each slot as it needs them.
+ */
+class CHeaderPool
+{
+
+public:
+
+    /**
+     * Get access to the singleton instance.
+     */
+    static CHeaderPool *Instance();
+
+    /**
+     * Set the number of worker threads.  Zero disables the pool.
+     */
+    void set_threads( int threads );
+
+    /**
+     * The number of worker threads.
+     */
+    int threads();
+
+    /**
+     * Queue a slot to be parsed.  Urgent slots jump the queue.
+     */
+    void submit( std::shared_ptr<THeaderSlot> slot, bool urgent = false );
+
+    /**
+     * Wait until every queued slot has been dealt with.
+     */
+    void wait();
+
+    /**
+     * Is there work outstanding?
+     */
+    bool busy();
+
+    /**
+     * The number of slots completed, out of those submitted, since the
+     * pool was last idle.
+     */
+    void progress( long *done, long *total );
+
+    /**
+     * Parse a single slot, on the calling thread.
+     */
+    static void parse( THeaderSlot &slot );
+
+protected:
+
+    /**
+     * Protected functions to allow our singleton implementation.
+     */
+    CHeaderPool();
+    CHeaderPool(const CHeaderPool &);
+    CHeaderPool & operator=(const CHeaderPool &);
+
+private:
+
+    /**
+     * The main-loop of each thread.
+     */
+    void worker( int id );
+
+    /**
+     * The single instance of this class.
+     */
+    static CHeaderPool *pinstance;
+
+    /**
+     * The queue, and the lock/condition protecting it.
+     */
+    std::mutex m_lock;
+    std::condition_variable m_work;
+    std::condition_variable m_idle;
+    std::deque<std::shared_ptr<THeaderSlot> > m_queue;
+
+    /**
+     * The number of slots being parsed right now.
+     */
+    int m_active;
+
+    /**
+     * The threads we want, and the threads we've started.
+     */
+    std::atomic<int> m_target;
+    int m_started;
+
+    /**
+     * Progress counters.
+     */
+    std::atomic<long> m_done;
+    std::atomic<long> m_total;
+
+};
+
+#endif /* _headerpool_h_ */
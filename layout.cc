@@ -0,0 +1,331 @@
+/**
+ * layout.cc - Fitting UTF-8 text into a number of terminal columns.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <algorithm>
+
+#include "layout.h"
+
+
+/**
+ * A range of code points, inclusive.
+ */
+struct TRange
+{
+    uint32_t first;
+    uint32_t last;
+};
+
+
+/**
+ * Characters which take no columns: combining marks, and invisible
+ * formatting characters.  Sorted.
+ */
+static const TRange zero_width[] =
+{
+    { 0x0300, 0x036F }, { 0x0483, 0x0489 }, { 0x0591, 0x05BD }, { 0x05BF, 0x05BF },
+    { 0x05C1, 0x05C2 }, { 0x05C4, 0x05C5 }, { 0x05C7, 0x05C7 }, { 0x0600, 0x0605 },
+    { 0x0610, 0x061A }, { 0x064B, 0x065F }, { 0x0670, 0x0670 }, { 0x06D6, 0x06DD },
+    { 0x06DF, 0x06E4 }, { 0x06E7, 0x06E8 }, { 0x06EA, 0x06ED }, { 0x070F, 0x070F },
+    { 0x0711, 0x0711 }, { 0x0730, 0x074A }, { 0x07A6, 0x07B0 }, { 0x07EB, 0x07F3 },
+    { 0x0901, 0x0902 }, { 0x093C, 0x093C }, { 0x0941, 0x0948 }, { 0x094D, 0x094D },
+    { 0x0951, 0x0954 }, { 0x0962, 0x0963 }, { 0x0981, 0x0981 }, { 0x09BC, 0x09BC },
+    { 0x09C1, 0x09C4 }, { 0x09CD, 0x09CD }, { 0x09E2, 0x09E3 }, { 0x0A01, 0x0A02 },
+    { 0x0A3C, 0x0A3C }, { 0x0A41, 0x0A42 }, { 0x0A47, 0x0A48 }, { 0x0A4B, 0x0A4D },
+    { 0x0A70, 0x0A71 }, { 0x0A81, 0x0A82 }, { 0x0ABC, 0x0ABC }, { 0x0AC1, 0x0AC5 },
+    { 0x0AC7, 0x0AC8 }, { 0x0ACD, 0x0ACD }, { 0x0B01, 0x0B01 }, { 0x0B3C, 0x0B3C },
+    { 0x0B3F, 0x0B3F }, { 0x0B41, 0x0B43 }, { 0x0B4D, 0x0B4D }, { 0x0B56, 0x0B56 },
+    { 0x0B82, 0x0B82 }, { 0x0BC0, 0x0BC0 }, { 0x0BCD, 0x0BCD }, { 0x0C3E, 0x0C40 },
+    { 0x0C46, 0x0C48 }, { 0x0C4A, 0x0C4D }, { 0x0C55, 0x0C56 }, { 0x0CBC, 0x0CBC },
+    { 0x0CBF, 0x0CBF }, { 0x0CC6, 0x0CC6 }, { 0x0CCC, 0x0CCD }, { 0x0D41, 0x0D43 },
+    { 0x0D4D, 0x0D4D }, { 0x0DCA, 0x0DCA }, { 0x0DD2, 0x0DD4 }, { 0x0DD6, 0x0DD6 },
+    { 0x0E31, 0x0E31 }, { 0x0E34, 0x0E3A }, { 0x0E47, 0x0E4E }, { 0x0EB1, 0x0EB1 },
+    { 0x0EB4, 0x0EB9 }, { 0x0EBB, 0x0EBC }, { 0x0EC8, 0x0ECD }, { 0x0F18, 0x0F19 },
+    { 0x0F35, 0x0F35 }, { 0x0F37, 0x0F37 }, { 0x0F39, 0x0F39 }, { 0x0F71, 0x0F7E },
+    { 0x0F80, 0x0F84 }, { 0x0F86, 0x0F87 }, { 0x0F90, 0x0FBC }, { 0x0FC6, 0x0FC6 },
+    { 0x102D, 0x1030 }, { 0x1032, 0x1032 }, { 0x1036, 0x1037 }, { 0x1039, 0x1039 },
+    { 0x1058, 0x1059 }, { 0x1160, 0x11FF }, { 0x135F, 0x135F }, { 0x1712, 0x1714 },
+    { 0x1732, 0x1734 }, { 0x1752, 0x1753 }, { 0x1772, 0x1773 }, { 0x17B4, 0x17B5 },
+    { 0x17B7, 0x17BD }, { 0x17C6, 0x17C6 }, { 0x17C9, 0x17D3 }, { 0x17DD, 0x17DD },
+    { 0x180B, 0x180D }, { 0x18A9, 0x18A9 }, { 0x1920, 0x1922 }, { 0x1927, 0x1928 },
+    { 0x1932, 0x1932 }, { 0x1939, 0x193B }, { 0x1A17, 0x1A18 }, { 0x1AB0, 0x1AFF },
+    { 0x1B00, 0x1B03 }, { 0x1B34, 0x1B34 }, { 0x1B36, 0x1B3A }, { 0x1B3C, 0x1B3C },
+    { 0x1B42, 0x1B42 }, { 0x1B6B, 0x1B73 }, { 0x1DC0, 0x1DFF }, { 0x200B, 0x200F },
+    { 0x202A, 0x202E }, { 0x2060, 0x2064 }, { 0x206A, 0x206F }, { 0x20D0, 0x20FF },
+    { 0x302A, 0x302F }, { 0x3099, 0x309A }, { 0xA806, 0xA806 }, { 0xA80B, 0xA80B },
+    { 0xA825, 0xA826 }, { 0xFB1E, 0xFB1E }, { 0xFE00, 0xFE0F }, { 0xFE20, 0xFE2F },
+    { 0xFEFF, 0xFEFF }, { 0xFFF9, 0xFFFB }, { 0x10A01, 0x10A03 }, { 0x10A05, 0x10A06 },
+    { 0x10A0C, 0x10A0F }, { 0x10A38, 0x10A3A }, { 0x10A3F, 0x10A3F }, { 0x1D167, 0x1D169 },
+    { 0x1D173, 0x1D182 }, { 0x1D185, 0x1D18B }, { 0x1D1AA, 0x1D1AD }, { 0x1D242, 0x1D244 },
+    { 0xE0001, 0xE0001 }, { 0xE0020, 0xE007F }, { 0xE0100, 0xE01EF }
+};
+
+
+/**
+ * Characters which take two columns: East Asian wide and fullwidth
+ * forms, and emoji.  Sorted.
+ */
+static const TRange double_width[] =
+{
+    { 0x1100, 0x115F }, { 0x231A, 0x231B }, { 0x2329, 0x232A }, { 0x23E9, 0x23EC },
+    { 0x23F0, 0x23F0 }, { 0x23F3, 0x23F3 }, { 0x25FD, 0x25FE }, { 0x2614, 0x2615 },
+    { 0x2648, 0x2653 }, { 0x267F, 0x267F }, { 0x2693, 0x2693 }, { 0x26A1, 0x26A1 },
+    { 0x26AA, 0x26AB }, { 0x26BD, 0x26BE }, { 0x26C4, 0x26C5 }, { 0x26CE, 0x26CE },
+    { 0x26D4, 0x26D4 }, { 0x26EA, 0x26EA }, { 0x26F2, 0x26F3 }, { 0x26F5, 0x26F5 },
+    { 0x26FA, 0x26FA }, { 0x26FD, 0x26FD }, { 0x2705, 0x2705 }, { 0x270A, 0x270B },
+    { 0x2728, 0x2728 }, { 0x274C, 0x274C }, { 0x274E, 0x274E }, { 0x2753, 0x2755 },
+    { 0x2757, 0x2757 }, { 0x2795, 0x2797 }, { 0x27B0, 0x27B0 }, { 0x27BF, 0x27BF },
+    { 0x2B1B, 0x2B1C }, { 0x2B50, 0x2B50 }, { 0x2B55, 0x2B55 }, { 0x2E80, 0x303E },
+    { 0x3041, 0x33FF }, { 0x3400, 0x4DBF }, { 0x4E00, 0x9FFF }, { 0xA000, 0xA4CF },
+    { 0xA960, 0xA97F }, { 0xAC00, 0xD7A3 }, { 0xF900, 0xFAFF }, { 0xFE10, 0xFE19 },
+    { 0xFE30, 0xFE6F }, { 0xFF00, 0xFF60 }, { 0xFFE0, 0xFFE6 }, { 0x16FE0, 0x16FE4 },
+    { 0x17000, 0x18AFF }, { 0x1B000, 0x1B2FF }, { 0x1F004, 0x1F004 }, { 0x1F0CF, 0x1F0CF },
+    { 0x1F18E, 0x1F18E }, { 0x1F191, 0x1F19A }, { 0x1F200, 0x1F202 }, { 0x1F210, 0x1F23B },
+    { 0x1F240, 0x1F248 }, { 0x1F250, 0x1F251 }, { 0x1F260, 0x1F265 }, { 0x1F300, 0x1F320 },
+    { 0x1F32D, 0x1F335 }, { 0x1F337, 0x1F37C }, { 0x1F37E, 0x1F393 }, { 0x1F3A0, 0x1F3CA },
+    { 0x1F3CF, 0x1F3D3 }, { 0x1F3E0, 0x1F3F0 }, { 0x1F3F4, 0x1F3F4 }, { 0x1F3F8, 0x1F43E },
+    { 0x1F440, 0x1F440 }, { 0x1F442, 0x1F4FC }, { 0x1F4FF, 0x1F53D }, { 0x1F54B, 0x1F54E },
+    { 0x1F550, 0x1F567 }, { 0x1F57A, 0x1F57A }, { 0x1F595, 0x1F596 }, { 0x1F5A4, 0x1F5A4 },
+    { 0x1F5FB, 0x1F64F }, { 0x1F680, 0x1F6C5 }, { 0x1F6CC, 0x1F6CC }, { 0x1F6D0, 0x1F6D2 },
+    { 0x1F6D5, 0x1F6D7 }, { 0x1F6EB, 0x1F6EC }, { 0x1F6F4, 0x1F6FC }, { 0x1F7E0, 0x1F7EB },
+    { 0x1F90C, 0x1F93A }, { 0x1F93C, 0x1F945 }, { 0x1F947, 0x1F9FF }, { 0x1FA70, 0x1FAFF },
+    { 0x20000, 0x2FFFD }, { 0x30000, 0x3FFFD }
+};
+
+
+/**
+ * Is the given code point in the given table?
+ */
+template <size_t N>
+static bool in_table( uint32_t c, const TRange (&table)[N] )
+{
+    if ( c < table[0].first || c > table[N - 1].last )
+        return false;
+
+    size_t lo = 0;
+    size_t hi = N;
+    while( lo < hi )
+    {
+        size_t mid = ( lo + hi ) / 2;
+        if ( c > table[mid].last )
+            lo = mid + 1;
+        else if ( c < table[mid].first )
+            hi = mid;
+        else
+            return true;
+    }
+    return false;
+}
+
+
+/**
+ * The number of columns the given code point takes.
+ */
+int CLayout::width( uint32_t c )
+{
+    if ( c < 0x300 )
+        return 1;
+    if ( in_table( c, zero_width ) )
+        return 0;
+    if ( in_table( c, double_width ) )
+        return 2;
+    return 1;
+}
+
+
+/**
+ * Decode a single UTF-8 character, refusing overlong forms, surrogates,
+ * and anything past U+10FFFF.
+ */
+uint32_t CLayout::decode( const unsigned char *text, size_t avail, size_t *len )
+{
+    *len = 1;
+
+    uint32_t c;
+    uint32_t min;
+    size_t n;
+
+    if ( text[0] < 0x80 )
+        return text[0];
+    else if ( text[0] >= 0xC2 && text[0] <= 0xDF )
+    {
+        n   = 2;
+        c   = text[0] & 0x1F;
+        min = 0x80;
+    }
+    else if ( ( text[0] & 0xF0 ) == 0xE0 )
+    {
+        n   = 3;
+        c   = text[0] & 0x0F;
+        min = 0x800;
+    }
+    else if ( text[0] >= 0xF0 && text[0] <= 0xF4 )
+    {
+        n   = 4;
+        c   = text[0] & 0x07;
+        min = 0x10000;
+    }
+    else
+        return LAYOUT_INVALID;
+
+    if ( avail < n )
+        return LAYOUT_INVALID;
+
+    for( size_t i = 1; i < n; i++ )
+    {
+        if ( ( text[i] & 0xC0 ) != 0x80 )
+            return LAYOUT_INVALID;
+        c = ( c << 6 ) | ( text[i] & 0x3F );
+    }
+
+    if ( c < min || c > 0x10FFFF || ( c >= 0xD800 && c <= 0xDFFF ) )
+        return LAYOUT_INVALID;
+
+    *len = n;
+    return c;
+}
+
+
+/**
+ * The number of columns the given text takes.
+ */
+size_t CLayout::width( const std::string &text )
+{
+    size_t used = 0;
+    prefix( text.data(), text.size(), (size_t)-1, &used );
+    return( used );
+}
+
+
+/**
+ * The number of bytes at the start of the text which fit.
+ */
+size_t CLayout::prefix( const char *text, size_t len, size_t columns, size_t *used )
+{
+    const unsigned char *p = (const unsigned char *)text;
+
+    size_t i    = 0;
+    size_t cols = 0;
+
+    while( i < len )
+    {
+        if ( p[i] < 0x80 )
+        {
+            if ( cols >= columns )
+                break;
+            i++;
+            cols++;
+            continue;
+        }
+
+        size_t n;
+        uint32_t c = decode( p + i, len - i, &n );
+        size_t w = ( c == LAYOUT_INVALID ) ? 1 : width( c );
+        if ( cols + w > columns )
+            break;
+
+        i    += n;
+        cols += w;
+    }
+
+    if ( used != NULL )
+        *used = cols;
+    return( i );
+}
+
+
+/**
+ * Append the text, fitted to the given number of columns.
+ *
+ * This is a single pass over the text, which stops once the columns are
+ * filled, and appends to out at most twice per run of ASCII.
+ */
+size_t CLayout::fit( const std::string &text, size_t columns, std::string &out, bool pad )
+{
+    const unsigned char *p = (const unsigned char *)text.data();
+    size_t len = text.size();
+
+    out.reserve( out.size() + std::min( len, columns * 4 ) + columns );
+
+    size_t i    = 0;
+    size_t cols = 0;
+
+    while( i < len )
+    {
+        /**
+         * Copy a run of printable ASCII as it is.
+         */
+        if ( p[i] >= 0x20 && p[i] < 0x7F )
+        {
+            size_t end = i + std::min( len - i, columns - cols );
+            size_t j   = i;
+            while( j < end && p[j] >= 0x20 && p[j] < 0x7F )
+                j++;
+
+            if ( j == i )
+                break;
+
+            out.append( text, i, j - i );
+            cols += j - i;
+            i = j;
+            continue;
+        }
+
+        size_t n;
+        uint32_t c = decode( p + i, len - i, &n );
+
+        /**
+         * Tabs stop every eight columns.
+         */
+        if ( c == '\t' )
+        {
+            size_t stop = std::min( columns, ( cols / 8 + 1 ) * 8 );
+            if ( cols >= stop )
+                break;
+            out.append( stop - cols, ' ' );
+            cols = stop;
+            i += n;
+            continue;
+        }
+
+        /**
+         * Other controls are drawn as spaces, and invalid bytes as '?'.
+         */
+        if ( c < 0x20 || ( c >= 0x7F && c < 0xA0 ) || c == LAYOUT_INVALID )
+        {
+            if ( cols >= columns )
+                break;
+            out += ( c == LAYOUT_INVALID ) ? '?' : ' ';
+            cols++;
+            i += n;
+            continue;
+        }
+
+        size_t w = width( c );
+        if ( cols + w > columns )
+            break;
+
+        out.append( text, i, n );
+        cols += w;
+        i += n;
+    }
+
+    if ( pad && cols < columns )
+        out.append( columns - cols, ' ' );
+
+    return( cols );
+}
@@ -0,0 +1,91 @@
+/**
+ * layout.h - Fitting UTF-8 text into a number of terminal columns.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _layout_h_
+#define _layout_h_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+
+/**
+ * The code point we decode invalid UTF-8 as.
+ */
+#define LAYOUT_INVALID ( (uint32_t) -1 )
+
+
+/**
+ * Display widths of UTF-8 text, and laying it out in a fixed number of
+ * columns.
+ *
+ * Most characters take one column, but East Asian wide characters take
+ * two, and combining marks none, so neither the number of bytes nor the
+ * number of characters says how much of a row some text will fill.  The
+ * widths come from our own tables, in the manner of wcwidth(), so they
+ * don't depend upon the locale.
+ *
+ * Runs of printable ASCII, the common case, are copied without being
+ * decoded.
+ */
+class CLayout
+{
+
+public:
+
+    /**
+     * The number of columns the given text takes.
+     */
+    static size_t width( const std::string &text );
+
+    /**
+     * The number of bytes at the start of the given text which fit in the
+     * given number of columns, without splitting a character.  The number
+     * of columns they take is stored in used, if that is not NULL.
+     */
+    static size_t prefix( const char *text, size_t len, size_t columns, size_t *used );
+
+    /**
+     * Append the given text to out, cut short to fit in the given number
+     * of columns and, if pad is set, padded with spaces to fill them.
+     *
+     * Tabs are expanded to the next multiple of eight columns, other
+     * control characters are replaced by spaces, and invalid UTF-8 by
+     * '?', so that every byte appended takes the column it is counted in.
+     * Returns the number of columns filled, before any padding.
+     */
+    static size_t fit( const std::string &text, size_t columns, std::string &out, bool pad = true );
+
+    /**
+     * The number of columns the given code point takes: 0, 1, or 2.
+     * Control characters count one, as fit() draws most as a space.
+     */
+    static int width( uint32_t c );
+
+private:
+
+    /**
+     * Decode the UTF-8 character at the start of the given text, storing
+     * the number of bytes it takes in len.  Returns LAYOUT_INVALID if it
+     * isn't valid, with len set to one.
+     */
+    static uint32_t decode( const unsigned char *text, size_t avail, size_t *len );
+
+};
+
+#endif /* _layout_h_ */
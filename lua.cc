@@ -83,6 +83,18 @@ CLua::CLua()
     lua_register(m_lua, "refresh_display", refresh_display);
     lua_register(m_lua, "sleep", sleep);
 
+    /**
+     * Timers.
+     */
+    lua_register(m_lua, "after", after);
+    lua_register(m_lua, "cancel_timer", cancel_timer);
+    lua_register(m_lua, "every", every);
+
+    /**
+     * Background commands.
+     */
+    lua_register(m_lua, "spawn", spawn);
+
     /**
      * Get/Set various strings.
      */
@@ -91,12 +103,18 @@ CLua::CLua()
     lua_register(m_lua, "global_mode", global_mode);
     lua_register(m_lua, "index_format", index_format);
     lua_register(m_lua, "index_limit", index_limit);
+    lua_register(m_lua, "index_view", index_view);
     lua_register(m_lua, "maildir_format", maildir_format);
     lua_register(m_lua, "maildir_limit", maildir_limit);
     lua_register(m_lua, "maildir_prefix", maildir_prefix);
     lua_register(m_lua, "message_filter", message_filter);
+    lua_register(m_lua, "mime_cache_limit", mime_cache_limit);
+    lua_register(m_lua, "mime_cache_stats", mime_cache_stats);
+    lua_register(m_lua, "parse_threads", parse_threads);
+    lua_register(m_lua, "scan_threads", scan_threads);
     lua_register(m_lua, "sendmail_path", sendmail_path );
     lua_register(m_lua, "sent_mail", sent_mail );
+    lua_register(m_lua, "sort_order", sort_order );
 
 
     /**
@@ -141,6 +159,7 @@ CLua::CLua()
     lua_register(m_lua, "header", header);
     lua_register(m_lua, "is_new", is_new);
     lua_register(m_lua, "mark_new", mark_new);
+    lua_register(m_lua, "parse_progress", parse_progress);
     lua_register(m_lua, "mark_read", mark_read);
 
     /**
@@ -149,6 +168,18 @@ CLua::CLua()
     lua_register(m_lua, "save", save_message);
     lua_register(m_lua, "save_message", save_message);
 
+    /**
+     * Full-text search.
+     */
+    lua_register(m_lua, "search", search);
+    lua_register(m_lua, "search_index", search_index);
+    lua_register(m_lua, "search_stats", search_stats);
+
+    /**
+     * Virtual folders.
+     */
+    lua_register(m_lua, "virtual_folder", virtual_folder);
+
     /**
      * Folder selection.
      */
@@ -244,6 +275,141 @@ bool CLua::call_function(std::string name)
 }
 
 
+/**
+ * Call a single Lua function, with a string.
+ */
+bool CLua::call_function( std::string name, const std::string &arg )
+{
+    if ( ! push_function( name ) )
+        return false;
+
+    lua_pushlstring( m_lua, arg.data(), arg.size() );
+    call_pushed( 1 );
+    return true;
+}
+
+
+/**
+ * Call a single Lua function, with a string and a number.
+ */
+bool CLua::call_function( std::string name, const std::string &arg, int number )
+{
+    if ( ! push_function( name ) )
+        return false;
+
+    lua_pushlstring( m_lua, arg.data(), arg.size() );
+    lua_pushinteger( m_lua, number );
+    call_pushed( 2 );
+    return true;
+}
+
+
+/**
+ * Push a global function.
+ */
+bool CLua::push_function( const std::string &name )
+{
+    lua_getglobal( m_lua, name.c_str() );
+    if ( ! lua_isfunction( m_lua, -1 ) )
+    {
+        lua_pop( m_lua, 1 );
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Keep a reference to a function.
+ */
+int CLua::ref_function( int index )
+{
+    if ( ! lua_isfunction( m_lua, index ) )
+        return LUA_NOREF;
+
+    lua_pushvalue( m_lua, index );
+    return( luaL_ref( m_lua, LUA_REGISTRYINDEX ) );
+}
+
+
+/**
+ * Push a function we hold a reference to.
+ */
+bool CLua::push_ref( int ref )
+{
+    lua_rawgeti( m_lua, LUA_REGISTRYINDEX, ref );
+    if ( ! lua_isfunction( m_lua, -1 ) )
+    {
+        lua_pop( m_lua, 1 );
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Call the function we've pushed, and its arguments.
+ */
+void CLua::call_pushed( int nargs )
+{
+    /**
+     * Errors are discarded, so that they don't pile up on the stack.
+     */
+    if ( lua_pcall( m_lua, nargs, 0, 0 ) != 0 )
+        lua_pop( m_lua, 1 );
+}
+
+
+/**
+ * Call a function we hold a reference to.
+ */
+bool CLua::call_ref( int ref )
+{
+    if ( ! push_ref( ref ) )
+        return false;
+
+    call_pushed( 0 );
+    return true;
+}
+
+
+/**
+ * Call a function we hold a reference to, with a string.
+ */
+bool CLua::call_ref( int ref, const std::string &arg )
+{
+    if ( ! push_ref( ref ) )
+        return false;
+
+    lua_pushlstring( m_lua, arg.data(), arg.size() );
+    call_pushed( 1 );
+    return true;
+}
+
+
+/**
+ * Call a function we hold a reference to, with a number.
+ */
+bool CLua::call_ref( int ref, int arg )
+{
+    if ( ! push_ref( ref ) )
+        return false;
+
+    lua_pushinteger( m_lua, arg );
+    call_pushed( 1 );
+    return true;
+}
+
+
+/**
+ * Release a reference.
+ */
+void CLua::unref( int ref )
+{
+    luaL_unref( m_lua, LUA_REGISTRYINDEX, ref );
+}
+
+
 /**
  * get the value from a nested table.
  */
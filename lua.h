@@ -27,6 +27,7 @@ extern "C" {
 # include <lualib.h>
 }
 
+#include <string>
 #include <vector>
 
 
@@ -57,6 +58,37 @@ public:
      */
     bool call_function(std::string name);
 
+    /**
+     * Call a single Lua function, passing the given arguments as values,
+     * rather than pasting them into code, and ignoring the return code.
+     */
+    bool call_function( std::string name, const std::string &arg );
+    bool call_function( std::string name, const std::string &arg, int number );
+
+    /**
+     * Keep a reference to the function at the given index of the stack,
+     * so that it may be called later.  Returns LUA_NOREF if it isn't a
+     * function.
+     */
+    int ref_function( int index );
+
+    /**
+     * Call a function we hold a reference to, passing no arguments and
+     * ignoring the return code.
+     */
+    bool call_ref( int ref );
+
+    /**
+     * Call a function we hold a reference to, passing a single argument.
+     */
+    bool call_ref( int ref, const std::string &arg );
+    bool call_ref( int ref, int arg );
+
+    /**
+     * Release a reference to a function.
+     */
+    void unref( int ref );
+
     /**
      * Lookup a value in a nested table.
      */
@@ -98,6 +130,23 @@ public:
      */
     static CLua *pinstance;
 
+    /**
+     * Push a function we hold a reference to.  Returns false, leaving
+     * the stack alone, if there is no such function.
+     */
+    bool push_ref( int ref );
+
+    /**
+     * Push the named global function.  Returns false, leaving the stack
+     * alone, if there is no such function.
+     */
+    bool push_function( const std::string &name );
+
+    /**
+     * Call the pushed function with the given number of arguments.
+     */
+    void call_pushed( int nargs );
+
     /**
      * The handle to the lua intepreter.
      */
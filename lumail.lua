@@ -44,6 +44,55 @@ else
 end
 
 
+--
+-- The maildir prefix is scanned by a small pool of threads, which helps
+-- considerably when it lives upon network storage.  The default is four.
+--
+-- scan_threads( 8 );
+
+
+--
+-- Message headers are parsed by a second pool of threads, so that the
+-- index can be shown straight away and fill in as they are read.  Set
+-- this to zero to parse headers only as they're displayed.  The default
+-- is two.
+--
+-- parse_threads( 4 );
+
+
+--
+-- The bodies of recently viewed messages are kept in memory, up to the
+-- given number of bytes, after which the least-recently viewed are
+-- discarded.  The default is 32Mb.
+--
+-- mime_cache_limit( 64 * 1024 * 1024 );
+
+
+--
+-- Messages in the folders you open are added to a full-text index, in
+-- the background, and stored beneath ~/.lumail/cache.  To index every
+-- maildir, rather than only those you've opened, call:
+--
+-- search_index();
+--
+-- search( "words" ) returns the paths of the messages containing all of
+-- the given words, and index_limit( "search:words" ) shows only those.
+--
+
+
+--
+-- Virtual folders hold every message, from any maildir, which matches a
+-- query, using the same syntax as index_limit, without the "query:".  They are listed before
+-- the maildirs, as "virtual:name", and may be selected like any other.
+-- Defining the first one indexes every maildir, as search_index() does.
+--
+-- virtual_folder( "unread", "flag:N" );
+-- virtual_folder( "big", "size:>1M and after:2013-01-01" );
+--
+-- An empty query removes a folder.
+--
+
+
 --
 -- There is only one folder which is special, and that is the one where
 -- lumail will record copies of outgoing mail(s).
@@ -103,9 +152,52 @@ maildir_limit( "all" );
 --        new  -> Show all unread messages.
 --       "str" -> Show all messages which match the substring "str".
 --
+-- A limit beginning "query:" is a query, made of terms such as:
+--
+--        from:steve  to:lumail  subject:"build failed"
+--        flag:F  flag:N  after:2013-06-01  before:2013-07-01
+--        size:>1M  size:<10K
+--
+-- which may be combined with "and", "or", "not", and parentheses:
+--
+--   index_limit( 'query:from:steve and ( flag:N or size:>1M )' );
+--
+-- Flags ignore case, and "after:" and "before:" both exclude the day
+-- given.  Without the prefix, "subject:lumail" is a plain substring.
+--
 index_limit( "all" );
 
 
+--
+-- Messages are sorted by the modification time of their files, oldest first.
+-- The time of arrival is the same for delivered mail, and faster, as it
+-- avoids a stat() of every message when a folder is opened.
+--
+-- Valid options are:
+--
+--        arrival -> The delivery time, from the filename.  This is the
+--                   fastest, as it needs nothing but the directory listing.
+--        mtime   -> The modification time of the file.
+--        date    -> The Date: header.
+--        from    -> The sender.
+--        subject -> The subject, ignoring any "Re:" prefix.
+--        size    -> The size of the message.
+--
+sort_order( "mtime" );
+
+
+--
+-- The index may be threaded, so that replies are drawn beneath the
+-- message they answer, using the Message-ID, References, and In-Reply-To
+-- headers.  Threads are ordered by their first message, in the order
+-- set above.
+--
+--        flat     -> One message per line, in sort order.
+--        threaded -> Conversations, with a tree drawn before each reply.
+--
+index_view( "flat" );
+
+
 --
 -- The index format controls how messages are displayed inside folder lists.
 --
@@ -118,6 +210,9 @@ index_limit( "all" );
 --   $SUBJECT
 --   $TO
 --
+-- Fields may also be written as ${FROM}, and given a width which they
+-- will be padded, or truncated, to: ${FROM:20} aligns to the left, and
+-- ${FROM:>20} to the right.  Use $$ for a literal dollar sign.
 --
 index_format( "[$FLAGS] $DAY/$MONTH/$YEAR $FROM - $SUBJECT" );
 
@@ -152,9 +247,10 @@ headers = { "$TO", "$FROM", "$DATE", "$SUBJECT" }
 --
 -- This function is called when the client is launched.
 --
--- You might consider something useful like this:
+-- You might consider something useful like this, which syncs your mail
+-- in the background:
 --
---    os.execute( "imapsync ..." );
+--    spawn( "imapsync ...", function( code ) msg( "Synced" ) end )
 --
 function on_start()
    msg("lumail v" .. VERSION .. " http://lumail.org/" );
@@ -204,7 +300,8 @@ end
 
 
 --
--- This function is called when a message is displayed.
+-- This function is called when a message is displayed, once each time
+-- it is opened rather than every time the screen is redrawn.
 --
 -- The argument is the path to the message on-disk.
 --
@@ -221,6 +318,16 @@ function on_read_message( path )
 end
 
 
+--
+-- This function is called when new mail arrives in a folder.
+--
+-- The arguments are the path to the maildir and the number of new messages.
+--
+function on_new_mail( folder, count )
+   msg( count .. " new message(s) in " .. folder );
+end
+
+
 --
 -- Show the version of this client.
 --
@@ -241,16 +348,17 @@ end
 
 
 --
--- This function is called when the client is idle, roughly once a second.
+-- This function is called once a second, whatever else the client is doing.
 --
 -- Every second we update the status-area to show a message.
 --
--- Once every five minutes we shell out to call imapsync.
+-- Once every five minutes we call imapsync, in the background, and show
+-- what it is doing until it has finished.
 --
 do
 
-   -- Last sync time, in seconds-past-epoch.
-   local ls = os.time()
+   -- The last line imapsync wrote, or nil if it isn't running.
+   local syncing = nil
 
    function on_idle()
       m = global_mode()
@@ -265,26 +373,82 @@ do
          str = "mode:" .. m ;
       end
 
+      -- Show how many headers remain to be parsed.
+      local done, total = parse_progress()
+      if ( done < total ) then
+         str = str .. " parsed:" .. done .. "/" .. total
+      end
+
+      -- And how many messages remain to be indexed.
+      local documents, words, pending = search_stats()
+      if ( pending > 0 ) then
+         str = str .. " indexing:" .. pending
+      end
+
+      -- And whether we're syncing.
+      if ( syncing ) then
+         str = str .. " syncing:" .. syncing
+      end
+
       -- Show the message & the time.
       msg( str .. " time:" .. os.date("%X" ) );
+   end
 
-      --
-      -- If the time between the last sync is more than
-      -- five minutes resync mail.
-      --
-      ct = os.time()
-      if ( ( ct - ls ) >=  ( 60 * 5 ) ) then
-         ls = ct
-         if ( executable( "/usr/bin/imapsync" ) ) then
-            os.execute( "imapsync" );
-         else
-            msg("/usr/bin/imapsync not installed" )
-         end
+   --
+   -- Resync mail every five minutes, unless the last sync is still
+   -- running.  The folders it changes are picked up as it finishes.
+   --
+   every( 60 * 5, function()
+      if ( syncing ) then
+         return
       end
-   end
+      if ( not executable( "/usr/bin/imapsync" ) ) then
+         msg("/usr/bin/imapsync not installed" )
+         return
+      end
+
+      syncing = "started"
+      local pid = spawn( "imapsync",
+                         function( code )
+                            syncing = nil
+                            if ( code ~= 0 ) then
+                               msg( "imapsync failed: " .. code )
+                            end
+                         end,
+                         function( line )
+                            syncing = line
+                         end )
+      if ( not pid ) then
+         syncing = nil
+         msg( "imapsync could not be started" )
+      end
+   end )
 end
 
 
+--
+-- Functions may also be called later, once or repeatedly, without
+-- waiting for the idle hook:
+--
+--    after( 2, function() msg( "Two seconds have passed" ) end )
+--
+--    local t = every( 60, function() msg( os.date() ) end )
+--
+-- Both return an id, which may be passed to cancel_timer() to stop
+-- the timer before it next fires.
+--
+-- Commands which take a while are best run in the background, rather
+-- than with exec() or os.execute(), which leave the client waiting:
+--
+--    spawn( "fetchmail", on_exit, on_output )
+--
+-- on_exit is called with the exit status once the command has finished,
+-- and on_output, if given, with each line it writes.  Either may be nil.
+-- The command reads nothing, and what it writes never reaches the screen.
+-- spawn() returns the process ID, or nil if the command couldn't be run.
+--
+
+
 --
 -- Switch to the index-view mode.
 --
@@ -19,12 +19,13 @@
 #include <vector>
 #include <algorithm>
 #include <sys/types.h>
-#include <dirent.h>
 
+#include "directory.h"
 #include "file.h"
 #include "global.h"
 #include "maildir.h"
 #include "message.h"
+#include "virtualfolders.h"
 
 /**
  * Constructor.  NOP
@@ -43,9 +44,14 @@ CMaildir::~CMaildir()
 
 /**
  * The number of new messages for this directory.
+ *
+ * A virtual folder already knows its counts.
  */
 int CMaildir::newMessages()
 {
+  if (CVirtualFolders::is_virtual(m_path))
+    return (CVirtualFolders::Instance()->unread(CVirtualFolders::name_of(m_path)));
+
   return (CMaildir::countFiles(m_path + "/new"));
 }
 
@@ -54,6 +60,12 @@ int CMaildir::newMessages()
  */
 int CMaildir::availableMessages()
 {
+  if (CVirtualFolders::is_virtual(m_path)) {
+    CVirtualFolders *folders = CVirtualFolders::Instance();
+    std::string name = CVirtualFolders::name_of(m_path);
+    return (folders->count(name) - folders->unread(name));
+  }
+
   return (CMaildir::countFiles(m_path + "/cur"));
 }
 
@@ -62,6 +74,9 @@ int CMaildir::availableMessages()
  */
 std::string CMaildir::name()
 {
+  if (CVirtualFolders::is_virtual(m_path))
+    return (CVirtualFolders::name_of(m_path));
+
   unsigned found = m_path.find_last_of("/");
   return (m_path.substr(found + 1));
 }
@@ -100,117 +115,86 @@ bool CMaildir::matches_filter( std::string *filter )
 
 /**
  * Count files in a directory.
+ *
+ * This is called for every visible folder on every refresh, so we avoid
+ * stat()ing each entry and rely upon the kernel-supplied d_type instead.
  */
 int CMaildir::countFiles(std::string path)
 {
-  int count = 0;
-  dirent *de;
-  DIR *dp;
-
-  dp = opendir(path.c_str());
-  if (dp) {
-    while (true) {
-      de = readdir(dp);
-      if (de == NULL)
-        break;
-
-      if (!CFile::is_directory(std::string(path + "/" + de->d_name)))
-        count += 1;
-    }
-    closedir(dp);
-  }
-  return count;
+  return (CDirectory::count_files(path));
 }
 
 /**
- * Return a sorted list of maildirs beneath the given path.
+ * Get the path of each message in the folder.
+ *
+ * The cur/ and new/ directories are read via getdents64, and the d_type
+ * each entry carries, so we don't stat() every message.
  */
-std::vector < std::string > CMaildir::getFolders(std::string path)
+std::vector<std::string> CMaildir::getMessagePaths()
 {
-  std::vector < std::string > result;
-  dirent *de;
-  DIR *dp;
-
-  std::string prefix = path.empty()? "." : path.c_str();
-  dp = opendir(prefix.c_str());
-  if (dp) {
-    while (true) {
-      de = readdir(dp);
-      if (de == NULL)
-        break;
-
-      std::string subdir_name = std::string(de->d_name);
-      std::string subdir_path = std::string(prefix + "/" + subdir_name);
-      if (CMaildir::is_maildir(subdir_path))
-        result.push_back(subdir_path);
-      else {
-        if (subdir_name != "." && subdir_name != "..") {
-          DIR* sdp = opendir(subdir_path.c_str());
-          if (sdp) {
-            closedir(sdp);
-            std::vector < std::string > sub_maildirs;
-            sub_maildirs = CMaildir::getFolders(subdir_path);
-            std::vector < std::string >::iterator it;
-            for (it = sub_maildirs.begin(); it != sub_maildirs.end(); ++it) {
-              result.push_back(*it);
-            }
-          }
-        }
-      }
-    }
-    closedir(dp);
-    std::sort(result.begin(), result.end());
-  }
+  CArena arena;
+  std::vector<TStringRef> paths;
+  getMessagePaths(arena, paths);
+
+  std::vector<std::string> result;
+  result.reserve(paths.size());
+
+  std::vector<TStringRef>::iterator it;
+  for (it = paths.begin(); it != paths.end(); ++it)
+    result.push_back(it->str());
+
   return result;
 }
 
 /**
- * Get each messages in the folder.
+ * Get the path of each message in the folder, into the given arena.
  *
- * These are heap-allocated and will be persistent until the folder
- * selection is changed.
- *
- * The return value is *all possible messages*, no attention to `index_limit`
- * is paid.
+ * Each path is built in place, so a scan makes no allocation per message.
  */
-std::vector<CMessage *> CMaildir::getMessages()
+void CMaildir::getMessagePaths(CArena &arena, std::vector<TStringRef> &result)
 {
-  std::vector<CMessage*> result;
-  dirent *de;
-  DIR *dp;
-
   /**
    * Directories we search.
    */
-  std::vector < std::string > dirs;
-  dirs.push_back(m_path + "/cur/");
-  dirs.push_back(m_path + "/new/");
+  const char *dirs[] = { "/cur/", "/new/" };
 
   /**
    * For each directory.
    */
-  std::vector < std::string >::iterator it;
-  for (it = dirs.begin(); it != dirs.end(); ++it) {
+  for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+
+    TStringRef path = arena.join(m_path, dirs[i]);
+    CDirectory dir(path.data);
 
-    std::string path = *it;
+    const char *name;
+    bool is_dir;
+    while (dir.next(&name, &is_dir)) {
+      if (!is_dir)
+        result.push_back(arena.join(path, name));
+    }
+  }
+}
 
-    dp = opendir(path.c_str());
-    if (dp) {
+/**
+ * Get each messages in the folder.
+ *
+ * These are heap-allocated, and owned by the caller.
+ *
+ * The return value is *all possible messages*, no attention to `index_limit`
+ * is paid.
+ */
+std::vector<CMessage *> CMaildir::getMessages()
+{
+  std::vector<CMessage*> result;
 
-      while (true) {
+  CArena arena;
+  std::vector<TStringRef> paths;
+  getMessagePaths(arena, paths);
 
-        de = readdir(dp);
-        if (de == NULL)
-          break;
+  std::vector<TStringRef>::iterator it;
+  for (it = paths.begin(); it != paths.end(); ++it)
+    result.push_back(new CMessage(it->str()));
 
-        if (!CFile::is_directory (std::string(path + de->d_name))) {
-          CMessage *t = new CMessage(std::string(path + de->d_name));
-          result.push_back(t);
-        }
-      }
-      closedir(dp);
-    }
-  }
   return result;
 }
 
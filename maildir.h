@@ -22,6 +22,8 @@
 #include <vector>
 #include <string>
 
+#include "arena.h"
+
 /**
  * Forward decleration of class.
  */
@@ -83,9 +85,15 @@ class CMaildir
   static bool is_maildir(std::string path);
 
   /**
-   * Return a sorted list of maildirs beneath the given path.
+   * Get the path of each message in the folder.
+   */
+  std::vector <std::string> getMessagePaths();
+
+  /**
+   * Get the path of each message in the folder, stored in the given
+   * arena, which must outlive the result.
    */
-  static std::vector < std::string > getFolders(std::string path);
+  void getMessagePaths(CArena &arena, std::vector<TStringRef> &result);
 
   /**
    * Get each message in the folder.
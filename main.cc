@@ -24,12 +24,19 @@
 #include <getopt.h>
 
 #include "debug.h"
+#include "eventloop.h"
 #include "file.h"
+#include "global.h"
+#include "headercache.h"
+#include "headerpool.h"
+#include "mimecache.h"
 #include "lua.h"
 #include "message.h"
 #include "maildir.h"
 #include "screen.h"
+#include "searchindex.h"
 #include "version.h"
+#include "watcher.h"
 
 /**
  * Some simple remapping of keyboard input.
@@ -194,6 +201,17 @@ int main(int argc, char *argv[])
     }
 
 
+    /**
+     * Start parsing headers in the background.
+     */
+    CHeaderPool *pool = CHeaderPool::Instance();
+    pool->set_threads( CGlobal::Instance()->get_parse_threads() );
+
+    /**
+     * Bound the memory used by parsed messages.
+     */
+    CMimeCache::Instance()->set_limit( CGlobal::Instance()->get_mime_cache_limit() );
+
     /**
      * We're starting, so call the on_start() function.
      */
@@ -236,41 +254,93 @@ int main(int argc, char *argv[])
     /**
      * Now enter our event-loop
      */
-    while (true)
+    CSearchIndex *index = CSearchIndex::Instance();
+    CEventLoop *loop    = CEventLoop::Instance();
+
+    /**
+     * Pick up any changes to the maildirs as soon as they're made.
+     */
+    loop->watch( CWatcher::Instance()->fd(), []()
     {
-	char key = getch();
-	if (key == ERR)
-        {
-	    /*
-	     * Timeout - so we go round the loop again.
-	     */
-	    lua->call_function("on_idle");
+        if ( CWatcher::Instance()->poll() )
+            CGlobal::Instance()->changed();
+    } );
 
-	}
-        else
-        {
-            /**
-             * The human-readable version of the key which has
-             * been pressed.
-             *
-             * i.e. Ctrl-r -> ^R.
-             */
-            const char *name = get_key_name( key );
+    /**
+     * The idle hook runs once a second, whatever else is going on.
+     */
+    loop->add_timer( 1, 1, [lua]()
+    {
+        lua->call_function("on_idle");
+
+        /**
+         * Save any headers we've parsed.
+         */
+        CHeaderCache::Instance()->flush();
+    } );
 
+    while (true)
+    {
+        /**
+         * Wait for a key, or for anything else to happen.  While headers
+         * are being parsed in the background, or messages wait to be
+         * indexed, wake up often to show, and do, that work.
+         */
+        bool input = loop->wait( ( pool->busy() || index->pending() ) ? 100 : -1 );
+
+        if ( input )
+        {
             /**
-             * See if we can handle it via our keyboard map, or
-             * the lua function "on_key".
+             * Handle every key we've been sent, before drawing.  Keys
+             * are read without waiting, but anything they run, such as
+             * a prompt, waits as it always has.
              */
-	    if ( (!lua->on_key( name )) && ( !lua->on_keypress(name)) )
+            while( true )
             {
+                timeout( 0 );
+                char key = getch();
+                timeout( 1000 );
+
+                if ( key == ERR )
+                    break;
+
                 /**
-                 * Both calls failed, so show a message.
+                 * The human-readable version of the key which has
+                 * been pressed.
+                 *
+                 * i.e. Ctrl-r -> ^R.
                  */
-                std::string foo = "msg(\"Unbound key: ";
-                foo += std::string(name) + "\");";
-                lua->execute(foo);
-	    }
-	}
+                const char *name = get_key_name( key );
+
+                /**
+                 * See if we can handle it via our keyboard map, or
+                 * the lua function "on_key".
+                 */
+                if ( (!lua->on_key( name )) && ( !lua->on_keypress(name)) )
+                {
+                    /**
+                     * Both calls failed, so show a message.
+                     */
+                    std::string foo = "msg(\"Unbound key: ";
+                    foo += std::string(name) + "\");";
+                    lua->execute(foo);
+                }
+            }
+        }
+        else if ( index->pending() )
+        {
+	    /*
+	     * Index a few messages, and save the index once we're done,
+	     * rather than rewriting it while it grows.
+	     */
+            if ( ! index->work( 0.05 ) )
+                index->flush();
+        }
+
+        /**
+         * Show any change to a selected virtual folder.
+         */
+        CGlobal::Instance()->update_virtual_folders();
 
 	screen.refresh_display();
     }
@@ -23,6 +23,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <mimetic/mimetic.h>
@@ -31,20 +32,60 @@
 #include <time.h>
 
 #include "file.h"
+#include "flags.h"
 #include "message.h"
+#include "format.h"
 #include "global.h"
+#include "header.h"
+#include "headercache.h"
+#include "headerpool.h"
+#include "messagetable.h"
+#include "mimecache.h"
 
 using namespace std;
 using namespace mimetic;
 
 
+/**
+ * The table holding messages which aren't part of the index, such as
+ * those opened by path from lua.
+ */
+static CMessageTable *loose_messages()
+{
+    static CMessageTable table;
+    return( &table );
+}
+
+
 /**
  * Constructor.
  */
 CMessage::CMessage(std::string filename)
 {
-    m_path = filename;
-    m_me   = NULL;
+    m_table         = loose_messages();
+    m_row           = m_table->add( filename );
+    m_owner         = true;
+    m_header_loaded = false;
+    m_cache_checked = false;
+    m_cache_hit     = false;
+    m_prefetched    = false;
+    m_slot_urgent   = false;
+}
+
+
+/**
+ * Constructor - a view of the given row of a table.
+ */
+CMessage::CMessage(CMessageTable *table, uint32_t row)
+{
+    m_table         = table;
+    m_row           = row;
+    m_owner         = false;
+    m_header_loaded = false;
+    m_cache_checked = false;
+    m_cache_hit     = false;
+    m_prefetched    = false;
+    m_slot_urgent   = false;
 }
 
 
@@ -53,8 +94,34 @@ CMessage::CMessage(std::string filename)
  */
 CMessage::~CMessage()
 {
-    if ( m_me != NULL )
-        delete( m_me );
+    CMimeCache::Instance()->remove( this );
+
+    if ( m_owner )
+        m_table->remove( m_row );
+}
+
+
+/**
+ * Forget everything we've parsed.
+ */
+void CMessage::reset()
+{
+    CMimeCache::Instance()->remove( this );
+
+    if ( m_slot )
+    {
+        int expected = SLOT_PENDING;
+        m_slot->state.compare_exchange_strong( expected, SLOT_CANCELLED );
+        m_slot.reset();
+    }
+
+    m_header        = CHeader();
+    m_cached        = THeaderEntry();
+    m_header_loaded = false;
+    m_cache_checked = false;
+    m_cache_hit     = false;
+    m_prefetched    = false;
+    m_slot_urgent   = false;
 }
 
 
@@ -63,7 +130,7 @@ CMessage::~CMessage()
  */
 std::string CMessage::path()
 {
-    return (m_path);
+    return( m_table->path( m_row ) );
 }
 
 
@@ -72,48 +139,42 @@ std::string CMessage::path()
  */
 void CMessage::path( std::string new_path )
 {
-    m_path = new_path;
+    m_table->rename( m_row, new_path );
 }
 
 
 /**
  * Get the flags for this message.
+ *
+ * These are the flags from the filename, plus 'N' if the message is in
+ * new/, in ASCII order and padded to four characters.
  */
 std::string CMessage::flags()
 {
-    std::string flags = "";
-    std::string pth   = path();
-
-    if (pth.empty())
-        return (flags);
-
-    size_t offset = pth.find(":2,");
-    if (offset != std::string::npos)
-        flags = pth.substr(offset + 3);
+    std::string flags;
+    this->flags( flags );
+    return flags;
+}
 
-    if ( flags.size() > 3)
-        flags = "";
 
-    /**
-     * Sleazy Hack.
-     */
-    if ( pth.find( "/new/" ) != std::string::npos )
-        flags += "N";
+/**
+ * Append the flags for this message to the given buffer.
+ */
+void CMessage::flags( std::string &out )
+{
+    size_t start = out.size();
 
+    uint64_t all = m_table->flags( m_row );
+    if ( m_table->in_new( m_row ) )
+        all |= CFlags::bit( 'N' );
 
-    /**
-     * Sort the flags, and remove duplicates
-     */
-    std::sort( flags.begin(), flags.end());
-    flags.erase(std::unique(flags.begin(), flags.end()), flags.end());
+    CFlags::render( all, out );
 
     /**
      * Pad.
      */
-    while( (int)strlen(flags.c_str()) < 4 )
-        flags += " ";
-
-    return flags;
+    if ( out.size() - start < 4 )
+        out.append( 4 - ( out.size() - start ), ' ' );
 }
 
 
@@ -130,54 +191,16 @@ void CMessage::add_flag( char c )
     /**
      * If the flag is already present, return.
      */
-    if ( flags().find( c ) == std::string::npos)
+    uint64_t bit   = CFlags::bit( c );
+    uint64_t flags = m_table->flags( m_row );
+    if ( ( bit == 0 ) || ( flags & bit ) )
         return;
 
-    /**
-     * Get the path and ensure it is present.
-     */
-    std::string p = path();
-
-    if (p.empty())
-        return;
-
-    /**
-     * Get the current flags.
-     */
-    size_t offset     = p.find(":2,");
-    std::string base  = p;
-    std::string flags = "";
-
-    /**
-     * If we found flags then add the new one.
-     */
-    if (offset != std::string::npos)
-    {
-        flags = p.substr(offset);
-        base  = p.substr(0,offset);
-    }
-    else
-    {
-        flags = ":2,";
-    }
+    std::string o_path = path();
+    std::string n_path = CFlags::with_flags( o_path, flags | bit );
 
-    /**
-     * Sleazy Hack.
-     */
-    if ( p.find( "/new/" ) != std::string::npos )
-        flags += "N";
-
-    /**
-     * Add the new-flag.
-     */
-    flags += c;
-
-    CFile::move( p, base + flags );
-
-    /**
-     * Update the path.
-     */
-    path( base + flags );
+    if ( CFile::move( o_path, n_path ) )
+        path( n_path );
 }
 
 
@@ -194,54 +217,16 @@ void CMessage::remove_flag( char c )
     /**
      * If the flag is not present, return.
      */
-    if ( flags().find( c ) == std::string::npos)
-        return;
-
-    /**
-     * Get the path and ensure it is present.
-     */
-    std::string p = path();
-
-    if (p.empty())
+    uint64_t bit   = CFlags::bit( c );
+    uint64_t flags = m_table->flags( m_row );
+    if ( ( bit == 0 ) || ! ( flags & bit ) )
         return;
 
-    /**
-     * Find the flags.
-     */
-    size_t offset     = p.find(":2,");
-    std::string base  = p;
-    std::string flags = "";
-
-    /**
-     * If we found flags then add the new one.
-     */
-    if (offset != std::string::npos)
-    {
-        flags = p.substr(offset);
-        base  = p.substr(0,offset);
-    }
-    else
-    {
-        flags = ":2,";
-    }
-
-    /**
-     * Remove the flag.
-     */
-    std::string::size_type k = 0;
-    while((k=flags.find(c,k))!=flags.npos) {
-        flags.erase(k, 1);
-    }
-
-    /**
-     * Move the file.
-     */
-    CFile::move( p, base + flags );
+    std::string o_path = path();
+    std::string n_path = CFlags::with_flags( o_path, flags & ~bit );
 
-    /**
-     * Update the path.
-     */
-    path( base + flags );
+    if ( CFile::move( o_path, n_path ) )
+        path( n_path );
 }
 
 
@@ -273,14 +258,12 @@ bool CMessage::matches_filter( std::string *filter )
 
 /**
  * Is this message new?
+ *
+ * That is the case if it lives in new/, or has the 'N' flag.
  */
 bool CMessage::is_new()
 {
-    std::string f = flags();
-    if ( f.find( 'N' ) != std::string::npos )
-        return true;
-    else
-        return false;
+    return( m_table->is_new( m_row ) );
 }
 
 
@@ -311,6 +294,11 @@ bool CMessage::mark_read()
         n_path = before + "/cur/" + after;
         if ( rename(  c_path.c_str(), n_path.c_str() )  == 0 ) {
             path(n_path);
+
+            /**
+             * It might also carry an explicit 'N' flag.
+             */
+            remove_flag( 'N' );
             return true;
         }
         else {
@@ -376,93 +364,238 @@ bool CMessage::mark_new()
 
 /**
  * Format the message for display in the header - via the lua format string.
+ *
+ * The format-string is compiled once, and then expanded in a single pass.
  */
 std::string CMessage::format( std::string fmt )
 {
-    std::string result = fmt;
+    std::string result;
+    format( result, fmt );
+    return( result );
+}
 
+
+/**
+ * Append the formatted message to the given buffer, with placeholders
+ * for any fields which need our headers.
+ */
+void CMessage::format_pending( std::string &out )
+{
+    CGlobal *global   = CGlobal::Instance();
+    CFormat *compiled = CFormat::compiled( *global->get_variable("index_format") );
+
+    compiled->append( out, [this]( TFormatField field, std::string &value )
+    {
+        if ( field == FIELD_FLAGS )
+            flags( value );
+        else if ( field != FIELD_LITERAL )
+            value += "...";
+    } );
+}
+
+
+/**
+ * Append the formatted message to the given buffer.
+ *
+ * This runs for every visible row on every refresh, so each field is
+ * appended in place: the headers are referred to, rather than copied.
+ */
+void CMessage::format( std::string &out, const std::string &fmt )
+{
     /**
-     * Get the format-string we'll expand from the global
-     * setting, if it wasn't supplied.
+     * Use the global index_format if no format was supplied.
      */
-    if ( result.empty() ) {
+    CFormat *compiled;
+    if ( fmt.empty() ) {
         CGlobal *global  = CGlobal::Instance();
-        std::string *fmt = global->get_variable("index_format");
-        result = std::string(*fmt);
+        compiled = CFormat::compiled( *global->get_variable("index_format") );
     }
+    else
+        compiled = CFormat::compiled( fmt );
 
-    /**
-     * The variables we know about.
-     */
-    const char *fields[9] = { "FLAGS", "FROM", "TO", "SUBJECT",  "DATE", "YEAR", "MONTH", "DAY", 0 };
-    const char **std_name = fields;
+    compiled->append( out, [this]( TFormatField field, std::string &value )
+    {
+        switch( field ) {
+        case FIELD_FLAGS:   flags( value );                   break;
+        case FIELD_FROM:    value += header_value( "From" );    break;
+        case FIELD_TO:      value += header_value( "To" );      break;
+        case FIELD_SUBJECT: value += header_value( "Subject" ); break;
+        case FIELD_DATE:    date( value, EFULL );             break;
+        case FIELD_YEAR:    date( value, EYEAR );             break;
+        case FIELD_MONTH:   date( value, EMONTH );            break;
+        case FIELD_DAY:     date( value, EDAY );              break;
+        case FIELD_LITERAL: break;
+        }
+    } );
+}
 
 
-    /**
-     * Iterate over everything we could possibly-expand.
-     */
-    for( int i = 0 ; std_name[i] ; ++i) {
+/**
+ * Collect the result of any background parse of our headers.
+ */
+void CMessage::collect()
+{
+    if ( ! m_slot )
+        return;
 
-        size_t offset = result.find( std_name[i], 0 );
+    int state = m_slot->state.load( std::memory_order_acquire );
+    if ( state == SLOT_READY ) {
+        m_cached        = m_slot->entry;
+        m_cache_checked = true;
+        m_cache_hit     = true;
 
-        if ( ( offset != std::string::npos ) && ( offset < result.size() ) ) {
+        if ( m_slot->parsed ) {
+            m_header        = std::move( m_slot->header );
+            m_header_loaded = true;
+        }
+        m_slot.reset();
+    }
+    else if ( state == SLOT_FAILED ) {
+        m_slot.reset();
+    }
+}
 
-            /**
-             * The bit before the variable, the bit after, and the body we'll replace it with.
-             */
-            std::string before = result.substr(0,offset-1);
-            std::string body = "";
-            std::string after  = result.substr(offset+strlen(std_name[i]));
 
-            /**
-             * Expand the specific variables.
-             */
-            if ( strcmp(std_name[i] , "TO" ) == 0 ) {
-                body = to();
-            }
-            if ( strcmp(std_name[i] , "DATE" ) == 0 ) {
-                body = date();
-            }
-            if ( strcmp(std_name[i] , "FROM" ) == 0 ) {
-                body += from();
-            }
-            if ( strcmp(std_name[i] , "FLAGS" ) == 0 ) {
-                body = flags();
-            }
-            if ( strcmp(std_name[i] , "SUBJECT" ) == 0 ) {
-                body = subject();
-            }
-            if ( strcmp(std_name[i],  "YEAR" ) == 0 ) {
-                body = date(EYEAR);
-            }
-            if ( strcmp(std_name[i],  "MONTH" ) == 0 ) {
-                body = date(EMONTH);
-            }
-            if ( strcmp(std_name[i],  "DAY" ) == 0 ) {
-                body = date(EDAY);
-            }
+/**
+ * Look for this message in the header-cache.
+ */
+bool CMessage::cached_headers()
+{
+    collect();
 
-            result = before + body + after;
+    if ( ! m_cache_checked ) {
+        m_cache_checked = true;
+
+        std::string file = path();
+
+        struct stat sb;
+        if ( stat( file.c_str(), &sb ) == 0 ) {
+            CHeaderCache *cache = CHeaderCache::Instance();
+            m_cache_hit = cache->lookup( file, sb, m_cached );
         }
     }
-    return( result );
+    return( m_cache_hit );
+}
+
+
+/**
+ * Are the headers of this message available without any I/O?
+ */
+bool CMessage::headers_ready()
+{
+    collect();
+    return( m_header_loaded || ( m_cache_checked && m_cache_hit ) );
+}
+
+
+/**
+ * Queue this message to have its headers parsed in the background.
+ */
+void CMessage::queue_headers( bool urgent )
+{
+    CHeaderPool *pool = CHeaderPool::Instance();
+    if ( pool->threads() == 0 || headers_ready() )
+        return;
+
+    if ( m_slot ) {
+        /**
+         * Already queued: move it to the front, but only once.
+         */
+        if ( urgent && ! m_slot_urgent &&
+             m_slot->state.load( std::memory_order_acquire ) == SLOT_PENDING ) {
+            m_slot_urgent = true;
+            pool->submit( m_slot, true );
+        }
+        return;
+    }
+
+    m_slot        = std::make_shared<THeaderSlot>( path() );
+    m_slot_urgent = urgent;
+    pool->submit( m_slot, urgent );
+}
+
+
+/**
+ * Hint that the headers of this message will be wanted soon.
+ *
+ * Unless they're already cached we ask the kernel to start reading the
+ * start of the file in the background, so that when the row is drawn
+ * the parse doesn't wait on the disk.
+ */
+void CMessage::prefetch()
+{
+    if ( m_prefetched || m_header_loaded || m_slot )
+        return;
+
+    m_prefetched = true;
+    if ( cached_headers() )
+        return;
+
+    int fd = open( path().c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+        return;
+
+    posix_fadvise( fd, 0, HEADER_PREFETCH_SIZE, POSIX_FADV_WILLNEED );
+    close( fd );
 }
 
 
 /**
  * Get the value of a header.
+ *
+ * The common headers come from the header-cache, without opening the
+ * file.  Otherwise only the header-block is read, the full MIME parse is
+ * left until the body is required.
  */
 std::string CMessage::header( std::string name )
 {
-    if ( m_me == NULL ) {
-        ifstream file(path().c_str());
-        m_me = new MimeEntity(file);
+    return( header_value( name ) );
+}
+
+
+/**
+ * Get the value of a header, without copying it.
+ */
+const std::string &CMessage::header_value( const std::string &name )
+{
+    static const std::string empty;
+
+    if ( ! m_header_loaded ) {
+        if ( cached_headers() ) {
+            const std::string *value = CHeaderCache::field( m_cached, name.c_str() );
+            if ( value )
+                return( *value );
+        }
+
+        /**
+         * We're about to read the file ourselves, so any background
+         * parse is no longer required.
+         */
+        if ( m_slot ) {
+            int expected = SLOT_PENDING;
+            m_slot->state.compare_exchange_strong( expected, SLOT_CANCELLED );
+            m_slot.reset();
+        }
+
+        std::string file = path();
+
+        m_header.load( file );
+        m_header_loaded = true;
+
+        /**
+         * Populate the cache for next time.
+         */
+        struct stat sb;
+        if ( ! m_cache_hit && stat( file.c_str(), &sb ) == 0 ) {
+            CHeaderCache::fill( m_header, m_cached );
+
+            CHeaderCache *cache = CHeaderCache::Instance();
+            cache->store( file, sb, m_cached );
+            m_cache_hit = true;
+        }
     }
-    Header & h = m_me->header();
-    if (h.hasField(name ) )
-        return(h.field(name).value() );
-    else
-        return "";
+    const std::string *value = m_header.find( name );
+    return( value ? *value : empty );
 }
 
 
@@ -481,33 +614,50 @@ std::string CMessage::from()
  */
 std::string CMessage::date(TDate fmt)
 {
-    std::string date = header("Date");
+    std::string date;
+    this->date( date, fmt );
+    return( date );
+}
 
-    if (date.empty()) {
+
+/**
+ * Append the date of the message to the given buffer.
+ */
+void CMessage::date( std::string &out, TDate fmt )
+{
+    const char *date = header_value( "Date" ).c_str();
+
+    char mtime[32] = { '\0' };
+    if ( *date == '\0' ) {
         struct stat st_buf;
-        const char *p = path().c_str();
+        std::string p = path();
 
-        int err = stat(p,&st_buf);
+        int err = stat(p.c_str(),&st_buf);
         if ( !err ) {
             time_t modt = st_buf.st_mtime;
-            date = ctime(&modt);
+            ctime_r(&modt, mtime);
         }
+        date = mtime;
     }
     if ( fmt == EFULL )
-    	return( date );
-    if ( fmt == EYEAR )
     {
-        struct tm tm;
+        out += date;
+        return;
+    }
 
-        if (strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S", &tm) != NULL)
+    struct tm tm;
+    bool parsed = ( strptime(date, "%a, %d %b %Y %H:%M:%S", &tm) != NULL );
+    char buff[20] = { '\0' };
+
+    if ( fmt == EYEAR )
+    {
+        if ( parsed )
         {
-            char buff[20] = { '\0' };
             snprintf(buff, sizeof(buff)-1, "%d", ( 1900 + tm.tm_year ) );
-
-            return( std::string(buff) );
+            out += buff;
         }
         else
-            return std::string("$YEAR");
+            out += "$YEAR";
     }
     if ( fmt == EMONTH )
     {
@@ -523,31 +673,21 @@ std::string CMessage::date(TDate fmt)
                                  "October",
                                  "November",
                                  "December" };
-        struct tm tm;
-
-        if (strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S", &tm) != NULL)
-        {
-            return( std::string(months[tm.tm_mon]) );
-        }
+        if ( parsed )
+            out += months[tm.tm_mon];
         else
-            return std::string("$MONTH");
+            out += "$MONTH";
     }
     if ( fmt == EDAY )
     {
-        struct tm tm;
-
-        if (strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S", &tm) != NULL)
+        if ( parsed )
         {
-            char buff[20] = { '\0' };
             snprintf(buff, sizeof(buff)-1, "%d", ( tm.tm_mday ) );
-
-            return( std::string(buff) );
+            out += buff;
         }
         else
-            return std::string("$DAY");
+            out += "$DAY";
     }
-
-    return std::string("");
 }
 
 
@@ -570,6 +710,45 @@ std::string CMessage::subject()
 }
 
 
+/**
+ * The Date: header as seconds past the epoch.
+ *
+ * The mtime is the fallback for a missing, or bogus, Date.
+ */
+int64_t CMessage::date_epoch()
+{
+    int64_t epoch = 0;
+
+    if ( cached_headers() && m_cached.date_epoch != 0 )
+        return( m_cached.date_epoch );
+
+    if ( CSort::parse_date( header( "Date" ), &epoch ) )
+        return( epoch );
+
+    struct stat st_buf;
+    if ( stat( path().c_str(), &st_buf ) == 0 )
+        epoch = (int64_t)st_buf.st_mtime;
+
+    return( epoch );
+}
+
+
+/**
+ * The size of the message file, in bytes.
+ */
+int64_t CMessage::size()
+{
+    if ( cached_headers() )
+        return( m_cached.size );
+
+    struct stat st_buf;
+    if ( stat( path().c_str(), &st_buf ) == 0 )
+        return( (int64_t)st_buf.st_size );
+
+    return 0;
+}
+
+
 /**
  * Get the body of the message, as a vector of lines.
  */
@@ -578,11 +757,22 @@ std::vector<std::string> CMessage::body()
     std::vector<std::string> result;
 
     /**
-     * Parse if we've not done so.
+     * Parse if we've not done so, or if the parse was evicted from the
+     * cache.  The size of the file is a fair estimate of the memory the
+     * parsed entity uses.
      */
-    if ( m_me == NULL ) {
+    CMimeCache *cache = CMimeCache::Instance();
+    std::shared_ptr<MimeEntity> me = cache->get( this );
+    if ( ! me ) {
         ifstream file(path().c_str());
-        m_me = new MimeEntity(file);
+        me = std::make_shared<MimeEntity>(file);
+
+        struct stat st_buf;
+        size_t bytes = 0;
+        if ( stat( path().c_str(), &st_buf ) == 0 )
+            bytes = st_buf.st_size;
+
+        cache->insert( this, me, bytes );
     }
 
     /**
@@ -593,7 +783,7 @@ std::vector<std::string> CMessage::body()
     /**
      * Iterate over every part.
      */
-    mimetic::MimeEntityList& parts = m_me->body().parts();
+    mimetic::MimeEntityList& parts = me->body().parts();
     mimetic::MimeEntityList::iterator mbit = parts.begin(), meit = parts.end();
     for(; mbit != meit; ++mbit) {
 
@@ -617,7 +807,7 @@ std::vector<std::string> CMessage::body()
      * thing and hope for the best.
      */
     if ( body.empty() )
-        body = m_me->body();
+        body = me->body();
 
 
     /**
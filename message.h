@@ -23,6 +23,13 @@
 #include <string>
 #include <stdint.h>
 #include <mimetic/mimetic.h>
+#include "header.h"
+#include "headercache.h"
+#include "headerpool.h"
+#include "sort.h"
+
+
+class CMessageTable;
 
 
 /**
@@ -31,6 +38,9 @@
  * The constructor will be passed a reference to a filename, which is assumed to be file
  * beneath a Maildir folder.
  *
+ * The path and flags live in a row of a CMessageTable, so this object is a view
+ * of that row plus whatever we've parsed from the file.
+ *
  * Using the mimetic library we'll parse the message and make various fields available.
  *
  */
@@ -44,6 +54,11 @@ class CMessage
    */
   CMessage(std::string filename);
 
+  /**
+   * Constructor - a view of the given row of a table.
+   */
+  CMessage(CMessageTable *table, uint32_t row);
+
 
   /**
    * Destructor.
@@ -67,9 +82,21 @@ class CMessage
   std::string format( std::string fmt = "");
 
   /**
-   * Get the flags for this message.
+   * Append the formatted message to the given buffer.
+   */
+  void format( std::string &out, const std::string &fmt );
+
+  /**
+   * Append the formatted message to the given buffer, with placeholders
+   * for any fields which need our headers.
+   */
+  void format_pending( std::string &out );
+
+  /**
+   * Get the flags for this message, padded to four characters.
    */
   std::string flags();
+  void flags( std::string &out );
 
   /**
    * Add a flag to a message.
@@ -115,6 +142,7 @@ class CMessage
    * Get the date of the message.
    */
   std::string date(TDate fmt = EFULL);
+  void date( std::string &out, TDate fmt );
 
   /**
    * Get the recipient of the message.
@@ -126,24 +154,87 @@ class CMessage
    */
   std::string subject();
 
+  /**
+   * Hint that the headers of this message will be wanted soon.
+   */
+  void prefetch();
+
+  /**
+   * Are the headers of this message available without any I/O?
+   */
+  bool headers_ready();
+
+  /**
+   * Queue this message to have its headers parsed in the background.
+   */
+  void queue_headers( bool urgent = false );
+
   /**
    * Get the body of the message, as a vector of lines.
    */
   std::vector<std::string> body();
 
+  /**
+   * The Date: header as seconds past the epoch, or the mtime if that
+   * is missing or bogus.
+   */
+  int64_t date_epoch();
+
+  /**
+   * The size of the message file, in bytes.
+   */
+  int64_t size();
+
+  /**
+   * The value of a header, without copying it.  This is valid until our
+   * headers are next loaded, or reset.
+   */
+  const std::string &header_value( const std::string &name );
+
+  /**
+   * Forget everything we've parsed, as our row now holds a different
+   * message.
+   */
+  void reset();
+
 
  private:
 
 
   /**
-   * The file we represent.
+   * The table, and row, holding our path and flags, and whether we
+   * added that row ourselves.
+   */
+  CMessageTable *m_table;
+  uint32_t m_row;
+  bool m_owner;
+
+  /**
+   * The headers of this message, read on first use.
+   */
+  CHeader m_header;
+  bool m_header_loaded;
+
+  /**
+   * The headers of this message from the header-cache, if it had them.
+   */
+  bool cached_headers();
+  THeaderEntry m_cached;
+  bool m_cache_checked;
+  bool m_cache_hit;
+
+  /**
+   * Have we asked for our headers to be read ahead?
    */
-  std::string m_path;
+  bool m_prefetched;
 
   /**
-   * MIME Entity object for this message.
+   * Our headers, as parsed in the background, and whether we've asked
+   * for them urgently.
    */
-  mimetic::MimeEntity *m_me;
+  void collect();
+  std::shared_ptr<THeaderSlot> m_slot;
+  bool m_slot_urgent;
 };
 
 #endif /* _message_h */
@@ -0,0 +1,511 @@
+/**
+ * messagetable.cc - Compact storage for the metadata of many messages.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <algorithm>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "messagetable.h"
+
+
+/**
+ * Markers for empty, and deleted, slots in the index.
+ */
+#define INDEX_EMPTY   ( (uint32_t) -1 )
+#define INDEX_DELETED ( (uint32_t) -2 )
+
+
+/**
+ * Constructor.
+ */
+CMessageTable::CMessageTable()
+{
+    m_garbage      = 0;
+    m_last_folder  = 0;
+    m_index_used   = 0;
+    m_last_version = 0;
+}
+
+
+/**
+ * Split a path into the folder, with its trailing slash, and the name.
+ *
+ * For "/maildir/inbox/cur/123.host:2,S" the folder is "/maildir/inbox/",
+ * the name is "cur/123.host:2,S", and the unique part is "123.host".
+ */
+void CMessageTable::split( const TStringRef &path, size_t *folder, size_t *base, size_t *unique )
+{
+    size_t slash = path.rfind( '/' );
+    if ( slash == std::string::npos )
+    {
+        *folder = 0;
+        *base   = 0;
+    }
+    else
+    {
+        size_t parent = ( slash > 0 ) ? path.rfind( '/', slash - 1 ) : std::string::npos;
+        if ( parent == std::string::npos )
+            *folder = slash + 1;
+        else
+            *folder = parent + 1;
+
+        *base = slash + 1 - *folder;
+    }
+
+    size_t colon = path.find( ':', *folder + *base );
+    if ( colon == std::string::npos )
+        colon = path.size;
+
+    *unique = colon - ( *folder + *base );
+}
+
+
+/**
+ * Get the id of the folder which begins the given path.
+ *
+ * Messages arrive a folder at a time, so the last folder is checked
+ * first, without building a string.
+ */
+uint32_t CMessageTable::folder_id( const TStringRef &path, size_t len )
+{
+    if ( m_last_folder < m_folders.size() )
+    {
+        const std::string &last = m_folders[m_last_folder];
+        if ( last.size() == len && memcmp( path.data, last.data(), len ) == 0 )
+            return( m_last_folder );
+    }
+
+    std::unordered_map<std::string, uint32_t>::iterator it =
+        m_folder_ids.find( std::string( path.data, len ) );
+    if ( it == m_folder_ids.end() )
+        return( MESSAGE_NO_ROW );
+
+    m_last_folder = it->second;
+    return( it->second );
+}
+
+
+/**
+ * Get the id of the folder which begins the given path, adding it if
+ * required.
+ */
+uint32_t CMessageTable::intern( const TStringRef &path, size_t len )
+{
+    uint32_t id = folder_id( path, len );
+    if ( id != MESSAGE_NO_ROW )
+        return( id );
+
+    std::string folder( path.data, len );
+
+    id = m_folders.size();
+    m_folders.push_back( folder );
+    m_folder_ids[folder] = id;
+    m_last_folder = id;
+    return( id );
+}
+
+
+/**
+ * FNV-1a over the unique name, mixed with the folder.
+ */
+uint64_t CMessageTable::hash( uint32_t folder, const char *unique, size_t len )
+{
+    uint64_t h = 14695981039346656037ULL ^ ( (uint64_t)folder * 0x9E3779B97F4A7C15ULL );
+    for( size_t i = 0; i < len; i++ )
+    {
+        h ^= (unsigned char)unique[i];
+        h *= 1099511628211ULL;
+    }
+    return( h );
+}
+
+
+/**
+ * Store the path of the given row, and index it.
+ */
+void CMessageTable::set_path( uint32_t row, const TStringRef &path )
+{
+    size_t folder, base, unique;
+    split( path, &folder, &base, &unique );
+
+    uint32_t id = intern( path, folder );
+    size_t len  = path.size - folder;
+
+    m_folder[row]   = id;
+    m_name[row]     = m_names.size();
+    m_name_len[row] = len;
+    m_base[row]     = base;
+    m_unique[row]   = unique;
+    m_names.append( path.data + folder, len );
+
+    m_flags[row] = CFlags::parse( path ) | MESSAGE_LIVE;
+    if ( CFlags::in_new( path ) )
+        m_flags[row] |= MESSAGE_IN_NEW;
+
+    m_hash[row] = hash( id, path.data + folder + base, unique );
+    index( row );
+
+    m_version[row] = ++m_last_version;
+}
+
+
+/**
+ * Add the given row to our index.
+ *
+ * The index is kept at most half full, counting deleted slots.
+ */
+void CMessageTable::index( uint32_t row )
+{
+    if ( ( m_index_used + 1 ) * 2 > m_index.size() )
+        reindex( size() + 1 );
+
+    size_t mask = m_index.size() - 1;
+    size_t slot = m_hash[row] & mask;
+
+    while( m_index[slot] != INDEX_EMPTY && m_index[slot] != INDEX_DELETED )
+        slot = ( slot + 1 ) & mask;
+
+    if ( m_index[slot] == INDEX_EMPTY )
+        m_index_used += 1;
+    m_index[slot] = row;
+}
+
+
+/**
+ * Remove the given row from our index.
+ */
+void CMessageTable::unindex( uint32_t row )
+{
+    size_t mask = m_index.size() - 1;
+    size_t slot = m_hash[row] & mask;
+
+    while( m_index[slot] != INDEX_EMPTY )
+    {
+        if ( m_index[slot] == row )
+        {
+            m_index[slot] = INDEX_DELETED;
+            return;
+        }
+        slot = ( slot + 1 ) & mask;
+    }
+}
+
+
+/**
+ * Rebuild the index, with room for at least the given number of rows,
+ * dropping deleted slots.
+ */
+void CMessageTable::reindex( size_t rows )
+{
+    size_t capacity = 1024;
+    while( capacity < rows * 4 )
+        capacity *= 2;
+
+    m_index.assign( capacity, INDEX_EMPTY );
+    m_index_used = 0;
+
+    size_t mask = capacity - 1;
+    for( uint32_t row = 0; row < m_flags.size(); row++ )
+    {
+        if ( ! live( row ) )
+            continue;
+
+        size_t slot = m_hash[row] & mask;
+        while( m_index[slot] != INDEX_EMPTY )
+            slot = ( slot + 1 ) & mask;
+
+        m_index[slot] = row;
+        m_index_used += 1;
+    }
+}
+
+
+/**
+ * Add a message, reusing a free row if there is one.
+ */
+uint32_t CMessageTable::add( const TStringRef &path )
+{
+    uint32_t row;
+
+    if ( ! m_free.empty() )
+    {
+        row = m_free.back();
+        m_free.pop_back();
+    }
+    else
+    {
+        row = m_flags.size();
+        m_folder.push_back( 0 );
+        m_name.push_back( 0 );
+        m_name_len.push_back( 0 );
+        m_base.push_back( 0 );
+        m_unique.push_back( 0 );
+        m_flags.push_back( 0 );
+        m_hash.push_back( 0 );
+        m_version.push_back( 0 );
+        m_key_number.push_back( 0 );
+        m_key_text.push_back( std::string() );
+        m_key_order.push_back( -1 );
+    }
+
+    m_key_order[row] = -1;
+    set_path( row, path );
+    return( row );
+}
+
+
+/**
+ * Remove the message in the given row.
+ */
+void CMessageTable::remove( uint32_t row )
+{
+    if ( ! live( row ) )
+        return;
+
+    unindex( row );
+
+    m_garbage += m_name_len[row];
+    m_flags[row]     = 0;
+    m_key_order[row] = -1;
+    std::string().swap( m_key_text[row] );
+    m_free.push_back( row );
+
+    compact();
+}
+
+
+/**
+ * Update the path of the message in the given row.
+ *
+ * The sort key is kept: nothing it is built from changes on a rename.
+ */
+void CMessageTable::rename( uint32_t row, const TStringRef &path )
+{
+    unindex( row );
+    m_garbage += m_name_len[row];
+    set_path( row, path );
+
+    compact();
+}
+
+
+/**
+ * Find the row holding the given message.
+ */
+uint32_t CMessageTable::find( const TStringRef &path )
+{
+    return( find( path, std::vector<bool>() ) );
+}
+
+
+/**
+ * Find the row holding the given message, ignoring those in the
+ * skip-list.
+ */
+uint32_t CMessageTable::find( const TStringRef &path, const std::vector<bool> &skip )
+{
+    size_t folder, base, unique;
+    split( path, &folder, &base, &unique );
+
+    uint32_t id = folder_id( path, folder );
+    if ( id == MESSAGE_NO_ROW )
+        return( MESSAGE_NO_ROW );
+
+    const char *name = path.data + folder;
+    size_t len       = path.size - folder;
+    uint64_t h       = hash( id, name + base, unique );
+
+    if ( m_index.empty() )
+        return( MESSAGE_NO_ROW );
+
+    size_t mask    = m_index.size() - 1;
+    uint32_t found = MESSAGE_NO_ROW;
+
+    for( size_t slot = h & mask; m_index[slot] != INDEX_EMPTY; slot = ( slot + 1 ) & mask )
+    {
+        uint32_t row = m_index[slot];
+        if ( row == INDEX_DELETED || m_hash[row] != h )
+            continue;
+        if ( row < skip.size() && skip[row] )
+            continue;
+
+        const char *stored = m_names.data() + m_name[row];
+        if ( m_folder[row] != id || m_unique[row] != unique ||
+             memcmp( stored + m_base[row], name + base, unique ) != 0 )
+            continue;
+
+        /**
+         * The same file?  Otherwise remember the first candidate.
+         */
+        if ( m_name_len[row] == len && memcmp( stored, name, len ) == 0 )
+            return( row );
+
+        if ( found == MESSAGE_NO_ROW )
+            found = row;
+    }
+    return( found );
+}
+
+
+/**
+ * The path of the message in the given row.
+ */
+std::string CMessageTable::path( uint32_t row )
+{
+    std::string out;
+    path( row, out );
+    return( out );
+}
+
+
+/**
+ * Append the path of the message in the given row to the buffer.
+ */
+void CMessageTable::path( uint32_t row, std::string &out )
+{
+    out += m_folders[m_folder[row]];
+    out.append( m_names, m_name[row], m_name_len[row] );
+}
+
+
+/**
+ * Is the given row stored under exactly the given path?
+ */
+bool CMessageTable::is_path( uint32_t row, const TStringRef &path )
+{
+    const std::string &folder = m_folders[m_folder[row]];
+    size_t len = m_name_len[row];
+
+    return( path.size == folder.size() + len &&
+            memcmp( path.data, folder.data(), folder.size() ) == 0 &&
+            memcmp( path.data + folder.size(), m_names.data() + m_name[row], len ) == 0 );
+}
+
+
+/**
+ * Store the sort key of the given row.
+ */
+void CMessageTable::set_key( uint32_t row, TSortOrder order, int64_t number, const std::string &text )
+{
+    m_key_number[row] = number;
+    m_key_text[row]   = text;
+    m_key_order[row]  = (int8_t)order;
+}
+
+
+/**
+ * Compute the sort key of the given row, if it can be found from the
+ * path or the file alone.
+ *
+ * The mtime is the fallback for a filename without a timestamp.
+ */
+bool CMessageTable::file_key( uint32_t row, TSortOrder order )
+{
+    if ( order != SORT_ARRIVAL && order != SORT_MTIME && order != SORT_SIZE )
+        return false;
+
+    std::string file = path( row );
+    int64_t number   = 0;
+
+    if ( order == SORT_ARRIVAL )
+        number = CSort::arrival( file );
+
+    if ( number == 0 )
+    {
+        struct stat st_buf;
+        if ( stat( file.c_str(), &st_buf ) == 0 )
+            number = ( order == SORT_SIZE ) ? (int64_t)st_buf.st_size : (int64_t)st_buf.st_mtime;
+    }
+
+    m_key_number[row] = number;
+    m_key_text[row].clear();
+    m_key_order[row]  = (int8_t)order;
+    return true;
+}
+
+
+/**
+ * Compare two rows by their sort keys.
+ */
+bool CMessageTable::less( uint32_t a, uint32_t b )
+{
+    if ( m_key_number[a] != m_key_number[b] )
+        return( m_key_number[a] < m_key_number[b] );
+
+    int cmp = m_key_text[a].compare( m_key_text[b] );
+    if ( cmp != 0 )
+        return( cmp < 0 );
+
+    /**
+     * Ties are broken on the folder, then the unique part of the name,
+     * so that renames don't move a message.
+     */
+    if ( m_folder[a] != m_folder[b] )
+        return( m_folders[m_folder[a]] < m_folders[m_folder[b]] );
+
+    const char *ua = m_names.data() + m_name[a] + m_base[a];
+    const char *ub = m_names.data() + m_name[b] + m_base[b];
+    size_t len     = std::min( m_unique[a], m_unique[b] );
+
+    cmp = memcmp( ua, ub, len );
+    if ( cmp != 0 )
+        return( cmp < 0 );
+    if ( m_unique[a] != m_unique[b] )
+        return( m_unique[a] < m_unique[b] );
+
+    /**
+     * The same message in both new/ and cur/.
+     */
+    return( a < b );
+}
+
+
+/**
+ * Sort the given rows.
+ */
+void CMessageTable::sort( std::vector<uint32_t> &rows )
+{
+    std::sort( rows.begin(), rows.end(),
+               [this]( uint32_t a, uint32_t b ) { return( less( a, b ) ); } );
+}
+
+
+/**
+ * Rebuild the name arena once more than half of it is garbage.
+ */
+void CMessageTable::compact()
+{
+    if ( m_garbage < 65536 || m_garbage * 2 < m_names.size() )
+        return;
+
+    std::string names;
+    names.reserve( m_names.size() - m_garbage );
+
+    for( uint32_t row = 0; row < m_flags.size(); row++ )
+    {
+        if ( ! live( row ) )
+            continue;
+
+        uint32_t offset = names.size();
+        names.append( m_names, m_name[row], m_name_len[row] );
+        m_name[row] = offset;
+    }
+
+    m_names.swap( names );
+    m_garbage = 0;
+}
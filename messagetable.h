@@ -0,0 +1,280 @@
+/**
+ * messagetable.h - Compact storage for the metadata of many messages.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _messagetable_h_
+#define _messagetable_h_ 1
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "flags.h"
+#include "sort.h"
+#include "stringref.h"
+
+
+/**
+ * The row number we return when a message isn't present.
+ */
+#define MESSAGE_NO_ROW ( (uint32_t) -1 )
+
+
+/**
+ * Bits we store alongside the flags of each row, above those CFlags uses.
+ */
+#define MESSAGE_IN_NEW ( (uint64_t)1 << 62 )
+#define MESSAGE_LIVE   ( (uint64_t)1 << 63 )
+
+
+/**
+ * A table of messages, stored as a set of parallel arrays.
+ *
+ * Each message is a row, holding only what filtering and sorting need:
+ * the folder, as an interned id, the rest of its path, as an offset into
+ * a single string arena, its flags as a bitmask, and its sort key.  Scans
+ * over thousands of messages therefore walk a few contiguous arrays,
+ * rather than chasing a pointer per message.
+ *
+ * Rows are reused once removed, so their numbers are only stable for as
+ * long as the message is present.
+ */
+class CMessageTable
+{
+
+public:
+
+    /**
+     * Constructor.
+     */
+    CMessageTable();
+
+    /**
+     * Add a message, returning its row.
+     */
+    uint32_t add( const TStringRef &path );
+
+    /**
+     * Remove the message in the given row.
+     */
+    void remove( uint32_t row );
+
+    /**
+     * Update the path of the message in the given row.
+     */
+    void rename( uint32_t row, const TStringRef &path );
+
+    /**
+     * Find the row holding the given message, or MESSAGE_NO_ROW.
+     *
+     * Messages are matched on their folder and the unique part of their
+     * filename, so a message is found after its flags change, or it moves
+     * from new/ to cur/.  An exact match is preferred, and rows marked in
+     * the skip-list are ignored.
+     */
+    uint32_t find( const TStringRef &path );
+    uint32_t find( const TStringRef &path, const std::vector<bool> &skip );
+
+    /**
+     * The number of rows, including those free for reuse.
+     */
+    uint32_t rows() { return( m_flags.size() ); }
+
+    /**
+     * The number of messages present.
+     */
+    uint32_t size() { return( m_flags.size() - m_free.size() ); }
+
+    /**
+     * Is the given row in use?
+     */
+    bool live( uint32_t row ) { return( ( m_flags[row] & MESSAGE_LIVE ) != 0 ); }
+
+    /**
+     * The path of the message in the given row.
+     */
+    std::string path( uint32_t row );
+    void path( uint32_t row, std::string &out );
+
+    /**
+     * Is the given row stored under exactly the given path?
+     */
+    bool is_path( uint32_t row, const TStringRef &path );
+
+    /**
+     * The flags from the filename of the given row.
+     */
+    uint64_t flags( uint32_t row ) { return( m_flags[row] & ~( MESSAGE_IN_NEW | MESSAGE_LIVE ) ); }
+
+    /**
+     * Is the message in new/ ?
+     */
+    bool in_new( uint32_t row ) { return( ( m_flags[row] & MESSAGE_IN_NEW ) != 0 ); }
+
+    /**
+     * Is the message new, i.e. in new/ or flagged 'N'?
+     */
+    bool is_new( uint32_t row ) { return( ( m_flags[row] & ( MESSAGE_IN_NEW | CFlags::bit( 'N' ) ) ) != 0 ); }
+
+    /**
+     * A number which changes whenever the given row is added, or
+     * renamed, for those holding something derived from its path.
+     */
+    uint32_t version( uint32_t row ) { return( m_version[row] ); }
+
+    /**
+     * The last version handed out, which changes whenever any row does.
+     */
+    uint32_t last_version() { return( m_last_version ); }
+
+    /**
+     * Does the given row hold a sort key for the given order?
+     */
+    bool has_key( uint32_t row, TSortOrder order ) { return( m_key_order[row] == (int8_t)order ); }
+
+    /**
+     * Store the sort key of the given row.
+     */
+    void set_key( uint32_t row, TSortOrder order, int64_t number, const std::string &text );
+
+    /**
+     * Compute the sort key of the given row, if it can be found from the
+     * path or the file alone.  Returns false for those orders which need
+     * the headers of the message.
+     */
+    bool file_key( uint32_t row, TSortOrder order );
+
+    /**
+     * Compare two rows by their sort keys.  This is a strict weak
+     * ordering, ties being broken on folder and filename.
+     */
+    bool less( uint32_t a, uint32_t b );
+
+    /**
+     * Sort the given rows, all of which must have keys.
+     */
+    void sort( std::vector<uint32_t> &rows );
+
+private:
+
+    /**
+     * Split a path into its folder and name, where the folder includes
+     * the trailing slash and the name includes the new/ or cur/ prefix.
+     */
+    static void split( const TStringRef &path, size_t *folder, size_t *base, size_t *unique );
+
+    /**
+     * Get the id of the folder which makes up the first len characters
+     * of the given path, or MESSAGE_NO_ROW if we've not seen it.
+     */
+    uint32_t folder_id( const TStringRef &path, size_t len );
+
+    /**
+     * As folder_id, but adding the folder if required.
+     */
+    uint32_t intern( const TStringRef &path, size_t len );
+
+    /**
+     * Store the path of the given row.
+     */
+    void set_path( uint32_t row, const TStringRef &path );
+
+    /**
+     * The hash we index the given folder and unique name by.
+     */
+    static uint64_t hash( uint32_t folder, const char *unique, size_t len );
+
+    /**
+     * Add the given row to our index, or remove it.
+     */
+    void index( uint32_t row );
+    void unindex( uint32_t row );
+
+    /**
+     * Resize the index to hold at least the given number of rows.
+     */
+    void reindex( size_t rows );
+
+    /**
+     * Rebuild the name arena, dropping the names of removed rows.
+     */
+    void compact();
+
+    /**
+     * The folders we've seen, and their ids.
+     */
+    std::vector<std::string> m_folders;
+    std::unordered_map<std::string, uint32_t> m_folder_ids;
+    uint32_t m_last_folder;
+
+    /**
+     * The names of all rows, end to end.
+     */
+    std::string m_names;
+
+    /**
+     * The number of bytes of m_names which belong to removed rows.
+     */
+    size_t m_garbage;
+
+    /**
+     * The columns: the folder id, the offset and length of the name, the
+     * offset of the basename within it, and the length of the unique
+     * part of the basename.
+     */
+    std::vector<uint32_t> m_folder;
+    std::vector<uint32_t> m_name;
+    std::vector<uint16_t> m_name_len;
+    std::vector<uint16_t> m_base;
+    std::vector<uint16_t> m_unique;
+
+    /**
+     * The flags, plus MESSAGE_IN_NEW and MESSAGE_LIVE.
+     */
+    std::vector<uint64_t> m_flags;
+
+    /**
+     * The version of each row, and the last we handed out.
+     */
+    std::vector<uint32_t> m_version;
+    uint32_t m_last_version;
+
+    /**
+     * The sort keys, and the order each was built for, or -1.
+     */
+    std::vector<int64_t> m_key_number;
+    std::vector<std::string> m_key_text;
+    std::vector<int8_t> m_key_order;
+
+    /**
+     * Rows free for reuse.
+     */
+    std::vector<uint32_t> m_free;
+
+    /**
+     * Rows indexed by hash( folder, unique name ), which is held for
+     * each row.  The index is open-addressed, with linear probing, so it
+     * is a single array rather than a node per message.
+     */
+    std::vector<uint64_t> m_hash;
+    std::vector<uint32_t> m_index;
+    size_t m_index_used;
+
+};
+
+#endif /* _messagetable_h_ */
@@ -0,0 +1,155 @@
+/**
+ * mimecache.cc - Bounded cache of parsed MIME entities.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include "mimecache.h"
+
+
+/**
+ * Instance-handle.
+ */
+CMimeCache *CMimeCache::pinstance = NULL;
+
+
+/**
+ * Get access to our singleton-object.
+ */
+CMimeCache *CMimeCache::Instance()
+{
+    if (!pinstance)
+        pinstance = new CMimeCache;
+
+    return pinstance;
+}
+
+
+/**
+ * Constructor - This is private as this class is a singleton.
+ */
+CMimeCache::CMimeCache()
+{
+    m_limit     = MIME_CACHE_DEFAULT_LIMIT;
+    m_resident  = 0;
+    m_evictions = 0;
+}
+
+
+/**
+ * Set the budget, in bytes.
+ */
+void CMimeCache::set_limit( size_t bytes )
+{
+    m_limit = bytes;
+    evict();
+}
+
+
+/**
+ * Get the parsed entity for the given message, marking it as recently
+ * used.
+ */
+std::shared_ptr<mimetic::MimeEntity> CMimeCache::get( const CMessage *owner )
+{
+    std::unordered_map<const CMessage *, std::list<TMimeEntry>::iterator>::iterator it =
+        m_index.find( owner );
+    if ( it == m_index.end() )
+        return( std::shared_ptr<mimetic::MimeEntity>() );
+
+    m_lru.splice( m_lru.begin(), m_lru, it->second );
+    return( it->second->entity );
+}
+
+
+/**
+ * Hold the parsed entity for the given message.
+ */
+void CMimeCache::insert( const CMessage *owner, std::shared_ptr<mimetic::MimeEntity> entity, size_t bytes )
+{
+    remove( owner );
+
+    TMimeEntry entry;
+    entry.owner  = owner;
+    entry.entity = entity;
+    entry.bytes  = bytes;
+
+    m_lru.push_front( entry );
+    m_index[owner] = m_lru.begin();
+    m_resident += bytes;
+
+    evict();
+}
+
+
+/**
+ * Forget the entity for the given message.
+ */
+void CMimeCache::remove( const CMessage *owner )
+{
+    std::unordered_map<const CMessage *, std::list<TMimeEntry>::iterator>::iterator it =
+        m_index.find( owner );
+    if ( it == m_index.end() )
+        return;
+
+    m_resident -= it->second->bytes;
+    m_lru.erase( it->second );
+    m_index.erase( it );
+}
+
+
+/**
+ * Free the least-recently used entities until we're within budget, but
+ * never the newest.
+ */
+void CMimeCache::evict()
+{
+    while( ( m_resident > m_limit ) && ( m_lru.size() > 1 ) )
+    {
+        TMimeEntry &oldest = m_lru.back();
+
+        m_resident -= oldest.bytes;
+        m_index.erase( oldest.owner );
+        m_lru.pop_back();
+        m_evictions += 1;
+    }
+}
+
+
+/**
+ * The number of bytes held.
+ */
+size_t CMimeCache::resident()
+{
+    return( m_resident );
+}
+
+
+/**
+ * The number of entities held.
+ */
+size_t CMimeCache::count()
+{
+    return( m_lru.size() );
+}
+
+
+/**
+ * The number of entities evicted to stay within the budget.
+ */
+size_t CMimeCache::evictions()
+{
+    return( m_evictions );
+}
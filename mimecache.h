@@ -0,0 +1,140 @@
+/**
+ * mimecache.h - Bounded cache of parsed MIME entities.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _mimecache_h_
+#define _mimecache_h_ 1
+
+#include <list>
+#include <memory>
+#include <stddef.h>
+#include <unordered_map>
+
+
+class CMessage;
+
+namespace mimetic
+{
+    class MimeEntity;
+}
+
+
+/**
+ * The default memory budget, in bytes.
+ */
+#define MIME_CACHE_DEFAULT_LIMIT ( 32 * 1024 * 1024 )
+
+
+/**
+ * A singleton holding the parsed MIME trees of recently viewed messages.
+ *
+ * Each entity is charged against a byte budget, and once that is exceeded
+ * the least-recently used are freed.  The compact header fields a message
+ * holds are unaffected, only the full parse is dropped, to be repeated if
+ * the body is wanted again.
+ *
+ * Entities are handed out as shared pointers, so one which is evicted
+ * while in use stays valid until the caller is finished with it.
+ */
+class CMimeCache
+{
+
+public:
+
+    /**
+     * Get access to the singleton instance.
+     */
+    static CMimeCache *Instance();
+
+    /**
+     * Set the budget, in bytes, evicting as required.
+     */
+    void set_limit( size_t bytes );
+
+    /**
+     * Get the parsed entity for the given message, if we hold it.
+     */
+    std::shared_ptr<mimetic::MimeEntity> get( const CMessage *owner );
+
+    /**
+     * Hold the parsed entity for the given message, which is roughly the
+     * given number of bytes.
+     *
+     * The newest entity is always kept, even if it alone is over budget.
+     */
+    void insert( const CMessage *owner, std::shared_ptr<mimetic::MimeEntity> entity, size_t bytes );
+
+    /**
+     * Forget the entity for the given message.
+     */
+    void remove( const CMessage *owner );
+
+    /**
+     * Statistics: the bytes held, the number of entities, and the number
+     * evicted to stay within the budget.
+     */
+    size_t resident();
+    size_t count();
+    size_t evictions();
+
+protected:
+
+    /**
+     * Protected functions to allow our singleton implementation.
+     */
+    CMimeCache();
+    CMimeCache(const CMimeCache &);
+    CMimeCache & operator=(const CMimeCache &);
+
+private:
+
+    /**
+     * Free the least-recently used entities until we're within budget.
+     */
+    void evict();
+
+    /**
+     * The single instance of this class.
+     */
+    static CMimeCache *pinstance;
+
+    /**
+     * A single cached entity.
+     */
+    struct TMimeEntry
+    {
+        const CMessage *owner;
+        std::shared_ptr<mimetic::MimeEntity> entity;
+        size_t bytes;
+    };
+
+    /**
+     * The entities, most-recently used first, and indexed by owner.
+     */
+    std::list<TMimeEntry> m_lru;
+    std::unordered_map<const CMessage *, std::list<TMimeEntry>::iterator> m_index;
+
+    /**
+     * The budget, and our usage.
+     */
+    size_t m_limit;
+    size_t m_resident;
+    size_t m_evictions;
+
+};
+
+#endif /* _mimecache_h_ */
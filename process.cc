@@ -0,0 +1,259 @@
+/**
+ * process.cc - Running commands in the background.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <utility>
+#include <vector>
+
+#include "debug.h"
+#include "eventloop.h"
+#include "process.h"
+
+
+extern char **environ;
+
+
+/**
+ * Instance-handle.
+ */
+CProcess *CProcess::pinstance = NULL;
+
+
+/**
+ * Get access to our singleton-object.
+ */
+CProcess *CProcess::Instance()
+{
+    if (!pinstance)
+        pinstance = new CProcess;
+
+    return pinstance;
+}
+
+
+/**
+ * Constructor - This is private as this class is a singleton.
+ */
+CProcess::CProcess()
+{
+    /**
+     * Reap our children in the loop, rather than in the handler.
+     */
+    CEventLoop::Instance()->on_signal( SIGCHLD, [this]() { reap(); } );
+}
+
+
+/**
+ * Run a command in the background.
+ */
+pid_t CProcess::spawn( const std::string &cmd, TOutputFunction on_output, TExitFunction on_exit )
+{
+    int fds[2];
+    if ( pipe2( fds, O_CLOEXEC ) != 0 )
+    {
+        DEBUG_LOG( std::string( "pipe2() failed: " ) + strerror( errno ) );
+        return -1;
+    }
+    fcntl( fds[0], F_SETFL, fcntl( fds[0], F_GETFL ) | O_NONBLOCK );
+
+    /**
+     * The child reads nothing, and writes everything to the pipe.
+     */
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init( &actions );
+    posix_spawn_file_actions_addopen( &actions, 0, "/dev/null", O_RDONLY, 0 );
+    posix_spawn_file_actions_adddup2( &actions, fds[1], 1 );
+    posix_spawn_file_actions_adddup2( &actions, fds[1], 2 );
+
+    /**
+     * Nor does it inherit our signal mask, or a broken pipe being ignored.
+     */
+    sigset_t none, defaults;
+    sigemptyset( &none );
+    sigemptyset( &defaults );
+    sigaddset( &defaults, SIGPIPE );
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init( &attr );
+    posix_spawnattr_setsigmask( &attr, &none );
+    posix_spawnattr_setsigdefault( &attr, &defaults );
+    posix_spawnattr_setflags( &attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF );
+
+    const char *argv[] = { "sh", "-c", cmd.c_str(), NULL };
+
+    pid_t pid;
+    int err = posix_spawn( &pid, "/bin/sh", &actions, &attr, (char *const *)argv, environ );
+
+    posix_spawn_file_actions_destroy( &actions );
+    posix_spawnattr_destroy( &attr );
+    close( fds[1] );
+
+    if ( err != 0 )
+    {
+        DEBUG_LOG( std::string( "posix_spawn() failed: " ) + strerror( err ) );
+        close( fds[0] );
+        return -1;
+    }
+
+    TChild child;
+    child.fd        = fds[0];
+    child.on_output = on_output;
+    child.on_exit   = on_exit;
+    m_children[pid] = child;
+
+    CEventLoop::Instance()->watch( fds[0], [this, pid]()
+    {
+        std::unordered_map<pid_t, TChild>::iterator it = m_children.find( pid );
+        if ( it == m_children.end() )
+            return;
+
+        TChild &child = it->second;
+        if ( ! read_output( child, false ) )
+        {
+            CEventLoop::Instance()->unwatch( child.fd );
+            close( child.fd );
+            child.fd = -1;
+
+            /**
+             * The command has probably finished too, and if we missed
+             * the signal we'd never notice.
+             */
+            reap();
+        }
+    } );
+
+    return( pid );
+}
+
+
+/**
+ * Read what a child has written.
+ */
+bool CProcess::read_output( TChild &child, bool finished )
+{
+    char buf[4096];
+    bool eof = false;
+
+    while( true )
+    {
+        ssize_t len = read( child.fd, buf, sizeof(buf) );
+        if ( len > 0 )
+        {
+            child.partial.append( buf, len );
+            continue;
+        }
+        if ( len < 0 && errno == EINTR )
+            continue;
+
+        eof = ( len == 0 );
+        break;
+    }
+
+    /**
+     * Hand on each complete line, and whatever is left once we'll read
+     * no more.
+     */
+    std::string::size_type start = 0;
+    std::string::size_type nl;
+    std::vector<std::string> lines;
+
+    while( ( nl = child.partial.find( '\n', start ) ) != std::string::npos )
+    {
+        lines.push_back( child.partial.substr( start, nl - start ) );
+        start = nl + 1;
+    }
+    child.partial.erase( 0, start );
+
+    if ( ( eof || finished ) && ! child.partial.empty() )
+    {
+        lines.push_back( child.partial );
+        child.partial.clear();
+    }
+
+    if ( child.on_output )
+    {
+        TOutputFunction fn = child.on_output;
+        std::vector<std::string>::iterator it;
+        for (it = lines.begin(); it != lines.end(); ++it)
+            fn( *it );
+    }
+
+    return( ! eof );
+}
+
+
+/**
+ * Reap the children which have exited.
+ */
+void CProcess::reap()
+{
+    /**
+     * Find them all first, as their functions may start more.
+     */
+    std::vector<std::pair<pid_t, int> > exited;
+
+    std::unordered_map<pid_t, TChild>::iterator it;
+    for (it = m_children.begin(); it != m_children.end(); ++it)
+    {
+        int status;
+        if ( waitpid( it->first, &status, WNOHANG ) == it->first )
+            exited.push_back( std::make_pair( it->first, status ) );
+    }
+
+    std::vector<std::pair<TExitFunction, int> > done;
+
+    std::vector<std::pair<pid_t, int> >::iterator eit;
+    for (eit = exited.begin(); eit != exited.end(); ++eit)
+    {
+        it = m_children.find( eit->first );
+
+        /**
+         * Anything still in the pipe was written before it exited.
+         */
+        TChild &child = it->second;
+        if ( child.fd >= 0 )
+        {
+            read_output( child, true );
+            CEventLoop::Instance()->unwatch( child.fd );
+            close( child.fd );
+        }
+
+        int status = eit->second;
+        int code   = -1;
+        if ( WIFEXITED( status ) )
+            code = WEXITSTATUS( status );
+        else if ( WIFSIGNALED( status ) )
+            code = 128 + WTERMSIG( status );
+
+        done.push_back( std::make_pair( child.on_exit, code ) );
+        m_children.erase( it );
+    }
+
+    std::vector<std::pair<TExitFunction, int> >::iterator dit;
+    for (dit = done.begin(); dit != done.end(); ++dit)
+    {
+        if ( dit->first )
+            dit->first( dit->second );
+    }
+}
@@ -0,0 +1,115 @@
+/**
+ * process.h - Running commands in the background.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _process_h_
+#define _process_h_ 1
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <sys/types.h>
+
+
+/**
+ * A singleton which runs shell commands in the background.
+ *
+ * Each command is started with posix_spawn(), reading from /dev/null and
+ * writing both its output and its errors to a non-blocking pipe, so that
+ * it can neither wait for the keyboard nor scribble over the screen.
+ *
+ * The pipe is watched by the event loop, and its output handed on a line
+ * at a time.  SIGCHLD tells us when a command has finished.
+ */
+class CProcess
+{
+
+public:
+
+    /**
+     * Get access to the singleton instance.
+     */
+    static CProcess *Instance();
+
+    /**
+     * The function called with each line of output, without its newline.
+     */
+    typedef std::function<void(const std::string &)> TOutputFunction;
+
+    /**
+     * The function called when a command has finished, with its exit
+     * status, or 128 plus the number of the signal which killed it.
+     */
+    typedef std::function<void(int)> TExitFunction;
+
+    /**
+     * Run the given command with /bin/sh.  Returns the process ID, or -1
+     * if the command couldn't be started.
+     */
+    pid_t spawn( const std::string &cmd, TOutputFunction on_output, TExitFunction on_exit );
+
+    /**
+     * The number of commands still running.
+     */
+    size_t running() { return( m_children.size() ); }
+
+protected:
+
+    /**
+     * Protected functions to allow our singleton implementation.
+     */
+    CProcess();
+    CProcess(const CProcess &);
+    CProcess & operator=(const CProcess &);
+
+private:
+
+    /**
+     * The single instance of this class.
+     */
+    static CProcess *pinstance;
+
+    /**
+     * A command which is running.
+     */
+    struct TChild
+    {
+        int fd;
+        std::string partial;
+        TOutputFunction on_output;
+        TExitFunction on_exit;
+    };
+
+    /**
+     * Read what the given child has written, passing on complete lines,
+     * and everything if it has finished.  Returns false at end-of-file.
+     */
+    bool read_output( TChild &child, bool finished );
+
+    /**
+     * Reap any children which have exited, and call their functions.
+     */
+    void reap();
+
+    /**
+     * Children, by process ID.
+     */
+    std::unordered_map<pid_t, TChild> m_children;
+
+};
+
+#endif /* _process_h_ */
@@ -0,0 +1,546 @@
+/**
+ * query.cc - Queries limiting the messages shown in the index.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unordered_map>
+
+#include "flags.h"
+#include "query.h"
+
+
+/**
+ * The prefix which marks a limit as a query.
+ */
+#define QUERY_PREFIX "query:"
+
+
+/**
+ * The most compiled queries we keep.
+ */
+#define QUERY_CACHE_MAX 32
+
+
+/**
+ * The cache of compiled queries.
+ */
+static std::unordered_map<std::string, CQuery *> query_cache;
+
+
+/**
+ * The named fields a term may use.
+ */
+static const char *field_names[] = {
+    "from", "to", "subject", "flag", "after", "before", "size",
+};
+
+
+/**
+ * The named field the given token uses, or -1.  The value follows the
+ * ':' at offset *colon.
+ */
+static int field_named( const std::string &text, size_t *colon )
+{
+    size_t start = ( ! text.empty() && text[0] == '-' ) ? 1 : 0;
+    size_t end = text.find( ':', start );
+    if ( end == std::string::npos )
+        return( -1 );
+
+    for( size_t i = 0; i < sizeof(field_names) / sizeof(field_names[0]); i++ )
+    {
+        if ( ( strlen( field_names[i] ) == end - start ) &&
+             ( strncasecmp( text.c_str() + start, field_names[i], end - start ) == 0 ) )
+        {
+            *colon = end;
+            return( i );
+        }
+    }
+    return( -1 );
+}
+
+
+/**
+ * Parse a day, as YYYY-MM-DD, into the local midnight which starts it, or
+ * with an offset, the one which starts a later day.
+ */
+static bool parse_day( const std::string &value, int64_t *epoch, int offset = 0 )
+{
+    struct tm tm;
+    memset( &tm, 0, sizeof(tm) );
+
+    const char *end = strptime( value.c_str(), "%Y-%m-%d", &tm );
+    if ( end == NULL || *end != '\0' )
+        return false;
+
+    tm.tm_mday += offset;
+    tm.tm_isdst = -1;
+    *epoch = (int64_t)mktime( &tm );
+    return true;
+}
+
+
+/**
+ * Parse a size, such as "10K" or "1M", in bytes.
+ */
+static bool parse_size( const char *value, int64_t *size )
+{
+    char *end;
+    long long n = strtoll( value, &end, 10 );
+    if ( end == value || n < 0 )
+        return false;
+
+    switch( toupper( *end ) ) {
+    case 'K': n *= 1024;               end++; break;
+    case 'M': n *= 1024 * 1024;        end++; break;
+    case 'G': n *= 1024 * 1024 * 1024; end++; break;
+    }
+    if ( toupper( *end ) == 'B' )
+        end++;
+
+    *size = n;
+    return( *end == '\0' );
+}
+
+
+/**
+ * Compile the given query.
+ */
+CQuery::CQuery( const std::string &query )
+{
+    m_pos    = 0;
+    m_root   = -1;
+
+    tokenize( query );
+
+    if ( m_tokens.empty() )
+    {
+        m_error = "empty query";
+        return;
+    }
+
+    m_root = parse_or();
+    if ( m_root >= 0 && m_pos < m_tokens.size() )
+    {
+        m_error = "unexpected ')'";
+        m_root  = -1;
+    }
+}
+
+
+/**
+ * Split the query into tokens.
+ *
+ * Tokens are separated by whitespace, and parentheses are tokens of
+ * their own.  Double-quotes may surround a whole token, or the value of
+ * a field, and hide any spaces, or parentheses, within.
+ */
+void CQuery::tokenize( const std::string &query )
+{
+    size_t i = 0;
+    size_t len = query.size();
+
+    while( i < len )
+    {
+        char c = query[i];
+        if ( isspace( (unsigned char)c ) )
+        {
+            i++;
+            continue;
+        }
+
+        TQueryToken token;
+        token.quoted = ( c == '"' );
+
+        if ( c == '(' || c == ')' )
+        {
+            token.text = c;
+            m_tokens.push_back( token );
+            i++;
+            continue;
+        }
+
+        while( i < len && ! isspace( (unsigned char)query[i] ) &&
+               query[i] != '(' && query[i] != ')' )
+        {
+            if ( query[i] == '"' )
+            {
+                size_t end = query.find( '"', i + 1 );
+                if ( end == std::string::npos )
+                    end = len;
+
+                token.text.append( query, i + 1, end - i - 1 );
+                i = ( end < len ) ? end + 1 : len;
+            }
+            else
+                token.text += query[i++];
+        }
+
+        m_tokens.push_back( token );
+    }
+}
+
+
+/**
+ * Is the current token the given keyword?
+ */
+bool CQuery::keyword( const char *word )
+{
+    if ( m_pos >= m_tokens.size() || m_tokens[m_pos].quoted )
+        return false;
+
+    return( strcasecmp( m_tokens[m_pos].text.c_str(), word ) == 0 );
+}
+
+
+/**
+ * Add a node, returning its index.
+ */
+int CQuery::node( TQueryOp op, int left, int right )
+{
+    TQueryNode n;
+    n.op     = op;
+    n.field  = QUERY_LINE;
+    n.number = 0;
+    n.left   = left;
+    n.right  = right;
+
+    m_nodes.push_back( n );
+    return( m_nodes.size() - 1 );
+}
+
+
+/**
+ * Parse terms separated by "or".
+ */
+int CQuery::parse_or()
+{
+    int left = parse_and();
+
+    while( left >= 0 && keyword( "or" ) )
+    {
+        m_pos++;
+
+        int right = parse_and();
+        if ( right < 0 )
+            return -1;
+
+        left = node( OP_OR, left, right );
+    }
+    return( left );
+}
+
+
+/**
+ * Parse terms separated by "and", or nothing at all.
+ */
+int CQuery::parse_and()
+{
+    int left = parse_unary();
+
+    while( left >= 0 && m_pos < m_tokens.size() && ! keyword( "or" ) && ! keyword( ")" ) )
+    {
+        if ( keyword( "and" ) )
+            m_pos++;
+
+        int right = parse_unary();
+        if ( right < 0 )
+            return -1;
+
+        left = node( OP_AND, left, right );
+    }
+    return( left );
+}
+
+
+/**
+ * Parse a negated term, a group, or a term.
+ */
+int CQuery::parse_unary()
+{
+    if ( m_pos >= m_tokens.size() )
+    {
+        m_error = "incomplete query";
+        return -1;
+    }
+
+    if ( keyword( "not" ) )
+    {
+        m_pos++;
+
+        int child = parse_unary();
+        return( child < 0 ? -1 : node( OP_NOT, child ) );
+    }
+
+    if ( keyword( "(" ) )
+    {
+        m_pos++;
+
+        int group = parse_or();
+        if ( group < 0 )
+            return -1;
+
+        if ( ! keyword( ")" ) )
+        {
+            m_error = "missing ')'";
+            return -1;
+        }
+        m_pos++;
+        return( group );
+    }
+
+    if ( keyword( ")" ) )
+    {
+        m_error = "unexpected ')'";
+        return -1;
+    }
+
+    TQueryToken &token = m_tokens[m_pos];
+    if ( ! token.quoted && token.text.size() > 1 && token.text[0] == '-' )
+    {
+        token.text.erase( 0, 1 );
+
+        int child = parse_term();
+        return( child < 0 ? -1 : node( OP_NOT, child ) );
+    }
+
+    return( parse_term() );
+}
+
+
+/**
+ * Parse a single term.
+ */
+int CQuery::parse_term()
+{
+    TQueryToken &token = m_tokens[m_pos++];
+
+    size_t colon;
+    int field = token.quoted ? -1 : field_named( token.text, &colon );
+
+    if ( field < 0 )
+    {
+        int n = node( OP_CONTAINS );
+        m_nodes[n].text = token.text;
+        return( n );
+    }
+
+    std::string name  = field_names[field];
+    std::string value = token.text.substr( colon + 1 );
+
+    if ( value.empty() )
+    {
+        m_error = "missing value for " + name + ":";
+        return -1;
+    }
+
+    if ( name == "from" || name == "to" || name == "subject" )
+    {
+        int n = node( OP_CONTAINS );
+        m_nodes[n].field = ( name == "from" ) ? QUERY_FROM : ( name == "to" ) ? QUERY_TO : QUERY_SUBJECT;
+        m_nodes[n].text  = value;
+        return( n );
+    }
+
+    /**
+     * Each letter matches the flag in either case, and all must match.
+     */
+    if ( name == "flag" )
+    {
+        int all = -1;
+        for( size_t i = 0; i < value.size(); i++ )
+        {
+            unsigned char c = value[i];
+            if ( CFlags::bit( c ) == 0 )
+            {
+                m_error = "unknown flag '" + value.substr( i, 1 ) + "'";
+                return -1;
+            }
+
+            int n = node( OP_FLAGS );
+            m_nodes[n].field  = QUERY_FLAGS;
+            m_nodes[n].number = (int64_t)( CFlags::bit( toupper( c ) ) | CFlags::bit( tolower( c ) ) );
+            all = ( all < 0 ) ? n : node( OP_AND, all, n );
+        }
+        return( all );
+    }
+
+    if ( name == "after" || name == "before" )
+    {
+        /**
+         * Both are exclusive: after a day is from the midnight ending it.
+         */
+        int64_t epoch;
+        if ( ! parse_day( value, &epoch, ( name == "after" ) ? 1 : 0 ) )
+        {
+            m_error = "YYYY-MM-DD expected for " + name + ":";
+            return -1;
+        }
+
+        int n = node( ( name == "after" ) ? OP_AT_LEAST : OP_LESS );
+        m_nodes[n].field  = QUERY_DATE;
+        m_nodes[n].number = epoch;
+        return( n );
+    }
+
+    /**
+     * size:>N, size:<N, size:N, and the forms with '='.
+     */
+    TQueryOp op = OP_AT_LEAST;
+    const char *p = value.c_str();
+    bool inclusive = false;
+
+    if ( *p == '>' || *p == '<' )
+    {
+        op = ( *p == '>' ) ? OP_MORE : OP_LESS;
+        inclusive = ( p[1] == '=' );
+        p += inclusive ? 2 : 1;
+    }
+
+    int64_t size;
+    if ( ! parse_size( p, &size ) )
+    {
+        m_error = "size expected for size:, such as 100K or >1M";
+        return -1;
+    }
+
+    if ( inclusive )
+    {
+        if ( op == OP_MORE )
+            op = OP_AT_LEAST;
+        else
+            size += 1;
+    }
+
+    int n = node( op );
+    m_nodes[n].field  = QUERY_SIZE;
+    m_nodes[n].number = size;
+    return( n );
+}
+
+
+/**
+ * Does any term look at the given field?
+ */
+bool CQuery::needs( TQueryField field )
+{
+    std::vector<TQueryNode>::iterator it;
+    for (it = m_nodes.begin(); it != m_nodes.end(); ++it)
+    {
+        if ( it->op != OP_AND && it->op != OP_OR && it->op != OP_NOT && it->field == field )
+            return true;
+    }
+    return false;
+}
+
+
+/**
+ * Does the message with the given values match?
+ */
+bool CQuery::matches( const TTextFunction &text, const TNumberFunction &number )
+{
+    if ( m_root < 0 )
+        return false;
+
+    return( eval( m_root, text, number ) );
+}
+
+
+/**
+ * Evaluate the given node.
+ *
+ * Header fields are matched ignoring case, but the index line is matched
+ * exactly, as a plain substring limit always has been.
+ */
+bool CQuery::eval( int node, const TTextFunction &text, const TNumberFunction &number )
+{
+    const TQueryNode &n = m_nodes[node];
+
+    switch( n.op ) {
+    case OP_AND:
+        return( eval( n.left, text, number ) && eval( n.right, text, number ) );
+    case OP_OR:
+        return( eval( n.left, text, number ) || eval( n.right, text, number ) );
+    case OP_NOT:
+        return( ! eval( n.left, text, number ) );
+    case OP_CONTAINS:
+    {
+        const std::string &value = text( n.field );
+        if ( n.field == QUERY_LINE )
+            return( strstr( value.c_str(), n.text.c_str() ) != NULL );
+        return( strcasestr( value.c_str(), n.text.c_str() ) != NULL );
+    }
+    case OP_FLAGS:
+        return( ( (uint64_t)number( QUERY_FLAGS ) & (uint64_t)n.number ) != 0 );
+    case OP_AT_LEAST:
+        return( number( n.field ) >= n.number );
+    case OP_LESS:
+        return( number( n.field ) < n.number );
+    case OP_MORE:
+        return( number( n.field ) > n.number );
+    }
+    return false;
+}
+
+
+/**
+ * Get the compiled version of the given limit.
+ */
+CQuery *CQuery::compiled( const std::string &limit )
+{
+    if ( limit.compare( 0, strlen( QUERY_PREFIX ), QUERY_PREFIX ) != 0 )
+        return NULL;
+
+    std::unordered_map<std::string, CQuery *>::iterator it = query_cache.find( limit );
+    if ( it != query_cache.end() )
+        return( it->second );
+
+    /**
+     * Every distinct limit typed would otherwise be kept forever.
+     */
+    if ( query_cache.size() >= QUERY_CACHE_MAX )
+        clear_cache();
+
+    CQuery *q = new CQuery( limit.substr( strlen( QUERY_PREFIX ) ) );
+    query_cache[limit] = q;
+    return( q );
+}
+
+
+/**
+ * Forget all compiled queries.
+ */
+void CQuery::clear_cache()
+{
+    std::unordered_map<std::string, CQuery *>::iterator it;
+    for (it = query_cache.begin(); it != query_cache.end(); ++it)
+        delete( it->second );
+
+    query_cache.clear();
+}
+
+
+/**
+ * The number of compiled queries we hold.
+ */
+size_t CQuery::cached()
+{
+    return( query_cache.size() );
+}
@@ -0,0 +1,206 @@
+/**
+ * query.h - Queries limiting the messages shown in the index.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _query_h_
+#define _query_h_ 1
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+/**
+ * The values of a message a query may look at.  The first four are
+ * text, the rest numbers.
+ */
+enum TQueryField
+{
+    QUERY_FROM,
+    QUERY_TO,
+    QUERY_SUBJECT,
+    QUERY_LINE,
+    QUERY_FLAGS,
+    QUERY_DATE,
+    QUERY_SIZE
+};
+
+
+/**
+ * A query, compiled into a tree of predicates.
+ *
+ * A query is a list of terms, all of which must match:
+ *
+ *   from:TEXT, to:TEXT, subject:TEXT   The header contains TEXT, ignoring case.
+ *   flag:LETTERS                       The message has every one of the flags,
+ *                                      ignoring case, where 'N' is a new
+ *                                      message.
+ *   after:YYYY-MM-DD                   Sent after the given day.
+ *   before:YYYY-MM-DD                  Sent before the given day.
+ *   size:>N, size:<N, size:N           Larger than, smaller than, or at least
+ *                                      N bytes, with an optional K, M or G.
+ *   TEXT                               The formatted index line contains TEXT.
+ *
+ * Values containing spaces are quoted: subject:"build failed".  Terms may
+ * be combined with "and", "or", and "not", or a leading '-', and grouped
+ * with parentheses.  "and" binds more tightly than "or".
+ *
+ * Only a limit beginning "query:" is a query: anything else is matched as
+ * a plain substring, as it always has been, even if it happens to contain
+ * a word such as "subject:".
+ */
+class CQuery
+{
+
+public:
+
+    /**
+     * Called to get the value of a text, or a numeric, field.  They are
+     * only called for the fields a term needs, as it is evaluated.
+     */
+    typedef std::function<const std::string &( TQueryField field )> TTextFunction;
+    typedef std::function<int64_t( TQueryField field )> TNumberFunction;
+
+    /**
+     * Compile the given query.
+     */
+    CQuery( const std::string &query );
+
+    /**
+     * Is the query valid?  If not this is the reason.
+     */
+    const std::string &error() { return( m_error ); }
+
+    /**
+     * Does any term look at the given field?
+     */
+    bool needs( TQueryField field );
+
+    /**
+     * Does the message with the given values match?
+     */
+    bool matches( const TTextFunction &text, const TNumberFunction &number );
+
+    /**
+     * Get the compiled version of the given limit, compiling it the first
+     * time it is seen, or NULL if it isn't a query.
+     *
+     * Only a few are kept, so the result is only valid until the next
+     * call.
+     */
+    static CQuery *compiled( const std::string &limit );
+
+    /**
+     * Forget all compiled queries.
+     */
+    static void clear_cache();
+
+    /**
+     * The number of compiled queries we hold.
+     */
+    static size_t cached();
+
+private:
+
+    /**
+     * The kinds of node in the tree.
+     */
+    enum TQueryOp
+    {
+        OP_AND,
+        OP_OR,
+        OP_NOT,
+        OP_CONTAINS,
+        OP_FLAGS,
+        OP_AT_LEAST,
+        OP_LESS,
+        OP_MORE
+    };
+
+    /**
+     * A node: an operator, with the index of its children, or a term
+     * comparing a field with a value.
+     */
+    struct TQueryNode
+    {
+        TQueryOp op;
+        TQueryField field;
+        std::string text;
+        int64_t number;
+        int left;
+        int right;
+    };
+
+    /**
+     * A token of the query, and whether it was quoted.
+     */
+    struct TQueryToken
+    {
+        std::string text;
+        bool quoted;
+    };
+
+    /**
+     * Split the query into tokens.
+     */
+    void tokenize( const std::string &query );
+
+    /**
+     * Parse the tokens from m_pos, by precedence, returning the index of
+     * the node built, or -1 on error.
+     */
+    int parse_or();
+    int parse_and();
+    int parse_unary();
+    int parse_term();
+
+    /**
+     * Is the current token the given keyword?
+     */
+    bool keyword( const char *word );
+
+    /**
+     * Add a node, returning its index.
+     */
+    int node( TQueryOp op, int left = -1, int right = -1 );
+
+    /**
+     * Evaluate the given node.
+     */
+    bool eval( int node, const TTextFunction &text, const TNumberFunction &number );
+
+    /**
+     * The tokens, and the one being parsed.
+     */
+    std::vector<TQueryToken> m_tokens;
+    size_t m_pos;
+
+    /**
+     * The tree, and its root.
+     */
+    std::vector<TQueryNode> m_nodes;
+    int m_root;
+
+    /**
+     * Why the query is invalid, or "".
+     */
+    std::string m_error;
+
+};
+
+#endif /* _query_h_ */
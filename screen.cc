@@ -17,6 +17,7 @@
  */
 
 #include <algorithm>
+#include <clocale>
 #include <cstdlib>
 #include <iostream>
 #include <algorithm>
@@ -25,18 +26,36 @@
 #include <cctype>
 #include <sys/ioctl.h>
 #include <ncurses.h>
+#include "eventloop.h"
 #include "lang.h"
 #include "lua.h"
 #include "global.h"
+#include "headerpool.h"
 #include "history.h"
 #include "message.h"
 #include "screen.h"
+#include "virtualfolders.h"
+
+/**
+ * Nothing has been drawn yet, and the size hasn't been read.
+ */
+bool CScreen::m_invalid = true;
+int CScreen::m_width  = 0;
+int CScreen::m_height = 0;
+volatile sig_atomic_t CScreen::m_resized = 1;
+
 
 /**
  * Constructor.  NOP.
  */
 CScreen::CScreen()
 {
+    m_pending = false;
+    m_message = NULL;
+    m_state.version = 0;
+    m_state.folders = 0;
+    m_state.width   = 0;
+    m_state.height  = 0;
 }
 
 /**
@@ -48,6 +67,10 @@ CScreen::~CScreen()
 
 /**
  * This function will draw the appropriate screen, depending upon our current mode.
+ *
+ * We keep the rows we last drew, and the state they were drawn from.  If
+ * nothing has changed since then we return at once, and otherwise only
+ * the rows whose text or attributes differ are written to the terminal.
  */
 void CScreen::refresh_display()
 {
@@ -57,6 +80,38 @@ void CScreen::refresh_display()
     CGlobal *global = CGlobal::Instance();
     std::string * s = global->get_variable("global_mode");
 
+    /**
+     * A resize makes us start again from scratch.
+     */
+    CScreen::update_geometry();
+
+    TScreenState state;
+    state.mode    = *s;
+    state.version = global->version();
+    state.folders = CVirtualFolders::Instance()->version();
+    state.width   = CScreen::width();
+    state.height  = CScreen::height();
+
+    if ( ! m_invalid && ! m_pending &&
+         state.mode    == m_state.mode &&
+         state.version == m_state.version &&
+         state.folders == m_state.folders &&
+         state.width   == m_state.width &&
+         state.height  == m_state.height )
+        return;
+
+    /**
+     * If the screen was drawn over then every row must be drawn again.
+     * The frame does the same for itself if the size has changed.
+     */
+    if ( m_invalid )
+    {
+        m_frame.clear();
+        m_invalid = false;
+    }
+    m_frame.begin( state.width, state.height );
+    m_pending = false;
+
     if (strcmp(s->c_str(), "maildir") == 0)
 	drawMaildir();
     else if (strcmp(s->c_str(), "index") == 0)
@@ -64,13 +119,52 @@ void CScreen::refresh_display()
     else if (strcmp(s->c_str(), "message") == 0)
 	drawMessage();
     else {
+        std::string unknown = "UNKNOWN MODE: '" + *s + "'";
+        for( int row = 0; row < m_frame.rows(); row++ )
+            draw_row( row, 3, ( row == 3 ) ? unknown : "", COLOR_PAIR(2) );
+    }
+
+    m_frame.end();
+
+    /**
+     * Drawing may have bounded the selection, so take the version after.
+     */
+    state.version = global->version();
+    m_state = state;
+
+    if ( state.mode != "message" )
+        m_message = NULL;
+
+    /**
+     * We've started reading a message so call our hook.  Anything it
+     * changes is drawn next time.
+     */
+    if ( ! m_read.empty() )
+    {
+        std::string path = m_read;
+        m_read = "";
+
         CLua *lua = CLua::Instance();
-        lua->execute( "clear();" );
-        move(3, 3);
-        printw("UNKNOWN MODE: '%s'", s->c_str());
+        lua->call_function( "on_read_message", path );
     }
 }
 
+/**
+ * Forget what is on the screen.
+ */
+void CScreen::invalidate()
+{
+    m_invalid = true;
+}
+
+/**
+ * Draw a single row, if it has changed.
+ */
+void CScreen::draw_row( int row, int col, const std::string &text, int attr, int columns )
+{
+    m_frame.draw_row( row, col, text, attr, columns );
+}
+
 /**
  * Draw a list of folders.
  */
@@ -95,8 +189,9 @@ void CScreen::drawMaildir()
      */
     if ( count < 1 )
     {
-        move(2, 2);
-        printw("No maildirs found matching the limit '%s'.", limit->c_str());
+        std::string none = "No maildirs found matching the limit '" + *limit + "'.";
+        for( int row = 0; row < (height - 1); row++ )
+            draw_row( row, 2, ( row == 2 ) ? none : "", COLOR_PAIR(2) );
         return;
     }
 
@@ -116,6 +211,8 @@ void CScreen::drawMaildir()
      */
     std::vector < std::string > sfolders = global->get_selected_folders();
 
+    int width = CScreen::width();
+
     for (row = 0; row < (height - 1); row++) {
         /**
          * What we'll output for this row.
@@ -139,41 +236,30 @@ void CScreen::drawMaildir()
 		found = "[x]";
 	}
 
-        /**
-         * First row is the current one.
-         */
-	if (row == 0)
-          attron(A_STANDOUT);
-
-	std::string path = "";
-
 	if (cur != NULL) {
             std::ostringstream fmt;
             fmt << found << " - " << cur->path();
-            buf = fmt.str();
-        }
-
-	while ((int)buf.size() < (CScreen::width() - 3))
-            buf += std::string(" ");
-
-	move(row, 2);
 
-        if ( unread )
-        {
-            if ( row == 0 )
-                attrset( COLOR_PAIR(1) |A_REVERSE );
-            else
-                attrset( COLOR_PAIR(1) );
+            /**
+             * A virtual folder shows how many messages it holds, as it
+             * has no directory to look at.
+             */
+            if ( CVirtualFolders::is_virtual( cur->path() ) )
+                fmt << " (" << ( cur->availableMessages() + unread ) << " messages, "
+                    << unread << " new)";
+            buf = fmt.str();
         }
-	printw("%s", buf.c_str());
-
-        attrset( COLOR_PAIR(2) );
 
         /**
-         * Remove the inverse.
+         * First row is the current one, and those with new mail stand out.
          */
-	if (row == 0)
-	    attroff(A_STANDOUT);
+        int attr = COLOR_PAIR(2);
+        if ( unread )
+            attr = COLOR_PAIR(1);
+        if ( row == 0 )
+            attr |= unread ? A_REVERSE : A_STANDOUT;
+
+        draw_row( row, 2, buf, attr, std::max( width - 3, 0 ) );
     }
 }
 
@@ -187,6 +273,7 @@ void CScreen::drawIndex()
      */
     CGlobal *global = CGlobal::Instance();
     std::vector<CMessage*> *messages = global->get_messages();
+    int height = CScreen::height();
 
     /**
      * If we have no messages report that.
@@ -195,43 +282,18 @@ void CScreen::drawIndex()
     {
         std::vector<std::string> folders = global->get_selected_folders();
 
-        if ( folders.size() < 1 )
+        for( int row = 0; row < (height - 1); row++ )
         {
             /**
-             * No folders selected, and no messages.
+             * No folders selected, and no messages.  Otherwise show the
+             * selected folders.
              */
-            clear();
-            move(2,2);
-            printw( NO_MESSAGES_NO_FOLDERS );
-            return;
-        }
-
-        /**
-         * Show the selected folders.
-         */
-        clear();
-        move(2, 2);
-        printw( NO_MESSAGES_IN_FOLDERS );
-
-        std::vector<std::string>::iterator it;
-        int height = CScreen::height();
-        int row = 4;
-
-        for (it = folders.begin(); it != folders.end(); ++it) {
-
-            /**
-             * Avoid drawing into the status area.
-             */
-            if ( row >= (height-1) )
-                break;
-
-            /**
-             * Show the name of the folder.
-             */
-            std::string name = (*it);
-            move( row, 5 );
-            printw("%s", name.c_str() );
-            row+=1;
+            if ( row == 2 )
+                draw_row( row, 2, folders.empty() ? NO_MESSAGES_NO_FOLDERS : NO_MESSAGES_IN_FOLDERS, COLOR_PAIR(2) );
+            else if ( row >= 4 && ( row - 4 ) < (int)folders.size() )
+                draw_row( row, 5, folders[row - 4], COLOR_PAIR(2) );
+            else
+                draw_row( row, 0, "", COLOR_PAIR(2) );
         }
         return;
     }
@@ -241,7 +303,6 @@ void CScreen::drawIndex()
      * The number of items we've found, vs. the size of the screen.
      */
     int count = messages->size();
-    int height = CScreen::height();
     int selected = global->get_selected_message();
 
     /*
@@ -252,18 +313,35 @@ void CScreen::drawIndex()
         global->set_selected_message(selected);
     }
 
+    /**
+     * Only the rows we're about to draw have their headers parsed.  Ask
+     * for those just off the screen to be read ahead, so that scrolling
+     * doesn't wait on the disk.
+     */
+    int first = std::max( 0, selected - INDEX_PREFETCH_ROWS );
+    int last  = std::min( count, selected + ( height - 1 ) + INDEX_PREFETCH_ROWS );
+    for( int i = first; i < last; i++ )
+    {
+        if ( i < selected || i >= selected + ( height - 1 ) )
+            messages->at(i)->prefetch();
+    }
+
     /**
      * OK so we have (at least one) selected maildir and we have messages.
      */
     int row = 0;
 
+    /**
+     * What we'll output for each row, reused to avoid allocations.
+     */
+    int width = CScreen::width() - 3;
+    std::string &buf = m_line;
+
+    CHeaderPool *pool = CHeaderPool::Instance();
+
     for (row = 0; row < (height - 1); row++)
     {
-
-        /**
-         * What we'll output for this row.
-         */
-	std::string  buf;
+        buf.clear();
 
         /**
          * The current object.
@@ -273,49 +351,39 @@ void CScreen::drawIndex()
             cur = messages->at(row + selected);
 
         bool unread = false;
-        if ( cur != NULL ) {
-            std::string flags = cur->flags();
-            if ( flags.find( "N" ) != std::string::npos )
-                unread = true;
-        }
-
-	if ( unread ) {
-            if (row == 0)
-                attrset(COLOR_PAIR(1)|A_REVERSE);
-            else
-                attrset(COLOR_PAIR(1));
-        }
-        else {
-            if (row == 0)
-                attrset(A_REVERSE);
-        }
-
-	std::string path = "";
-
-	if (cur != NULL)
-            buf =  cur->format();
+        if ( cur != NULL )
+            unread = cur->is_new();
 
         /**
-         * Pad.
+         * The first row is the current one, and new mail stands out.
          */
-	while ((int)buf.size() < (CScreen::width() - 3))
-            buf += std::string(" ");
+        int attr = unread ? COLOR_PAIR(1) : COLOR_PAIR(2);
+        if ( row == 0 )
+            attr = unread ? ( COLOR_PAIR(1) | A_REVERSE ) : A_REVERSE;
+
         /**
-         * Truncate.
+         * If the headers are still being parsed in the background then
+         * show a placeholder, and ask for this row to be done next.  The
+         * row will change by itself, so look again next time.
          */
-	if ((int)buf.size() > (CScreen::width() - 3))
-	    buf[(CScreen::width() - 3)] = '\0';
-
-	move(row, 2);
-	printw("%s", buf.c_str());
-
-        attrset( COLOR_PAIR(2) );
+	if (cur != NULL)
+        {
+            buf += global->get_thread_glyphs( row + selected );
+
+            if ( pool->threads() > 0 && ! cur->headers_ready() )
+            {
+                cur->queue_headers( true );
+                cur->format_pending( buf );
+                m_pending = true;
+            }
+            else
+                cur->format( buf, "" );
+        }
 
         /**
-         * Remove the inverse.
+         * Padded, or truncated, as it is drawn.
          */
-	if (row == 0)
-	    attroff(A_REVERSE);
+        draw_row( row, 2, buf, attr, std::max( width, 0 ) );
     }
 }
 
@@ -331,6 +399,7 @@ void CScreen::drawMessage()
      */
     CGlobal *global = CGlobal::Instance();
     std::vector<CMessage *> *messages = global->get_messages();
+    int height = CScreen::height();
 
     /**
      * How many lines we've scrolled down the message.
@@ -357,26 +426,33 @@ void CScreen::drawMessage()
         cur = messages->at(selected);
     else
     {
-        clear();
-        move(3,3);
-        printw(NO_MESSAGES);
+        for( int row = 0; row < (height - 1); row++ )
+            draw_row( row, 3, ( row == 3 ) ? NO_MESSAGES : "", COLOR_PAIR(2) );
+        m_message = NULL;
         return;
     }
 
     /**
      * Now we have a message - display it.
+     *
+     * If it isn't the one we drew last time then it has just been opened,
+     * so split up its body, and call the hook once it is on screen.  The
+     * body is split again only if the message is renamed.
      */
+    if ( cur != m_message )
+        m_read = cur->path();
 
-
-    /**
-     * Clear the screen.
-     */
-    CLua *lua = CLua::Instance();
-    lua->execute( "clear();" );
+    if ( cur != m_message || cur->path() != m_message_path )
+    {
+        m_message      = cur;
+        m_message_path = cur->path();
+        m_body         = cur->body();
+    }
 
     /**
      * The headers we'll print.
      */
+    CLua *lua = CLua::Instance();
     std::vector<std::string> headers = lua->table_to_array( "headers" );
 
     /**
@@ -391,9 +467,9 @@ void CScreen::drawMessage()
     }
 
     std::vector<std::string>::iterator it;
+    int width = CScreen::width();
     int row = 0;
     for (it = headers.begin(); it != headers.end(); ++it) {
-        move( row, 0 );
 
         /**
          * The header-name, in useful format.
@@ -407,37 +483,31 @@ void CScreen::drawMessage()
          * The header-value.
          */
         std::string value = cur->format( *it );
-        value = value.substr(0, (CScreen::width() - name.size() - 4 ) );
+        value = value.substr(0, ( width - name.size() - 4 ) );
 
-        printw( "%s: %s", name.c_str(), value.c_str() );
+        draw_row( row, 0, name + ": " + value, COLOR_PAIR(2) );
         row += 1;
     }
 
     /**
      * Now draw the body.
      */
-    std::vector<std::string> body = cur->body();
+    std::vector<std::string> &body = m_body;
 
     /**
      * How many lines to draw?
      */
-    int max = std::min((int)body.size(), (int)(CScreen::height() - headers.size()) );
+    int max = std::min((int)body.size(), (int)(height - headers.size()) );
 
-    for( int i = 0; i < (max-2); i++ )
+    for( ; row < (height - 1); row++ )
     {
-        move( i + ( headers.size() + 1 ), 0 );
+        int i = row - ( headers.size() + 1 );
 
-        std::string line = "";
-        if ( (i + offset) < (int)body.size() )
-            line = body[i+offset];
-
-        printw( "%s", line.c_str() );
+        if ( i >= 0 && i < (max-2) && (i + offset) < (int)body.size() )
+            draw_row( row, 0, body[i+offset], COLOR_PAIR(2) );
+        else
+            draw_row( row, 0, "", COLOR_PAIR(2) );
     }
-
-    /**
-     * We're reading a message so call our hook.
-     */
-    lua->execute( "on_read_message(\"" + cur->path() + "\");" );
 }
 
 /**
@@ -445,6 +515,13 @@ void CScreen::drawMessage()
  */
 void CScreen::setup()
 {
+    /**
+     * Use the locale's character set, so that curses writes UTF-8 when
+     * the terminal expects it, but keep numbers as Lua expects them.
+     */
+    setlocale( LC_ALL, "" );
+    setlocale( LC_NUMERIC, "C" );
+
     /**
      * Setup ncurses.
      */
@@ -472,6 +549,18 @@ void CScreen::setup()
     init_pair(1, COLOR_RED, COLOR_BLACK);
     init_pair(2, COLOR_WHITE, COLOR_BLACK);
 
+    /**
+     * Catch resizes ourselves, in place of curses, so that we only read
+     * the size of the terminal when it changes.  Without SA_RESTART a
+     * resize interrupts getch(), and the handler wakes the event loop,
+     * so that we redraw at once.
+     */
+    struct sigaction sa;
+    memset( &sa, 0, sizeof(sa) );
+    sa.sa_handler = CScreen::resized;
+    sigemptyset( &sa.sa_mask );
+    sigaction( SIGWINCH, &sa, NULL );
+    m_resized = 1;
 }
 
 /**
@@ -479,9 +568,9 @@ void CScreen::setup()
  */
 int CScreen::width()
 {
-    struct winsize w;
-    ioctl(0, TIOCGWINSZ, &w);
-    return (w.ws_col);
+    if ( m_resized )
+        update_geometry();
+    return (m_width);
 }
 
 /**
@@ -489,9 +578,51 @@ int CScreen::width()
  */
 int CScreen::height()
 {
+    if ( m_resized )
+        update_geometry();
+    return (m_height);
+}
+
+/**
+ * Note that the terminal has been resized.
+ */
+void CScreen::resized( int sig )
+{
+    m_resized = 1;
+    CEventLoop::wake();
+}
+
+/**
+ * Read the size of the terminal again, if it has changed.
+ */
+bool CScreen::update_geometry()
+{
+    if ( ! m_resized )
+        return false;
+
+    m_resized = 0;
+
     struct winsize w;
-    ioctl(0, TIOCGWINSZ, &w);
-    return (w.ws_row);
+    if ( ioctl(0, TIOCGWINSZ, &w) != 0 || w.ws_col == 0 || w.ws_row == 0 )
+        return false;
+
+    if ( w.ws_col == m_width && w.ws_row == m_height )
+        return false;
+
+    m_width  = w.ws_col;
+    m_height = w.ws_row;
+
+    /**
+     * Once curses is running it needs to know too, and what is on the
+     * terminal can no longer be trusted.
+     */
+    if ( stdscr != NULL && ! isendwin() )
+    {
+        resizeterm( m_height, m_width );
+        clearok( curscr, TRUE );
+    }
+    invalidate();
+    return true;
 }
 
 /**
@@ -500,10 +631,7 @@ int CScreen::height()
 void CScreen::clear_status()
 {
     move(CScreen::height() - 1, 0);
-
-    for (int i = 0; i < CScreen::width(); i++)
-	printw(" ");
-
+    clrtoeol();
 }
 
 
@@ -527,16 +655,23 @@ void CScreen::readline(char *buffer, int buflen)
   for (;;) {
     int c;
 
+    /**
+     * The prompt stays on the status-line, even if that moves.
+     */
+    if ( CScreen::update_geometry() )
+      y = CScreen::height() - 1;
+
     buffer[len] = ' ';
     mvaddnstr(y, x, buffer, len+1);
-    for( int padding = len; padding < CScreen::width(); padding++ )
-      {printw(" ");}
+    clrtoeol();
 
     move(y, x+pos);
     c = getch();
 
     if (c == KEY_ENTER || c == '\n' || c == '\r') {
       break;
+    } else if (c == ERR) {
+      /* Timeout, or a resize: draw the line again. */
     } else if (isprint(c)) {
       if (pos < buflen-1) {
         memmove(buffer+pos+1, buffer+pos, len-pos);
@@ -19,9 +19,19 @@
 #ifndef _screen_h_
 #define _screen_h_ 1
 
+#include <signal.h>
+#include <string>
 #include <vector>
+#include "frame.h"
 #include "maildir.h"
 
+
+/**
+ * The number of messages, either side of those on screen, whose headers
+ * we prefetch when drawing the index.
+ */
+#define INDEX_PREFETCH_ROWS 32
+
 /**
  * This class contains simple functions relating to the screen-handling.
  */
@@ -50,8 +60,17 @@ class CScreen
    */
   void setup();
 
+  /**
+   * Forget what we believe is on the screen, so that the next refresh
+   * redraws every row.  For use by anything which draws over it.
+   */
+  static void invalidate();
+
   /**
    * Return the width of the screen.
+   *
+   * The size is read from the terminal once, and again only after it has
+   * been resized, so this is cheap enough to call for every row.
    */
   static int width();
 
@@ -60,6 +79,13 @@ class CScreen
    */
   static int height();
 
+  /**
+   * If the terminal has been resized since we last looked then read its
+   * new size, tell curses, and have the next refresh redraw everything.
+   * Returns true if so.
+   */
+  static bool update_geometry();
+
   /**
    * Clear the status-line of the screen.
    */
@@ -78,6 +104,74 @@ class CScreen
   void drawIndex();
   void drawMessage();
 
+  /**
+   * Draw the given text at the given row, starting at the given column,
+   * unless that row of the screen already shows exactly that.
+   *
+   * The text is cut short at the edge of the screen, or padded, or cut,
+   * to the given number of columns if that is not zero.
+   */
+  void draw_row( int row, int col, const std::string &text, int attr, int columns = 0 );
+
+  /**
+   * Everything a frame is drawn from, short of the messages and folders
+   * themselves, which CGlobal::version() covers.
+   */
+  struct TScreenState
+  {
+    std::string mode;
+    unsigned int version;
+    unsigned int folders;
+    int width;
+    int height;
+  };
+
+  /**
+   * The rows on the screen, above the status-line, and the state they
+   * were drawn from.
+   */
+  CFrame m_frame;
+  TScreenState m_state;
+
+  /**
+   * Set when the screen has been drawn over, or when a row was drawn
+   * with a placeholder which will change by itself.
+   */
+  static bool m_invalid;
+  bool m_pending;
+
+  /**
+   * Our SIGWINCH handler, which just notes that the size must be read
+   * again.
+   */
+  static void resized( int sig );
+
+  /**
+   * The size of the terminal, and whether it has changed since.
+   */
+  static int m_width;
+  static int m_height;
+  static volatile sig_atomic_t m_resized;
+
+  /**
+   * The message we last drew in message mode, its path, and its body,
+   * so that scrolling doesn't split the body up again.
+   */
+  CMessage *m_message;
+  std::string m_message_path;
+  std::vector<std::string> m_body;
+
+  /**
+   * The message whose on_read_message hook is due, once drawn.
+   */
+  std::string m_read;
+
+  /**
+   * The line being drawn in the index, kept between frames so that
+   * drawing doesn't allocate once it has grown to the screen width.
+   */
+  std::string m_line;
+
 };
 
 #endif				/* _screen_h_ */
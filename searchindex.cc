@@ -0,0 +1,880 @@
+/**
+ * searchindex.cc - A persistent full-text index of messages.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.h"
+#include "header.h"
+#include "searchindex.h"
+
+
+/**
+ * The start of the on-disk index, changed whenever the format is.
+ */
+#define SEARCH_INDEX_MAGIC "lumail-search-index 1\n"
+
+
+/**
+ * Instance-handle.
+ */
+CSearchIndex *CSearchIndex::pinstance = NULL;
+
+
+/**
+ * Get access to our singleton-object.
+ */
+CSearchIndex *CSearchIndex::Instance()
+{
+    if (!pinstance)
+        pinstance = new CSearchIndex;
+
+    return pinstance;
+}
+
+
+/**
+ * Constructor - This is private as this class is a singleton.
+ *
+ * We default to ~/.lumail/cache, if ~/.lumail exists.
+ */
+CSearchIndex::CSearchIndex()
+{
+    m_loaded  = false;
+    m_dirty   = false;
+    m_removed = 0;
+
+    const char *home = getenv( "HOME" );
+    if ( home == NULL )
+        return;
+
+    std::string dir = std::string( home ) + "/.lumail";
+    if ( ! CFile::is_directory( dir ) )
+        return;
+
+    dir += "/cache";
+    if ( ! CFile::is_directory( dir ) )
+        mkdir( dir.c_str(), 0700 );
+
+    if ( CFile::is_directory( dir ) )
+        m_directory = dir;
+}
+
+
+/**
+ * Set the directory the index is stored in.
+ */
+void CSearchIndex::set_directory( std::string directory )
+{
+    m_directory = directory;
+    m_loaded    = false;
+    m_dirty     = false;
+    m_removed   = 0;
+
+    m_documents.clear();
+    m_ids.clear();
+    m_folders.clear();
+    m_folder_ids.clear();
+    m_postings.clear();
+    m_queue.clear();
+    m_queued.clear();
+    m_unreadable.clear();
+
+    if ( m_listener )
+        m_listener( "", "" );
+}
+
+
+/**
+ * Set the function told about changes.
+ */
+void CSearchIndex::set_listener( TChangeFunction listener )
+{
+    m_listener = listener;
+}
+
+
+/**
+ * Append an unsigned number, seven bits at a time.
+ */
+static void put_varint( std::string &out, uint64_t value )
+{
+    while( value >= 0x80 )
+    {
+        out += (char)( ( value & 0x7F ) | 0x80 );
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+
+/**
+ * Read a number written by put_varint(), advancing the offset.
+ */
+static bool get_varint( const std::string &in, size_t &offset, uint64_t &value )
+{
+    value = 0;
+    for( int shift = 0; shift < 64 && offset < in.size(); shift += 7 )
+    {
+        unsigned char c = in[offset++];
+        value |= (uint64_t)( c & 0x7F ) << shift;
+        if ( ( c & 0x80 ) == 0 )
+            return true;
+    }
+    return false;
+}
+
+
+/**
+ * Read a length-prefixed string written by save().
+ */
+static bool get_string( const std::string &in, size_t &offset, std::string &value )
+{
+    uint64_t len;
+    if ( ! get_varint( in, offset, len ) || len > in.size() - offset )
+        return false;
+
+    value.assign( in, offset, len );
+    offset += len;
+    return true;
+}
+
+
+/**
+ * The key of a message is its maildir, and the unique part of its name.
+ *
+ * For "/maildir/inbox/cur/123.host:2,S" the maildir is "/maildir/inbox"
+ * and the key "/maildir/inbox/123.host".
+ */
+std::string CSearchIndex::key( const TStringRef &path, TStringRef *folder )
+{
+    size_t slash  = path.rfind( '/' );
+    size_t start  = ( slash == std::string::npos ) ? 0 : slash + 1;
+    size_t parent = ( slash == std::string::npos || slash == 0 ) ? std::string::npos : path.rfind( '/', slash - 1 );
+
+    *folder = TStringRef( path.data, ( parent == std::string::npos ) ? 0 : parent );
+
+    size_t colon = path.find( ':', start );
+    if ( colon == std::string::npos )
+        colon = path.size;
+
+    std::string result( folder->data, folder->size );
+    result += '/';
+    result.append( path.data + start, colon - start );
+    return( result );
+}
+
+
+/**
+ * Get the id of the given maildir.
+ */
+uint32_t CSearchIndex::intern( const TStringRef &folder )
+{
+    std::string name = folder.str();
+
+    std::unordered_map<std::string, uint32_t>::iterator it = m_folder_ids.find( name );
+    if ( it != m_folder_ids.end() )
+        return( it->second );
+
+    uint32_t id = m_folders.size();
+    m_folders.push_back( name );
+    m_folder_ids[name] = id;
+    return( id );
+}
+
+
+/**
+ * Bring a maildir up to date.
+ */
+void CSearchIndex::update_folder( const std::string &folder, const std::vector<TStringRef> &paths )
+{
+    load();
+
+    std::vector<bool> seen( m_documents.size(), false );
+
+    std::vector<TStringRef>::const_iterator it;
+    for (it = paths.begin(); it != paths.end(); ++it)
+    {
+        TStringRef dir;
+        std::string k = key( *it, &dir );
+        std::unordered_map<std::string, uint32_t>::iterator found = m_ids.find( k );
+        if ( found == m_ids.end() )
+        {
+            enqueue( it->str(), k );
+            continue;
+        }
+
+        TDocument &doc = m_documents[found->second];
+        if ( TStringRef( doc.path ) != *it )
+            move( doc, it->str() );
+        seen[found->second] = true;
+    }
+
+    /**
+     * Anything else in this maildir has gone.
+     */
+    std::unordered_map<std::string, uint32_t>::iterator fit = m_folder_ids.find( folder );
+    if ( fit == m_folder_ids.end() )
+        return;
+
+    for( uint32_t id = 0; id < seen.size(); id++ )
+    {
+        if ( ! seen[id] && m_documents[id].folder == fit->second && ! m_documents[id].path.empty() )
+            forget( id );
+    }
+}
+
+
+/**
+ * Queue a message for indexing.
+ */
+void CSearchIndex::add( const std::string &path )
+{
+    TStringRef dir;
+    enqueue( path, key( path, &dir ) );
+}
+
+
+/**
+ * Queue a message, once.
+ */
+void CSearchIndex::enqueue( const std::string &path, const std::string &k )
+{
+    if ( m_unreadable.find( path ) != m_unreadable.end() )
+        return;
+
+    /**
+     * If it is queued already, it may have been renamed since.
+     */
+    std::unordered_map<std::string, std::string>::iterator it = m_queued.find( k );
+    if ( it != m_queued.end() )
+    {
+        it->second = path;
+        return;
+    }
+
+    m_queued[k] = path;
+    m_queue.push_back( k );
+}
+
+
+/**
+ * Remove a message, if it is indexed under the given path.
+ */
+void CSearchIndex::remove( const std::string &path )
+{
+    load();
+
+    TStringRef dir;
+    std::unordered_map<std::string, uint32_t>::iterator it = m_ids.find( key( path, &dir ) );
+    if ( it != m_ids.end() && m_documents[it->second].path == path )
+        forget( it->second );
+}
+
+
+/**
+ * Rename a message, or index it if we've not seen it.
+ */
+void CSearchIndex::rename( const std::string &from, const std::string &to )
+{
+    load();
+
+    TStringRef dir;
+    std::unordered_map<std::string, uint32_t>::iterator it = m_ids.find( key( from, &dir ) );
+    if ( it == m_ids.end() )
+    {
+        add( to );
+        return;
+    }
+
+    /**
+     * A move to another maildir changes the key.  If we already hold a
+     * message there, indexed first, or from events seen out of order,
+     * it is replaced, so that it doesn't linger in the posting-lists.
+     */
+    std::string renamed = key( to, &dir );
+    if ( renamed != it->first )
+    {
+        uint32_t id = it->second;
+        m_ids.erase( it );
+
+        std::unordered_map<std::string, uint32_t>::iterator old = m_ids.find( renamed );
+        if ( old != m_ids.end() )
+            forget( old->second );
+
+        m_ids[renamed] = id;
+        m_documents[id].folder = intern( dir );
+    }
+
+    move( m_documents[m_ids[renamed]], to );
+}
+
+
+/**
+ * Forget a message.  Its id stays in the posting-lists until compact().
+ */
+void CSearchIndex::forget( uint32_t id )
+{
+    TStringRef dir;
+    m_ids.erase( key( m_documents[id].path, &dir ) );
+
+    if ( m_listener )
+        m_listener( m_documents[id].path, "" );
+
+    std::string().swap( m_documents[id].path );
+    m_removed += 1;
+    m_dirty    = true;
+}
+
+
+/**
+ * Update the path of a message.
+ */
+void CSearchIndex::move( TDocument &doc, const std::string &path )
+{
+    std::string from = doc.path;
+
+    doc.path = path;
+    m_dirty  = true;
+
+    if ( m_listener )
+        m_listener( from, path );
+}
+
+
+/**
+ * Index queued messages, within the time budget.
+ */
+bool CSearchIndex::work( double seconds )
+{
+    load();
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() +
+        std::chrono::microseconds( (int64_t)( seconds * 1000000 ) );
+
+    while( ! m_queue.empty() )
+    {
+        std::unordered_map<std::string, std::string>::iterator it = m_queued.find( m_queue.front() );
+        m_queue.pop_front();
+
+        std::string path = it->second;
+        m_queued.erase( it );
+
+        /**
+         * Don't try a message we can't read again, unless it moves.
+         */
+        if ( ! index( path ) )
+            m_unreadable.insert( path );
+
+        if ( std::chrono::steady_clock::now() >= end )
+            break;
+    }
+    return( ! m_queue.empty() );
+}
+
+
+/**
+ * The number of queued messages.
+ */
+size_t CSearchIndex::pending()
+{
+    return( m_queue.size() );
+}
+
+
+/**
+ * Does this line look like part of a base64-encoded attachment?
+ */
+static bool is_encoded( const char *line, size_t len )
+{
+    if ( len < 40 )
+        return false;
+
+    for( size_t i = 0; i < len; i++ )
+    {
+        char c = line[i];
+        if ( ! isalnum( (unsigned char)c ) && c != '+' && c != '/' && c != '=' && c != '\r' )
+            return false;
+    }
+    return true;
+}
+
+
+/**
+ * Read and index a single message.
+ *
+ * The words come from the addresses and subject, and from the body.  The
+ * body isn't decoded: text parts are indexed as they are, and lines which
+ * look like base64 are skipped.  Returns false if it couldn't be read.
+ */
+bool CSearchIndex::index( const std::string &path )
+{
+    TStringRef dir;
+    std::string k = key( path, &dir );
+
+    /**
+     * Queued twice, or renamed since?
+     */
+    std::unordered_map<std::string, uint32_t>::iterator it = m_ids.find( k );
+    if ( it != m_ids.end() )
+    {
+        if ( m_documents[it->second].path != path )
+            move( m_documents[it->second], path );
+        return true;
+    }
+
+    int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+        return false;
+
+    std::string text;
+    text.resize( SEARCH_INDEX_READ_LIMIT );
+
+    size_t got = 0;
+    while( got < text.size() )
+    {
+        ssize_t n = read( fd, &text[got], text.size() - got );
+        if ( n <= 0 )
+            break;
+        got += n;
+    }
+    close( fd );
+    text.resize( got );
+
+    /**
+     * Split the header from the body.
+     */
+    size_t body = text.find( "\n\n" );
+    size_t crlf = text.find( "\r\n\r\n" );
+    if ( crlf != std::string::npos && ( body == std::string::npos || crlf < body ) )
+        body = crlf + 4;
+    else if ( body != std::string::npos )
+        body += 2;
+    else
+        body = text.size();
+
+    std::vector<std::string> words;
+
+    CHeader header;
+    header.parse( text.substr( 0, body ) );
+
+    const char *fields[] = { "From", "To", "Cc", "Subject" };
+    for( size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++ )
+    {
+        const std::string *value = header.find( fields[i] );
+        if ( value )
+            tokenize( value->data(), value->size(), words );
+    }
+
+    size_t offset = body;
+    while( offset < text.size() )
+    {
+        size_t end = text.find( '\n', offset );
+        if ( end == std::string::npos )
+            end = text.size();
+
+        if ( ! is_encoded( text.data() + offset, end - offset ) )
+            tokenize( text.data() + offset, end - offset, words );
+
+        offset = end + 1;
+    }
+
+    std::sort( words.begin(), words.end() );
+    words.erase( std::unique( words.begin(), words.end() ), words.end() );
+
+    /**
+     * Ids only ever grow, so each is appended to its lists in order.
+     */
+    uint32_t id = m_documents.size();
+
+    TDocument doc;
+    doc.path   = path;
+    doc.folder = intern( dir );
+    m_documents.push_back( doc );
+    m_ids[k] = id;
+
+    std::vector<std::string>::iterator wit;
+    for (wit = words.begin(); wit != words.end(); ++wit)
+    {
+        TPostings &postings = m_postings[*wit];
+        put_varint( postings.ids, id - postings.last );
+        postings.last   = id;
+        postings.count += 1;
+    }
+
+    m_dirty = true;
+
+    if ( m_listener )
+        m_listener( "", path );
+    return true;
+}
+
+
+/**
+ * Split text into lower-cased words.
+ *
+ * A word is a run of letters and digits.  Anything outside ASCII counts
+ * as a letter, so UTF-8 words are kept whole.
+ */
+void CSearchIndex::tokenize( const char *text, size_t len, std::vector<std::string> &words )
+{
+    size_t i = 0;
+    while( i < len )
+    {
+        while( i < len && ! isalnum( (unsigned char)text[i] ) && (unsigned char)text[i] < 0x80 )
+            i++;
+
+        size_t start = i;
+        while( i < len && ( isalnum( (unsigned char)text[i] ) || (unsigned char)text[i] >= 0x80 ) )
+            i++;
+
+        size_t n = i - start;
+        if ( n < SEARCH_INDEX_MIN_WORD || n > SEARCH_INDEX_MAX_WORD )
+            continue;
+
+        std::string word( text + start, n );
+        for( size_t j = 0; j < n; j++ )
+        {
+            if ( word[j] >= 'A' && word[j] <= 'Z' )
+                word[j] += 'a' - 'A';
+        }
+        words.push_back( word );
+    }
+}
+
+
+/**
+ * Decode a posting-list.
+ */
+void CSearchIndex::decode( const TPostings &postings, std::vector<uint32_t> &ids )
+{
+    ids.clear();
+    ids.reserve( postings.count );
+
+    size_t offset = 0;
+    uint64_t id = 0, delta;
+    while( get_varint( postings.ids, offset, delta ) )
+    {
+        id += delta;
+        ids.push_back( (uint32_t)id );
+    }
+}
+
+
+/**
+ * Find the messages containing every word of the query.
+ *
+ * The shortest posting-list is decoded first, and each of the others
+ * narrows it down.
+ */
+std::vector<std::string> CSearchIndex::search( const std::string &query )
+{
+    std::vector<std::string> result;
+
+    load();
+    while( work( 1.0 ) )
+        ;
+
+    std::vector<std::string> words;
+    tokenize( query.data(), query.size(), words );
+    if ( words.empty() )
+        return( result );
+
+    std::vector<const TPostings *> lists;
+    std::vector<std::string>::iterator wit;
+    for (wit = words.begin(); wit != words.end(); ++wit)
+    {
+        std::unordered_map<std::string, TPostings>::iterator it = m_postings.find( *wit );
+        if ( it == m_postings.end() )
+            return( result );
+        lists.push_back( &it->second );
+    }
+
+    std::sort( lists.begin(), lists.end(),
+               []( const TPostings *a, const TPostings *b ) { return( a->count < b->count ); } );
+
+    std::vector<uint32_t> ids, next, both;
+    decode( *lists[0], ids );
+
+    for( size_t i = 1; i < lists.size() && ! ids.empty(); i++ )
+    {
+        decode( *lists[i], next );
+
+        both.clear();
+        std::set_intersection( ids.begin(), ids.end(), next.begin(), next.end(),
+                               std::back_inserter( both ) );
+        ids.swap( both );
+    }
+
+    std::vector<uint32_t>::iterator it;
+    for (it = ids.begin(); it != ids.end(); ++it)
+    {
+        if ( ! m_documents[*it].path.empty() )
+            result.push_back( m_documents[*it].path );
+    }
+    return( result );
+}
+
+
+/**
+ * The number of messages indexed.
+ */
+size_t CSearchIndex::documents()
+{
+    load();
+    return( m_documents.size() - m_removed );
+}
+
+
+/**
+ * Append the path of every indexed message.
+ */
+void CSearchIndex::paths( std::vector<std::string> &out )
+{
+    load();
+
+    std::vector<TDocument>::iterator it;
+    for (it = m_documents.begin(); it != m_documents.end(); ++it)
+    {
+        if ( ! it->path.empty() )
+            out.push_back( it->path );
+    }
+}
+
+
+/**
+ * The number of distinct words indexed.
+ */
+size_t CSearchIndex::words()
+{
+    load();
+    return( m_postings.size() );
+}
+
+
+/**
+ * Drop removed messages, renumbering those which remain.
+ */
+void CSearchIndex::compact()
+{
+    std::vector<uint32_t> renumber( m_documents.size(), (uint32_t)-1 );
+    std::vector<TDocument> documents;
+    documents.reserve( m_documents.size() - m_removed );
+
+    for( uint32_t id = 0; id < m_documents.size(); id++ )
+    {
+        if ( m_documents[id].path.empty() )
+            continue;
+
+        renumber[id] = documents.size();
+        documents.push_back( m_documents[id] );
+    }
+
+    std::vector<uint32_t> ids;
+    std::unordered_map<std::string, TPostings>::iterator it;
+    for (it = m_postings.begin(); it != m_postings.end(); )
+    {
+        decode( it->second, ids );
+
+        TPostings postings;
+        postings.last  = 0;
+        postings.count = 0;
+
+        std::vector<uint32_t>::iterator iit;
+        for (iit = ids.begin(); iit != ids.end(); ++iit)
+        {
+            uint32_t id = renumber[*iit];
+            if ( id == (uint32_t)-1 )
+                continue;
+
+            put_varint( postings.ids, id - postings.last );
+            postings.last   = id;
+            postings.count += 1;
+        }
+
+        if ( postings.count == 0 )
+            it = m_postings.erase( it );
+        else
+        {
+            it->second.ids.swap( postings.ids );
+            it->second.last  = postings.last;
+            it->second.count = postings.count;
+            ++it;
+        }
+    }
+
+    m_documents.swap( documents );
+    m_removed = 0;
+
+    std::unordered_map<std::string, uint32_t>::iterator iit;
+    for (iit = m_ids.begin(); iit != m_ids.end(); ++iit)
+        iit->second = renumber[iit->second];
+}
+
+
+/**
+ * Write the index to disk, if it has changed.
+ */
+void CSearchIndex::flush()
+{
+    if ( m_dirty )
+        save();
+}
+
+
+/**
+ * Read the on-disk copy, the first time we're used.
+ */
+void CSearchIndex::load()
+{
+    if ( m_loaded )
+        return;
+    m_loaded = true;
+
+    if ( m_directory.empty() )
+        return;
+
+    std::string file = m_directory + "/search-index";
+    std::ifstream in( file.c_str(), std::ios::binary );
+    if ( ! in.is_open() )
+        return;
+
+    std::string data( ( std::istreambuf_iterator<char>( in ) ), std::istreambuf_iterator<char>() );
+
+    size_t offset = strlen( SEARCH_INDEX_MAGIC );
+    if ( data.compare( 0, offset, SEARCH_INDEX_MAGIC ) != 0 )
+        return;
+
+    bool ok = true;
+    uint64_t count;
+
+    ok = get_varint( data, offset, count );
+    for( uint64_t i = 0; ok && i < count; i++ )
+    {
+        TDocument doc;
+        ok = get_string( data, offset, doc.path );
+        if ( ! ok )
+            break;
+
+        TStringRef dir;
+        std::string k = key( doc.path, &dir );
+        doc.folder = intern( dir );
+
+        if ( doc.path.empty() )
+            m_removed += 1;
+        else
+            m_ids[k] = m_documents.size();
+
+        m_documents.push_back( doc );
+    }
+
+    ok = ok && get_varint( data, offset, count );
+    for( uint64_t i = 0; ok && i < count; i++ )
+    {
+        std::string word;
+        uint64_t entries, last;
+
+        ok = get_string( data, offset, word ) &&
+             get_varint( data, offset, entries ) &&
+             get_varint( data, offset, last );
+        if ( ! ok )
+            break;
+
+        TPostings &postings = m_postings[word];
+        ok = get_string( data, offset, postings.ids ) && last < m_documents.size();
+        postings.count = entries;
+        postings.last  = last;
+    }
+
+    /**
+     * Anything damaged is discarded, to be rebuilt.
+     */
+    if ( ! ok )
+    {
+        m_documents.clear();
+        m_ids.clear();
+        m_folders.clear();
+        m_folder_ids.clear();
+        m_postings.clear();
+        m_removed = 0;
+    }
+}
+
+
+/**
+ * Save the on-disk copy, dropping removed messages if there are many.
+ */
+void CSearchIndex::save()
+{
+    m_dirty = false;
+
+    if ( m_directory.empty() )
+        return;
+
+    if ( m_removed * 4 > m_documents.size() )
+        compact();
+
+    std::string data = SEARCH_INDEX_MAGIC;
+
+    put_varint( data, m_documents.size() );
+    std::vector<TDocument>::iterator dit;
+    for (dit = m_documents.begin(); dit != m_documents.end(); ++dit)
+    {
+        put_varint( data, dit->path.size() );
+        data += dit->path;
+    }
+
+    put_varint( data, m_postings.size() );
+    std::unordered_map<std::string, TPostings>::iterator it;
+    for (it = m_postings.begin(); it != m_postings.end(); ++it)
+    {
+        put_varint( data, it->first.size() );
+        data += it->first;
+        put_varint( data, it->second.count );
+        put_varint( data, it->second.last );
+        put_varint( data, it->second.ids.size() );
+        data += it->second.ids;
+    }
+
+    /**
+     * Write to a temporary file and rename, so a crash never leaves
+     * us with a truncated index.
+     */
+    std::string file = m_directory + "/search-index";
+    std::string tmp  = file + ".tmp";
+
+    std::ofstream out( tmp.c_str(), std::ios::binary | std::ios::trunc );
+    if ( ! out.is_open() )
+        return;
+
+    out.write( data.data(), data.size() );
+    out.close();
+
+    if ( out.fail() )
+        unlink( tmp.c_str() );
+    else
+        ::rename( tmp.c_str(), file.c_str() );
+}
@@ -0,0 +1,270 @@
+/**
+ * searchindex.h - A persistent full-text index of messages.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _searchindex_h_
+#define _searchindex_h_ 1
+
+#include <deque>
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "stringref.h"
+
+
+/**
+ * The most of each message we read when indexing it.
+ */
+#define SEARCH_INDEX_READ_LIMIT ( 256 * 1024 )
+
+
+/**
+ * Words shorter, or longer, than these are not indexed.
+ */
+#define SEARCH_INDEX_MIN_WORD 2
+#define SEARCH_INDEX_MAX_WORD 40
+
+
+/**
+ * A singleton holding an inverted index of the words in the headers and
+ * bodies of our messages, so that they may be searched without reading
+ * every file.
+ *
+ * Messages are known by their maildir and the unique part of their
+ * filename, as in the header-cache, so renames are cheap.  New files are
+ * queued, and read a few at a time by work(), from the main loop.  The
+ * posting-list of each word is stored as delta-encoded varints, and the
+ * whole index is saved to ~/.lumail/cache/search-index.
+ *
+ * Removed messages are only marked as such: their ids are dropped from
+ * the posting-lists when enough have accumulated, as the index is saved.
+ */
+class CSearchIndex
+{
+
+public:
+
+    /**
+     * Called as the path of an indexed message changes: from "" once it
+     * is indexed, to "" once it is removed, and with both "" when the
+     * whole index is replaced.
+     */
+    typedef std::function<void( const std::string &from, const std::string &to )> TChangeFunction;
+
+    /**
+     * Get access to the singleton instance.
+     */
+    static CSearchIndex *Instance();
+
+    /**
+     * Set the function told about changes.
+     */
+    void set_listener( TChangeFunction listener );
+
+    /**
+     * Set the directory the index is stored in, discarding anything held
+     * in memory.  An empty directory disables persistence.
+     */
+    void set_directory( std::string directory );
+
+    /**
+     * Bring the given maildir up to date with the given message paths:
+     * renamed messages are updated, those missing are removed, and new
+     * ones are queued for indexing.
+     */
+    void update_folder( const std::string &folder, const std::vector<TStringRef> &paths );
+
+    /**
+     * Queue a single message for indexing, remove one, or rename one.
+     */
+    void add( const std::string &path );
+    void remove( const std::string &path );
+    void rename( const std::string &from, const std::string &to );
+
+    /**
+     * Index queued messages for up to the given number of seconds.
+     * Returns true if more remain.
+     */
+    bool work( double seconds );
+
+    /**
+     * The number of messages waiting to be indexed.
+     */
+    size_t pending();
+
+    /**
+     * Find the paths of the messages containing every word of the query.
+     *
+     * Anything still queued is indexed first.
+     */
+    std::vector<std::string> search( const std::string &query );
+
+    /**
+     * The number of messages, and words, indexed.
+     */
+    size_t documents();
+    size_t words();
+
+    /**
+     * Append the path of every indexed message.
+     */
+    void paths( std::vector<std::string> &out );
+
+    /**
+     * Write the index to disk, if it has changed.
+     */
+    void flush();
+
+    /**
+     * Append the words of the given text to the vector, lower-cased.
+     */
+    static void tokenize( const char *text, size_t len, std::vector<std::string> &words );
+
+protected:
+
+    /**
+     * Protected functions to allow our singleton implementation.
+     */
+    CSearchIndex();
+    CSearchIndex(const CSearchIndex &);
+    CSearchIndex & operator=(const CSearchIndex &);
+
+private:
+
+    /**
+     * An indexed message: its current path, and its maildir.  The path
+     * is empty once the message has been removed.
+     */
+    struct TDocument
+    {
+        std::string path;
+        uint32_t folder;
+    };
+
+    /**
+     * The messages containing one word, as ascending ids, delta-encoded.
+     */
+    struct TPostings
+    {
+        std::string ids;
+        uint32_t last;
+        uint32_t count;
+    };
+
+    /**
+     * The key we know the given message by, and the maildir it lives in.
+     */
+    static std::string key( const TStringRef &path, TStringRef *folder );
+
+    /**
+     * Get the id of the given maildir, adding it if required.
+     */
+    uint32_t intern( const TStringRef &folder );
+
+    /**
+     * Read and index a single message.  Returns false if it couldn't be
+     * read.
+     */
+    bool index( const std::string &path );
+
+    /**
+     * Queue a message, with the given key, unless it is queued already,
+     * or we've failed to read it before.
+     */
+    void enqueue( const std::string &path, const std::string &k );
+
+    /**
+     * Forget a message.
+     */
+    void forget( uint32_t id );
+
+    /**
+     * Update the path of a message, telling the listener.
+     */
+    void move( TDocument &doc, const std::string &path );
+
+    /**
+     * Decode a posting-list.
+     */
+    static void decode( const TPostings &postings, std::vector<uint32_t> &ids );
+
+    /**
+     * Drop removed messages from the posting-lists, and renumber.
+     */
+    void compact();
+
+    /**
+     * Read, or write, the on-disk copy.
+     */
+    void load();
+    void save();
+
+    /**
+     * The directory holding the on-disk copy, and whether we've read it,
+     * or changed since.
+     */
+    std::string m_directory;
+    bool m_loaded;
+    bool m_dirty;
+
+    /**
+     * Each message, by id, and the ids by key.
+     */
+    std::vector<TDocument> m_documents;
+    std::unordered_map<std::string, uint32_t> m_ids;
+    size_t m_removed;
+
+    /**
+     * The maildirs we've seen, and their ids.
+     */
+    std::vector<std::string> m_folders;
+    std::unordered_map<std::string, uint32_t> m_folder_ids;
+
+    /**
+     * The posting-list of each word.
+     */
+    std::unordered_map<std::string, TPostings> m_postings;
+
+    /**
+     * The keys of the messages waiting to be indexed, in order, and the
+     * path each was last seen at.
+     */
+    std::deque<std::string> m_queue;
+    std::unordered_map<std::string, std::string> m_queued;
+
+    /**
+     * The paths of messages we couldn't read.
+     */
+    std::unordered_set<std::string> m_unreadable;
+
+    /**
+     * Told about changes, if set.
+     */
+    TChangeFunction m_listener;
+
+    /**
+     * The singleton instance.
+     */
+    static CSearchIndex *pinstance;
+
+};
+
+#endif /* _searchindex_h_ */
@@ -0,0 +1,226 @@
+/**
+ * sort.cc - Sort keys for the message index.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "sort.h"
+
+
+/**
+ * Convert the name of a sort order into the order itself.
+ */
+bool CSort::parse_order( const std::string &name, TSortOrder *order )
+{
+    static const struct
+    {
+        const char *name;
+        TSortOrder order;
+    } orders[] = {
+        { "arrival", SORT_ARRIVAL },
+        { "mtime",   SORT_MTIME   },
+        { "date",    SORT_DATE    },
+        { "from",    SORT_FROM    },
+        { "subject", SORT_SUBJECT },
+        { "size",    SORT_SIZE    },
+    };
+
+    for( size_t i = 0; i < sizeof(orders) / sizeof(orders[0]); i++ )
+    {
+        if ( strcasecmp( name.c_str(), orders[i].name ) == 0 )
+        {
+            *order = orders[i].order;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Compare two keys.
+ */
+bool CSort::less( const TSortKey &a, const TSortKey &b )
+{
+    if ( a.number != b.number )
+        return( a.number < b.number );
+
+    int cmp = a.text.compare( b.text );
+    if ( cmp != 0 )
+        return( cmp < 0 );
+
+    return( a.tie < b.tie );
+}
+
+
+/**
+ * The delivery time of a message, from its filename.
+ *
+ * Maildir filenames begin with the time of delivery, in seconds, so this
+ * gives the same order as the mtime without a stat() per message.
+ */
+int64_t CSort::arrival( const std::string &path )
+{
+    size_t slash = path.rfind( '/' );
+    size_t i = ( slash == std::string::npos ) ? 0 : slash + 1;
+
+    /**
+     * A name which begins with more digits than any timestamp has isn't
+     * one, so it falls back to the mtime rather than overflowing.
+     */
+    int64_t seconds = 0;
+    for( size_t digits = 0; i < path.size() && isdigit( (unsigned char)path[i] ); i++ )
+    {
+        if ( ++digits > 18 )
+            return 0;
+        seconds = seconds * 10 + ( path[i] - '0' );
+    }
+
+    return( seconds );
+}
+
+
+/**
+ * Parse an RFC 2822 date into seconds past the epoch, UTC.
+ *
+ * We accept the optional day-name, optional seconds, and either a numeric
+ * zone or one of the obsolete names.  Anything after the zone, such as a
+ * "(UTC)" comment, is ignored.
+ */
+bool CSort::parse_date( const std::string &date, int64_t *epoch )
+{
+    const char *p = date.c_str();
+
+    while( isspace( *p ) )
+        p++;
+
+    /**
+     * Skip "Mon, "
+     */
+    const char *comma = strchr( p, ',' );
+    if ( comma != NULL && ( comma - p ) <= 4 )
+        p = comma + 1;
+
+    struct tm tm;
+    memset( &tm, 0, sizeof(tm) );
+
+    const char *rest = strptime( p, " %d %b %Y %H:%M", &tm );
+    if ( rest == NULL )
+        return false;
+
+    if ( *rest == ':' )
+    {
+        const char *secs = strptime( rest, ":%S", &tm );
+        if ( secs == NULL )
+            return false;
+        rest = secs;
+    }
+
+    while( isspace( *rest ) )
+        rest++;
+
+    /**
+     * The zone.
+     */
+    long offset = 0;
+    if ( ( *rest == '+' || *rest == '-' ) &&
+         isdigit( rest[1] ) && isdigit( rest[2] ) && isdigit( rest[3] ) && isdigit( rest[4] ) )
+    {
+        long hhmm = ( rest[1] - '0' ) * 1000 + ( rest[2] - '0' ) * 100 +
+                    ( rest[3] - '0' ) * 10   + ( rest[4] - '0' );
+        offset = ( hhmm / 100 ) * 3600 + ( hhmm % 100 ) * 60;
+        if ( *rest == '-' )
+            offset = -offset;
+    }
+    else
+    {
+        static const struct
+        {
+            const char *name;
+            int hours;
+        } zones[] = {
+            { "UT", 0 }, { "UTC", 0 }, { "GMT", 0 }, { "Z", 0 },
+            { "EST", -5 }, { "EDT", -4 }, { "CST", -6 }, { "CDT", -5 },
+            { "MST", -7 }, { "MDT", -6 }, { "PST", -8 }, { "PDT", -7 },
+        };
+
+        for( size_t i = 0; i < sizeof(zones) / sizeof(zones[0]); i++ )
+        {
+            size_t len = strlen( zones[i].name );
+            if ( strncasecmp( rest, zones[i].name, len ) == 0 && ! isalpha( rest[len] ) )
+            {
+                offset = zones[i].hours * 3600;
+                break;
+            }
+        }
+    }
+
+    *epoch = (int64_t)timegm( &tm ) - offset;
+    return true;
+}
+
+
+/**
+ * Fold a header for comparison: trimmed and lower-cased.
+ */
+std::string CSort::fold( const std::string &text )
+{
+    size_t start = 0;
+    size_t end   = text.size();
+
+    while( start < end && isspace( (unsigned char)text[start] ) )
+        start++;
+    while( end > start && isspace( (unsigned char)text[end - 1] ) )
+        end--;
+
+    std::string result = text.substr( start, end - start );
+    for( size_t i = 0; i < result.size(); i++ )
+        result[i] = tolower( (unsigned char)result[i] );
+
+    return( result );
+}
+
+
+/**
+ * Fold a subject for comparison, removing reply/forward prefixes.
+ */
+std::string CSort::subject( const std::string &text )
+{
+    std::string result = fold( text );
+
+    static const char *prefixes[] = { "re:", "fwd:", "fw:" };
+
+    bool found = true;
+    while( found )
+    {
+        found = false;
+        for( size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++ )
+        {
+            size_t len = strlen( prefixes[i] );
+            if ( result.compare( 0, len, prefixes[i] ) == 0 )
+            {
+                result = fold( result.substr( len ) );
+                found  = true;
+            }
+        }
+    }
+    return( result );
+}
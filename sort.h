@@ -0,0 +1,92 @@
+/**
+ * sort.h - Sort keys for the message index.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _sort_h_
+#define _sort_h_ 1
+
+#include <stdint.h>
+#include <string>
+
+
+/**
+ * The orders in which the index may be sorted.
+ */
+enum TSortOrder { SORT_ARRIVAL, SORT_MTIME, SORT_DATE, SORT_FROM, SORT_SUBJECT, SORT_SIZE };
+
+
+/**
+ * The key a message is sorted by.
+ *
+ * This is computed once per message, so that comparisons are cheap and
+ * never touch the disk.  Numeric orders fill in `number`, textual orders
+ * fill in `text`, and `tie` - which is unique per message - makes the
+ * ordering total.
+ */
+struct TSortKey
+{
+    int64_t number;
+    std::string text;
+    std::string tie;
+};
+
+
+/**
+ * Helpers for building, and comparing, sort keys.
+ */
+class CSort
+{
+
+public:
+
+    /**
+     * Convert the name of a sort order, as used by `sort_order`, into the
+     * order itself.  Returns false if the name is unknown.
+     */
+    static bool parse_order( const std::string &name, TSortOrder *order );
+
+    /**
+     * Compare two keys.  This is a strict weak ordering.
+     */
+    static bool less( const TSortKey &a, const TSortKey &b );
+
+    /**
+     * The delivery time of a message, from the timestamp which begins
+     * its maildir filename, or 0 if there isn't one, or it is too long
+     * to be a time.
+     */
+    static int64_t arrival( const std::string &path );
+
+    /**
+     * Parse an RFC 2822 date into seconds past the epoch, UTC.
+     */
+    static bool parse_date( const std::string &date, int64_t *epoch );
+
+    /**
+     * Fold a header for comparison: trimmed and lower-cased.
+     */
+    static std::string fold( const std::string &text );
+
+    /**
+     * Fold a subject for comparison, also removing any "Re:" or "Fwd:"
+     * prefixes so that replies sort alongside the original.
+     */
+    static std::string subject( const std::string &text );
+
+};
+
+#endif /* _sort_h_ */
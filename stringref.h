@@ -0,0 +1,92 @@
+/**
+ * stringref.h - A reference to characters held elsewhere.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _stringref_h_
+#define _stringref_h_ 1
+
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+
+/**
+ * A pointer and length, referring to a string owned by somebody else:
+ * a std::string, a literal, or a CArena.
+ *
+ * This is only valid for as long as the characters it refers to, and is
+ * intended for passing transient strings down a call-chain without
+ * copying them.  Strings and literals convert to it implicitly.
+ */
+struct TStringRef
+{
+    const char *data;
+    size_t size;
+
+    TStringRef() : data( "" ), size( 0 ) {}
+    TStringRef( const char *d, size_t s ) : data( d ), size( s ) {}
+    TStringRef( const char *d ) : data( d ), size( strlen( d ) ) {}
+    TStringRef( const std::string &s ) : data( s.data() ), size( s.size() ) {}
+
+    /**
+     * A copy, for when one must be kept.
+     */
+    std::string str() const { return( std::string( data, size ) ); }
+
+    /**
+     * Search for a character, from the end or the given offset,
+     * returning std::string::npos if it is absent.
+     */
+    size_t rfind( char c ) const
+    {
+        for( size_t i = size; i > 0; i-- )
+        {
+            if ( data[i - 1] == c )
+                return( i - 1 );
+        }
+        return( std::string::npos );
+    }
+
+    size_t rfind( char c, size_t before ) const
+    {
+        size_t end = ( before < size ) ? before + 1 : size;
+        for( size_t i = end; i > 0; i-- )
+        {
+            if ( data[i - 1] == c )
+                return( i - 1 );
+        }
+        return( std::string::npos );
+    }
+
+    size_t find( char c, size_t from = 0 ) const
+    {
+        const void *p = ( from < size ) ? memchr( data + from, c, size - from ) : NULL;
+        return( p ? (size_t)( (const char *)p - data ) : std::string::npos );
+    }
+
+    bool operator==( const TStringRef &other ) const
+    {
+        return( size == other.size && memcmp( data, other.data, size ) == 0 );
+    }
+
+    bool operator!=( const TStringRef &other ) const
+    {
+        return( ! ( *this == other ) );
+    }
+};
+
+#endif /* _stringref_h_ */
@@ -0,0 +1,370 @@
+/**
+ * arena_bench.cpp - Count the heap allocations made by a folder scan,
+ * and by drawing a screen of the index, before and after moving their
+ * transient strings into an arena and formatting fields in place.
+ *
+ * Both "before" versions are copies of the code they replaced.
+ *
+ * Usage: ./arena_bench [messages] [frames]
+ */
+
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "arena.h"
+#include "directory.h"
+#include "flags.h"
+#include "format.h"
+#include "header.h"
+#include "messagetable.h"
+
+
+/**
+ * Every allocation is counted, including the blocks of the arena.
+ */
+static size_t allocations = 0;
+
+void *operator new( size_t size )
+{
+    allocations += 1;
+    void *p = malloc( size ? size : 1 );
+    if ( p == NULL )
+        throw std::bad_alloc();
+    return( p );
+}
+
+void operator delete( void *p ) noexcept
+{
+    free( p );
+}
+
+
+/**
+ * Current time in seconds.
+ */
+double now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return( tv.tv_sec + tv.tv_usec / 1000000.0 );
+}
+
+
+/**
+ * The previous scan: a string per directory, and a string per path,
+ * with the header-cache prune building a set of the names, and the caller
+ * building each stored path to compare it.
+ */
+void legacy_scan( const std::string &maildir, CMessageTable &table )
+{
+    std::vector<std::string> result;
+
+    std::vector<std::string> dirs;
+    dirs.push_back( maildir + "/cur/" );
+    dirs.push_back( maildir + "/new/" );
+
+    std::vector<std::string>::iterator it;
+    for (it = dirs.begin(); it != dirs.end(); ++it)
+    {
+        std::string path = *it;
+        CDirectory dir( path );
+
+        const char *name;
+        bool is_dir;
+        while( dir.next( &name, &is_dir ) )
+        {
+            if ( ! is_dir )
+                result.push_back( path + name );
+        }
+    }
+
+    std::unordered_set<std::string> present;
+    for (it = result.begin(); it != result.end(); ++it)
+    {
+        std::string name = it->substr( it->rfind( '/' ) + 1 );
+        size_t colon = name.find( ':' );
+        if ( colon != std::string::npos )
+            name = name.substr( 0, colon );
+        present.insert( name );
+    }
+
+    for (it = result.begin(); it != result.end(); ++it)
+    {
+        uint32_t row = table.find( *it );
+        if ( row == MESSAGE_NO_ROW )
+            table.add( *it );
+        else if ( table.path( row ) != *it )
+            table.rename( row, *it );
+    }
+}
+
+
+/**
+ * The current scan, into a reused arena.
+ */
+void arena_scan( const std::string &maildir, CMessageTable &table,
+                 CArena &arena, std::vector<TStringRef> &result )
+{
+    arena.reset();
+    result.clear();
+
+    const char *dirs[] = { "/cur/", "/new/" };
+    for( size_t i = 0; i < 2; i++ )
+    {
+        TStringRef path = arena.join( maildir, dirs[i] );
+        CDirectory dir( path.data );
+
+        const char *name;
+        bool is_dir;
+        while( dir.next( &name, &is_dir ) )
+        {
+            if ( ! is_dir )
+                result.push_back( arena.join( path, name ) );
+        }
+    }
+
+    std::vector<TStringRef> present;
+    present.reserve( result.size() );
+
+    std::vector<TStringRef>::iterator it;
+    for (it = result.begin(); it != result.end(); ++it)
+    {
+        size_t start = it->rfind( '/' ) + 1;
+        size_t colon = it->find( ':', start );
+        if ( colon == std::string::npos )
+            colon = it->size;
+        present.push_back( TStringRef( it->data + start, colon - start ) );
+    }
+
+    for (it = result.begin(); it != result.end(); ++it)
+    {
+        uint32_t row = table.find( *it );
+        if ( row == MESSAGE_NO_ROW )
+            table.add( *it );
+        else if ( ! table.is_path( row, *it ) )
+            table.rename( row, *it );
+    }
+}
+
+
+/**
+ * A message, as far as formatting is concerned.
+ */
+struct TRow
+{
+    CHeader header;
+    uint64_t flags;
+};
+
+
+/**
+ * The previous flags(), returning a string.
+ */
+std::string legacy_flags( TRow &row )
+{
+    std::string flags;
+    CFlags::render( row.flags, flags );
+    if ( flags.size() < 4 )
+        flags.append( 4 - flags.size(), ' ' );
+    return flags;
+}
+
+
+/**
+ * The previous drawing of one frame: a new buffer, fields copied out of
+ * the headers, and padding appended a temporary at a time.
+ */
+size_t legacy_frame( std::vector<TRow> &rows, CFormat *format, int width )
+{
+    size_t drawn = 0;
+    std::string buf;
+    buf.reserve( width );
+
+    for( size_t i = 0; i < rows.size(); i++ )
+    {
+        buf.clear();
+        TRow &row = rows[i];
+
+        format->append( buf, [&row]( TFormatField field, std::string &value )
+        {
+            switch( field ) {
+            case FIELD_FLAGS:   value += legacy_flags( row );             break;
+            case FIELD_FROM:    value += row.header.get( "From" );    break;
+            case FIELD_SUBJECT: value += row.header.get( "Subject" ); break;
+            default: break;
+            }
+        } );
+
+        while( (int)buf.size() < width - 3 )
+            buf += std::string( " " );
+        if ( (int)buf.size() > width - 3 )
+            buf[width - 3] = '\0';
+
+        drawn += strlen( buf.c_str() );
+    }
+    return( drawn );
+}
+
+
+/**
+ * The current drawing of one frame, into a buffer kept between frames.
+ */
+size_t current_frame( std::vector<TRow> &rows, CFormat *format, int width, std::string &buf )
+{
+    size_t drawn = 0;
+
+    for( size_t i = 0; i < rows.size(); i++ )
+    {
+        buf.clear();
+        TRow &row = rows[i];
+
+        format->append( buf, [&row]( TFormatField field, std::string &value )
+        {
+            const std::string *found;
+            switch( field ) {
+            case FIELD_FLAGS:
+            {
+                size_t start = value.size();
+                CFlags::render( row.flags, value );
+                if ( value.size() - start < 4 )
+                    value.append( 4 - ( value.size() - start ), ' ' );
+                break;
+            }
+            case FIELD_FROM:
+                if ( ( found = row.header.find( "From" ) ) != NULL )
+                    value += *found;
+                break;
+            case FIELD_SUBJECT:
+                if ( ( found = row.header.find( "Subject" ) ) != NULL )
+                    value += *found;
+                break;
+            default: break;
+            }
+        } );
+
+        if ( (int)buf.size() < width - 3 )
+            buf.append( width - 3 - buf.size(), ' ' );
+        else
+            buf.resize( width - 3 );
+
+        drawn += buf.size();
+    }
+    return( drawn );
+}
+
+
+int main( int argc, char *argv[] )
+{
+    int messages = ( argc > 1 ) ? atoi( argv[1] ) : 20000;
+    int frames   = ( argc > 2 ) ? atoi( argv[2] ) : 1000;
+
+    /**
+     * Build a synthetic maildir.
+     */
+    char base[] = "/tmp/arena.bench.XXXXXX";
+    if ( mkdtemp( base ) == NULL )
+    {
+        perror( "mkdtemp" );
+        return 1;
+    }
+    std::string maildir = base;
+    mkdir( ( maildir + "/cur" ).c_str(), 0755 );
+    mkdir( ( maildir + "/new" ).c_str(), 0755 );
+
+    for( int i = 0; i < messages; i++ )
+    {
+        char name[160];
+        bool unread = ( i % 10 ) == 0;
+        snprintf( name, sizeof(name), "%s/%s/%d.M%dP%d.localhost%s", base,
+                  unread ? "new" : "cur", 1370000000 + i, i, getpid(), unread ? "" : ":2,S" );
+        FILE *f = fopen( name, "w" );
+        if ( f )
+            fclose( f );
+    }
+
+    printf( "%d messages, %d frames\n\n", messages, frames );
+    printf( "                     %12s %12s %10s %10s\n", "allocs", "allocs", "time", "time" );
+    printf( "                     %12s %12s %10s %10s\n", "before", "after", "before", "after" );
+
+    /**
+     * Rescan a folder we already hold, as each refresh does.  The first
+     * scan fills the table, and the arena.
+     */
+    CMessageTable legacy_table, arena_table;
+    CArena arena;
+    std::vector<TStringRef> paths;
+
+    legacy_scan( maildir, legacy_table );
+    arena_scan( maildir, arena_table, arena, paths );
+
+    size_t count = allocations;
+    double start = now();
+    legacy_scan( maildir, legacy_table );
+    double legacy_time = now() - start;
+    size_t legacy_allocs = allocations - count;
+
+    count = allocations;
+    start = now();
+    arena_scan( maildir, arena_table, arena, paths );
+    double arena_time = now() - start;
+    size_t arena_allocs = allocations - count;
+
+    printf( "rescan folder     : %12zu %12zu %7.1f ms %7.1f ms\n",
+            legacy_allocs, arena_allocs, legacy_time * 1000, arena_time * 1000 );
+
+    /**
+     * Draw a screen of sixty rows, repeatedly.
+     */
+    std::vector<TRow> rows( 60 );
+    for( size_t i = 0; i < rows.size(); i++ )
+    {
+        char text[256];
+        snprintf( text, sizeof(text),
+                  "From: A correspondent of some length <person%zu@example.org>\n"
+                  "Subject: Re: the subject of message number %zu, which is long\n"
+                  "Date: Sat, 1 Jun 2013 12:00:00 +0000\n\n", i, i );
+        rows[i].header.parse( text );
+        rows[i].flags = CFlags::bit( 'S' ) | ( ( i % 3 ) ? 0 : CFlags::bit( 'R' ) );
+    }
+
+    CFormat *format = CFormat::compiled( "[$FLAGS] $FROM - $SUBJECT" );
+    std::string line;
+    size_t a = 0, b = 0;
+
+    current_frame( rows, format, 160, line );
+
+    count = allocations;
+    start = now();
+    for( int i = 0; i < frames; i++ )
+        a += legacy_frame( rows, format, 160 );
+    legacy_time   = ( now() - start ) / frames;
+    legacy_allocs = ( allocations - count ) / frames;
+
+    count = allocations;
+    start = now();
+    for( int i = 0; i < frames; i++ )
+        b += current_frame( rows, format, 160, line );
+    arena_time   = ( now() - start ) / frames;
+    arena_allocs = ( allocations - count ) / frames;
+
+    printf( "draw index frame  : %12zu %12zu %7.3f ms %7.3f ms\n",
+            legacy_allocs, arena_allocs, legacy_time * 1000, arena_time * 1000 );
+
+    /**
+     * Cleanup.
+     */
+    std::string cmd = "rm -rf ";
+    cmd += base;
+    if ( system( cmd.c_str() ) != 0 )
+        fprintf( stderr, "Failed to remove %s\n", base );
+
+    return( a == b ? 0 : 1 );
+}
@@ -0,0 +1,68 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "arena.h"
+
+
+/**
+ * Strings are copied, and joined, with a trailing NUL.
+ */
+TEST_CASE( "arena/strings", "CArena string tests" )
+{
+    CArena arena( 16 );
+
+    std::string dir = "/mail/inbox/cur/";
+    TStringRef path = arena.join( dir, "1370000000.M1P1.host:2,S" );
+    REQUIRE( path.size == 40 );
+    REQUIRE( path.str() == "/mail/inbox/cur/1370000000.M1P1.host:2,S" );
+    REQUIRE( path.data[path.size] == '\0' );
+
+    TStringRef copy = arena.copy( "steve" );
+    REQUIRE( copy == TStringRef( "steve" ) );
+    REQUIRE( copy != TStringRef( "steven" ) );
+
+    /**
+     * Earlier strings survive the arena growing.
+     */
+    REQUIRE( path.str() == "/mail/inbox/cur/1370000000.M1P1.host:2,S" );
+    REQUIRE( arena.used() == 41 + 6 );
+}
+
+
+/**
+ * A reset keeps the memory, in a single block.
+ */
+TEST_CASE( "arena/reset", "CArena reset tests" )
+{
+    CArena arena( 64 );
+
+    for( int i = 0; i < 100; i++ )
+        arena.copy( "0123456789" );
+    REQUIRE( arena.blocks() > 1 );
+
+    arena.reset();
+    REQUIRE( arena.blocks() == 1 );
+    REQUIRE( arena.used() == 0 );
+
+    for( int i = 0; i < 100; i++ )
+        arena.copy( "0123456789" );
+    REQUIRE( arena.blocks() == 1 );
+}
+
+
+/**
+ * References search like strings.
+ */
+TEST_CASE( "arena/stringref", "TStringRef tests" )
+{
+    TStringRef path( "/mail/inbox/cur/123.host:2,S" );
+
+    REQUIRE( path.rfind( '/' ) == 15 );
+    REQUIRE( path.rfind( '/', 14 ) == 11 );
+    REQUIRE( path.rfind( '/', 0 ) == 0 );
+    REQUIRE( path.find( ':' ) == 24 );
+    REQUIRE( path.find( ':', 25 ) == std::string::npos );
+    REQUIRE( path.find( 'x', 100 ) == std::string::npos );
+    REQUIRE( TStringRef( "message" ).rfind( '/' ) == std::string::npos );
+    REQUIRE( TStringRef().size == 0 );
+}
@@ -0,0 +1,105 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "directory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/**
+ * Create a temporary directory containing a few files, and a couple of
+ * sub-directories, and ensure only the files are counted.
+ */
+TEST_CASE( "directory/count_files", "CDirectory::count_files tests" )
+{
+    char base[] = "/tmp/directory.test.XXXXXX";
+    REQUIRE( mkdtemp( base ) != NULL );
+
+    std::string path = base;
+
+    /**
+     * An empty directory has no files.
+     */
+    REQUIRE( CDirectory::count_files( path ) == 0 );
+
+    /**
+     * Add three files and two directories.
+     */
+    for( int i = 0; i < 3; i++ )
+    {
+        std::string file = path + "/file." + std::to_string( i );
+        FILE *f = fopen( file.c_str(), "w" );
+        REQUIRE( f != NULL );
+        fclose( f );
+    }
+    REQUIRE( mkdir( ( path + "/one" ).c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( path + "/two" ).c_str(), 0755 ) == 0 );
+
+    REQUIRE( CDirectory::count_files( path ) == 3 );
+
+    /**
+     * Missing directories have no files.
+     */
+    REQUIRE( CDirectory::count_files( path + "/missing" ) == 0 );
+
+    /**
+     * Cleanup.
+     */
+    for( int i = 0; i < 3; i++ )
+        unlink( ( path + "/file." + std::to_string( i ) ).c_str() );
+    rmdir( ( path + "/one" ).c_str() );
+    rmdir( ( path + "/two" ).c_str() );
+    REQUIRE( rmdir( base ) == 0 );
+}
+
+
+/**
+ * Walk a directory and ensure every entry is returned exactly once,
+ * with the correct type, and that "." and ".." are skipped.
+ */
+TEST_CASE( "directory/next", "CDirectory::next tests" )
+{
+    char base[] = "/tmp/directory.test.XXXXXX";
+    REQUIRE( mkdtemp( base ) != NULL );
+
+    std::string path = base;
+
+    FILE *f = fopen( ( path + "/message" ).c_str(), "w" );
+    REQUIRE( f != NULL );
+    fclose( f );
+    REQUIRE( mkdir( ( path + "/cur" ).c_str(), 0755 ) == 0 );
+    REQUIRE( symlink( "cur", ( path + "/link" ).c_str() ) == 0 );
+
+    CDirectory dir( path );
+    REQUIRE( dir.is_open() );
+
+    int files = 0;
+    int dirs  = 0;
+
+    const char *name;
+    bool is_dir;
+    while( dir.next( &name, &is_dir ) )
+    {
+        REQUIRE( strcmp( name, "." ) != 0 );
+        REQUIRE( strcmp( name, ".." ) != 0 );
+
+        if ( is_dir )
+            dirs += 1;
+        else
+            files += 1;
+    }
+
+    /**
+     * The symlink points at a directory, so counts as one.
+     */
+    REQUIRE( files == 1 );
+    REQUIRE( dirs  == 2 );
+
+    unlink( ( path + "/link" ).c_str() );
+    unlink( ( path + "/message" ).c_str() );
+    rmdir( ( path + "/cur" ).c_str() );
+    REQUIRE( rmdir( base ) == 0 );
+}
@@ -0,0 +1,142 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "eventloop.h"
+#include <algorithm>
+#include <signal.h>
+#include <unistd.h>
+#include <string>
+
+
+/**
+ * Give the loop an empty pipe for stdin, so that only our events wake it.
+ */
+static void quiet_stdin()
+{
+    static bool done = false;
+    if ( done )
+        return;
+
+    int fds[2];
+    REQUIRE( pipe( fds ) == 0 );
+    REQUIRE( dup2( fds[0], 0 ) == 0 );
+    done = true;
+}
+
+
+/**
+ * Timers fire in order, once or repeatedly, until cancelled.
+ */
+TEST_CASE( "eventloop/timers", "CEventLoop timer tests" )
+{
+    quiet_stdin();
+    CEventLoop *loop = CEventLoop::Instance();
+
+    std::string fired;
+    loop->add_timer( 0.02, 0, [&fired]() { fired += "b"; } );
+    loop->add_timer( 0.01, 0, [&fired]() { fired += "a"; } );
+    int every = loop->add_timer( 0.005, 0.005, [&fired]() { fired += "."; } );
+    int never = loop->add_timer( 10, 0, [&fired]() { fired += "!"; } );
+    REQUIRE( loop->timers() == 4 );
+
+    while( fired.find( 'b' ) == std::string::npos )
+        REQUIRE( loop->wait( 1000 ) == false );
+
+    REQUIRE( fired.find( 'a' ) < fired.find( 'b' ) );
+    REQUIRE( std::count( fired.begin(), fired.end(), '.' ) >= 2 );
+    REQUIRE( loop->timers() == 2 );
+
+    REQUIRE( loop->cancel_timer( every ) );
+    REQUIRE( loop->cancel_timer( never ) );
+    REQUIRE( ! loop->cancel_timer( never ) );
+    REQUIRE( loop->timers() == 0 );
+
+    /**
+     * With nothing to do we wait until the time is up.
+     */
+    fired.clear();
+    REQUIRE( loop->wait( 20 ) == false );
+    REQUIRE( fired.empty() );
+
+    /**
+     * A timer may cancel itself.
+     */
+    int id = 0;
+    int calls = 0;
+    id = loop->add_timer( 0, 0.001, [&]() { calls++; loop->cancel_timer( id ); } );
+    loop->wait( 100 );
+    loop->wait( 10 );
+    REQUIRE( calls == 1 );
+    REQUIRE( loop->timers() == 0 );
+}
+
+
+/**
+ * Descriptors are dispatched when readable, and input on stdin returns at
+ * once.
+ */
+TEST_CASE( "eventloop/watch", "CEventLoop descriptor tests" )
+{
+    quiet_stdin();
+    CEventLoop *loop = CEventLoop::Instance();
+
+    int fds[2];
+    REQUIRE( pipe( fds ) == 0 );
+
+    std::string got;
+    loop->watch( fds[0], [&]()
+    {
+        char buf[16];
+        ssize_t len = read( fds[0], buf, sizeof(buf) );
+        if ( len > 0 )
+            got.append( buf, len );
+    } );
+
+    REQUIRE( write( fds[1], "hi", 2 ) == 2 );
+    REQUIRE( loop->wait( 1000 ) == false );
+    REQUIRE( got == "hi" );
+
+    loop->unwatch( fds[0] );
+    REQUIRE( write( fds[1], "!", 1 ) == 1 );
+    REQUIRE( loop->wait( 10 ) == false );
+    REQUIRE( got == "hi" );
+
+    close( fds[0] );
+    close( fds[1] );
+
+    /**
+     * Input on stdin.
+     */
+    int in[2];
+    REQUIRE( pipe( in ) == 0 );
+    int saved = dup( 0 );
+    REQUIRE( dup2( in[0], 0 ) == 0 );
+    REQUIRE( write( in[1], "k", 1 ) == 1 );
+    REQUIRE( loop->wait( -1 ) == true );
+    REQUIRE( dup2( saved, 0 ) == 0 );
+    close( in[0] );
+    close( in[1] );
+    close( saved );
+}
+
+
+/**
+ * Signals are handled in the loop, and wake() wakes it.
+ */
+TEST_CASE( "eventloop/signals", "CEventLoop signal tests" )
+{
+    quiet_stdin();
+    CEventLoop *loop = CEventLoop::Instance();
+
+    int count = 0;
+    loop->on_signal( SIGUSR1, [&count]() { count++; } );
+
+    raise( SIGUSR1 );
+    REQUIRE( count == 0 );
+    REQUIRE( loop->wait( 1000 ) == false );
+    REQUIRE( count == 1 );
+
+    CEventLoop::wake();
+    REQUIRE( loop->wait( 1000 ) == false );
+    REQUIRE( count == 1 );
+}
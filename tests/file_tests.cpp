@@ -3,6 +3,7 @@
 #include "catch.hpp"
 #include "file.h"
 #include <sys/stat.h>
+#include <unistd.h>
 
 
 /**
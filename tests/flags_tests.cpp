@@ -0,0 +1,77 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "flags.h"
+
+
+/**
+ * Render a set of flags.
+ */
+static std::string render( uint64_t flags )
+{
+    std::string out;
+    CFlags::render( flags, out );
+    return( out );
+}
+
+
+/**
+ * Flags are parsed from the filename only, and rendered in ASCII order.
+ */
+TEST_CASE( "flags/parse", "CFlags::parse tests" )
+{
+    REQUIRE( CFlags::parse( "/m/inbox/new/123.host" ) == 0 );
+    REQUIRE( CFlags::parse( "/m/inbox/cur/123.host:2," ) == 0 );
+
+    REQUIRE( render( CFlags::parse( "/m/inbox/cur/123.host:2,S" ) ) == "S" );
+    REQUIRE( render( CFlags::parse( "/m/inbox/cur/123.host:2,TSRPFD" ) ) == "DFPRST" );
+    REQUIRE( render( CFlags::parse( "/m/inbox/cur/123.host:2,SaS" ) ) == "Sa" );
+
+    /**
+     * Separators in directory names are ignored.
+     */
+    REQUIRE( CFlags::parse( "/m/odd:2,F/cur/123.host" ) == 0 );
+
+    REQUIRE( CFlags::parse( "cur/123.host:2,RS" ) == ( CFlags::bit( 'R' ) | CFlags::bit( 'S' ) ) );
+}
+
+
+/**
+ * Bits, for valid and invalid letters.
+ */
+TEST_CASE( "flags/bit", "CFlags::bit tests" )
+{
+    static_assert( CFlags::bit( 'A' ) == 1, "bit() is usable at compile-time" );
+
+    REQUIRE( CFlags::bit( 'Z' ) == ( (uint64_t)1 << 25 ) );
+    REQUIRE( CFlags::bit( 'a' ) == ( (uint64_t)1 << 26 ) );
+    REQUIRE( CFlags::bit( 'z' ) == ( (uint64_t)1 << 51 ) );
+    REQUIRE( CFlags::bit( ',' ) == 0 );
+    REQUIRE( CFlags::bit( '2' ) == 0 );
+}
+
+
+/**
+ * The location is separate from the flags.
+ */
+TEST_CASE( "flags/in_new", "CFlags::in_new tests" )
+{
+    REQUIRE( CFlags::in_new( "/m/inbox/new/123.host" ) );
+    REQUIRE( CFlags::in_new( "new/123.host" ) );
+    REQUIRE( ! CFlags::in_new( "/m/inbox/cur/123.host:2,S" ) );
+    REQUIRE( ! CFlags::in_new( "/m/renew/123.host" ) );
+    REQUIRE( ! CFlags::in_new( "/m/new/cur/123.host" ) );
+}
+
+
+/**
+ * Replacing the flags of a path.
+ */
+TEST_CASE( "flags/with_flags", "CFlags::with_flags tests" )
+{
+    uint64_t rs = CFlags::bit( 'R' ) | CFlags::bit( 'S' );
+
+    REQUIRE( CFlags::with_flags( "/m/cur/123.host", rs ) == "/m/cur/123.host:2,RS" );
+    REQUIRE( CFlags::with_flags( "/m/cur/123.host:2,S", rs ) == "/m/cur/123.host:2,RS" );
+    REQUIRE( CFlags::with_flags( "/m/cur/123.host:2,FS", 0 ) == "/m/cur/123.host:2," );
+}
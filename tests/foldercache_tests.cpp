@@ -0,0 +1,264 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "foldercache.h"
+#include "maildir_helpers.h"
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+
+/**
+ * Set the mtime of the given directory.
+ */
+static void set_mtime( const std::string &path, time_t mtime )
+{
+    struct timeval tv[2];
+    tv[0].tv_sec  = tv[1].tv_sec  = mtime;
+    tv[0].tv_usec = tv[1].tv_usec = 0;
+    REQUIRE( utimes( path.c_str(), tv ) == 0 );
+}
+
+
+/**
+ * A temporary home, with a ~/.lumail, and a mail prefix beneath it.
+ */
+static std::string make_home()
+{
+    std::string home = make_base( "foldercache" );
+    make_dir( home + "/.lumail" );
+    make_dir( home + "/Maildir" );
+    return( home );
+}
+
+
+/**
+ * Is the given path in the list?
+ */
+static bool contains( const std::vector<std::string> &list, const std::string &path )
+{
+    return( std::find( list.begin(), list.end(), path ) != list.end() );
+}
+
+
+/**
+ * Maildirs are found, sorted, and nested maildirs are found only beneath
+ * the prefix.
+ */
+TEST_CASE( "foldercache/find", "CFolderCache discovery tests" )
+{
+    std::string home   = make_home();
+    std::string prefix = home + "/Maildir";
+
+    make_maildir( prefix + "/b" );
+    make_maildir( prefix + "/a" );
+    make_dir( prefix + "/lists" );
+    make_maildir( prefix + "/lists/debian" );
+    make_maildir( prefix + "/a/nested" );
+    make_dir( prefix + "/empty" );
+
+    CTestFolderCache cache;
+    std::vector<std::string> found = cache.folders( prefix, 2 );
+
+    REQUIRE( found.size() == 3 );
+    REQUIRE( found[0] == prefix + "/a" );
+    REQUIRE( found[1] == prefix + "/b" );
+    REQUIRE( found[2] == prefix + "/lists/debian" );
+
+    /**
+     * The prefix may be a maildir itself.
+     */
+    make_dir( prefix + "/cur" );
+    make_dir( prefix + "/new" );
+    make_dir( prefix + "/tmp" );
+
+    found = cache.folders( prefix, 1 );
+    REQUIRE( found.size() == 4 );
+    REQUIRE( found[0] == prefix );
+
+    remove_base( home );
+}
+
+
+/**
+ * Directories are re-read only when their mtime changes, and an mtime
+ * from the last second isn't trusted.
+ */
+TEST_CASE( "foldercache/revalidate", "CFolderCache mtime tests" )
+{
+    std::string home   = make_home();
+    std::string prefix = home + "/Maildir";
+    time_t old         = time(NULL) - 3600;
+
+    make_maildir( prefix + "/a" );
+    set_mtime( prefix + "/a", old );
+    set_mtime( prefix, old );
+
+    CTestFolderCache cache;
+    REQUIRE( cache.folders( prefix ).size() == 1 );
+    unsigned int version = cache.version();
+
+    /**
+     * A new folder whose parent keeps its old mtime isn't seen.
+     */
+    make_maildir( prefix + "/b" );
+    set_mtime( prefix, old );
+    REQUIRE( cache.folders( prefix ).size() == 1 );
+    REQUIRE( cache.version() == version );
+
+    /**
+     * Until the parent is invalidated.
+     */
+    cache.invalidate( prefix );
+    REQUIRE( cache.folders( prefix ).size() == 2 );
+    REQUIRE( cache.version() == version + 1 );
+
+    /**
+     * Or its mtime changes.
+     */
+    make_maildir( prefix + "/c" );
+    set_mtime( prefix, old + 1 );
+    REQUIRE( cache.folders( prefix ).size() == 3 );
+
+    /**
+     * A directory changed within the last second is read every time,
+     * as a further change might not move its mtime.
+     */
+    make_maildir( prefix + "/d" );
+    REQUIRE( cache.folders( prefix ).size() == 4 );
+
+    make_maildir( prefix + "/e" );
+    set_mtime( prefix, time(NULL) );
+    REQUIRE( cache.folders( prefix ).size() == 5 );
+
+    make_maildir( prefix + "/f" );
+    set_mtime( prefix, time(NULL) );
+    REQUIRE( cache.folders( prefix ).size() == 6 );
+
+    remove_base( home );
+}
+
+
+/**
+ * Vanished directories are pruned, and a new prefix starts afresh.
+ */
+TEST_CASE( "foldercache/prune", "CFolderCache pruning tests" )
+{
+    std::string home   = make_home();
+    std::string prefix = home + "/Maildir";
+    std::string other  = home + "/Other";
+
+    make_maildir( prefix + "/a" );
+    make_dir( prefix + "/lists" );
+    make_maildir( prefix + "/lists/debian" );
+    make_dir( other );
+    make_maildir( other + "/x" );
+
+    CTestFolderCache cache;
+    REQUIRE( cache.folders( prefix ).size() == 2 );
+    REQUIRE( contains( cache.directories(), prefix + "/lists" ) );
+
+    std::string cmd = "rm -rf " + prefix + "/lists";
+    REQUIRE( system( cmd.c_str() ) == 0 );
+
+    std::vector<std::string> found = cache.folders( prefix );
+    REQUIRE( found.size() == 1 );
+    REQUIRE( found[0] == prefix + "/a" );
+    REQUIRE( ! contains( cache.directories(), prefix + "/lists" ) );
+    REQUIRE( ! contains( cache.directories(), prefix + "/lists/debian" ) );
+
+    /**
+     * Nothing from the old prefix survives a change.
+     */
+    found = cache.folders( other );
+    REQUIRE( found.size() == 1 );
+    REQUIRE( found[0] == other + "/x" );
+
+    std::vector<std::string> dirs = cache.directories();
+    std::vector<std::string>::iterator it;
+    for (it = dirs.begin(); it != dirs.end(); ++it)
+        REQUIRE( it->compare( 0, other.size(), other ) == 0 );
+
+    remove_base( home );
+}
+
+
+/**
+ * The cache is saved to ~/.lumail/folders.cache, and trusted on restart
+ * only if it is for the same prefix.
+ */
+TEST_CASE( "foldercache/persist", "CFolderCache persistence tests" )
+{
+    std::string home   = make_home();
+    std::string prefix = home + "/Maildir";
+    std::string file   = home + "/.lumail/folders.cache";
+    time_t old         = time(NULL) - 3600;
+
+    make_maildir( prefix + "/a" );
+    make_maildir( prefix + "/b" );
+    set_mtime( prefix, old );
+
+    {
+        CTestFolderCache cache;
+        REQUIRE( cache.folders( prefix ).size() == 2 );
+    }
+
+    /**
+     * The format: a marker, the prefix, and then a line per directory.
+     */
+    std::ifstream in( file.c_str() );
+    REQUIRE( in.is_open() );
+
+    std::string line;
+    REQUIRE( (bool)std::getline( in, line ) );
+    REQUIRE( line == "lumail-folder-cache 1" );
+    REQUIRE( (bool)std::getline( in, line ) );
+    REQUIRE( line == prefix );
+
+    bool seen = false;
+    while( std::getline( in, line ) )
+    {
+        std::string expected = "\t1\t" + prefix + "/a\t";
+        if ( line.find( expected ) != std::string::npos )
+            seen = true;
+    }
+    REQUIRE( seen );
+    in.close();
+
+    /**
+     * A restart trusts what was saved, so a change which kept the old
+     * mtime goes unseen.
+     */
+    make_maildir( prefix + "/c" );
+    set_mtime( prefix, old );
+    {
+        CTestFolderCache cache;
+        REQUIRE( cache.folders( prefix ).size() == 2 );
+    }
+
+    /**
+     * A cache for another prefix is ignored.
+     */
+    {
+        CTestFolderCache cache;
+        REQUIRE( cache.folders( prefix + "/." ).size() == 3 );
+    }
+
+    /**
+     * As is one which isn't ours.
+     */
+    {
+        std::ofstream out( file.c_str(), std::ios::trunc );
+        out << "something else\n" << prefix << "\n";
+    }
+    {
+        CTestFolderCache cache;
+        REQUIRE( cache.folders( prefix ).size() == 3 );
+    }
+
+    remove_base( home );
+}
@@ -0,0 +1,116 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "format.h"
+
+
+/**
+ * Expand a format with some fixed values.
+ */
+static std::string expand( const std::string &fmt )
+{
+    CFormat f( fmt );
+
+    std::string out;
+    f.append( out, []( TFormatField field, std::string &value )
+    {
+        switch( field )
+        {
+        case FIELD_FLAGS:   value += "NS";                  break;
+        case FIELD_FROM:    value += "Steve";               break;
+        case FIELD_TO:      value += "Bob";                 break;
+        case FIELD_SUBJECT: value += "Hello";               break;
+        case FIELD_DAY:     value += "3";                   break;
+        case FIELD_MONTH:   value += "June";                break;
+        case FIELD_YEAR:    value += "2013";                break;
+        case FIELD_DATE:    value += "\xc3\xa9t\xc3\xa9";   break;
+        default:            break;
+        }
+    } );
+    return( out );
+}
+
+
+/**
+ * Simple fields, including repeated ones, and the default index_format.
+ */
+TEST_CASE( "format/fields", "CFormat field tests" )
+{
+    REQUIRE( expand( "" ) == "" );
+    REQUIRE( expand( "plain text" ) == "plain text" );
+    REQUIRE( expand( "$FROM" ) == "Steve" );
+    REQUIRE( expand( "[$FLAGS] $FROM - $SUBJECT" ) == "[NS] Steve - Hello" );
+    REQUIRE( expand( "[$FLAGS] $DAY/$MONTH/$YEAR $FROM - $SUBJECT" ) == "[NS] 3/June/2013 Steve - Hello" );
+
+    /**
+     * Every occurrence is expanded, not just the first.
+     */
+    REQUIRE( expand( "$FROM $FROM" ) == "Steve Steve" );
+
+    /**
+     * Names without a dollar are literal.
+     */
+    REQUIRE( expand( "FROM: $FROM" ) == "FROM: Steve" );
+}
+
+
+/**
+ * Braces, unknown fields, and dollars.
+ */
+TEST_CASE( "format/syntax", "CFormat syntax tests" )
+{
+    REQUIRE( expand( "${FROM}x" ) == "Stevex" );
+    REQUIRE( expand( "$FROMx" ) == "Stevex" );
+    REQUIRE( expand( "$UNKNOWN $TO" ) == "$UNKNOWN Bob" );
+    REQUIRE( expand( "${UNKNOWN} $TO" ) == "${UNKNOWN} Bob" );
+    REQUIRE( expand( "$$ $$FROM" ) == "$ $FROM" );
+    REQUIRE( expand( "costs $5" ) == "costs $5" );
+    REQUIRE( expand( "${FROM" ) == "${FROM" );
+    REQUIRE( expand( "end $" ) == "end $" );
+}
+
+
+/**
+ * Widths pad, or truncate, by column.
+ */
+TEST_CASE( "format/width", "CFormat width tests" )
+{
+    REQUIRE( expand( "[${FROM:8}]" ) == "[Steve   ]" );
+    REQUIRE( expand( "[${FROM:>8}]" ) == "[   Steve]" );
+    REQUIRE( expand( "[${FROM:3}]" ) == "[Ste]" );
+    REQUIRE( expand( "[${FROM:>3}]" ) == "[Ste]" );
+    REQUIRE( expand( "[${FROM:0}]" ) == "[Steve]" );
+
+    /**
+     * Multi-byte characters count once.
+     */
+    REQUIRE( expand( "[${DATE:4}]" ) == "[\xc3\xa9t\xc3\xa9 ]" );
+    REQUIRE( expand( "[${DATE:1}]" ) == "[\xc3\xa9]" );
+
+    /**
+     * Wide characters count twice, and are never split.
+     */
+    CFormat wide( "[${SUBJECT:5}]" );
+    std::string out;
+    wide.append( out, []( TFormatField field, std::string &value )
+    {
+        value += "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e";
+    } );
+    REQUIRE( out == "[\xe6\x97\xa5\xe6\x9c\xac ]" );
+}
+
+
+/**
+ * Compiled formats are cached until cleared.
+ */
+TEST_CASE( "format/cache", "CFormat cache tests" )
+{
+    CFormat *a = CFormat::compiled( "$FROM" );
+    CFormat *b = CFormat::compiled( "$FROM" );
+    CFormat *c = CFormat::compiled( "$TO" );
+
+    REQUIRE( a == b );
+    REQUIRE( a != c );
+
+    CFormat::clear_cache();
+}
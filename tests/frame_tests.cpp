@@ -0,0 +1,207 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "eventloop.h"
+#include "frame.h"
+#include <fstream>
+#include <iterator>
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+
+/**
+ * Where the terminal's output goes.
+ */
+static std::string terminal;
+
+
+/**
+ * Start curses on a terminal of the given size, which draws to a file.
+ */
+static void start_screen( int width, int height )
+{
+    static bool done = false;
+    if ( done )
+        return;
+
+    setenv( "TERM", "xterm", 1 );
+    setenv( "COLUMNS", std::to_string( width ).c_str(), 1 );
+    setenv( "LINES", std::to_string( height ).c_str(), 1 );
+
+    char name[] = "/tmp/frame.test.XXXXXX";
+    int fd = mkstemp( name );
+    REQUIRE( fd >= 0 );
+    terminal = name;
+
+    FILE *out = fdopen( fd, "w" );
+    FILE *in  = fopen( "/dev/null", "r" );
+    REQUIRE( newterm( NULL, out, in ) != NULL );
+    done = true;
+}
+
+
+/**
+ * What the given row of the screen shows, without trailing spaces.
+ */
+static std::string screen_row( int row )
+{
+    char buf[512];
+    int len = mvinnstr( row, 0, buf, sizeof(buf) - 1 );
+    if ( len < 0 )
+        return( "" );
+
+    std::string text( buf, len );
+    text.erase( text.find_last_not_of( ' ' ) + 1 );
+    return( text );
+}
+
+
+/**
+ * The first frame is drawn in full.
+ */
+TEST_CASE( "frame/first", "CFrame first frame tests" )
+{
+    start_screen( 40, 10 );
+    erase();
+
+    CFrame frame;
+    frame.begin( 40, 10 );
+    REQUIRE( frame.rows() == 9 );
+
+    frame.draw_row( 0, 0, "first row", 0 );
+    frame.draw_row( 1, 2, "indented", 0 );
+    frame.draw_row( 2, 0, "padded", 0, 10 );
+
+    REQUIRE( screen_row( 0 ) == "first row" );
+    REQUIRE( screen_row( 1 ) == "  indented" );
+    REQUIRE( screen_row( 2 ) == "padded" );
+
+    /**
+     * An unchanged row isn't drawn again, unless we've forgotten it.
+     */
+    mvaddstr( 0, 0, "XX" );
+    frame.begin( 40, 10 );
+    frame.draw_row( 0, 0, "first row", 0 );
+    REQUIRE( screen_row( 0 ) == "XXrst row" );
+
+    frame.clear();
+    frame.draw_row( 0, 0, "first row", 0 );
+    REQUIRE( screen_row( 0 ) == "first row" );
+
+    /**
+     * Rows are cut at the edge of the screen.
+     */
+    std::string wide( 60, 'x' );
+    frame.draw_row( 3, 0, wide, 0 );
+    frame.draw_row( 4, 0, "next", 0 );
+    REQUIRE( screen_row( 3 ) == std::string( 40, 'x' ) );
+    REQUIRE( screen_row( 4 ) == "next" );
+}
+
+
+/**
+ * After a resize every row is laid out at the new width.
+ */
+TEST_CASE( "frame/resize", "CFrame resize tests" )
+{
+    start_screen( 40, 10 );
+    resizeterm( 10, 40 );
+    erase();
+
+    std::string wide( 70, 'x' );
+
+    CFrame frame;
+    frame.begin( 40, 10 );
+    frame.draw_row( 0, 0, wide, 0 );
+    frame.draw_row( 1, 0, "second", 0 );
+    REQUIRE( screen_row( 0 ) == std::string( 40, 'x' ) );
+
+    /**
+     * Growing: the same rows now use the extra columns.
+     */
+    REQUIRE( resizeterm( 12, 60 ) == OK );
+    frame.begin( 60, 12 );
+    REQUIRE( frame.rows() == 11 );
+    frame.draw_row( 0, 0, wide, 0 );
+    frame.draw_row( 1, 0, "second", 0 );
+    REQUIRE( screen_row( 0 ) == std::string( 60, 'x' ) );
+    REQUIRE( screen_row( 1 ) == "second" );
+
+    /**
+     * Shrinking: nothing wraps into the row below.
+     */
+    REQUIRE( resizeterm( 8, 20 ) == OK );
+    erase();
+    frame.begin( 20, 8 );
+    REQUIRE( frame.rows() == 7 );
+    frame.draw_row( 0, 0, wide, 0 );
+    frame.draw_row( 1, 0, "second", 0 );
+    REQUIRE( screen_row( 0 ) == std::string( 20, 'x' ) );
+    REQUIRE( screen_row( 1 ) == "second" );
+
+    /**
+     * A row outside the screen is ignored.
+     */
+    frame.draw_row( 7, 0, "status", 0 );
+    REQUIRE( screen_row( 7 ) == "" );
+}
+
+
+/**
+ * What has been written to the terminal.
+ */
+static std::string terminal_output()
+{
+    std::ifstream in( terminal.c_str() );
+    return( std::string( std::istreambuf_iterator<char>( in ),
+                         std::istreambuf_iterator<char>() ) );
+}
+
+
+/**
+ * A frame drawn without any input, such as from a timer, reaches the
+ * terminal at once.
+ */
+TEST_CASE( "frame/output", "CFrame terminal output tests" )
+{
+    start_screen( 40, 10 );
+    resizeterm( 10, 40 );
+
+    /**
+     * Give the loop an empty pipe for stdin, so that only our timer
+     * wakes it.
+     */
+    int fds[2];
+    REQUIRE( pipe( fds ) == 0 );
+    REQUIRE( dup2( fds[0], 0 ) == 0 );
+
+    CFrame frame;
+    frame.begin( 40, 10 );
+
+    bool fired = false;
+    CEventLoop::Instance()->add_timer( 0.01, 0, [&]()
+    {
+        frame.draw_row( 5, 0, "drawn by a timer", 0 );
+        frame.end();
+        fired = true;
+    } );
+
+    while( ! fired )
+        REQUIRE( ! CEventLoop::Instance()->wait( 1000 ) );
+
+    REQUIRE( terminal_output().find( "drawn by a timer" ) != std::string::npos );
+
+    /**
+     * A frame which draws nothing writes nothing.
+     */
+    size_t size = terminal_output().size();
+    frame.begin( 40, 10 );
+    frame.draw_row( 5, 0, "drawn by a timer", 0 );
+    frame.end();
+    REQUIRE( terminal_output().size() == size );
+
+    unlink( terminal.c_str() );
+}
@@ -0,0 +1,82 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "header.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+/**
+ * Simple headers, with case-insensitive lookup.
+ */
+TEST_CASE( "header/parse", "CHeader::parse tests" )
+{
+    CHeader h;
+    h.parse( "From: Steve <steve@example.com>\n"
+             "Subject:   Hello World  \n"
+             "X-Empty:\n"
+             "\n"
+             "From: not a header\n" );
+
+    REQUIRE( h.size() == 3 );
+    REQUIRE( h.get( "From" ) == "Steve <steve@example.com>" );
+    REQUIRE( h.get( "from" ) == "Steve <steve@example.com>" );
+    REQUIRE( h.get( "SUBJECT" ) == "Hello World" );
+
+    REQUIRE( h.has( "x-empty" ) );
+    REQUIRE( h.get( "X-Empty" ) == "" );
+
+    REQUIRE( ! h.has( "To" ) );
+    REQUIRE( h.get( "To" ) == "" );
+}
+
+
+/**
+ * Folded headers, CRLF line-endings, and repeated headers.
+ */
+TEST_CASE( "header/folding", "CHeader::parse folding tests" )
+{
+    CHeader h;
+    h.parse( "Received: from a\r\n"
+             "Received: from b\r\n"
+             "Subject: This is\r\n"
+             "\ta long subject\r\n"
+             "  which was folded\r\n"
+             "\r\n"
+             "Body\r\n" );
+
+    REQUIRE( h.size() == 3 );
+    REQUIRE( h.get( "Received" ) == "from a" );
+    REQUIRE( h.get( "Subject" ) == "This is\ta long subject  which was folded" );
+}
+
+
+/**
+ * Only the header is read from disk.
+ */
+TEST_CASE( "header/load", "CHeader::load tests" )
+{
+    char path[] = "/tmp/header.test.XXXXXX";
+    int fd = mkstemp( path );
+    REQUIRE( fd >= 0 );
+
+    FILE *f = fdopen( fd, "w" );
+    REQUIRE( f != NULL );
+
+    fprintf( f, "To: bob@example.com\nSubject: Attachment\n\n" );
+    for( int i = 0; i < 100000; i++ )
+        fprintf( f, "Subject: line %d of the body\n", i );
+    fclose( f );
+
+    CHeader h;
+    REQUIRE( h.load( path ) );
+    REQUIRE( h.size() == 2 );
+    REQUIRE( h.get( "to" ) == "bob@example.com" );
+    REQUIRE( h.get( "subject" ) == "Attachment" );
+
+    unlink( path );
+
+    REQUIRE( ! h.load( path ) );
+    REQUIRE( h.size() == 0 );
+}
@@ -0,0 +1,149 @@
+/**
+ * headercache_bench.cpp - Compare loading the headers of an index with a
+ * cold header-cache, which must read every message, against a warm one.
+ *
+ * Usage: ./headercache_bench [messages]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "header.h"
+#include "headercache.h"
+#include "sort.h"
+
+
+/**
+ * Current time in seconds.
+ */
+double now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return( tv.tv_sec + tv.tv_usec / 1000000.0 );
+}
+
+
+/**
+ * Load the index headers of each message, via the cache.
+ *
+ * Returns the number of cache hits.
+ */
+int load_index( std::vector<std::string> &paths )
+{
+    CHeaderCache *cache = CHeaderCache::Instance();
+    int hits = 0;
+
+    std::vector<std::string>::iterator it;
+    for (it = paths.begin(); it != paths.end(); ++it)
+    {
+        struct stat sb;
+        if ( stat( it->c_str(), &sb ) != 0 )
+            continue;
+
+        THeaderEntry entry;
+        if ( cache->lookup( *it, sb, entry ) )
+        {
+            hits += 1;
+            continue;
+        }
+
+        CHeader header;
+        header.load( *it );
+
+        entry.from        = header.get( "From" );
+        entry.to          = header.get( "To" );
+        entry.subject     = header.get( "Subject" );
+        entry.date        = header.get( "Date" );
+        entry.message_id  = header.get( "Message-ID" );
+        entry.references  = header.get( "References" );
+        entry.in_reply_to = header.get( "In-Reply-To" );
+        if ( ! CSort::parse_date( entry.date, &entry.date_epoch ) )
+            entry.date_epoch = 0;
+
+        cache->store( *it, sb, entry );
+    }
+    cache->flush();
+    return( hits );
+}
+
+
+int main( int argc, char *argv[] )
+{
+    int messages = ( argc > 1 ) ? atoi( argv[1] ) : 20000;
+
+    /**
+     * Build a synthetic maildir, and a cache directory.
+     */
+    char base[] = "/tmp/headercache.bench.XXXXXX";
+    if ( mkdtemp( base ) == NULL )
+    {
+        perror( "mkdtemp" );
+        return 1;
+    }
+    std::string cache  = std::string( base ) + "/cache";
+    std::string folder = std::string( base ) + "/inbox";
+    std::string cur    = folder + "/cur";
+    mkdir( cache.c_str(), 0755 );
+    mkdir( folder.c_str(), 0755 );
+    mkdir( cur.c_str(), 0755 );
+
+    std::string body( 16 * 1024, 'x' );
+
+    std::vector<std::string> paths;
+    for( int i = 0; i < messages; i++ )
+    {
+        char name[128];
+        snprintf( name, sizeof(name), "%s/%d.M%dP%d.localhost:2,S", cur.c_str(), 1370000000 + i, i, getpid() );
+        FILE *f = fopen( name, "w" );
+        if ( ! f )
+            continue;
+
+        fprintf( f, "Received: from mx.example.com by localhost\n"
+                    "From: Sender %d <sender%d@example.com>\n"
+                    "To: Recipient <recipient@example.com>\n"
+                    "Subject: Message number %d\n"
+                    "Date: Mon, 3 Jun 2013 12:30:15 +0100\n"
+                    "Message-ID: <%d@example.com>\n"
+                    "References: <%d@example.com>\n"
+                    "\n%s\n", i, i, i, i, i - 1, body.c_str() );
+        fclose( f );
+
+        paths.push_back( name );
+    }
+
+    printf( "Loading headers for %d messages\n\n", messages );
+
+    CHeaderCache::Instance()->set_directory( cache );
+
+    double start = now();
+    int hits = load_index( paths );
+    double cold = now() - start;
+    printf( "cold cache : %8.1f ms (%d hits)\n", cold * 1000, hits );
+
+    /**
+     * Re-read the cache from disk, as a new process would.
+     */
+    CHeaderCache::Instance()->set_directory( cache );
+
+    start = now();
+    hits = load_index( paths );
+    double warm = now() - start;
+    printf( "warm cache : %8.1f ms (%d hits)\n", warm * 1000, hits );
+    printf( "speedup    : %8.1fx\n", cold / warm );
+
+    /**
+     * Cleanup.
+     */
+    std::string cmd = "rm -rf " + std::string( base );
+    if ( system( cmd.c_str() ) != 0 )
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "headercache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+
+/**
+ * Create a message file, with the given mtime.
+ */
+static void create( const std::string &path, const char *body, time_t mtime )
+{
+    FILE *f = fopen( path.c_str(), "w" );
+    REQUIRE( f != NULL );
+    fputs( body, f );
+    fclose( f );
+
+    struct timeval tv[2];
+    tv[0].tv_sec  = tv[1].tv_sec  = mtime;
+    tv[0].tv_usec = tv[1].tv_usec = 0;
+    utimes( path.c_str(), tv );
+}
+
+
+/**
+ * Entries survive a round-trip to disk, and are keyed on the unique part
+ * of the filename, the size, and the mtime.
+ */
+TEST_CASE( "headercache/persist", "CHeaderCache persistence tests" )
+{
+    char base[] = "/tmp/headercache.test.XXXXXX";
+    REQUIRE( mkdtemp( base ) != NULL );
+
+    std::string dir    = base;
+    std::string cache  = dir + "/cache";
+    std::string folder = dir + "/inbox";
+    REQUIRE( mkdir( cache.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( folder.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/new" ).c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/cur" ).c_str(), 0755 ) == 0 );
+
+    std::string msg = folder + "/new/1370000000.M1P1.host";
+    create( msg, "Subject: test\n\nbody\n", 1370000000 );
+
+    struct stat sb;
+    REQUIRE( stat( msg.c_str(), &sb ) == 0 );
+
+    THeaderEntry entry;
+    entry.from        = "Steve <steve@example.com>";
+    entry.to          = "bob@example.com";
+    entry.subject     = "Tabs\tand\nnewlines \\ survive";
+    entry.date        = "Mon, 3 Jun 2013 12:30:15 +0100";
+    entry.message_id  = "<1@example.com>";
+    entry.references  = "";
+    entry.in_reply_to = "";
+    entry.date_epoch  = 1370259015;
+
+    CHeaderCache *hc = CHeaderCache::Instance();
+    hc->set_directory( cache );
+
+    THeaderEntry found;
+    REQUIRE( ! hc->lookup( msg, sb, found ) );
+
+    hc->store( msg, sb, entry );
+    REQUIRE( entry.size == (int64_t)sb.st_size );
+    REQUIRE( entry.mtime == (int64_t)sb.st_mtime );
+    hc->flush();
+
+    /**
+     * Re-read from disk, and look the message up after a flag change.
+     */
+    hc->set_directory( cache );
+
+    std::string renamed = folder + "/cur/1370000000.M1P1.host:2,S";
+    REQUIRE( rename( msg.c_str(), renamed.c_str() ) == 0 );
+    REQUIRE( stat( renamed.c_str(), &sb ) == 0 );
+
+    REQUIRE( hc->lookup( renamed, sb, found ) );
+    REQUIRE( found.from == entry.from );
+    REQUIRE( found.subject == entry.subject );
+    REQUIRE( found.references == "" );
+    REQUIRE( found.date_epoch == 1370259015 );
+
+    std::string value;
+    REQUIRE( CHeaderCache::field( found, "Message-ID", value ) );
+    REQUIRE( value == "<1@example.com>" );
+    REQUIRE( ! CHeaderCache::field( found, "X-Mailer", value ) );
+
+    /**
+     * A modified file is a miss.
+     */
+    create( renamed, "Subject: changed\n\nbody\n", 1370000001 );
+    REQUIRE( stat( renamed.c_str(), &sb ) == 0 );
+    REQUIRE( ! hc->lookup( renamed, sb, found ) );
+
+    /**
+     * Pruned entries are gone.
+     */
+    hc->store( renamed, sb, entry );
+    REQUIRE( hc->lookup( renamed, sb, found ) );
+    hc->prune( folder, std::vector<std::string>() );
+    REQUIRE( ! hc->lookup( renamed, sb, found ) );
+
+    hc->set_directory( "" );
+
+    /**
+     * Cleanup.
+     */
+    std::string cmd = "rm -rf " + dir;
+    REQUIRE( system( cmd.c_str() ) == 0 );
+}
+
+
+/**
+ * A cache which can't be saved leaves no temporary file behind.
+ */
+TEST_CASE( "headercache/save", "CHeaderCache save failure tests" )
+{
+    char base[] = "/tmp/headercache.test.XXXXXX";
+    REQUIRE( mkdtemp( base ) != NULL );
+
+    std::string dir    = base;
+    std::string cache  = dir + "/cache";
+    std::string folder = dir + "/inbox";
+    REQUIRE( mkdir( cache.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( folder.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/cur" ).c_str(), 0755 ) == 0 );
+
+    std::string msg = folder + "/cur/1370000000.M1P1.host:2,S";
+    create( msg, "Subject: test\n\nbody\n", 1370000000 );
+
+    struct stat sb;
+    REQUIRE( stat( msg.c_str(), &sb ) == 0 );
+
+    THeaderEntry entry;
+    entry.subject    = "test";
+    entry.date_epoch = 1370000000;
+
+    CHeaderCache *hc = CHeaderCache::Instance();
+    hc->set_directory( cache );
+    hc->store( msg, sb, entry );
+    hc->flush();
+
+    /**
+     * Find the saved file, and put a directory in its place which it
+     * can't be renamed over.
+     */
+    std::string cmd = "cd " + cache + " && for i in *; do " +
+        "rm \"$i\" && mkdir \"$i\" && touch \"$i/keep\"; done";
+    REQUIRE( system( cmd.c_str() ) == 0 );
+
+    entry.subject = "changed";
+    hc->store( msg, sb, entry );
+    hc->flush();
+
+    cmd = "test -z \"$(ls " + cache + " | grep tmp)\"";
+    REQUIRE( system( cmd.c_str() ) == 0 );
+
+    hc->set_directory( "" );
+
+    /**
+     * Cleanup.
+     */
+    cmd = "rm -rf " + dir;
+    REQUIRE( system( cmd.c_str() ) == 0 );
+}
@@ -0,0 +1,106 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "headerpool.h"
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <sys/stat.h>
+
+
+/**
+ * Headers are parsed by the workers, and published through each slot.
+ */
+TEST_CASE( "headerpool/parse", "CHeaderPool tests" )
+{
+    char base[] = "/tmp/headerpool.test.XXXXXX";
+    REQUIRE( mkdtemp( base ) != NULL );
+
+    std::string dir   = base;
+    std::string cache = dir + "/cache";
+    REQUIRE( mkdir( cache.c_str(), 0755 ) == 0 );
+
+    CHeaderCache *hc = CHeaderCache::Instance();
+    hc->set_directory( cache );
+
+    CHeaderPool *pool = CHeaderPool::Instance();
+    REQUIRE( pool->threads() == 0 );
+
+    /**
+     * Queue a batch of messages, and one which doesn't exist.
+     */
+    std::vector<std::shared_ptr<THeaderSlot> > slots;
+    for( int i = 0; i < 200; i++ )
+    {
+        std::stringstream path;
+        path << dir << "/" << i;
+
+        FILE *f = fopen( path.str().c_str(), "w" );
+        REQUIRE( f != NULL );
+        fprintf( f, "From: user%d@example.com\nSubject: message %d\n\nbody\n", i, i );
+        fclose( f );
+
+        slots.push_back( std::make_shared<THeaderSlot>( path.str() ) );
+    }
+    slots.push_back( std::make_shared<THeaderSlot>( dir + "/missing" ) );
+
+    /**
+     * A cancelled slot is never parsed.
+     */
+    slots[0]->state = SLOT_CANCELLED;
+
+    for( size_t i = 0; i < slots.size(); i++ )
+        pool->submit( slots[i], ( i % 10 ) == 0 );
+
+    /**
+     * Nothing happens until there are workers.
+     */
+    REQUIRE( ! pool->busy() );
+    REQUIRE( slots[1]->state.load() == SLOT_PENDING );
+
+    pool->set_threads( 4 );
+    REQUIRE( pool->threads() == 4 );
+
+    pool->wait();
+    REQUIRE( ! pool->busy() );
+
+    long done, total;
+    pool->progress( &done, &total );
+    REQUIRE( done == total );
+    REQUIRE( total == (long)slots.size() );
+
+    REQUIRE( slots[0]->state.load() == SLOT_CANCELLED );
+    REQUIRE( slots[200]->state.load() == SLOT_FAILED );
+
+    for( int i = 1; i < 200; i++ )
+    {
+        std::stringstream subject;
+        subject << "message " << i;
+
+        REQUIRE( slots[i]->state.load() == SLOT_READY );
+        REQUIRE( slots[i]->parsed );
+        REQUIRE( slots[i]->entry.subject == subject.str() );
+        REQUIRE( slots[i]->header.get( "subject" ) == subject.str() );
+    }
+
+    /**
+     * A second pass is served from the header-cache.
+     */
+    std::shared_ptr<THeaderSlot> again = std::make_shared<THeaderSlot>( slots[5]->path );
+    pool->submit( again );
+    pool->wait();
+
+    REQUIRE( again->state.load() == SLOT_READY );
+    REQUIRE( ! again->parsed );
+    REQUIRE( again->entry.subject == "message 5" );
+
+    pool->set_threads( 0 );
+    hc->set_directory( "" );
+
+    /**
+     * Cleanup.
+     */
+    std::string cmd = "rm -rf " + dir;
+    REQUIRE( system( cmd.c_str() ) == 0 );
+}
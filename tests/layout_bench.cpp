@@ -0,0 +1,121 @@
+/**
+ * layout_bench.cpp - Time laying out 60-row frames of the index, as the
+ * screen does when every row has changed.
+ *
+ * Usage: ./layout_bench [frames] [columns]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+
+#include "layout.h"
+
+
+/**
+ * Current time in seconds.
+ */
+double now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return( tv.tv_sec + tv.tv_usec / 1000000.0 );
+}
+
+
+/**
+ * The rows of a frame.
+ */
+#define ROWS 60
+
+
+int main( int argc, char *argv[] )
+{
+    int frames  = ( argc > 1 ) ? atoi( argv[1] ) : 10000;
+    int columns = ( argc > 2 ) ? atoi( argv[2] ) : 200;
+
+    /**
+     * Index lines, as formatted: mostly ASCII, some accented, some wide,
+     * and some longer than the screen.
+     */
+    const char *senders[] =
+    {
+        "Steve Kemp", "J\xc3\xbcrgen M\xc3\xbcller", "\xe5\xb1\xb1\xe7\x94\xb0\xe5\xa4\xaa\xe9\x83\x8e",
+        "Zo\xc3\xab", "debian-devel@lists.debian.org"
+    };
+    const char *subjects[] =
+    {
+        "Re: lumail release",
+        "Caf\xc3\xa9 tomorrow?",
+        "\xe4\xbc\x9a\xe8\xad\xb0\xe3\x81\xae\xe4\xba\x88\xe5\xae\x9a\xe3\x81\xab\xe3\x81\xa4\xe3\x81\xb8\xe3\x81\xa6",
+        "Build failed \xf0\x9f\x98\x9e",
+        "A very long subject which goes on, and on, past the edge of any sensible terminal, to see that we stop early"
+    };
+
+    std::vector<std::string> lines;
+    for( int i = 0; i < ROWS; i++ )
+    {
+        std::string line = "[N   ] ";
+        line += senders[i % 5];
+        line += " - ";
+        line += subjects[( i / 5 ) % 5];
+        lines.push_back( line );
+    }
+
+    printf( "%d frames of %d rows, %d columns\n\n", frames, ROWS, columns );
+
+    /**
+     * Padding one space at a time, and truncating by byte, as we used to.
+     */
+    std::string row;
+    size_t bytes = 0;
+
+    double start = now();
+    for( int f = 0; f < frames; f++ )
+    {
+        for( int i = 0; i < ROWS; i++ )
+        {
+            std::string buf = lines[i];
+            while( (int)buf.size() < columns )
+                buf += std::string( " " );
+            if ( (int)buf.size() > columns )
+                buf.resize( columns );
+            bytes += buf.size();
+        }
+    }
+    double naive = now() - start;
+
+    /**
+     * Laid out by display width, into a reused buffer.
+     */
+    start = now();
+    for( int f = 0; f < frames; f++ )
+    {
+        for( int i = 0; i < ROWS; i++ )
+        {
+            row.clear();
+            CLayout::fit( lines[i], columns, row );
+            bytes += row.size();
+        }
+    }
+    double fitted = now() - start;
+
+    /**
+     * Measuring alone.
+     */
+    start = now();
+    for( int f = 0; f < frames; f++ )
+    {
+        for( int i = 0; i < ROWS; i++ )
+            bytes += CLayout::width( lines[i] );
+    }
+    double measured = now() - start;
+
+    printf( "pad by byte       : %8.2f us/frame\n", naive * 1000000 / frames );
+    printf( "fit by width      : %8.2f us/frame\n", fitted * 1000000 / frames );
+    printf( "measure only      : %8.2f us/frame\n", measured * 1000000 / frames );
+    printf( "\n(%zu bytes)\n", bytes );
+    return 0;
+}
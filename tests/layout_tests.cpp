@@ -0,0 +1,113 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "layout.h"
+
+
+/**
+ * Fit the given text, returning the result.
+ */
+static std::string fit( const std::string &text, size_t columns, bool pad = true )
+{
+    std::string out;
+    CLayout::fit( text, columns, out, pad );
+    return( out );
+}
+
+
+/**
+ * Widths of single characters, and of strings.
+ */
+TEST_CASE( "layout/width", "CLayout width tests" )
+{
+    REQUIRE( CLayout::width( (uint32_t)'a' ) == 1 );
+    REQUIRE( CLayout::width( (uint32_t)0xE9 ) == 1 );
+    REQUIRE( CLayout::width( (uint32_t)0x0301 ) == 0 );
+    REQUIRE( CLayout::width( (uint32_t)0x200B ) == 0 );
+    REQUIRE( CLayout::width( (uint32_t)0x65E5 ) == 2 );
+    REQUIRE( CLayout::width( (uint32_t)0xAC00 ) == 2 );
+    REQUIRE( CLayout::width( (uint32_t)0xFF21 ) == 2 );
+    REQUIRE( CLayout::width( (uint32_t)0x1F600 ) == 2 );
+    REQUIRE( CLayout::width( (uint32_t)0x0416 ) == 1 );
+
+    REQUIRE( CLayout::width( std::string( "" ) ) == 0 );
+    REQUIRE( CLayout::width( std::string( "Steve" ) ) == 5 );
+    REQUIRE( CLayout::width( std::string( "\xc3\xa9t\xc3\xa9" ) ) == 3 );
+    REQUIRE( CLayout::width( std::string( "e\xcc\x81" ) ) == 1 );
+    REQUIRE( CLayout::width( std::string( "\xe6\x97\xa5\xe6\x9c\xac" ) ) == 4 );
+
+    /**
+     * Invalid UTF-8 counts a column per byte.
+     */
+    REQUIRE( CLayout::width( std::string( "\xff\xfe" ) ) == 2 );
+    REQUIRE( CLayout::width( std::string( "\xc0\xaf" ) ) == 2 );
+    REQUIRE( CLayout::width( std::string( "\xe6\x97" ) ) == 2 );
+    REQUIRE( CLayout::width( std::string( "\xed\xa0\x80" ) ) == 3 );
+}
+
+
+/**
+ * Prefixes never split a character.
+ */
+TEST_CASE( "layout/prefix", "CLayout::prefix tests" )
+{
+    std::string text = "a\xe6\x97\xa5" "b";
+    size_t used = 99;
+
+    REQUIRE( CLayout::prefix( text.data(), text.size(), 0, &used ) == 0 );
+    REQUIRE( used == 0 );
+    REQUIRE( CLayout::prefix( text.data(), text.size(), 1, &used ) == 1 );
+    REQUIRE( CLayout::prefix( text.data(), text.size(), 2, &used ) == 1 );
+    REQUIRE( used == 1 );
+    REQUIRE( CLayout::prefix( text.data(), text.size(), 3, &used ) == 4 );
+    REQUIRE( used == 3 );
+    REQUIRE( CLayout::prefix( text.data(), text.size(), 10, &used ) == 5 );
+    REQUIRE( used == 4 );
+
+    /**
+     * Combining marks stay with the character before them.
+     */
+    std::string accent = "e\xcc\x81x";
+    REQUIRE( CLayout::prefix( accent.data(), accent.size(), 1, NULL ) == 3 );
+}
+
+
+/**
+ * Fitting pads, or truncates, to an exact number of columns.
+ */
+TEST_CASE( "layout/fit", "CLayout::fit tests" )
+{
+    REQUIRE( fit( "Steve", 8 ) == "Steve   " );
+    REQUIRE( fit( "Steve", 3 ) == "Ste" );
+    REQUIRE( fit( "Steve", 0 ) == "" );
+    REQUIRE( fit( "Steve", 8, false ) == "Steve" );
+    REQUIRE( fit( "", 2 ) == "  " );
+
+    REQUIRE( fit( "\xc3\xa9t\xc3\xa9", 4 ) == "\xc3\xa9t\xc3\xa9 " );
+    REQUIRE( fit( "\xc3\xa9t\xc3\xa9", 2 ) == "\xc3\xa9t" );
+
+    /**
+     * A wide character which doesn't fit leaves a space.
+     */
+    REQUIRE( fit( "\xe6\x97\xa5\xe6\x9c\xac", 3 ) == "\xe6\x97\xa5 " );
+    REQUIRE( fit( "\xe6\x97\xa5\xe6\x9c\xac", 3, false ) == "\xe6\x97\xa5" );
+    REQUIRE( fit( "a\xe6\x97\xa5", 2 ) == "a " );
+
+    /**
+     * Controls become spaces, tabs stop every eight columns, and invalid
+     * bytes become '?'.
+     */
+    REQUIRE( fit( "a\nb", 4 ) == "a b " );
+    REQUIRE( fit( "a\tb", 10 ) == "a       b " );
+    REQUIRE( fit( "a\tb", 4 ) == "a   " );
+    REQUIRE( fit( "a\xff" "b", 3 ) == "a?b" );
+    REQUIRE( fit( "\xc2\x85", 1 ) == " " );
+
+    /**
+     * The result is appended, and the columns filled returned.
+     */
+    std::string out = "> ";
+    REQUIRE( CLayout::fit( "\xe6\x97\xa5x", 10, out, true ) == 3 );
+    REQUIRE( out.size() == 2 + 4 + 7 );
+    REQUIRE( CLayout::width( out ) == 12 );
+}
@@ -0,0 +1,112 @@
+/**
+ * maildir_bench.cpp - Compare the old readdir+stat file-counting with
+ * the getdents64/d_type implementation in CDirectory.
+ *
+ * Usage: ./maildir_bench [messages] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <string>
+
+#include "directory.h"
+#include "file.h"
+
+
+/**
+ * The previous implementation of CMaildir::countFiles.
+ */
+int legacy_count_files(std::string path)
+{
+    int count = 0;
+    dirent *de;
+    DIR *dp;
+
+    dp = opendir(path.c_str());
+    if (dp) {
+        while (true) {
+            de = readdir(dp);
+            if (de == NULL)
+                break;
+
+            if (!CFile::is_directory(std::string(path + "/" + de->d_name)))
+                count += 1;
+        }
+        closedir(dp);
+    }
+    return count;
+}
+
+
+/**
+ * Current time in seconds.
+ */
+double now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return( tv.tv_sec + tv.tv_usec / 1000000.0 );
+}
+
+
+int main( int argc, char *argv[] )
+{
+    int messages   = ( argc > 1 ) ? atoi( argv[1] ) : 40000;
+    int iterations = ( argc > 2 ) ? atoi( argv[2] ) : 10;
+
+    /**
+     * Build a synthetic "cur" directory.
+     */
+    char base[] = "/tmp/maildir.bench.XXXXXX";
+    if ( mkdtemp( base ) == NULL )
+    {
+        perror( "mkdtemp" );
+        return 1;
+    }
+    std::string cur = std::string( base ) + "/cur";
+    mkdir( cur.c_str(), 0755 );
+
+    for( int i = 0; i < messages; i++ )
+    {
+        char name[128];
+        snprintf( name, sizeof(name), "%s/%d.M%dP%d.localhost:2,S", cur.c_str(), 1370000000 + i, i, getpid() );
+        FILE *f = fopen( name, "w" );
+        if ( f )
+            fclose( f );
+    }
+
+    /**
+     * Time both implementations.
+     */
+    int a = 0, b = 0;
+
+    double start = now();
+    for( int i = 0; i < iterations; i++ )
+        a = legacy_count_files( cur );
+    double legacy = ( now() - start ) / iterations;
+
+    start = now();
+    for( int i = 0; i < iterations; i++ )
+        b = CDirectory::count_files( cur );
+    double fast = ( now() - start ) / iterations;
+
+    printf( "messages: %d, iterations: %d\n", messages, iterations );
+    printf( "readdir+stat : %8.3f ms (count %d)\n", legacy * 1000, a );
+    printf( "getdents64   : %8.3f ms (count %d)\n", fast * 1000, b );
+    printf( "speedup      : %8.2fx\n", legacy / fast );
+
+    /**
+     * Cleanup.
+     */
+    std::string cmd = "rm -rf ";
+    cmd += base;
+    if ( system( cmd.c_str() ) != 0 )
+        fprintf( stderr, "Failed to remove %s\n", base );
+
+    return( a == b ? 0 : 1 );
+}
@@ -0,0 +1,73 @@
+/**
+ * maildir_helpers.h - Temporary maildirs, shared by the test-cases.
+ */
+
+#ifndef _maildir_helpers_h_
+#define _maildir_helpers_h_ 1
+
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "catch.hpp"
+#include "foldercache.h"
+
+
+/**
+ * A cache of our own, rather than the singleton, so that each test can
+ * start afresh, as if lumail had been restarted.
+ */
+class CTestFolderCache : public CFolderCache
+{
+public:
+    CTestFolderCache() : CFolderCache() {}
+};
+
+
+/**
+ * Make a directory.
+ */
+inline void make_dir( const std::string &path )
+{
+    REQUIRE( mkdir( path.c_str(), 0755 ) == 0 );
+}
+
+
+/**
+ * Make a maildir.
+ */
+inline void make_maildir( const std::string &path )
+{
+    make_dir( path );
+    make_dir( path + "/cur" );
+    make_dir( path + "/new" );
+    make_dir( path + "/tmp" );
+}
+
+
+/**
+ * A temporary directory, named for the test, which is also HOME.
+ */
+inline std::string make_base( const std::string &name )
+{
+    std::string path = "/tmp/" + name + ".test.XXXXXX";
+    std::vector<char> base( path.begin(), path.end() );
+    base.push_back( '\0' );
+
+    REQUIRE( mkdtemp( &base[0] ) != NULL );
+    setenv( "HOME", &base[0], 1 );
+    return( &base[0] );
+}
+
+
+/**
+ * Remove a temporary directory, including any we made unreadable.
+ */
+inline void remove_base( const std::string &base )
+{
+    std::string cmd = "chmod -R u+rwx " + base + " && rm -rf " + base;
+    REQUIRE( system( cmd.c_str() ) == 0 );
+}
+
+#endif /* _maildir_helpers_h_ */
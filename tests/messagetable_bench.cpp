@@ -0,0 +1,217 @@
+/**
+ * messagetable_bench.cpp - Compare a vector of individually allocated
+ * message objects against the message table, for building the index,
+ * limiting it to new messages, and sorting it by arrival.
+ *
+ * No files are created: arrival keys come from the filename alone.
+ *
+ * Usage: ./messagetable_bench [messages]
+ */
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "flags.h"
+#include "messagetable.h"
+#include "sort.h"
+
+
+/**
+ * The previous layout: one heap object per message, holding its own
+ * path, flags, and sort key, beside its parsed headers.
+ */
+struct TLegacyMessage
+{
+    std::string path;
+    uint64_t flags;
+    bool in_new;
+    TSortKey key;
+
+    /**
+     * Stand-in for the rest of the object: the header fields, and the
+     * header-block, which sit between one message's flags and the next.
+     */
+    char headers[320];
+};
+
+
+/**
+ * The key the index used to recognise a message across renames: the
+ * folder plus the unique part of the filename.
+ */
+std::string message_key( const std::string &path )
+{
+    size_t slash = path.rfind( '/' );
+    if ( slash == std::string::npos )
+        return( path );
+
+    std::string base = path.substr( slash + 1 );
+    size_t colon = base.find( ':' );
+    if ( colon != std::string::npos )
+        base = base.substr( 0, colon );
+
+    size_t parent = path.rfind( '/', slash ? slash - 1 : 0 );
+    if ( ( parent == std::string::npos ) || ( parent >= slash ) )
+        return( base );
+
+    return( path.substr( 0, parent ) + "/" + base );
+}
+
+
+/**
+ * Current time in seconds.
+ */
+double now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return( tv.tv_sec + tv.tv_usec / 1000000.0 );
+}
+
+
+int main( int argc, char *argv[] )
+{
+    int messages = ( argc > 1 ) ? atoi( argv[1] ) : 500000;
+
+    srand( 42 );
+
+    /**
+     * Synthetic paths, in directory order, with one in ten unread.
+     */
+    std::vector<std::string> paths;
+    paths.reserve( messages );
+    for( int i = 0; i < messages; i++ )
+    {
+        char name[160];
+        bool unread = ( rand() % 10 ) == 0;
+        snprintf( name, sizeof(name), "/home/user/Maildir/folder%d/%s/%d.M%dP%d.localhost%s",
+                  i % 20, unread ? "new" : "cur", 1370000000 + ( rand() % 10000000 ), i, 4242,
+                  unread ? "" : ":2,S" );
+        paths.push_back( name );
+    }
+
+    printf( "%d messages\n\n", messages );
+    printf( "                     %10s %10s\n", "objects", "table" );
+
+    /**
+     * Build, including the index used to match messages across renames.
+     */
+    double start = now();
+    std::vector<TLegacyMessage *> legacy;
+    std::unordered_map<std::string, TLegacyMessage *> *keys =
+        new std::unordered_map<std::string, TLegacyMessage *>;
+    for( int i = 0; i < messages; i++ )
+    {
+        TLegacyMessage *msg = new TLegacyMessage;
+        msg->path   = paths[i];
+        msg->flags  = CFlags::parse( paths[i] );
+        msg->in_new = CFlags::in_new( paths[i] );
+        legacy.push_back( msg );
+        (*keys)[message_key( paths[i] )] = msg;
+    }
+    double legacy_build = now() - start;
+
+    start = now();
+    CMessageTable *table = new CMessageTable();
+    std::vector<uint32_t> rows;
+    for( int i = 0; i < messages; i++ )
+        rows.push_back( table->add( paths[i] ) );
+    double table_build = now() - start;
+
+    printf( "build             : %8.1f ms %8.1f ms\n", legacy_build * 1000, table_build * 1000 );
+
+    /**
+     * Keys.
+     */
+    start = now();
+    for( int i = 0; i < messages; i++ )
+    {
+        legacy[i]->key.number = CSort::arrival( legacy[i]->path );
+        legacy[i]->key.tie    = legacy[i]->path;
+    }
+    double legacy_keys = now() - start;
+
+    start = now();
+    for( int i = 0; i < messages; i++ )
+        table->file_key( rows[i], SORT_ARRIVAL );
+    double table_keys = now() - start;
+
+    printf( "arrival keys      : %8.1f ms %8.1f ms\n", legacy_keys * 1000, table_keys * 1000 );
+
+    /**
+     * Sort.
+     */
+    start = now();
+    std::sort( legacy.begin(), legacy.end(),
+               []( TLegacyMessage *a, TLegacyMessage *b ) { return( CSort::less( a->key, b->key ) ); } );
+    double legacy_sort = now() - start;
+
+    start = now();
+    table->sort( rows );
+    double table_sort = now() - start;
+
+    printf( "sort              : %8.1f ms %8.1f ms\n", legacy_sort * 1000, table_sort * 1000 );
+
+    /**
+     * Limit to new messages, as index_limit("new") does.  Repeated, as
+     * this runs on every refresh.
+     */
+    const int passes = 20;
+    size_t legacy_new = 0;
+    size_t table_new  = 0;
+
+    std::vector<TLegacyMessage *> legacy_visible;
+    legacy_visible.reserve( messages );
+    start = now();
+    for( int pass = 0; pass < passes; pass++ )
+    {
+        legacy_visible.clear();
+        for( size_t i = 0; i < legacy.size(); i++ )
+        {
+            if ( legacy[i]->in_new || ( legacy[i]->flags & CFlags::bit( 'N' ) ) )
+                legacy_visible.push_back( legacy[i] );
+        }
+        legacy_new = legacy_visible.size();
+    }
+    double legacy_filter = ( now() - start ) / passes;
+
+    std::vector<uint32_t> table_visible;
+    table_visible.reserve( messages );
+    start = now();
+    for( int pass = 0; pass < passes; pass++ )
+    {
+        table_visible.clear();
+        for( size_t i = 0; i < rows.size(); i++ )
+        {
+            if ( table->is_new( rows[i] ) )
+                table_visible.push_back( rows[i] );
+        }
+        table_new = table_visible.size();
+    }
+    double table_filter = ( now() - start ) / passes;
+
+    printf( "limit to new      : %8.1f ms %8.1f ms (%zu / %zu matched)\n",
+            legacy_filter * 1000, table_filter * 1000, legacy_new, table_new );
+
+    /**
+     * Free.  The table goes first, as freeing half a million objects
+     * leaves malloc with a lot of tidying up to do on the next free.
+     */
+    start = now();
+    delete( table );
+    double table_free = now() - start;
+
+    start = now();
+    for( size_t i = 0; i < legacy.size(); i++ )
+        delete( legacy[i] );
+    delete( keys );
+    double legacy_free = now() - start;
+
+    printf( "free              : %8.1f ms %8.1f ms\n", legacy_free * 1000, table_free * 1000 );
+    return 0;
+}
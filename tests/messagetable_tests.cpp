@@ -0,0 +1,162 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "messagetable.h"
+#include <sstream>
+
+
+/**
+ * Paths are stored, and found again after renames.
+ */
+TEST_CASE( "messagetable/paths", "CMessageTable path tests" )
+{
+    CMessageTable table;
+
+    uint32_t a = table.add( "/mail/inbox/new/1370000000.M1P1.host" );
+    uint32_t b = table.add( "/mail/inbox/cur/1370000001.M2P2.host:2,RS" );
+    uint32_t c = table.add( "/mail/work/cur/1370000000.M1P1.host:2," );
+    uint32_t d = table.add( "message.eml" );
+    uint32_t e = table.add( "/message.eml" );
+
+    REQUIRE( table.size() == 5 );
+    REQUIRE( table.path( a ) == "/mail/inbox/new/1370000000.M1P1.host" );
+    REQUIRE( table.path( b ) == "/mail/inbox/cur/1370000001.M2P2.host:2,RS" );
+    REQUIRE( table.path( d ) == "message.eml" );
+    REQUIRE( table.path( e ) == "/message.eml" );
+
+    /**
+     * Flags.
+     */
+    REQUIRE( table.in_new( a ) );
+    REQUIRE( table.is_new( a ) );
+    REQUIRE( ! table.is_new( b ) );
+    REQUIRE( table.flags( b ) == ( CFlags::bit( 'R' ) | CFlags::bit( 'S' ) ) );
+
+    /**
+     * The same unique name in another folder is a different message.
+     */
+    REQUIRE( table.find( "/mail/inbox/new/1370000000.M1P1.host" ) == a );
+    REQUIRE( table.find( "/mail/work/cur/1370000000.M1P1.host:2," ) == c );
+    REQUIRE( table.find( "/mail/inbox/cur/1370000000.M1P1.host:2,S" ) == a );
+    REQUIRE( table.find( "/mail/other/cur/1370000000.M1P1.host:2,S" ) == MESSAGE_NO_ROW );
+
+    /**
+     * Renames keep the row, and change its version.
+     */
+    uint32_t version = table.version( a );
+    REQUIRE( version != 0 );
+    REQUIRE( version != table.version( b ) );
+
+    table.rename( a, "/mail/inbox/cur/1370000000.M1P1.host:2,S" );
+    REQUIRE( table.version( a ) != version );
+    REQUIRE( table.path( a ) == "/mail/inbox/cur/1370000000.M1P1.host:2,S" );
+    REQUIRE( ! table.in_new( a ) );
+    REQUIRE( table.flags( a ) == CFlags::bit( 'S' ) );
+    REQUIRE( table.find( "/mail/inbox/new/1370000000.M1P1.host" ) == a );
+
+    /**
+     * The skip-list, and exact matches, let two copies coexist.
+     */
+    uint32_t dup = table.add( "/mail/inbox/new/1370000000.M1P1.host" );
+    REQUIRE( table.find( "/mail/inbox/new/1370000000.M1P1.host" ) == dup );
+    REQUIRE( table.find( "/mail/inbox/cur/1370000000.M1P1.host:2,S" ) == a );
+
+    std::vector<bool> skip( table.rows(), false );
+    skip[a] = true;
+    REQUIRE( table.find( "/mail/inbox/cur/1370000000.M1P1.host:2,S", skip ) == dup );
+
+    /**
+     * Removed rows are reused.
+     */
+    table.remove( b );
+    REQUIRE( ! table.live( b ) );
+    REQUIRE( table.find( "/mail/inbox/cur/1370000001.M2P2.host:2,RS" ) == MESSAGE_NO_ROW );
+    REQUIRE( table.size() == 5 );
+
+    uint32_t f = table.add( "/mail/inbox/new/1370000002.M3P3.host" );
+    REQUIRE( f == b );
+    REQUIRE( table.path( f ) == "/mail/inbox/new/1370000002.M3P3.host" );
+}
+
+
+/**
+ * Rows sort by their keys, with ties broken on the filename.
+ */
+TEST_CASE( "messagetable/sort", "CMessageTable sort tests" )
+{
+    CMessageTable table;
+
+    std::vector<uint32_t> rows;
+    rows.push_back( table.add( "/mail/inbox/cur/1370000003.B.host:2,S" ) );
+    rows.push_back( table.add( "/mail/inbox/cur/1370000001.A.host:2,S" ) );
+    rows.push_back( table.add( "/mail/inbox/new/1370000003.A.host" ) );
+    rows.push_back( table.add( "/mail/inbox/cur/1370000002.A.host:2," ) );
+
+    for( size_t i = 0; i < rows.size(); i++ )
+    {
+        REQUIRE( ! table.has_key( rows[i], SORT_ARRIVAL ) );
+        REQUIRE( table.file_key( rows[i], SORT_ARRIVAL ) );
+        REQUIRE( table.has_key( rows[i], SORT_ARRIVAL ) );
+    }
+    REQUIRE( ! table.file_key( rows[0], SORT_SUBJECT ) );
+
+    table.sort( rows );
+    REQUIRE( table.path( rows[0] ) == "/mail/inbox/cur/1370000001.A.host:2,S" );
+    REQUIRE( table.path( rows[1] ) == "/mail/inbox/cur/1370000002.A.host:2," );
+    REQUIRE( table.path( rows[2] ) == "/mail/inbox/new/1370000003.A.host" );
+    REQUIRE( table.path( rows[3] ) == "/mail/inbox/cur/1370000003.B.host:2,S" );
+
+    /**
+     * With equal numbers the text decides.
+     */
+    table.set_key( rows[0], SORT_SUBJECT, 0, "zebra" );
+    table.set_key( rows[1], SORT_SUBJECT, 0, "apple" );
+    table.set_key( rows[2], SORT_SUBJECT, 0, "mango" );
+    table.set_key( rows[3], SORT_SUBJECT, 0, "apple" );
+
+    table.sort( rows );
+    REQUIRE( table.path( rows[0] ) == "/mail/inbox/cur/1370000002.A.host:2," );
+    REQUIRE( table.path( rows[1] ) == "/mail/inbox/cur/1370000003.B.host:2,S" );
+    REQUIRE( table.path( rows[2] ) == "/mail/inbox/new/1370000003.A.host" );
+    REQUIRE( table.path( rows[3] ) == "/mail/inbox/cur/1370000001.A.host:2,S" );
+}
+
+
+/**
+ * The name arena is compacted, without disturbing the live rows.
+ */
+TEST_CASE( "messagetable/compact", "CMessageTable compaction tests" )
+{
+    CMessageTable table;
+
+    std::vector<uint32_t> rows;
+    for( int i = 0; i < 20000; i++ )
+    {
+        std::stringstream path;
+        path << "/mail/inbox/new/" << 1370000000 + i << ".M" << i << "P1.host";
+        rows.push_back( table.add( path.str() ) );
+    }
+
+    /**
+     * Rename them all, twice, and remove the odd ones.
+     */
+    for( int i = 0; i < 20000; i++ )
+    {
+        std::stringstream path;
+        path << "/mail/inbox/cur/" << 1370000000 + i << ".M" << i << "P1.host:2,";
+        table.rename( rows[i], path.str() );
+        table.rename( rows[i], path.str() + "S" );
+
+        if ( i % 2 )
+            table.remove( rows[i] );
+    }
+
+    REQUIRE( table.size() == 10000 );
+    for( int i = 0; i < 20000; i += 2 )
+    {
+        std::stringstream path;
+        path << "/mail/inbox/cur/" << 1370000000 + i << ".M" << i << "P1.host:2,S";
+        REQUIRE( table.path( rows[i] ) == path.str() );
+        REQUIRE( table.find( path.str() ) == rows[i] );
+    }
+}
@@ -0,0 +1,93 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "mimecache.h"
+
+
+/**
+ * The cache never looks inside an entity, so a stand-in will do.
+ */
+namespace mimetic
+{
+    class MimeEntity
+    {
+    public:
+        MimeEntity( int *live ) : m_live( live ) { *m_live += 1; }
+        ~MimeEntity() { *m_live -= 1; }
+    private:
+        int *m_live;
+    };
+}
+
+
+/**
+ * Entities are evicted least-recently used first, once over budget.
+ */
+TEST_CASE( "mimecache/lru", "CMimeCache eviction tests" )
+{
+    int live = 0;
+
+    /**
+     * The owners are only used as keys.
+     */
+    const CMessage *a = (const CMessage *)0x10;
+    const CMessage *b = (const CMessage *)0x20;
+    const CMessage *c = (const CMessage *)0x30;
+
+    CMimeCache *cache = CMimeCache::Instance();
+    cache->set_limit( 250 );
+
+    cache->insert( a, std::make_shared<mimetic::MimeEntity>( &live ), 100 );
+    cache->insert( b, std::make_shared<mimetic::MimeEntity>( &live ), 100 );
+    REQUIRE( cache->resident() == 200 );
+    REQUIRE( cache->count() == 2 );
+    REQUIRE( live == 2 );
+
+    /**
+     * Touch a, so that b is the oldest.
+     */
+    REQUIRE( cache->get( a ).get() != NULL );
+
+    cache->insert( c, std::make_shared<mimetic::MimeEntity>( &live ), 100 );
+    REQUIRE( cache->resident() == 200 );
+    REQUIRE( cache->evictions() == 1 );
+    REQUIRE( live == 2 );
+    REQUIRE( cache->get( b ).get() == NULL );
+    REQUIRE( cache->get( a ).get() != NULL );
+    REQUIRE( cache->get( c ).get() != NULL );
+
+    /**
+     * An entity in use survives eviction until it is released.
+     */
+    {
+        std::shared_ptr<mimetic::MimeEntity> held = cache->get( c );
+        cache->set_limit( 0 );
+
+        REQUIRE( cache->count() == 1 );
+        REQUIRE( cache->resident() == 100 );
+        REQUIRE( cache->get( a ).get() == NULL );
+
+        cache->remove( c );
+        REQUIRE( cache->count() == 0 );
+        REQUIRE( cache->resident() == 0 );
+        REQUIRE( live == 1 );
+    }
+    REQUIRE( live == 0 );
+
+    /**
+     * The newest is kept even if it alone is over budget.
+     */
+    cache->insert( a, std::make_shared<mimetic::MimeEntity>( &live ), 1000 );
+    REQUIRE( cache->count() == 1 );
+
+    /**
+     * Replacing an entity doesn't double-count it.
+     */
+    cache->set_limit( 5000 );
+    cache->insert( a, std::make_shared<mimetic::MimeEntity>( &live ), 500 );
+    REQUIRE( cache->resident() == 500 );
+    REQUIRE( live == 1 );
+
+    cache->remove( a );
+    REQUIRE( live == 0 );
+}
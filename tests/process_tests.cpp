@@ -0,0 +1,115 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "eventloop.h"
+#include "process.h"
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+
+/**
+ * Give the loop an empty pipe for stdin, so that only our events wake it.
+ */
+static void quiet_stdin()
+{
+    static bool done = false;
+    if ( done )
+        return;
+
+    int fds[2];
+    REQUIRE( pipe( fds ) == 0 );
+    REQUIRE( dup2( fds[0], 0 ) == 0 );
+    done = true;
+}
+
+
+/**
+ * Run the loop until every command has finished.
+ */
+static void finish()
+{
+    CProcess *proc = CProcess::Instance();
+    for( int i = 0; i < 1000 && proc->running() > 0; i++ )
+        CEventLoop::Instance()->wait( 100 );
+    REQUIRE( proc->running() == 0 );
+}
+
+
+/**
+ * Output arrives a line at a time, then the exit status.
+ */
+TEST_CASE( "process/output", "CProcess output tests" )
+{
+    quiet_stdin();
+    CProcess *proc = CProcess::Instance();
+
+    std::vector<std::string> lines;
+    int code = -1;
+
+    pid_t pid = proc->spawn( "echo one; echo two >&2; printf three",
+                             [&lines]( const std::string &line ) { lines.push_back( line ); },
+                             [&]( int c ) { code = c; REQUIRE( lines.size() == 3 ); } );
+    REQUIRE( pid > 0 );
+    REQUIRE( proc->running() == 1 );
+
+    finish();
+    REQUIRE( code == 0 );
+    REQUIRE( lines.size() == 3 );
+    REQUIRE( lines[0] == "one" );
+    REQUIRE( lines[1] == "two" );
+    REQUIRE( lines[2] == "three" );
+
+    /**
+     * The command reads nothing.
+     */
+    lines.clear();
+    proc->spawn( "cat; echo done",
+                 [&lines]( const std::string &line ) { lines.push_back( line ); },
+                 NULL );
+    finish();
+    REQUIRE( lines.size() == 1 );
+    REQUIRE( lines[0] == "done" );
+}
+
+
+/**
+ * Exit statuses, and signals.
+ */
+TEST_CASE( "process/exit", "CProcess exit tests" )
+{
+    quiet_stdin();
+    CProcess *proc = CProcess::Instance();
+
+    int failed = -1, missing = -1, killed = -1, slow = -1;
+
+    proc->spawn( "exit 3", NULL, [&failed]( int c ) { failed = c; } );
+    proc->spawn( "/no/such/command", NULL, [&missing]( int c ) { missing = c; } );
+    proc->spawn( "kill -9 $$", NULL, [&killed]( int c ) { killed = c; } );
+    proc->spawn( "sleep 0.2", NULL, [&slow]( int c ) { slow = c; } );
+    REQUIRE( proc->running() == 4 );
+
+    /**
+     * We don't wait for one command to see another finish.
+     */
+    while( killed < 0 || failed < 0 || missing < 0 )
+        CEventLoop::Instance()->wait( 1000 );
+    REQUIRE( slow == -1 );
+
+    finish();
+    REQUIRE( failed == 3 );
+    REQUIRE( missing == 127 );
+    REQUIRE( killed == 128 + 9 );
+    REQUIRE( slow == 0 );
+
+    /**
+     * A command may be started when another finishes.
+     */
+    int second = -1;
+    proc->spawn( "true", NULL, [&]( int )
+    {
+        proc->spawn( "exit 1", NULL, [&second]( int c ) { second = c; } );
+    } );
+    finish();
+    REQUIRE( second == 1 );
+}
@@ -0,0 +1,286 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "flags.h"
+#include "query.h"
+#include <time.h>
+
+
+/**
+ * A message, as far as a query is concerned.
+ */
+struct TFakeMessage
+{
+    std::string from;
+    std::string to;
+    std::string subject;
+    std::string line;
+    uint64_t flags;
+    int64_t date;
+    int64_t size;
+};
+
+
+/**
+ * Does the given query match the given message?
+ */
+bool matches( const std::string &text, TFakeMessage &msg )
+{
+    CQuery query( text );
+    REQUIRE( query.error() == "" );
+
+    return( query.matches(
+        [&msg]( TQueryField field ) -> const std::string &
+        {
+            switch( field ) {
+            case QUERY_FROM:    return( msg.from );
+            case QUERY_TO:      return( msg.to );
+            case QUERY_SUBJECT: return( msg.subject );
+            default:            return( msg.line );
+            }
+        },
+        [&msg]( TQueryField field ) -> int64_t
+        {
+            switch( field ) {
+            case QUERY_DATE: return( msg.date );
+            case QUERY_SIZE: return( msg.size );
+            default:         return( (int64_t)msg.flags );
+            }
+        } ) );
+}
+
+
+/**
+ * The local midnight starting the given day.
+ */
+int64_t day( int year, int month, int mday )
+{
+    struct tm tm;
+    memset( &tm, 0, sizeof(tm) );
+    tm.tm_year  = year - 1900;
+    tm.tm_mon   = month - 1;
+    tm.tm_mday  = mday;
+    tm.tm_isdst = -1;
+    return( (int64_t)mktime( &tm ) );
+}
+
+
+/**
+ * Only limits with the prefix are queries.
+ */
+TEST_CASE( "query/compiled", "CQuery detection tests" )
+{
+    REQUIRE( CQuery::compiled( "all" ) == NULL );
+    REQUIRE( CQuery::compiled( "new" ) == NULL );
+    REQUIRE( CQuery::compiled( "Steve Kemp" ) == NULL );
+    REQUIRE( CQuery::compiled( "Re: lumail" ) == NULL );
+    REQUIRE( CQuery::compiled( "this or that" ) == NULL );
+
+    /**
+     * A substring which mentions a field is still a substring.
+     */
+    REQUIRE( CQuery::compiled( "from:steve" ) == NULL );
+    REQUIRE( CQuery::compiled( "Re: subject: lumail" ) == NULL );
+    REQUIRE( CQuery::compiled( "to:" ) == NULL );
+    REQUIRE( CQuery::cached() == 0 );
+
+    CQuery *query = CQuery::compiled( "query:from:steve" );
+    REQUIRE( query != NULL );
+    REQUIRE( query->error() == "" );
+    REQUIRE( query->needs( QUERY_FROM ) );
+    REQUIRE( query == CQuery::compiled( "query:from:steve" ) );
+    REQUIRE( CQuery::compiled( "query:-subject:spam" ) != NULL );
+
+    /**
+     * A query need not use a field, and mistakes are kept for reporting.
+     */
+    query = CQuery::compiled( "query:lumail or steve" );
+    REQUIRE( query != NULL );
+    REQUIRE( query->needs( QUERY_LINE ) );
+    REQUIRE( CQuery::compiled( "query:" )->error() != "" );
+    REQUIRE( CQuery::compiled( "query:after:soon" )->error() != "" );
+
+    CQuery::clear_cache();
+    REQUIRE( CQuery::cached() == 0 );
+}
+
+
+/**
+ * Only a few compiled queries are kept.
+ */
+TEST_CASE( "query/cache", "CQuery cache tests" )
+{
+    for( int i = 0; i < 1000; i++ )
+    {
+        CQuery *query = CQuery::compiled( "query:size:>" + std::to_string( i ) );
+        REQUIRE( query != NULL );
+        REQUIRE( query->error() == "" );
+        REQUIRE( CQuery::cached() <= 32 );
+    }
+
+    CQuery::clear_cache();
+}
+
+
+/**
+ * Each kind of term.
+ */
+TEST_CASE( "query/terms", "CQuery term tests" )
+{
+    TFakeMessage msg;
+    msg.from    = "Steve Kemp <steve@steve.org.uk>";
+    msg.to      = "lumail@example.com";
+    msg.subject = "Re: build failed on amd64";
+    msg.line    = "[RS  ] Steve Kemp - Re: build failed on amd64";
+    msg.flags   = CFlags::bit( 'R' ) | CFlags::bit( 'S' );
+    msg.date    = day( 2013, 6, 15 ) + 3600;
+    msg.size    = 2 * 1024 * 1024;
+
+    /**
+     * Headers match ignoring case.
+     */
+    REQUIRE( matches( "from:steve", msg ) );
+    REQUIRE( matches( "from:STEVE.ORG", msg ) );
+    REQUIRE( ! matches( "from:bob", msg ) );
+    REQUIRE( matches( "to:lumail", msg ) );
+    REQUIRE( matches( "subject:\"build failed\"", msg ) );
+    REQUIRE( ! matches( "subject:\"build passed\"", msg ) );
+
+    /**
+     * Flags must all be present, in either case.
+     */
+    REQUIRE( matches( "flag:R", msg ) );
+    REQUIRE( matches( "flag:RS", msg ) );
+    REQUIRE( matches( "flag:r", msg ) );
+    REQUIRE( matches( "flag:rS", msg ) );
+    REQUIRE( ! matches( "flag:F", msg ) );
+    REQUIRE( ! matches( "flag:f", msg ) );
+    REQUIRE( ! matches( "flag:RF", msg ) );
+    REQUIRE( ! matches( "flag:rf", msg ) );
+
+    /**
+     * Dates are whole days, and neither includes the day given.
+     */
+    REQUIRE( matches( "after:2013-06-01", msg ) );
+    REQUIRE( matches( "after:2013-06-14", msg ) );
+    REQUIRE( ! matches( "after:2013-06-15", msg ) );
+    REQUIRE( ! matches( "after:2013-06-16", msg ) );
+    REQUIRE( matches( "before:2013-06-16", msg ) );
+    REQUIRE( ! matches( "before:2013-06-15", msg ) );
+
+    /**
+     * The last second of a day is still that day, and the first of the
+     * next is after it.
+     */
+    msg.date = day( 2013, 6, 16 ) - 1;
+    REQUIRE( ! matches( "after:2013-06-15", msg ) );
+    msg.date = day( 2013, 6, 16 );
+    REQUIRE( matches( "after:2013-06-15", msg ) );
+    REQUIRE( ! matches( "before:2013-06-16", msg ) );
+
+    /**
+     * Across the end of a month.
+     */
+    msg.date = day( 2013, 7, 1 );
+    REQUIRE( matches( "after:2013-06-30", msg ) );
+    msg.date = day( 2013, 6, 15 ) + 3600;
+
+    /**
+     * Sizes.
+     */
+    REQUIRE( matches( "size:>1M", msg ) );
+    REQUIRE( ! matches( "size:>2M", msg ) );
+    REQUIRE( matches( "size:>=2M", msg ) );
+    REQUIRE( matches( "size:2M", msg ) );
+    REQUIRE( matches( "size:<3mb", msg ) );
+    REQUIRE( ! matches( "size:<2M", msg ) );
+    REQUIRE( matches( "size:<=2M", msg ) );
+    REQUIRE( matches( "size:>2000K", msg ) );
+
+    /**
+     * Bare words match the index line exactly.
+     */
+    REQUIRE( matches( "from:steve amd64", msg ) );
+    REQUIRE( ! matches( "from:steve AMD64", msg ) );
+    REQUIRE( matches( "from:steve \"[RS  ]\"", msg ) );
+}
+
+
+/**
+ * Operators, precedence, and grouping.
+ */
+TEST_CASE( "query/operators", "CQuery boolean tests" )
+{
+    TFakeMessage msg;
+    msg.from    = "alice@example.com";
+    msg.to      = "bob@example.com";
+    msg.subject = "lunch?";
+    msg.line    = "";
+    msg.flags   = CFlags::bit( 'N' );
+    msg.date    = day( 2013, 6, 1 );
+    msg.size    = 1000;
+
+    REQUIRE( matches( "from:alice to:bob", msg ) );
+    REQUIRE( matches( "from:alice and to:bob", msg ) );
+    REQUIRE( ! matches( "from:alice and to:carol", msg ) );
+    REQUIRE( matches( "from:alice or to:carol", msg ) );
+    REQUIRE( matches( "from:carol OR to:bob", msg ) );
+
+    REQUIRE( ! matches( "not from:alice", msg ) );
+    REQUIRE( ! matches( "-from:alice", msg ) );
+    REQUIRE( matches( "-from:carol", msg ) );
+    REQUIRE( matches( "not not from:alice", msg ) );
+
+    /**
+     * "and" binds more tightly than "or".
+     */
+    REQUIRE( matches( "from:carol and to:carol or flag:N", msg ) );
+    REQUIRE( ! matches( "from:carol and ( to:carol or flag:N )", msg ) );
+    REQUIRE( matches( "(from:alice or from:carol) size:<1K", msg ) );
+    REQUIRE( ! matches( "not (from:alice or from:carol)", msg ) );
+}
+
+
+/**
+ * Mistakes are reported, and match nothing.
+ */
+TEST_CASE( "query/errors", "CQuery error tests" )
+{
+    REQUIRE( CQuery( "from:" ).error() != "" );
+    REQUIRE( CQuery( "flag:!" ).error() != "" );
+    REQUIRE( CQuery( "after:yesterday" ).error() != "" );
+    REQUIRE( CQuery( "before:2013-13-01" ).error() != "" );
+    REQUIRE( CQuery( "size:big" ).error() != "" );
+    REQUIRE( CQuery( "size:>1Q" ).error() != "" );
+    REQUIRE( CQuery( "( from:steve" ).error() != "" );
+    REQUIRE( CQuery( "from:steve )" ).error() != "" );
+    REQUIRE( CQuery( "from:steve or" ).error() != "" );
+    REQUIRE( CQuery( "not" ).error() != "" );
+    REQUIRE( CQuery( "" ).error() != "" );
+
+    CQuery query( "from:steve and" );
+    std::string empty;
+    REQUIRE( ! query.matches( [&empty]( TQueryField ) -> const std::string & { return( empty ); },
+                              []( TQueryField ) -> int64_t { return( 0 ); } ) );
+}
+
+
+/**
+ * The fields a query needs.
+ */
+TEST_CASE( "query/needs", "CQuery field tests" )
+{
+    CQuery flags( "flag:F or size:>1M" );
+    REQUIRE( flags.needs( QUERY_FLAGS ) );
+    REQUIRE( flags.needs( QUERY_SIZE ) );
+    REQUIRE( ! flags.needs( QUERY_FROM ) );
+    REQUIRE( ! flags.needs( QUERY_DATE ) );
+    REQUIRE( ! flags.needs( QUERY_LINE ) );
+
+    CQuery headers( "not from:steve subject:lumail after:2013-01-01 word" );
+    REQUIRE( headers.needs( QUERY_FROM ) );
+    REQUIRE( headers.needs( QUERY_SUBJECT ) );
+    REQUIRE( headers.needs( QUERY_DATE ) );
+    REQUIRE( headers.needs( QUERY_LINE ) );
+    REQUIRE( ! headers.needs( QUERY_TO ) );
+}
@@ -0,0 +1,178 @@
+/**
+ * searchindex_bench.cpp - Compare searching every message file, as grep
+ * would, against querying the full-text index.
+ *
+ * Usage: ./searchindex_bench [messages]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+
+#include "searchindex.h"
+
+
+/**
+ * Current time in seconds.
+ */
+double now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return( tv.tv_sec + tv.tv_usec / 1000000.0 );
+}
+
+
+/**
+ * Does the file contain every one of the given words, ignoring case?
+ */
+bool grep( const std::string &path, const std::vector<std::string> &words )
+{
+    int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 )
+        return false;
+
+    char buf[16384];
+    ssize_t n = read( fd, buf, sizeof(buf) - 1 );
+    close( fd );
+    if ( n <= 0 )
+        return false;
+    buf[n] = '\0';
+
+    for( size_t i = 0; i < words.size(); i++ )
+    {
+        if ( strcasestr( buf, words[i].c_str() ) == NULL )
+            return false;
+    }
+    return true;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    int messages = ( argc > 1 ) ? atoi( argv[1] ) : 100000;
+
+    const char *vocabulary[] = {
+        "build", "failed", "release", "lunch", "meeting", "patch", "review",
+        "kernel", "debian", "package", "upload", "security", "update", "mail",
+        "server", "backup", "disk", "network", "invoice", "holiday", "weekend",
+        "question", "answer", "thanks", "regards", "tomorrow", "today", "lumail",
+    };
+    int words = sizeof(vocabulary) / sizeof(vocabulary[0]);
+
+    char base[] = "/tmp/searchindex.bench.XXXXXX";
+    if ( mkdtemp( base ) == NULL )
+    {
+        perror( "mkdtemp" );
+        return 1;
+    }
+    std::string folder = std::string( base ) + "/inbox";
+    std::string cache  = std::string( base ) + "/cache";
+    mkdir( folder.c_str(), 0755 );
+    mkdir( cache.c_str(), 0755 );
+    mkdir( ( folder + "/cur" ).c_str(), 0755 );
+    mkdir( ( folder + "/new" ).c_str(), 0755 );
+
+    /**
+     * Synthetic messages: a subject and a few sentences from a small
+     * vocabulary, plus a word unique to each.
+     */
+    srand( 42 );
+    std::vector<std::string> paths;
+    for( int i = 0; i < messages; i++ )
+    {
+        char name[256];
+        snprintf( name, sizeof(name), "%s/cur/%d.M%dP1.localhost:2,S", folder.c_str(), 1370000000 + i, i );
+        paths.push_back( name );
+
+        FILE *f = fopen( name, "w" );
+        if ( f == NULL )
+            continue;
+
+        fprintf( f, "From: user%d@example.com\nTo: steve@example.com\nSubject: %s %s\n\n",
+                 i % 500, vocabulary[rand() % words], vocabulary[rand() % words] );
+        for( int line = 0; line < 20; line++ )
+        {
+            for( int w = 0; w < 10; w++ )
+                fprintf( f, "%s ", vocabulary[rand() % words] );
+            fprintf( f, "\n" );
+        }
+        fprintf( f, "token%d\n", i );
+        fclose( f );
+    }
+
+    printf( "%d messages\n\n", messages );
+
+    /**
+     * Build, save, and reload the index.
+     */
+    CSearchIndex *index = CSearchIndex::Instance();
+    index->set_directory( cache );
+
+    std::vector<TStringRef> refs( paths.begin(), paths.end() );
+
+    double start = now();
+    index->update_folder( folder, refs );
+    while( index->work( 10 ) )
+        ;
+    double build = now() - start;
+
+    start = now();
+    index->flush();
+    double save = now() - start;
+
+    struct stat sb;
+    stat( ( cache + "/search-index" ).c_str(), &sb );
+
+    start = now();
+    index->set_directory( cache );
+    size_t documents = index->documents();
+    double load = now() - start;
+
+    printf( "index build       : %8.1f ms (%zu messages, %zu words)\n", build * 1000, documents, index->words() );
+    printf( "index save        : %8.1f ms (%ld bytes)\n", save * 1000, (long)sb.st_size );
+    printf( "index load        : %8.1f ms\n\n", load * 1000 );
+
+    /**
+     * Queries.
+     */
+    const char *queries[] = { "token4242", "lumail", "build failed", "kernel security update" };
+
+    printf( "                         %10s %10s\n", "grep", "index" );
+    for( size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++ )
+    {
+        std::vector<std::string> terms;
+        CSearchIndex::tokenize( queries[q], strlen( queries[q] ), terms );
+
+        size_t grepped = 0;
+        start = now();
+        for( size_t i = 0; i < paths.size(); i++ )
+        {
+            if ( grep( paths[i], terms ) )
+                grepped++;
+        }
+        double linear = now() - start;
+
+        start = now();
+        size_t found = index->search( queries[q] ).size();
+        double indexed = now() - start;
+
+        printf( "%-22s: %8.1f ms %8.2f ms (%zu / %zu matched)\n",
+                queries[q], linear * 1000, indexed * 1000, grepped, found );
+    }
+
+    index->set_directory( "" );
+
+    std::string cmd = "rm -rf ";
+    cmd += base;
+    if ( system( cmd.c_str() ) != 0 )
+        fprintf( stderr, "Failed to remove %s\n", base );
+
+    return 0;
+}
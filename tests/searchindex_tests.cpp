@@ -0,0 +1,378 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "searchindex.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/**
+ * Create a message file.
+ */
+static void create( const std::string &path, const char *text )
+{
+    FILE *f = fopen( path.c_str(), "w" );
+    REQUIRE( f != NULL );
+    fputs( text, f );
+    fclose( f );
+}
+
+
+/**
+ * Search, returning the results in order.
+ */
+static std::vector<std::string> search( const std::string &query )
+{
+    std::vector<std::string> result = CSearchIndex::Instance()->search( query );
+    std::sort( result.begin(), result.end() );
+    return( result );
+}
+
+
+/**
+ * Words are lower-cased runs of letters and digits.
+ */
+TEST_CASE( "searchindex/tokenize", "CSearchIndex::tokenize tests" )
+{
+    std::vector<std::string> words;
+    std::string text = "Re: Build FAILED on x86_64, see http://ci.example.com/42 a 5";
+    CSearchIndex::tokenize( text.data(), text.size(), words );
+
+    REQUIRE( words.size() == 12 );
+    REQUIRE( words[0] == "re" );
+    REQUIRE( words[1] == "build" );
+    REQUIRE( words[2] == "failed" );
+    REQUIRE( words[4] == "x86" );
+    REQUIRE( words[5] == "64" );
+    REQUIRE( words[11] == "42" );
+
+    words.clear();
+    text = "caf\xc3\xa9 na\xc3\xafve";
+    CSearchIndex::tokenize( text.data(), text.size(), words );
+    REQUIRE( words.size() == 2 );
+    REQUIRE( words[0] == "caf\xc3\xa9" );
+}
+
+
+/**
+ * Messages are found by header and body words, follow renames, are
+ * forgotten when removed, and survive a round-trip to disk.
+ */
+TEST_CASE( "searchindex/search", "CSearchIndex search tests" )
+{
+    char base[] = "/tmp/searchindex.test.XXXXXX";
+    REQUIRE( mkdtemp( base ) != NULL );
+
+    std::string dir    = base;
+    std::string cache  = dir + "/cache";
+    std::string folder = dir + "/inbox";
+    REQUIRE( mkdir( cache.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( folder.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/new" ).c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/cur" ).c_str(), 0755 ) == 0 );
+
+    std::string a = folder + "/new/1370000000.M1P1.host";
+    std::string b = folder + "/cur/1370000001.M2P2.host:2,S";
+    std::string c = folder + "/cur/1370000002.M3P3.host:2,S";
+
+    create( a, "From: Alice <alice@example.com>\nSubject: Build failed\n\nThe nightly build failed again.\n" );
+    create( b, "From: Bob <bob@example.com>\nSubject: Lunch\n\nShall we get lunch?  The build can wait.\n" );
+    create( c, "From: Carol <carol@example.com>\nSubject: Photo\n\n"
+               "Attached.\n"
+               "iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAADUlEQVR42mNkYPhfDwAChwGA\n" );
+
+    CSearchIndex *index = CSearchIndex::Instance();
+    index->set_directory( cache );
+
+    std::vector<TStringRef> paths;
+    paths.push_back( a );
+    paths.push_back( b );
+    paths.push_back( c );
+
+    index->update_folder( folder, paths );
+    REQUIRE( index->pending() == 3 );
+    REQUIRE( ! index->work( 10 ) );
+    REQUIRE( index->documents() == 3 );
+
+    /**
+     * Every word must match, in any case, in the headers or the body.
+     */
+    REQUIRE( search( "build" ).size() == 2 );
+    REQUIRE( search( "BUILD nightly" ) == std::vector<std::string>( 1, a ) );
+    REQUIRE( search( "alice" ) == std::vector<std::string>( 1, a ) );
+    REQUIRE( search( "lunch build" ) == std::vector<std::string>( 1, b ) );
+    REQUIRE( search( "lunch nightly" ).empty() );
+    REQUIRE( search( "missing" ).empty() );
+    REQUIRE( search( "" ).empty() );
+
+    /**
+     * Encoded attachments aren't indexed.
+     */
+    REQUIRE( search( "attached" ) == std::vector<std::string>( 1, c ) );
+    REQUIRE( search( "ivborw0kggoaaaansuheugaaaaeaaaabcayaaaaffcsjaaaadulequr42mnkyphfdwachwga" ).empty() );
+
+    /**
+     * A rename, as seen by a scan, and by the watcher.
+     */
+    std::string a2 = folder + "/cur/1370000000.M1P1.host:2,S";
+    REQUIRE( rename( a.c_str(), a2.c_str() ) == 0 );
+    paths[0] = a2;
+    index->update_folder( folder, paths );
+    REQUIRE( index->pending() == 0 );
+    REQUIRE( search( "nightly" ) == std::vector<std::string>( 1, a2 ) );
+
+    std::string a3 = folder + "/cur/1370000000.M1P1.host:2,RS";
+    REQUIRE( rename( a2.c_str(), a3.c_str() ) == 0 );
+    index->rename( a2, a3 );
+    REQUIRE( search( "nightly" ) == std::vector<std::string>( 1, a3 ) );
+
+    /**
+     * Removal, as seen by a scan, and by the watcher.
+     */
+    paths.clear();
+    paths.push_back( a3 );
+    paths.push_back( c );
+    index->update_folder( folder, paths );
+    REQUIRE( search( "build" ) == std::vector<std::string>( 1, a3 ) );
+
+    index->remove( c );
+    REQUIRE( search( "attached" ).empty() );
+    REQUIRE( index->documents() == 1 );
+
+    /**
+     * Saving drops the removed messages, and the index is read back.
+     */
+    index->flush();
+    index->set_directory( cache );
+    REQUIRE( index->documents() == 1 );
+    REQUIRE( search( "build" ) == std::vector<std::string>( 1, a3 ) );
+    REQUIRE( search( "lunch" ).empty() );
+
+    /**
+     * New arrivals are numbered after the survivors.
+     */
+    index->add( b );
+    REQUIRE( search( "build" ).size() == 2 );
+    REQUIRE( index->documents() == 2 );
+
+    /**
+     * A damaged index is discarded.
+     */
+    create( cache + "/search-index", "lumail-search-index 1\n\xff\xff" );
+    index->set_directory( cache );
+    REQUIRE( index->documents() == 0 );
+
+    index->set_directory( "" );
+
+    std::string cmd = "rm -rf ";
+    cmd += base;
+    REQUIRE( system( cmd.c_str() ) == 0 );
+}
+
+
+/**
+ * The listener hears of every message which comes, moves, or goes.
+ */
+TEST_CASE( "searchindex/listener", "CSearchIndex listener tests" )
+{
+    char base[] = "/tmp/searchindex.test.XXXXXX";
+    REQUIRE( mkdtemp( base ) != NULL );
+
+    std::string dir    = base;
+    std::string cache  = dir + "/cache";
+    std::string folder = dir + "/inbox";
+    REQUIRE( mkdir( cache.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( folder.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/new" ).c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/cur" ).c_str(), 0755 ) == 0 );
+
+    std::string a  = folder + "/new/1370000000.M1P1.host";
+    std::string a2 = folder + "/cur/1370000000.M1P1.host:2,S";
+    create( a, "Subject: Hello\n\nworld\n" );
+
+    std::vector<std::pair<std::string, std::string> > events;
+
+    CSearchIndex *index = CSearchIndex::Instance();
+    index->set_listener( [&events]( const std::string &from, const std::string &to )
+    {
+        events.push_back( std::make_pair( from, to ) );
+    } );
+
+    index->set_directory( cache );
+    REQUIRE( events.size() == 1 );
+    REQUIRE( events[0] == std::make_pair( std::string(), std::string() ) );
+
+    index->add( a );
+    REQUIRE( events.size() == 1 );
+    REQUIRE( ! index->work( 10 ) );
+    REQUIRE( events.size() == 2 );
+    REQUIRE( events[1] == std::make_pair( std::string(), a ) );
+
+    std::vector<std::string> all;
+    index->paths( all );
+    REQUIRE( all == std::vector<std::string>( 1, a ) );
+
+    REQUIRE( rename( a.c_str(), a2.c_str() ) == 0 );
+    index->rename( a, a2 );
+    REQUIRE( events.size() == 3 );
+    REQUIRE( events[2] == std::make_pair( a, a2 ) );
+
+    index->remove( a2 );
+    REQUIRE( events.size() == 4 );
+    REQUIRE( events[3] == std::make_pair( a2, std::string() ) );
+
+    all.clear();
+    index->paths( all );
+    REQUIRE( all.empty() );
+
+    index->set_listener( CSearchIndex::TChangeFunction() );
+    index->set_directory( "" );
+
+    std::string cmd = "rm -rf ";
+    cmd += base;
+    REQUIRE( system( cmd.c_str() ) == 0 );
+}
+
+
+/**
+ * A message moved onto one we already hold replaces it.
+ */
+TEST_CASE( "searchindex/rename", "CSearchIndex rename tests" )
+{
+    char base[] = "/tmp/searchindex.test.XXXXXX";
+    REQUIRE( mkdtemp( base ) != NULL );
+
+    std::string dir   = base;
+    std::string cache = dir + "/cache";
+    std::string inbox = dir + "/inbox";
+    std::string lists = dir + "/lists";
+    REQUIRE( mkdir( cache.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( inbox.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( inbox + "/cur" ).c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( lists.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( lists + "/cur" ).c_str(), 0755 ) == 0 );
+
+    std::string a = inbox + "/cur/1370000000.M1P1.host:2,S";
+    std::string b = lists + "/cur/1370000000.M1P1.host:2,";
+    std::string c = lists + "/cur/1370000000.M1P1.host:2,RS";
+    create( a, "Subject: Moved\n\nwandering\n" );
+    create( b, "Subject: Stale\n\nforgotten\n" );
+
+    std::vector<std::pair<std::string, std::string> > events;
+
+    CSearchIndex *index = CSearchIndex::Instance();
+    index->set_directory( cache );
+    index->add( a );
+    index->add( b );
+    REQUIRE( ! index->work( 10 ) );
+    REQUIRE( index->documents() == 2 );
+
+    index->set_listener( [&events]( const std::string &from, const std::string &to )
+    {
+        events.push_back( std::make_pair( from, to ) );
+    } );
+
+    /**
+     * The destination was indexed before the move was seen.
+     */
+    REQUIRE( rename( a.c_str(), c.c_str() ) == 0 );
+    REQUIRE( unlink( b.c_str() ) == 0 );
+    index->rename( a, c );
+
+    REQUIRE( events.size() == 2 );
+    REQUIRE( events[0] == std::make_pair( b, std::string() ) );
+    REQUIRE( events[1] == std::make_pair( a, c ) );
+
+    REQUIRE( index->documents() == 1 );
+    REQUIRE( search( "wandering" ) == std::vector<std::string>( 1, c ) );
+    REQUIRE( search( "forgotten" ).empty() );
+
+    std::vector<std::string> all;
+    index->paths( all );
+    REQUIRE( all == std::vector<std::string>( 1, c ) );
+
+    /**
+     * Removing it leaves nothing behind.
+     */
+    index->remove( c );
+    REQUIRE( index->documents() == 0 );
+    REQUIRE( search( "wandering" ).empty() );
+
+    index->set_listener( CSearchIndex::TChangeFunction() );
+    index->set_directory( "" );
+
+    std::string cmd = "rm -rf ";
+    cmd += base;
+    REQUIRE( system( cmd.c_str() ) == 0 );
+}
+
+
+/**
+ * A message is queued once, however often its folder is scanned, and one
+ * we can't read isn't queued again.
+ */
+TEST_CASE( "searchindex/queue", "CSearchIndex queue tests" )
+{
+    char base[] = "/tmp/searchindex.test.XXXXXX";
+    REQUIRE( mkdtemp( base ) != NULL );
+
+    std::string dir    = base;
+    std::string cache  = dir + "/cache";
+    std::string folder = dir + "/inbox";
+    REQUIRE( mkdir( cache.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( folder.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/new" ).c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/cur" ).c_str(), 0755 ) == 0 );
+
+    std::string a  = folder + "/new/1370000000.M1P1.host";
+    std::string a2 = folder + "/cur/1370000000.M1P1.host:2,S";
+    std::string b  = folder + "/new/1370000001.M2P2.host";
+    create( a, "Subject: Hello\n\nworld\n" );
+
+    CSearchIndex *index = CSearchIndex::Instance();
+    index->set_directory( cache );
+
+    std::vector<TStringRef> paths;
+    paths.push_back( a );
+    paths.push_back( b );
+
+    index->update_folder( folder, paths );
+    index->update_folder( folder, paths );
+    index->add( a );
+    REQUIRE( index->pending() == 2 );
+
+    /**
+     * Renamed while queued: the message is indexed where it now lives.
+     */
+    REQUIRE( rename( a.c_str(), a2.c_str() ) == 0 );
+    paths[0] = a2;
+    index->update_folder( folder, paths );
+    REQUIRE( index->pending() == 2 );
+
+    REQUIRE( ! index->work( 10 ) );
+    REQUIRE( index->documents() == 1 );
+    REQUIRE( search( "world" ) == std::vector<std::string>( 1, a2 ) );
+
+    /**
+     * b doesn't exist, so isn't queued by later scans.
+     */
+    index->update_folder( folder, paths );
+    index->add( b );
+    REQUIRE( index->pending() == 0 );
+
+    /**
+     * Until the index is reset.
+     */
+    index->set_directory( cache );
+    index->add( b );
+    REQUIRE( index->pending() == 1 );
+
+    index->set_directory( "" );
+
+    std::string cmd = "rm -rf ";
+    cmd += base;
+    REQUIRE( system( cmd.c_str() ) == 0 );
+}
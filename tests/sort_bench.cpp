@@ -0,0 +1,181 @@
+/**
+ * sort_bench.cpp - Compare sorting the index with a stat()ing comparator
+ * against sorting precomputed keys.
+ *
+ * Usage: ./sort_bench [messages]
+ */
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "sort.h"
+
+
+/**
+ * The previous comparator: sort by mtime, stat()ing both files.
+ */
+bool legacy_sort( const std::string &a, const std::string &b )
+{
+    struct stat us;
+    struct stat them;
+
+    if (stat(a.c_str(), &us) < 0)
+        return 0;
+
+    if (stat(b.c_str(), &them) < 0)
+        return 0;
+
+    return (us.st_mtime < them.st_mtime);
+}
+
+
+/**
+ * Current time in seconds.
+ */
+double now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return( tv.tv_sec + tv.tv_usec / 1000000.0 );
+}
+
+
+/**
+ * Sort a flat array of (key, index) pairs.
+ */
+void sort_keys( std::vector<TSortKey> &keys, std::vector<size_t> &order )
+{
+    std::vector<std::pair<const TSortKey *, size_t> > flat;
+    flat.reserve( keys.size() );
+    for( size_t i = 0; i < keys.size(); i++ )
+        flat.push_back( std::make_pair( &keys[i], i ) );
+
+    std::sort( flat.begin(), flat.end(),
+               []( const std::pair<const TSortKey *, size_t> &a,
+                   const std::pair<const TSortKey *, size_t> &b )
+               {
+                   return( CSort::less( *a.first, *b.first ) );
+               } );
+
+    order.clear();
+    for( size_t i = 0; i < flat.size(); i++ )
+        order.push_back( flat[i].second );
+}
+
+
+int main( int argc, char *argv[] )
+{
+    int messages = ( argc > 1 ) ? atoi( argv[1] ) : 100000;
+
+    /**
+     * Build a synthetic "cur" directory, with shuffled mtimes.
+     */
+    char base[] = "/tmp/sort.bench.XXXXXX";
+    if ( mkdtemp( base ) == NULL )
+    {
+        perror( "mkdtemp" );
+        return 1;
+    }
+    std::string cur = std::string( base ) + "/cur";
+    mkdir( cur.c_str(), 0755 );
+
+    srand( 42 );
+
+    std::vector<std::string> paths;
+    for( int i = 0; i < messages; i++ )
+    {
+        char name[128];
+        snprintf( name, sizeof(name), "%s/%d.M%dP%d.localhost:2,S", cur.c_str(), 1370000000 + i, i, getpid() );
+        FILE *f = fopen( name, "w" );
+        if ( f )
+            fclose( f );
+
+        struct timeval tv[2];
+        tv[0].tv_sec  = tv[1].tv_sec  = 1370000000 + ( rand() % 10000000 );
+        tv[0].tv_usec = tv[1].tv_usec = 0;
+        utimes( name, tv );
+
+        paths.push_back( name );
+    }
+
+    printf( "Sorting %d messages\n\n", messages );
+
+    /**
+     * The previous approach.
+     */
+    std::vector<std::string> legacy = paths;
+    double start = now();
+    std::sort( legacy.begin(), legacy.end(), legacy_sort );
+    double legacy_time = now() - start;
+    printf( "stat() in comparator : %8.1f ms\n", legacy_time * 1000 );
+
+    /**
+     * Precomputed keys: one stat() per message, then a flat sort.
+     */
+    std::vector<TSortKey> keys( messages );
+    std::vector<size_t> order;
+
+    start = now();
+    for( int i = 0; i < messages; i++ )
+    {
+        struct stat sb;
+        keys[i].number = ( stat( paths[i].c_str(), &sb ) == 0 ) ? (int64_t)sb.st_mtime : 0;
+        keys[i].tie    = paths[i];
+    }
+    double key_time = now() - start;
+
+    start = now();
+    sort_keys( keys, order );
+    double sort_time = now() - start;
+
+    printf( "precomputed keys     : %8.1f ms (%.1f ms building keys, %.1f ms sorting)\n",
+            ( key_time + sort_time ) * 1000, key_time * 1000, sort_time * 1000 );
+    printf( "speedup              : %8.1fx\n", legacy_time / ( key_time + sort_time ) );
+
+    /**
+     * Arrival keys come from the filename, with no stat() at all.
+     */
+    start = now();
+    for( int i = 0; i < messages; i++ )
+        keys[i].number = CSort::arrival( paths[i] );
+    key_time = now() - start;
+
+    start = now();
+    sort_keys( keys, order );
+    sort_time = now() - start;
+
+    printf( "arrival keys         : %8.1f ms (%.1f ms building keys, %.1f ms sorting)\n\n",
+            ( key_time + sort_time ) * 1000, key_time * 1000, sort_time * 1000 );
+
+    /**
+     * Textual keys, such as subject, only cost the sort once built.
+     */
+    for( int i = 0; i < messages; i++ )
+    {
+        char subject[64];
+        snprintf( subject, sizeof(subject), "Re: Subject number %d", rand() % ( messages / 4 + 1 ) );
+        keys[i].number = 0;
+        keys[i].text   = CSort::subject( subject );
+    }
+
+    start = now();
+    sort_keys( keys, order );
+    printf( "subject keys         : %8.1f ms sorting\n", ( now() - start ) * 1000 );
+
+    /**
+     * Cleanup.
+     */
+    for( int i = 0; i < messages; i++ )
+        unlink( paths[i].c_str() );
+    rmdir( cur.c_str() );
+    rmdir( base );
+
+    return 0;
+}
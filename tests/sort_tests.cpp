@@ -0,0 +1,106 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "sort.h"
+
+
+/**
+ * Sort-order names are case-insensitive, and unknown ones are rejected.
+ */
+TEST_CASE( "sort/parse_order", "CSort::parse_order tests" )
+{
+    TSortOrder order = SORT_MTIME;
+
+    REQUIRE( CSort::parse_order( "arrival", &order ) );
+    REQUIRE( order == SORT_ARRIVAL );
+
+    REQUIRE( CSort::parse_order( "date", &order ) );
+    REQUIRE( order == SORT_DATE );
+
+    REQUIRE( CSort::parse_order( "Subject", &order ) );
+    REQUIRE( order == SORT_SUBJECT );
+
+    REQUIRE( CSort::parse_order( "SIZE", &order ) );
+    REQUIRE( order == SORT_SIZE );
+
+    REQUIRE( ! CSort::parse_order( "random", &order ) );
+    REQUIRE( order == SORT_SIZE );
+}
+
+
+/**
+ * The arrival time comes from the maildir filename.
+ */
+TEST_CASE( "sort/arrival", "CSort::arrival tests" )
+{
+    REQUIRE( CSort::arrival( "/m/inbox/cur/1370000000.M1P2.host:2,S" ) == 1370000000 );
+    REQUIRE( CSort::arrival( "/m/1999/new/42.host" ) == 42 );
+    REQUIRE( CSort::arrival( "/m/inbox/cur/host.123" ) == 0 );
+    REQUIRE( CSort::arrival( "987" ) == 987 );
+
+    /**
+     * Too many digits to be a time.
+     */
+    REQUIRE( CSort::arrival( "/m/new/999999999999999999.host" ) == 999999999999999999LL );
+    REQUIRE( CSort::arrival( "/m/new/9999999999999999999.host" ) == 0 );
+    REQUIRE( CSort::arrival( "/m/new/" + std::string( 100, '9' ) ) == 0 );
+}
+
+
+/**
+ * Dates with, and without, the optional parts.
+ */
+TEST_CASE( "sort/parse_date", "CSort::parse_date tests" )
+{
+    int64_t epoch = 0;
+
+    REQUIRE( CSort::parse_date( "Thu, 01 Jan 1970 00:00:00 +0000", &epoch ) );
+    REQUIRE( epoch == 0 );
+
+    REQUIRE( CSort::parse_date( "Mon, 3 Jun 2013 12:30:15 +0100", &epoch ) );
+    REQUIRE( epoch == 1370259015 );
+
+    /**
+     * No day-name, no seconds, and a named zone with a comment.
+     */
+    REQUIRE( CSort::parse_date( "3 Jun 2013 06:30 EST (Eastern)", &epoch ) );
+    REQUIRE( epoch == 1370259000 );
+
+    REQUIRE( CSort::parse_date( "3 Jun 2013 11:30:15 GMT", &epoch ) );
+    REQUIRE( epoch == 1370259015 );
+
+    REQUIRE( ! CSort::parse_date( "", &epoch ) );
+    REQUIRE( ! CSort::parse_date( "yesterday", &epoch ) );
+}
+
+
+/**
+ * Subjects are folded, and lose any reply/forward prefixes.
+ */
+TEST_CASE( "sort/subject", "CSort::subject tests" )
+{
+    REQUIRE( CSort::fold( "  Hello World " ) == "hello world" );
+
+    REQUIRE( CSort::subject( "Hello" ) == "hello" );
+    REQUIRE( CSort::subject( "Re: Hello" ) == "hello" );
+    REQUIRE( CSort::subject( "RE: Fwd: re:Hello" ) == "hello" );
+    REQUIRE( CSort::subject( "Regarding" ) == "regarding" );
+}
+
+
+/**
+ * Keys are ordered by number, then text, then the tie-breaker.
+ */
+TEST_CASE( "sort/less", "CSort::less tests" )
+{
+    TSortKey a = { 1, "b", "x" };
+    TSortKey b = { 2, "a", "a" };
+    TSortKey c = { 2, "a", "b" };
+    TSortKey d = { 2, "b", "a" };
+
+    REQUIRE( CSort::less( a, b ) );
+    REQUIRE( CSort::less( b, c ) );
+    REQUIRE( CSort::less( c, d ) );
+    REQUIRE( ! CSort::less( b, a ) );
+    REQUIRE( ! CSort::less( b, b ) );
+}
@@ -0,0 +1,149 @@
+/**
+ * threader_bench.cpp - Time threading a large index from scratch, and
+ * keeping it threaded as messages arrive and go.
+ *
+ * Usage: ./threader_bench [messages]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+
+#include "threader.h"
+
+
+/**
+ * Current time in seconds.
+ */
+double now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return( tv.tv_sec + tv.tv_usec / 1000000.0 );
+}
+
+
+/**
+ * The headers of a message.
+ */
+struct THeaders
+{
+    std::string id;
+    std::string references;
+    std::string in_reply_to;
+};
+
+
+int main( int argc, char *argv[] )
+{
+    int messages = ( argc > 1 ) ? atoi( argv[1] ) : 100000;
+
+    /**
+     * Synthetic mail: most messages reply to something recent, some of
+     * which we never saw, with References growing down each thread.
+     */
+    srand( 42 );
+    std::vector<THeaders> headers( messages );
+    for( int i = 0; i < messages; i++ )
+    {
+        char id[64];
+        snprintf( id, sizeof(id), "<%d.%d@example.com>", 1370000000 + i, i );
+        headers[i].id = id;
+
+        if ( i == 0 || rand() % 10 < 4 )
+            continue;
+
+        int parent = i - 1 - rand() % std::min( i, 2000 );
+        if ( rand() % 20 == 0 )
+        {
+            snprintf( id, sizeof(id), "<missing.%d@example.com>", parent );
+            headers[i].references = id;
+        }
+        else
+        {
+            headers[i].references = headers[parent].references;
+            if ( headers[i].references.size() > 400 )
+                headers[i].references.erase( 0, headers[i].references.find( '>' ) + 2 );
+            if ( ! headers[i].references.empty() )
+                headers[i].references += " ";
+            headers[i].references += headers[parent].id;
+        }
+        headers[i].in_reply_to = headers[parent].id;
+    }
+
+    std::vector<uint32_t> order;
+    for( int i = 0; i < messages; i++ )
+        order.push_back( i );
+
+    printf( "%d messages\n\n", messages );
+
+    /**
+     * Thread everything.
+     */
+    CThreader threader;
+    std::vector<uint32_t> rows;
+    std::vector<uint16_t> depths;
+    std::vector<std::string> glyphs;
+
+    double start = now();
+    threader.reserve( messages );
+    for( int i = 0; i < messages; i++ )
+        threader.add( i, headers[i].id, headers[i].references, headers[i].in_reply_to );
+    double build = now() - start;
+
+    start = now();
+    threader.flatten( order, rows, depths );
+    double flat = now() - start;
+
+    start = now();
+    CThreader::glyphs( depths, glyphs );
+    double glyph = now() - start;
+
+    size_t roots = 0;
+    for( size_t i = 0; i < depths.size(); i++ )
+        roots += ( depths[i] == 0 ) ? 1 : 0;
+
+    printf( "thread build      : %8.1f ms (%zu threads)\n", build * 1000, roots );
+    printf( "flatten           : %8.1f ms\n", flat * 1000 );
+    printf( "glyphs            : %8.1f ms\n", glyph * 1000 );
+    printf( "total             : %8.1f ms\n\n", ( build + flat + glyph ) * 1000 );
+
+    /**
+     * A few arrivals, and departures, as the watcher would report them.
+     */
+    start = now();
+    for( int i = 0; i < 10; i++ )
+        threader.remove( rand() % messages );
+    for( int i = 0; i < 10; i++ )
+        threader.add( messages + i, "<new." + std::to_string( i ) + "@example.com>",
+                      headers[messages - 1 - i].id, "" );
+    double update = now() - start;
+
+    for( int i = 0; i < 10; i++ )
+        order.push_back( messages + i );
+
+    start = now();
+    threader.flatten( order, rows, depths );
+    CThreader::glyphs( depths, glyphs );
+    flat = now() - start;
+
+    printf( "10 removed, 10 new: %8.3f ms, and %.1f ms to flatten\n", update * 1000, flat * 1000 );
+
+    /**
+     * The same, rebuilt from scratch.
+     */
+    start = now();
+    threader.clear();
+    threader.reserve( order.size() );
+    for( size_t i = 0; i < order.size(); i++ )
+    {
+        if ( order[i] < (uint32_t)messages )
+            threader.add( order[i], headers[order[i]].id, headers[order[i]].references, headers[order[i]].in_reply_to );
+    }
+    double rebuild = now() - start;
+
+    printf( "rebuild instead   : %8.1f ms\n", rebuild * 1000 );
+    return 0;
+}
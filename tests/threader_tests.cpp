@@ -0,0 +1,254 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "threader.h"
+#include <algorithm>
+
+
+/**
+ * Flatten the given order, returning the rows shown and their depths.
+ */
+static void flatten( CThreader &threader, const std::vector<uint32_t> &order,
+                     std::vector<uint32_t> &rows, std::vector<uint16_t> &depths )
+{
+    threader.flatten( order, rows, depths );
+    REQUIRE( rows.size() == depths.size() );
+}
+
+
+/**
+ * The order 0, 1, .. n-1.
+ */
+static std::vector<uint32_t> rows_upto( uint32_t n )
+{
+    std::vector<uint32_t> result;
+    for( uint32_t i = 0; i < n; i++ )
+        result.push_back( i );
+    return( result );
+}
+
+
+/**
+ * Message-ids are the text between angle brackets.
+ */
+TEST_CASE( "threader/ids", "CThreader::parse_ids tests" )
+{
+    std::vector<std::string> ids;
+    CThreader::parse_ids( "<a@example.com> <b@example.com>\n\t<c@x>", ids );
+    REQUIRE( ids.size() == 3 );
+    REQUIRE( ids[0] == "a@example.com" );
+    REQUIRE( ids[2] == "c@x" );
+
+    ids.clear();
+    CThreader::parse_ids( "", ids );
+    CThreader::parse_ids( "no brackets", ids );
+    CThreader::parse_ids( "<> <unterminated", ids );
+    REQUIRE( ids.empty() );
+
+    CThreader::parse_ids( "Your message of Monday <d@example.com>", ids );
+    REQUIRE( ids == std::vector<std::string>( 1, "d@example.com" ) );
+}
+
+
+/**
+ * Replies follow the message they answer, threads are ordered by their
+ * first message, and a missing message's replies take its place.
+ */
+TEST_CASE( "threader/flatten", "CThreader flattening tests" )
+{
+    CThreader threader;
+    threader.add( 0, "<a>", "", "" );
+    threader.add( 1, "<b>", "<a>", "<a>" );
+    threader.add( 2, "<c>", "<a> <b>", "<b>" );
+    threader.add( 3, "<d>", "", "" );
+    threader.add( 4, "<e>", "<x>", "" );
+    threader.add( 5, "<f>", "", "<x> <a>" );
+    threader.add( 6, "<g>", "<a>", "" );
+    REQUIRE( threader.size() == 7 );
+
+    /**
+     * In the order 0, 1, 2, 6, 4, 3, 5 the second thread starts with
+     * 4, so 5 is drawn before 3.
+     */
+    std::vector<uint32_t> order = rows_upto( 3 );
+    order.push_back( 6 );
+    order.push_back( 4 );
+    order.push_back( 3 );
+    order.push_back( 5 );
+
+    std::vector<uint32_t> rows;
+    std::vector<uint16_t> depths;
+    flatten( threader, order, rows, depths );
+
+    uint32_t want_rows[]   = { 0, 1, 2, 6, 4, 5, 3 };
+    uint16_t want_depths[] = { 0, 1, 2, 1, 0, 0, 0 };
+    REQUIRE( rows == std::vector<uint32_t>( want_rows, want_rows + 7 ) );
+    REQUIRE( depths == std::vector<uint16_t>( want_depths, want_depths + 7 ) );
+
+    /**
+     * Replies to the same message follow the order too.
+     */
+    order.clear();
+    order.push_back( 6 );
+    order.push_back( 0 );
+    order.push_back( 1 );
+    order.push_back( 2 );
+    flatten( threader, order, rows, depths );
+
+    uint32_t want_rows2[]   = { 0, 6, 1, 2 };
+    uint16_t want_depths2[] = { 0, 1, 1, 2 };
+    REQUIRE( rows == std::vector<uint32_t>( want_rows2, want_rows2 + 4 ) );
+    REQUIRE( depths == std::vector<uint16_t>( want_depths2, want_depths2 + 4 ) );
+
+    /**
+     * Rows we don't hold are shown on their own.
+     */
+    order.clear();
+    order.push_back( 99 );
+    order.push_back( 3 );
+    flatten( threader, order, rows, depths );
+    REQUIRE( rows.size() == 2 );
+    REQUIRE( rows[0] == 99 );
+    REQUIRE( depths[0] == 0 );
+}
+
+
+/**
+ * Messages may arrive, and go, in any order.
+ */
+TEST_CASE( "threader/incremental", "CThreader incremental update tests" )
+{
+    CThreader threader;
+
+    /**
+     * The last reply first: its References stand in for the rest.
+     */
+    threader.add( 2, "<c>", "<a> <b>", "" );
+    threader.add( 0, "<a>", "", "" );
+    threader.add( 1, "<b>", "<a>", "" );
+
+    std::vector<uint32_t> rows;
+    std::vector<uint16_t> depths;
+    flatten( threader, rows_upto( 3 ), rows, depths );
+
+    uint16_t want_depths[] = { 0, 1, 2 };
+    REQUIRE( rows == rows_upto( 3 ) );
+    REQUIRE( depths == std::vector<uint16_t>( want_depths, want_depths + 3 ) );
+
+    /**
+     * Removing the middle message leaves its reply in place.
+     */
+    threader.remove( 1 );
+    REQUIRE( threader.size() == 2 );
+
+    std::vector<uint32_t> order;
+    order.push_back( 0 );
+    order.push_back( 2 );
+    flatten( threader, order, rows, depths );
+    REQUIRE( rows == order );
+    REQUIRE( depths[1] == 1 );
+
+    /**
+     * With the reply gone too the thread is just its start.
+     */
+    threader.remove( 2 );
+    threader.remove( 2 );
+    flatten( threader, rows_upto( 1 ), rows, depths );
+    REQUIRE( rows == rows_upto( 1 ) );
+    REQUIRE( depths[0] == 0 );
+
+    /**
+     * A row reused for another message.
+     */
+    threader.add( 0, "<z>", "<y>", "" );
+    threader.add( 1, "<y>", "", "" );
+    flatten( threader, rows_upto( 2 ), rows, depths );
+
+    uint32_t want_rows2[] = { 1, 0 };
+    REQUIRE( rows == std::vector<uint32_t>( want_rows2, want_rows2 + 2 ) );
+    REQUIRE( depths[1] == 1 );
+    REQUIRE( threader.size() == 2 );
+
+    threader.clear();
+    REQUIRE( threader.size() == 0 );
+}
+
+
+/**
+ * Loops, and duplicates, don't break anything.
+ */
+TEST_CASE( "threader/broken", "CThreader broken header tests" )
+{
+    CThreader threader;
+    threader.add( 0, "<a>", "<b>", "" );
+    threader.add( 1, "<b>", "<a>", "" );
+    threader.add( 2, "<c>", "<c>", "" );
+    threader.add( 3, "<a>", "", "" );
+    threader.add( 4, "", "<a>", "" );
+
+    std::vector<uint32_t> rows;
+    std::vector<uint16_t> depths;
+    flatten( threader, rows_upto( 5 ), rows, depths );
+    REQUIRE( rows.size() == 5 );
+
+    std::vector<uint32_t> sorted( rows );
+    std::sort( sorted.begin(), sorted.end() );
+    REQUIRE( sorted == rows_upto( 5 ) );
+}
+
+
+/**
+ * Tree glyphs.
+ */
+TEST_CASE( "threader/glyphs", "CThreader::glyphs tests" )
+{
+    uint16_t depths[] = { 0, 1, 2, 1, 3, 0, 1 };
+
+    std::vector<std::string> glyphs;
+    CThreader::glyphs( std::vector<uint16_t>( depths, depths + 7 ), glyphs );
+
+    REQUIRE( glyphs.size() == 7 );
+    REQUIRE( glyphs[0] == "" );
+    REQUIRE( glyphs[1] == "|-> " );
+    REQUIRE( glyphs[2] == "| `-> " );
+    REQUIRE( glyphs[3] == "`-> " );
+    REQUIRE( glyphs[4] == "    `-> " );
+    REQUIRE( glyphs[5] == "" );
+    REQUIRE( glyphs[6] == "`-> " );
+}
+
+
+/**
+ * Messages coming and going, many times over, keep their threads.
+ */
+TEST_CASE( "threader/churn", "CThreader reuse tests" )
+{
+    CThreader threader;
+
+    for( int round = 0; round < 4; round++ )
+    {
+        for( uint32_t i = 0; i < 5000; i++ )
+        {
+            std::string id = "<" + std::to_string( round ) + "." + std::to_string( i ) + "@example.com>";
+            std::string parent = "<" + std::to_string( round ) + "." + std::to_string( i / 2 ) + "@example.com>";
+            threader.add( i, id, ( i > 0 ) ? parent : "", "" );
+        }
+        REQUIRE( threader.size() == 5000 );
+
+        std::vector<uint32_t> rows;
+        std::vector<uint16_t> depths;
+        flatten( threader, rows_upto( 5000 ), rows, depths );
+
+        /**
+         * A binary tree: a single thread, thirteen deep at most.
+         */
+        REQUIRE( rows.size() == 5000 );
+        REQUIRE( rows[0] == 0 );
+        REQUIRE( std::count( depths.begin(), depths.end(), 0 ) == 1 );
+        REQUIRE( *std::max_element( depths.begin(), depths.end() ) == 13 );
+
+        for( uint32_t i = 0; i < 5000; i++ )
+            threader.remove( i );
+        REQUIRE( threader.size() == 0 );
+    }
+}
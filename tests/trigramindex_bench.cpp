@@ -0,0 +1,120 @@
+/**
+ * trigramindex_bench.cpp - Compare limiting the index with strstr() on
+ * every formatted line against looking the filter up in the trigram
+ * index, and checking only the candidates.
+ *
+ * Usage: ./trigramindex_bench [messages]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+
+#include "trigramindex.h"
+
+
+/**
+ * Current time in seconds.
+ */
+double now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return( tv.tv_sec + tv.tv_usec / 1000000.0 );
+}
+
+
+int main( int argc, char *argv[] )
+{
+    int messages = ( argc > 1 ) ? atoi( argv[1] ) : 100000;
+
+    const char *vocabulary[] = {
+        "build", "failed", "release", "lunch", "meeting", "patch", "review",
+        "kernel", "debian", "package", "upload", "security", "update", "mail",
+        "server", "backup", "disk", "network", "invoice", "holiday", "weekend",
+        "question", "answer", "thanks", "regards", "tomorrow", "today", "lumail",
+    };
+    int words = sizeof(vocabulary) / sizeof(vocabulary[0]);
+
+    /**
+     * Synthetic index lines, as "[$FLAGS] $FROM - $SUBJECT" formats them.
+     */
+    srand( 42 );
+    std::vector<std::string> lines;
+    lines.reserve( messages );
+    for( int i = 0; i < messages; i++ )
+    {
+        char line[256];
+        snprintf( line, sizeof(line), "[%s] Person %d <user%d@example.com> - Re: %s %s %s (#%d)",
+                  ( rand() % 10 ) ? "S   " : "N   ", i % 500, i % 500,
+                  vocabulary[rand() % words], vocabulary[rand() % words],
+                  vocabulary[rand() % words], i );
+        lines.push_back( line );
+    }
+
+    printf( "%d messages\n\n", messages );
+
+    CTrigramIndex index;
+    double start = now();
+    for( int i = 0; i < messages; i++ )
+        index.add( i, lines[i] );
+    double build = now() - start;
+
+    /**
+     * The first lookup sorts the posting-lists it touches.
+     */
+    std::vector<uint32_t> rows;
+    start = now();
+    for( int i = 0; i < words; i++ )
+        index.candidates( vocabulary[i], rows );
+    double tidy = now() - start;
+
+    printf( "index build       : %8.1f ms\n", build * 1000 );
+    printf( "first lookups     : %8.1f ms\n\n", tidy * 1000 );
+
+    /**
+     * Limits, repeated as each refresh repeats them.
+     */
+    const char *filters[] = { "#4242)", "user42@", "lumail", "security update", "Re:" };
+    const int passes = 20;
+
+    printf( "                         %10s %10s\n", "strstr", "trigrams" );
+    for( size_t f = 0; f < sizeof(filters) / sizeof(filters[0]); f++ )
+    {
+        size_t linear_found = 0;
+        start = now();
+        for( int pass = 0; pass < passes; pass++ )
+        {
+            linear_found = 0;
+            for( size_t i = 0; i < lines.size(); i++ )
+            {
+                if ( strstr( lines[i].c_str(), filters[f] ) != NULL )
+                    linear_found++;
+            }
+        }
+        double linear = ( now() - start ) / passes;
+
+        size_t indexed_found = 0;
+        size_t candidates = 0;
+        start = now();
+        for( int pass = 0; pass < passes; pass++ )
+        {
+            indexed_found = 0;
+            index.candidates( filters[f], rows );
+            candidates = rows.size();
+            for( size_t i = 0; i < rows.size(); i++ )
+            {
+                if ( strstr( lines[rows[i]].c_str(), filters[f] ) != NULL )
+                    indexed_found++;
+            }
+        }
+        double indexed = ( now() - start ) / passes;
+
+        printf( "%-22s: %8.2f ms %8.2f ms (%zu / %zu matched, %zu candidates)\n",
+                filters[f], linear * 1000, indexed * 1000, linear_found, indexed_found, candidates );
+    }
+    return 0;
+}
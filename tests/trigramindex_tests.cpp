@@ -0,0 +1,112 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "trigramindex.h"
+
+
+/**
+ * Rows containing every trigram of the needle are candidates.
+ */
+TEST_CASE( "trigramindex/candidates", "CTrigramIndex lookup tests" )
+{
+    CTrigramIndex index;
+    index.add( 0, "[N   ] Steve Kemp - lumail release" );
+    index.add( 1, "[S   ] Debian - security update" );
+    index.add( 2, "[S   ] Steve Kemp - lunch tomorrow?" );
+
+    std::vector<uint32_t> rows;
+    REQUIRE( index.candidates( "Steve", rows ) == true );
+    REQUIRE( rows.size() == 2 );
+    REQUIRE( rows[0] == 0 );
+    REQUIRE( rows[1] == 2 );
+
+    REQUIRE( index.candidates( "security", rows ) == true );
+    REQUIRE( rows.size() == 1 );
+    REQUIRE( rows[0] == 1 );
+
+    /**
+     * Matching is case-sensitive, as strstr() is.
+     */
+    REQUIRE( index.candidates( "steve", rows ) == true );
+    REQUIRE( rows.empty() );
+
+    REQUIRE( index.candidates( "nothing here", rows ) == true );
+    REQUIRE( rows.empty() );
+}
+
+
+/**
+ * Needles shorter than a trigram can't be looked up.
+ */
+TEST_CASE( "trigramindex/short", "CTrigramIndex short needle tests" )
+{
+    CTrigramIndex index;
+    index.add( 0, "abcdef" );
+    index.add( 1, "ab" );
+
+    std::vector<uint32_t> rows;
+    REQUIRE( index.candidates( "ab", rows ) == false );
+    REQUIRE( index.candidates( "", rows ) == false );
+
+    REQUIRE( index.candidates( "abc", rows ) == true );
+    REQUIRE( rows.size() == 1 );
+    REQUIRE( rows[0] == 0 );
+}
+
+
+/**
+ * Candidates may include rows which no longer match, but never miss one
+ * which does.
+ */
+TEST_CASE( "trigramindex/readd", "CTrigramIndex re-adding tests" )
+{
+    CTrigramIndex index;
+    index.add( 5, "[N   ] one message" );
+    index.add( 7, "[N   ] another message" );
+
+    std::vector<uint32_t> rows;
+    REQUIRE( index.candidates( "[S", rows ) == false );
+    REQUIRE( index.candidates( "[S   ]", rows ) == true );
+    REQUIRE( rows.empty() );
+
+    index.add( 5, "[S   ] one message" );
+    REQUIRE( index.candidates( "[S   ]", rows ) == true );
+    REQUIRE( rows.size() == 1 );
+    REQUIRE( rows[0] == 5 );
+
+    /**
+     * The stale trigrams remain, and the row is listed once.
+     */
+    REQUIRE( index.candidates( "[N   ]", rows ) == true );
+    REQUIRE( rows.size() == 2 );
+    REQUIRE( rows[0] == 5 );
+    REQUIRE( rows[1] == 7 );
+    REQUIRE( index.added() == 3 );
+
+    index.clear();
+    REQUIRE( index.added() == 0 );
+    REQUIRE( index.candidates( "message", rows ) == true );
+    REQUIRE( rows.empty() );
+}
+
+
+/**
+ * Repeated trigrams, in the text or the needle, count once.
+ */
+TEST_CASE( "trigramindex/repeats", "CTrigramIndex repeated trigram tests" )
+{
+    CTrigramIndex index;
+    index.add( 0, "aaaaaaaa" );
+    index.add( 1, "aaa" );
+    index.add( 2, "abababab" );
+
+    std::vector<uint32_t> rows;
+    REQUIRE( index.candidates( "aaaaa", rows ) == true );
+    REQUIRE( rows.size() == 2 );
+    REQUIRE( rows[0] == 0 );
+    REQUIRE( rows[1] == 1 );
+
+    REQUIRE( index.candidates( "babab", rows ) == true );
+    REQUIRE( rows.size() == 1 );
+    REQUIRE( rows[0] == 2 );
+}
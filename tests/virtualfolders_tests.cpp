@@ -0,0 +1,205 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "headercache.h"
+#include "virtualfolders.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/**
+ * Create a message file.
+ */
+static void create( const std::string &path, const char *text )
+{
+    FILE *f = fopen( path.c_str(), "w" );
+    REQUIRE( f != NULL );
+    fputs( text, f );
+    fclose( f );
+}
+
+
+/**
+ * Paths of virtual folders.
+ */
+TEST_CASE( "virtualfolders/paths", "CVirtualFolders path tests" )
+{
+    REQUIRE( CVirtualFolders::path_of( "unread" ) == "virtual:unread" );
+    REQUIRE( CVirtualFolders::name_of( "virtual:unread" ) == "unread" );
+    REQUIRE( CVirtualFolders::name_of( "/home/steve/Maildir/inbox" ) == "" );
+    REQUIRE( CVirtualFolders::is_virtual( "virtual:" ) );
+    REQUIRE( ! CVirtualFolders::is_virtual( "/home/steve/Maildir/virtual:x" ) );
+    REQUIRE( ! CVirtualFolders::is_virtual( "" ) );
+}
+
+
+/**
+ * Folders are defined, replaced, and removed, and bad queries refused.
+ */
+TEST_CASE( "virtualfolders/define", "CVirtualFolders definition tests" )
+{
+    CVirtualFolders *vf = CVirtualFolders::Instance();
+
+    unsigned int version = vf->version();
+    REQUIRE( vf->define( "unread", "flag:N" ) == "" );
+    REQUIRE( vf->define( "big", "size:>1M" ) == "" );
+    REQUIRE( vf->version() != version );
+    REQUIRE( vf->names().size() == 2 );
+    REQUIRE( vf->names()[0] == "unread" );
+    REQUIRE( vf->query( "big" ) == "size:>1M" );
+    REQUIRE( vf->stale() );
+
+    REQUIRE( vf->define( "big", "size:>2M" ) == "" );
+    REQUIRE( vf->names().size() == 2 );
+    REQUIRE( vf->query( "big" ) == "size:>2M" );
+
+    REQUIRE( vf->define( "bad", "flag:N and" ) != "" );
+    REQUIRE( vf->define( "bad", "flag:!" ) != "" );
+    REQUIRE( vf->query( "bad" ) == "" );
+    REQUIRE( vf->names().size() == 2 );
+
+    REQUIRE( vf->define( "big", "" ) == "" );
+    REQUIRE( vf->define( "unread", "" ) == "" );
+    REQUIRE( vf->define( "missing", "" ) == "" );
+    REQUIRE( vf->names().empty() );
+    REQUIRE( vf->messages( "unread" ) == NULL );
+    REQUIRE( vf->count( "unread" ) == 0 );
+}
+
+
+/**
+ * Folders are filled from a list of messages, and follow them as they
+ * arrive, change their flags, and go away.
+ */
+TEST_CASE( "virtualfolders/refresh", "CVirtualFolders filling tests" )
+{
+    char base[] = "/tmp/virtualfolders.test.XXXXXX";
+    REQUIRE( mkdtemp( base ) != NULL );
+
+    std::string folder = std::string( base ) + "/inbox";
+    REQUIRE( mkdir( folder.c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/new" ).c_str(), 0755 ) == 0 );
+    REQUIRE( mkdir( ( folder + "/cur" ).c_str(), 0755 ) == 0 );
+
+    std::string a = folder + "/new/1370000000.M1P1.host";
+    std::string b = folder + "/cur/1370000001.M2P2.host:2,S";
+    std::string c = folder + "/cur/1370000002.M3P3.host:2,FS";
+
+    create( a, "From: Alice <alice@example.com>\nSubject: Build failed\n\nAgain.\n" );
+    create( b, "From: Bob <bob@example.com>\nSubject: Lunch\n\nShall we?\n" );
+    create( c, "From: Carol <carol@example.com>\nSubject: Build fixed\n\nDone.\n" );
+
+    CHeaderCache::Instance()->set_directory( "" );
+
+    CVirtualFolders *vf = CVirtualFolders::Instance();
+    vf->set_format( "[$FLAGS] $FROM - $SUBJECT" );
+    REQUIRE( vf->define( "unread", "flag:N" ) == "" );
+    REQUIRE( vf->define( "builds", "subject:build" ) == "" );
+    REQUIRE( vf->define( "flagged", "[F" ) == "" );
+    REQUIRE( vf->define( "bob", "bob" ) == "" );
+
+    std::vector<std::string> paths;
+    paths.push_back( a );
+    paths.push_back( b );
+    paths.push_back( c );
+    paths.push_back( folder + "/cur/1370000003.M4P4.host:2,S" );
+
+    unsigned int version = vf->version();
+    vf->refresh( paths );
+    REQUIRE( ! vf->stale() );
+    REQUIRE( vf->version() != version );
+
+    REQUIRE( vf->count( "unread" ) == 1 );
+    REQUIRE( vf->unread( "unread" ) == 1 );
+    REQUIRE( vf->messages( "unread" )->count( a ) == 1 );
+
+    REQUIRE( vf->count( "builds" ) == 2 );
+    REQUIRE( vf->unread( "builds" ) == 1 );
+    REQUIRE( vf->messages( "builds" )->count( c ) == 1 );
+
+    REQUIRE( vf->count( "flagged" ) == 1 );
+    REQUIRE( vf->messages( "flagged" )->count( c ) == 1 );
+
+    REQUIRE( vf->count( "bob" ) == 1 );
+    REQUIRE( vf->messages( "bob" )->count( b ) == 1 );
+
+    /**
+     * Reading a message moves it out of the unread folder, but keeps it
+     * in the others.
+     */
+    std::string a2 = folder + "/cur/1370000000.M1P1.host:2,S";
+    REQUIRE( rename( a.c_str(), a2.c_str() ) == 0 );
+
+    version = vf->version();
+    vf->changed( a, a2 );
+    REQUIRE( vf->version() != version );
+    REQUIRE( vf->count( "unread" ) == 0 );
+    REQUIRE( vf->unread( "unread" ) == 0 );
+    REQUIRE( vf->count( "builds" ) == 2 );
+    REQUIRE( vf->unread( "builds" ) == 0 );
+    REQUIRE( vf->messages( "builds" )->count( a2 ) == 1 );
+
+    /**
+     * A change nothing cares about leaves the version alone.
+     */
+    std::string d = folder + "/cur/1370000004.M5P5.host:2,S";
+    create( d, "From: Dave <dave@example.com>\nSubject: Hello\n\nHi.\n" );
+
+    version = vf->version();
+    vf->changed( "", d );
+    REQUIRE( vf->version() == version );
+
+    /**
+     * Arrivals, and departures.
+     */
+    std::string e = folder + "/new/1370000005.M6P6.host";
+    create( e, "From: Bob <bob@example.com>\nSubject: Build again\n\nSorry.\n" );
+
+    vf->changed( "", e );
+    REQUIRE( vf->count( "unread" ) == 1 );
+    REQUIRE( vf->count( "builds" ) == 3 );
+    REQUIRE( vf->unread( "builds" ) == 1 );
+    REQUIRE( vf->count( "bob" ) == 2 );
+
+    vf->changed( c, "" );
+    REQUIRE( vf->count( "flagged" ) == 0 );
+    REQUIRE( vf->count( "builds" ) == 2 );
+
+    /**
+     * A message which has gone can't match a query on its headers.
+     */
+    vf->changed( "", folder + "/new/1370000006.M7P7.host" );
+    REQUIRE( vf->count( "unread" ) == 2 );
+    REQUIRE( vf->count( "builds" ) == 2 );
+
+    /**
+     * A new index format refills the folders matching the line, and a
+     * new index everything.
+     */
+    vf->set_format( "$SUBJECT" );
+    REQUIRE( vf->stale() );
+    paths.clear();
+    paths.push_back( a2 );
+    paths.push_back( b );
+    paths.push_back( e );
+    vf->refresh( paths );
+    REQUIRE( vf->count( "bob" ) == 0 );
+    REQUIRE( vf->count( "unread" ) == 2 );
+
+    vf->changed( "", "" );
+    REQUIRE( vf->stale() );
+    vf->refresh( paths );
+    REQUIRE( vf->count( "unread" ) == 1 );
+    REQUIRE( vf->count( "builds" ) == 2 );
+
+    REQUIRE( vf->define( "unread", "" ) == "" );
+    REQUIRE( vf->define( "builds", "" ) == "" );
+    REQUIRE( vf->define( "flagged", "" ) == "" );
+    REQUIRE( vf->define( "bob", "" ) == "" );
+
+    std::string cmd = "rm -rf ";
+    cmd += base;
+    REQUIRE( system( cmd.c_str() ) == 0 );
+}
@@ -0,0 +1,132 @@
+/**
+ * walker_bench.cpp - Measure how the folder cache scales with the number
+ * of walker threads when discovering maildirs in a synthetic tree, both
+ * from cold and when revalidating what it already knows.
+ *
+ * Usage: ./walker_bench [max-threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "foldercache.h"
+
+
+/**
+ * Current time in seconds.
+ */
+double now()
+{
+    struct timeval tv;
+    gettimeofday( &tv, NULL );
+    return( tv.tv_sec + tv.tv_usec / 1000000.0 );
+}
+
+
+/**
+ * Make a directory look an hour old, so that the cache trusts its mtime.
+ */
+static void age( const std::string &path )
+{
+    struct timeval tv[2];
+    tv[0].tv_sec  = tv[1].tv_sec  = time(NULL) - 3600;
+    tv[0].tv_usec = tv[1].tv_usec = 0;
+    utimes( path.c_str(), tv );
+}
+
+
+/**
+ * A fresh cache, as lumail has when started without a saved one.
+ */
+class CBenchFolderCache : public CFolderCache
+{
+public:
+    CBenchFolderCache() : CFolderCache() {}
+};
+
+
+int main( int argc, char *argv[] )
+{
+    int max     = ( argc > 1 ) ? atoi( argv[1] ) : 8;
+
+    /**
+     * Build 10 x 10 x 30 = 3,000 nested maildirs.
+     */
+    char base[] = "/tmp/walker.bench.XXXXXX";
+    if ( mkdtemp( base ) == NULL )
+    {
+        perror( "mkdtemp" );
+        return 1;
+    }
+
+    const char *sub[] = { "", "/cur", "/new", "/tmp" };
+    for( int a = 0; a < 10; a++ )
+    {
+        std::string pa = std::string( base ) + "/lists." + std::to_string( a );
+        mkdir( pa.c_str(), 0755 );
+        for( int b = 0; b < 10; b++ )
+        {
+            std::string pb = pa + "/group." + std::to_string( b );
+            mkdir( pb.c_str(), 0755 );
+            for( int c = 0; c < 30; c++ )
+            {
+                std::string pc = pb + "/folder." + std::to_string( c );
+                for( int s = 0; s < 4; s++ )
+                    mkdir( ( pc + sub[s] ).c_str(), 0755 );
+                for( int s = 0; s < 4; s++ )
+                    age( pc + sub[s] );
+            }
+            age( pb );
+        }
+        age( pa );
+    }
+    age( base );
+
+    printf( "maildirs: 3000\n" );
+
+    size_t expected = 0;
+    double base_time = 0;
+    int rc = 0;
+
+    /**
+     * No ~/.lumail, so nothing is saved between runs.
+     */
+    setenv( "HOME", base, 1 );
+
+    for( int threads = 1; threads <= max; threads *= 2 )
+    {
+        CBenchFolderCache cache;
+
+        double start = now();
+        std::vector<std::string> found = cache.folders( base, threads );
+        double cold = now() - start;
+
+        start = now();
+        cache.folders( base, threads );
+        double warm = now() - start;
+
+        if ( threads == 1 )
+        {
+            expected  = found.size();
+            base_time = cold;
+        }
+        else if ( found.size() != expected )
+            rc = 1;
+
+        printf( "threads: %2d  cold: %8.2f ms  warm: %8.2f ms  found: %zu  speedup: %5.2fx\n",
+                threads, cold * 1000, warm * 1000, found.size(), base_time / cold );
+    }
+
+    std::string cmd = "rm -rf ";
+    cmd += base;
+    if ( system( cmd.c_str() ) != 0 )
+        fprintf( stderr, "Failed to remove %s\n", base );
+
+    return( ( expected == 3000 ) ? rc : 1 );
+}
@@ -0,0 +1,204 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "directory.h"
+#include "foldercache.h"
+#include "maildir_helpers.h"
+#include "walker.h"
+#include <map>
+#include <mutex>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/**
+ * Every directory is visited exactly once, by any number of threads, and
+ * a walker may be used again.
+ */
+TEST_CASE( "walker/walk", "CWalker tests" )
+{
+    std::string base = make_base( "walker" );
+
+    size_t expected = 1;
+    for( int a = 0; a < 5; a++ )
+    {
+        std::string pa = base + "/" + std::to_string( a );
+        make_dir( pa );
+        expected += 1;
+        for( int b = 0; b < 20; b++ )
+        {
+            make_dir( pa + "/" + std::to_string( b ) );
+            expected += 1;
+        }
+    }
+
+    for( int threads = 1; threads <= 8; threads *= 2 )
+    {
+        CWalker walker( threads );
+        REQUIRE( walker.threads() == threads );
+
+        for( int pass = 0; pass < 3; pass++ )
+        {
+            std::map<std::string, int> visits;
+            std::mutex lock;
+
+            walker.walk( base, [&]( const std::string &dir, std::vector<std::string> &children )
+            {
+                {
+                    std::lock_guard<std::mutex> guard( lock );
+                    visits[dir] += 1;
+                }
+
+                CDirectory d( dir );
+                const char *name;
+                bool is_dir;
+                while( d.next( &name, &is_dir ) )
+                {
+                    if ( is_dir )
+                        children.push_back( dir + "/" + name );
+                }
+            } );
+
+            REQUIRE( visits.size() == expected );
+
+            std::map<std::string, int>::iterator it;
+            for (it = visits.begin(); it != visits.end(); ++it)
+                REQUIRE( it->second == 1 );
+        }
+    }
+
+    /**
+     * The number of threads is bounded.
+     */
+    CWalker none( 0 );
+    REQUIRE( none.threads() == 1 );
+    CWalker many( WALKER_MAX_THREADS * 2 );
+    REQUIRE( many.threads() == WALKER_MAX_THREADS );
+
+    remove_base( base );
+}
+
+
+/**
+ * Maildirs are found beneath directories which aren't, but not within
+ * those which are, except for the root.
+ */
+TEST_CASE( "walker/nested", "Nested maildir tests" )
+{
+    std::string base = make_base( "walker" );
+
+    make_maildir( base + "/mail" );
+    make_maildir( base + "/mail/inside" );
+    make_dir( base + "/mail/plain" );
+    make_maildir( base + "/mail/plain/deep" );
+    make_dir( base + "/lists" );
+    make_dir( base + "/lists/a" );
+    make_dir( base + "/lists/a/b" );
+    make_maildir( base + "/lists/a/b/c" );
+
+    /**
+     * Only some of cur/new/tmp: walked into like any other directory.
+     */
+    make_dir( base + "/partial" );
+    make_dir( base + "/partial/cur" );
+    make_maildir( base + "/partial/cur/found" );
+
+    for( int threads = 1; threads <= 4; threads *= 2 )
+    {
+        CTestFolderCache cache;
+        std::vector<std::string> found = cache.folders( base, threads );
+
+        REQUIRE( found.size() == 3 );
+        REQUIRE( found[0] == base + "/lists/a/b/c" );
+        REQUIRE( found[1] == base + "/mail" );
+        REQUIRE( found[2] == base + "/partial/cur/found" );
+    }
+
+    /**
+     * A root which is a maildir is walked into.
+     */
+    CTestFolderCache cache;
+    std::vector<std::string> found = cache.folders( base + "/mail", 2 );
+    REQUIRE( found.size() == 3 );
+    REQUIRE( found[0] == base + "/mail" );
+    REQUIRE( found[1] == base + "/mail/inside" );
+    REQUIRE( found[2] == base + "/mail/plain/deep" );
+
+    remove_base( base );
+}
+
+
+/**
+ * A link to a maildir is found, but links to other directories aren't
+ * walked, so a loop doesn't lead back up the tree.
+ */
+TEST_CASE( "walker/symlinks", "Symlink tests" )
+{
+    std::string base = make_base( "walker" );
+
+    make_maildir( base + "/inbox" );
+    make_dir( base + "/loop" );
+    REQUIRE( symlink( base.c_str(), ( base + "/loop/back" ).c_str() ) == 0 );
+    REQUIRE( symlink( ( base + "/inbox" ).c_str(), ( base + "/alias" ).c_str() ) == 0 );
+    REQUIRE( symlink( "/nowhere", ( base + "/dangling" ).c_str() ) == 0 );
+
+    CTestFolderCache cache;
+    std::vector<std::string> found = cache.folders( base, 4 );
+
+    REQUIRE( found.size() == 2 );
+    REQUIRE( found[0] == base + "/alias" );
+    REQUIRE( found[1] == base + "/inbox" );
+
+    /**
+     * The root itself may be a link.
+     */
+    REQUIRE( symlink( base.c_str(), ( base + ".link" ).c_str() ) == 0 );
+    CTestFolderCache linked;
+    found = linked.folders( base + ".link", 2 );
+    REQUIRE( found.size() == 2 );
+    REQUIRE( found[1] == base + ".link/inbox" );
+    REQUIRE( unlink( ( base + ".link" ).c_str() ) == 0 );
+
+    remove_base( base );
+}
+
+
+/**
+ * A directory we can't read is skipped, and the rest are still found.
+ */
+TEST_CASE( "walker/unreadable", "Unreadable directory tests" )
+{
+    std::string base = make_base( "walker" );
+
+    make_maildir( base + "/inbox" );
+    make_dir( base + "/locked" );
+    make_maildir( base + "/locked/secret" );
+    make_dir( base + "/open" );
+    make_maildir( base + "/open/lists" );
+    REQUIRE( chmod( ( base + "/locked" ).c_str(), 0 ) == 0 );
+
+    CTestFolderCache cache;
+    std::vector<std::string> found = cache.folders( base, 4 );
+
+    /**
+     * root can read anything, so only the others see it skipped.
+     */
+    if ( geteuid() == 0 )
+        REQUIRE( found.size() == 3 );
+    else
+    {
+        REQUIRE( found.size() == 2 );
+        REQUIRE( found[0] == base + "/inbox" );
+        REQUIRE( found[1] == base + "/open/lists" );
+    }
+
+    /**
+     * Once readable again, it is found.
+     */
+    REQUIRE( chmod( ( base + "/locked" ).c_str(), 0755 ) == 0 );
+    cache.invalidate( base + "/locked" );
+    REQUIRE( cache.folders( base, 4 ).size() == 3 );
+
+    remove_base( base );
+}
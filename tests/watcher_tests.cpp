@@ -0,0 +1,283 @@
+#define CATCH_CONFIG_MAIN
+
+#include "catch.hpp"
+#include "maildir_helpers.h"
+#include "watcher.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/**
+ * A watcher of our own, rather than the singleton, which records each
+ * batch of changes.
+ */
+class CTestWatcher : public CWatcher
+{
+public:
+    CTestWatcher() : CWatcher()
+    {
+        set_handler( [this]( TWatchChanges &c ) { batches += 1; changes = c; } );
+    }
+    ~CTestWatcher() { close( fd() ); }
+
+    /**
+     * Process the pending events, forgetting the last batch.
+     */
+    bool drain()
+    {
+        TWatchChanges none;
+        none.tree_changed = false;
+        none.overflow     = false;
+        changes = none;
+        batches = 0;
+        return( poll() );
+    }
+
+    int batches;
+    TWatchChanges changes;
+};
+
+
+/**
+ * Make an empty file.
+ */
+static void make_file( const std::string &path )
+{
+    int fd = open( path.c_str(), O_CREAT | O_WRONLY, 0644 );
+    REQUIRE( fd >= 0 );
+    close( fd );
+}
+
+
+/**
+ * Move a file.
+ */
+static void move( const std::string &from, const std::string &to )
+{
+    REQUIRE( rename( from.c_str(), to.c_str() ) == 0 );
+}
+
+
+/**
+ * A temporary directory holding two maildirs, which is also HOME.
+ */
+static std::string make_folders()
+{
+    std::string base = make_base( "watcher" );
+    make_maildir( base + "/inbox" );
+    make_maildir( base + "/lists" );
+    return( base );
+}
+
+
+/**
+ * Watch both maildirs, with the inbox selected.
+ */
+static void watch( CTestWatcher &w, const std::string &base )
+{
+    std::vector<std::string> maildirs;
+    maildirs.push_back( base + "/inbox" );
+    maildirs.push_back( base + "/lists" );
+
+    std::vector<std::string> dirs;
+    dirs.push_back( base );
+
+    w.watch_folders( maildirs, dirs );
+    w.watch_selected( std::vector<std::string>( 1, base + "/inbox" ) );
+}
+
+
+/**
+ * Deliveries are new mail, and moves are paired up into renames.
+ */
+TEST_CASE( "watcher/pairing", "CWatcher event pairing tests" )
+{
+    std::string base  = make_folders();
+    std::string inbox = base + "/inbox";
+
+    CTestWatcher w;
+    REQUIRE( w.fd() >= 0 );
+    watch( w, base );
+
+    REQUIRE( ! w.drain() );
+    REQUIRE( w.batches == 0 );
+
+    /**
+     * A delivery, via tmp/.
+     */
+    make_file( inbox + "/tmp/1" );
+    move( inbox + "/tmp/1", inbox + "/new/1" );
+
+    REQUIRE( w.drain() );
+    REQUIRE( w.batches == 1 );
+    REQUIRE( w.changes.arrivals.size() == 1 );
+    REQUIRE( w.changes.arrivals[inbox] == 1 );
+    REQUIRE( w.changes.added.size() == 1 );
+    REQUIRE( w.changes.added[0] == inbox + "/new/1" );
+
+    /**
+     * Reading it moves it to cur/, which is a rename.
+     */
+    move( inbox + "/new/1", inbox + "/cur/1:2,S" );
+
+    REQUIRE( w.drain() );
+    REQUIRE( w.changes.arrivals.empty() );
+    REQUIRE( w.changes.added.empty() );
+    REQUIRE( w.changes.removed.empty() );
+    REQUIRE( w.changes.renamed.size() == 1 );
+    REQUIRE( w.changes.renamed[0].first == inbox + "/new/1" );
+    REQUIRE( w.changes.renamed[0].second == inbox + "/cur/1:2,S" );
+
+    /**
+     * Marking it new again moves it back, which isn't new mail.
+     */
+    move( inbox + "/cur/1:2,S", inbox + "/new/1" );
+
+    REQUIRE( w.drain() );
+    REQUIRE( w.changes.arrivals.empty() );
+    REQUIRE( w.changes.renamed.size() == 1 );
+    REQUIRE( w.changes.renamed[0].second == inbox + "/new/1" );
+
+    /**
+     * A message moved out of the inbox is removed from it, and reaches
+     * the other folder as new mail.  Nothing else is said about that
+     * folder, as its cur/ directory isn't watched.
+     */
+    move( inbox + "/new/1", base + "/lists/new/1" );
+
+    REQUIRE( w.drain() );
+    REQUIRE( w.changes.arrivals.size() == 1 );
+    REQUIRE( w.changes.arrivals[base + "/lists"] == 1 );
+    REQUIRE( w.changes.removed.size() == 1 );
+    REQUIRE( w.changes.removed[0] == inbox + "/new/1" );
+    REQUIRE( w.changes.other_added.empty() );
+
+    /**
+     * Moved somewhere we can't see is a removal.
+     */
+    make_file( inbox + "/cur/2:2,S" );
+    REQUIRE( w.drain() );
+    REQUIRE( w.changes.added.size() == 1 );
+
+    move( inbox + "/cur/2:2,S", base + "/elsewhere" );
+
+    REQUIRE( w.drain() );
+    REQUIRE( w.changes.removed.size() == 1 );
+    REQUIRE( w.changes.removed[0] == inbox + "/cur/2:2,S" );
+
+    /**
+     * New folders change the tree.
+     */
+    make_maildir( base + "/more" );
+
+    REQUIRE( w.drain() );
+    REQUIRE( w.changes.tree_changed );
+
+    remove_base( base );
+}
+
+
+/**
+ * Only the selected folders' cur/ directories are watched.
+ */
+TEST_CASE( "watcher/selected", "CWatcher selection tests" )
+{
+    std::string base  = make_folders();
+    std::string inbox = base + "/inbox";
+    std::string lists = base + "/lists";
+
+    CTestWatcher w;
+    watch( w, base );
+
+    make_file( lists + "/cur/1:2,S" );
+    REQUIRE( ! w.drain() );
+    REQUIRE( w.batches == 0 );
+
+    /**
+     * Select the other folder instead.
+     */
+    w.watch_selected( std::vector<std::string>( 1, lists ) );
+
+    make_file( lists + "/cur/2:2,S" );
+    make_file( inbox + "/cur/3:2,S" );
+
+    REQUIRE( w.drain() );
+    REQUIRE( w.changes.added.size() == 1 );
+    REQUIRE( w.changes.added[0] == lists + "/cur/2:2,S" );
+    REQUIRE( w.changes.other_added.empty() );
+
+    /**
+     * New mail is still seen in the folder which isn't selected, but
+     * its other changes are only passed on when watching everything.
+     */
+    make_file( inbox + "/new/4" );
+
+    REQUIRE( w.drain() );
+    REQUIRE( w.changes.arrivals[inbox] == 1 );
+    REQUIRE( w.changes.added.empty() );
+    REQUIRE( w.changes.other_added.empty() );
+
+    w.watch_everything( true );
+    make_file( inbox + "/cur/5:2,S" );
+
+    REQUIRE( ! w.drain() );
+    REQUIRE( w.batches == 1 );
+    REQUIRE( w.changes.other_added.size() == 1 );
+    REQUIRE( w.changes.other_added[0] == inbox + "/cur/5:2,S" );
+
+    /**
+     * A message marked as new in a folder which isn't selected isn't new
+     * mail either.
+     */
+    move( inbox + "/cur/5:2,S", inbox + "/new/5" );
+
+    REQUIRE( ! w.drain() );
+    REQUIRE( w.changes.arrivals.empty() );
+    REQUIRE( w.changes.other_renamed.size() == 1 );
+
+    remove_base( base );
+}
+
+
+/**
+ * If the kernel drops events we're told, so that the caller can rescan.
+ */
+TEST_CASE( "watcher/overflow", "CWatcher overflow tests" )
+{
+    std::string base  = make_folders();
+    std::string inbox = base + "/inbox";
+
+    CTestWatcher w;
+    watch( w, base );
+
+    /**
+     * More events than the kernel will queue.
+     */
+    int limit = 16384;
+    FILE *f = fopen( "/proc/sys/fs/inotify/max_queued_events", "r" );
+    if ( f != NULL )
+    {
+        REQUIRE( fscanf( f, "%d", &limit ) == 1 );
+        fclose( f );
+    }
+
+    for( int i = 0; i <= limit; i++ )
+        make_file( inbox + "/cur/" + std::to_string( i ) );
+
+    REQUIRE( w.drain() );
+    REQUIRE( w.changes.overflow );
+
+    /**
+     * Afterwards we're incremental again.
+     */
+    make_file( inbox + "/new/last" );
+
+    REQUIRE( w.drain() );
+    REQUIRE( ! w.changes.overflow );
+    REQUIRE( w.changes.added.size() == 1 );
+
+    remove_base( base );
+}
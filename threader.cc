@@ -0,0 +1,610 @@
+/**
+ * threader.cc - Conversation threads for the message index.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <string.h>
+
+#include "threader.h"
+
+
+/**
+ * Markers for the empty, and deleted, slots of our index.
+ */
+#define INDEX_EMPTY   ( (uint32_t) -1 )
+#define INDEX_DELETED ( (uint32_t) -2 )
+
+
+/**
+ * The marker for a root which is a row we don't hold, rather than a
+ * container.
+ */
+#define THREAD_LONE_ROW ( (uint64_t)1 << 32 )
+
+
+/**
+ * Constructor.
+ */
+CThreader::CThreader()
+{
+    m_messages   = 0;
+    m_index_used = 0;
+    m_ids        = 0;
+    m_garbage    = 0;
+}
+
+
+/**
+ * Add the message in the given row.
+ *
+ * This is steps one to three of the algorithm, for a single message: the
+ * References link their containers, oldest first, where they aren't
+ * linked already, and the message becomes the child of the last.
+ */
+void CThreader::add( uint32_t row, const std::string &message_id,
+                     const std::string &references, const std::string &in_reply_to )
+{
+    remove( row );
+
+    /**
+     * A message without a Message-ID, or with the same one as a message
+     * we already hold, gets a container of its own.
+     */
+    size_t pos = 0;
+    TStringRef id;
+
+    uint32_t c = next_id( message_id, &pos, &id ) ? container( id ) : allocate();
+    if ( m_containers[c].row != THREAD_NONE )
+        c = allocate();
+
+    m_containers[c].row = row;
+    if ( m_rows.size() <= row )
+        m_rows.resize( row + 1, THREAD_NONE );
+    m_rows[row] = c;
+    m_messages += 1;
+
+    /**
+     * Without References the first In-Reply-To will do.
+     */
+    m_touched.clear();
+
+    pos = 0;
+    while( next_id( references, &pos, &id ) )
+        m_touched.push_back( container( id ) );
+
+    pos = 0;
+    if ( m_touched.empty() && next_id( in_reply_to, &pos, &id ) )
+        m_touched.push_back( container( id ) );
+
+    uint32_t prev = THREAD_NONE;
+    std::vector<uint32_t>::iterator tit;
+    for (tit = m_touched.begin(); tit != m_touched.end(); ++tit)
+    {
+        uint32_t r = *tit;
+        if ( prev != THREAD_NONE && m_containers[r].parent == THREAD_NONE && ! ancestor( r, prev ) )
+            link( prev, r );
+        prev = r;
+    }
+
+    /**
+     * The message's own References are the best guide to its parent.
+     */
+    if ( prev != THREAD_NONE && ! ancestor( c, prev ) )
+    {
+        unlink( c );
+        link( prev, c );
+    }
+
+    /**
+     * Drop any containers we made but didn't use.
+     */
+    for (tit = m_touched.begin(); tit != m_touched.end(); ++tit)
+        prune( *tit );
+}
+
+
+/**
+ * Remove the message in the given row.
+ *
+ * Its container stays as long as replies hang from it.
+ */
+void CThreader::remove( uint32_t row )
+{
+    if ( row >= m_rows.size() || m_rows[row] == THREAD_NONE )
+        return;
+
+    uint32_t c = m_rows[row];
+    m_rows[row] = THREAD_NONE;
+    m_containers[c].row = THREAD_NONE;
+    m_messages -= 1;
+
+    prune( c );
+}
+
+
+/**
+ * Forget every message.
+ */
+void CThreader::clear()
+{
+    m_containers.clear();
+    m_free.clear();
+    m_index.clear();
+    m_index_used = 0;
+    m_ids        = 0;
+    m_names.clear();
+    m_garbage    = 0;
+    m_rows.clear();
+    m_messages = 0;
+}
+
+
+/**
+ * Make room for the given number of messages.  Most messages refer to
+ * at least one we don't hold, so allow for twice as many containers.
+ */
+void CThreader::reserve( size_t messages )
+{
+    m_containers.reserve( messages * 2 );
+    m_rows.reserve( messages );
+    m_names.reserve( messages * 64 );
+
+    if ( m_index.size() < messages * 8 )
+        reindex( messages * 2 );
+}
+
+
+/**
+ * Flatten the threads of the given rows.
+ *
+ * The rows are walked in order, and each marks its container, and each
+ * ancestor not yet marked, with its position.  So threads, and the
+ * replies to each message, are found in the order they're shown, and
+ * nothing needs sorting.
+ */
+void CThreader::flatten( const std::vector<uint32_t> &order,
+                         std::vector<uint32_t> &rows, std::vector<uint16_t> &depths )
+{
+    rows.clear();
+    depths.clear();
+
+    size_t n = m_containers.size();
+    m_first.assign( n, THREAD_NONE );
+    m_head.assign( n, THREAD_NONE );
+    m_tail.assign( n, THREAD_NONE );
+    m_shown.assign( n, THREAD_NONE );
+    m_roots.clear();
+
+    for( size_t i = 0; i < order.size(); i++ )
+    {
+        uint32_t row = order[i];
+        uint32_t c   = ( row < m_rows.size() ) ? m_rows[row] : THREAD_NONE;
+        if ( c == THREAD_NONE )
+        {
+            m_roots.push_back( THREAD_LONE_ROW | row );
+            continue;
+        }
+
+        if ( m_first[c] != THREAD_NONE )
+            continue;
+        m_first[c] = i;
+
+        while( true )
+        {
+            uint32_t p = m_containers[c].parent;
+            if ( p == THREAD_NONE )
+            {
+                m_roots.push_back( c );
+                break;
+            }
+
+            if ( m_tail[p] == THREAD_NONE )
+                m_head[p] = c;
+            else
+                m_shown[m_tail[p]] = c;
+            m_tail[p] = c;
+
+            if ( m_first[p] != THREAD_NONE )
+                break;
+
+            m_first[p] = i;
+            c = p;
+        }
+    }
+
+    /**
+     * Walk each tree, depth first.  A container without a message isn't
+     * shown, and its children are shown at its depth.
+     */
+    rows.reserve( order.size() );
+    depths.reserve( order.size() );
+
+    std::vector<uint64_t>::iterator it;
+    for (it = m_roots.begin(); it != m_roots.end(); ++it)
+    {
+        if ( *it & THREAD_LONE_ROW )
+        {
+            rows.push_back( (uint32_t)*it );
+            depths.push_back( 0 );
+            continue;
+        }
+
+        uint32_t root  = (uint32_t)*it;
+        uint32_t c     = root;
+        uint32_t depth = 0;
+
+        while( c != THREAD_NONE )
+        {
+            bool present = ( m_containers[c].row != THREAD_NONE );
+            if ( present )
+            {
+                rows.push_back( m_containers[c].row );
+                depths.push_back( depth > 0xffff ? 0xffff : depth );
+            }
+
+            /**
+             * Down to the first reply, or along to the next sibling, or
+             * back up until there is one.
+             */
+            if ( m_head[c] != THREAD_NONE )
+            {
+                depth += present ? 1 : 0;
+                c = m_head[c];
+                continue;
+            }
+
+            while( c != root && m_shown[c] == THREAD_NONE )
+            {
+                c = m_containers[c].parent;
+                depth -= ( m_containers[c].row != THREAD_NONE ) ? 1 : 0;
+            }
+            c = ( c == root ) ? THREAD_NONE : m_shown[c];
+        }
+    }
+}
+
+
+/**
+ * Draw the tree for each of a list of depths.
+ *
+ * Working backwards we know, at each depth, whether another message
+ * follows at that depth before the thread climbs above it: that decides
+ * between "|->" and "`->" for a message, and "| " or "  " beneath each of
+ * its ancestors.
+ */
+void CThreader::glyphs( const std::vector<uint16_t> &depths, std::vector<std::string> &out )
+{
+    out.resize( depths.size() );
+
+    std::vector<bool> more;
+    for( size_t i = depths.size(); i-- > 0; )
+    {
+        size_t depth = depths[i];
+        std::string &glyph = out[i];
+        glyph.clear();
+
+        for( size_t level = 1; level < depth; level++ )
+            glyph += ( level < more.size() && more[level] ) ? "| " : "  ";
+        if ( depth > 0 )
+            glyph += ( depth < more.size() && more[depth] ) ? "|-> " : "`-> ";
+
+        more.resize( depth + 1, false );
+        more[depth] = true;
+    }
+}
+
+
+/**
+ * Append the message-ids found in the given header to the list.
+ */
+void CThreader::parse_ids( const std::string &text, std::vector<std::string> &ids )
+{
+    size_t pos = 0;
+    TStringRef id;
+
+    while( next_id( text, &pos, &id ) )
+        ids.push_back( id.str() );
+}
+
+
+/**
+ * Find the next message-id in the given text: the text between a pair
+ * of angle brackets.
+ */
+bool CThreader::next_id( const std::string &text, size_t *pos, TStringRef *id )
+{
+    size_t start;
+    while( ( start = text.find( '<', *pos ) ) != std::string::npos )
+    {
+        size_t end = text.find( '>', start + 1 );
+        if ( end == std::string::npos )
+            break;
+
+        *pos = end + 1;
+        if ( end > start + 1 )
+        {
+            *id = TStringRef( text.data() + start + 1, end - start - 1 );
+            return true;
+        }
+    }
+
+    *pos = text.size();
+    return false;
+}
+
+
+/**
+ * Get the container for the given message-id, creating it if need be.
+ */
+uint32_t CThreader::container( const TStringRef &id )
+{
+    uint64_t h = hash( id );
+
+    if ( ! m_index.empty() )
+    {
+        size_t mask = m_index.size() - 1;
+        for( size_t slot = h & mask; m_index[slot] != INDEX_EMPTY; slot = ( slot + 1 ) & mask )
+        {
+            uint32_t c = m_index[slot];
+            if ( c == INDEX_DELETED || m_containers[c].hash != h )
+                continue;
+
+            const TContainer &t = m_containers[c];
+            if ( t.name_len == id.size && memcmp( m_names.data() + t.name, id.data, id.size ) == 0 )
+                return( c );
+        }
+    }
+
+    /**
+     * Ids too long to store are never looked up, so they're unique.
+     */
+    uint32_t c = allocate();
+    if ( id.size > 0xffff )
+        return( c );
+
+    compact();
+
+    m_containers[c].name     = m_names.size();
+    m_containers[c].name_len = id.size;
+    m_containers[c].hash     = h;
+    m_names.append( id.data, id.size );
+    index( c );
+    return( c );
+}
+
+
+/**
+ * The hash we index a message-id by: eight bytes at a time, as each id
+ * is hashed once per message which refers to it.
+ */
+uint64_t CThreader::hash( const TStringRef &id )
+{
+    uint64_t h = 14695981039346656037ULL ^ id.size;
+    size_t i = 0;
+
+    for( ; i + 8 <= id.size; i += 8 )
+    {
+        uint64_t word;
+        memcpy( &word, id.data + i, 8 );
+        h = ( h ^ word ) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    for( ; i < id.size; i++ )
+        h = ( h ^ (unsigned char)id.data[i] ) * 1099511628211ULL;
+
+    return( h ^ ( h >> 32 ) );
+}
+
+
+/**
+ * Add the given container to our index.
+ */
+void CThreader::index( uint32_t c )
+{
+    if ( ( m_index_used + 1 ) * 2 > m_index.size() )
+        reindex( m_ids + 1 );
+
+    size_t mask = m_index.size() - 1;
+    size_t slot = m_containers[c].hash & mask;
+
+    while( m_index[slot] != INDEX_EMPTY && m_index[slot] != INDEX_DELETED )
+        slot = ( slot + 1 ) & mask;
+
+    if ( m_index[slot] == INDEX_EMPTY )
+        m_index_used += 1;
+    m_index[slot] = c;
+    m_ids += 1;
+}
+
+
+/**
+ * Remove the given container from our index.
+ */
+void CThreader::unindex( uint32_t c )
+{
+    size_t mask = m_index.size() - 1;
+    size_t slot = m_containers[c].hash & mask;
+
+    while( m_index[slot] != INDEX_EMPTY )
+    {
+        if ( m_index[slot] == c )
+        {
+            m_index[slot] = INDEX_DELETED;
+            m_ids -= 1;
+            return;
+        }
+        slot = ( slot + 1 ) & mask;
+    }
+}
+
+
+/**
+ * Resize the index to hold at least the given number of ids, dropping
+ * any deleted slots.
+ */
+void CThreader::reindex( size_t ids )
+{
+    size_t capacity = 1024;
+    while( capacity < ids * 4 )
+        capacity *= 2;
+
+    m_index.assign( capacity, INDEX_EMPTY );
+    m_index_used = 0;
+
+    size_t mask = capacity - 1;
+    for( uint32_t c = 0; c < m_containers.size(); c++ )
+    {
+        if ( ! m_containers[c].used || m_containers[c].name_len == 0 )
+            continue;
+
+        size_t slot = m_containers[c].hash & mask;
+        while( m_index[slot] != INDEX_EMPTY )
+            slot = ( slot + 1 ) & mask;
+
+        m_index[slot] = c;
+        m_index_used += 1;
+    }
+}
+
+
+/**
+ * Allocate an empty container.
+ */
+uint32_t CThreader::allocate()
+{
+    uint32_t c;
+    if ( ! m_free.empty() )
+    {
+        c = m_free.back();
+        m_free.pop_back();
+    }
+    else
+    {
+        c = m_containers.size();
+        m_containers.push_back( TContainer() );
+    }
+
+    TContainer &t = m_containers[c];
+    t.row    = THREAD_NONE;
+    t.parent = THREAD_NONE;
+    t.child  = THREAD_NONE;
+    t.next   = THREAD_NONE;
+    t.name     = 0;
+    t.name_len = 0;
+    t.used     = true;
+    return( c );
+}
+
+
+/**
+ * Is a an ancestor of, or the same as, b?
+ */
+bool CThreader::ancestor( uint32_t a, uint32_t b )
+{
+    for( uint32_t c = b; c != THREAD_NONE; c = m_containers[c].parent )
+    {
+        if ( c == a )
+            return true;
+    }
+    return false;
+}
+
+
+/**
+ * Make parent the parent of child.
+ */
+void CThreader::link( uint32_t parent, uint32_t child )
+{
+    m_containers[child].parent = parent;
+    m_containers[child].next   = m_containers[parent].child;
+    m_containers[parent].child = child;
+}
+
+
+/**
+ * Make child a root.
+ */
+void CThreader::unlink( uint32_t child )
+{
+    uint32_t parent = m_containers[child].parent;
+    if ( parent == THREAD_NONE )
+        return;
+
+    uint32_t *link = &m_containers[parent].child;
+    while( *link != child )
+        link = &m_containers[*link].next;
+    *link = m_containers[child].next;
+
+    m_containers[child].parent = THREAD_NONE;
+    m_containers[child].next   = THREAD_NONE;
+}
+
+
+/**
+ * Free empty containers without children, from the given one up.
+ */
+void CThreader::prune( uint32_t c )
+{
+    while( c != THREAD_NONE )
+    {
+        TContainer &t = m_containers[c];
+        if ( ! t.used || t.row != THREAD_NONE || t.child != THREAD_NONE )
+            return;
+
+        uint32_t parent = t.parent;
+        unlink( c );
+
+        if ( t.name_len > 0 )
+        {
+            unindex( c );
+            m_garbage += t.name_len;
+        }
+
+        t.name_len = 0;
+        t.used     = false;
+        m_free.push_back( c );
+
+        c = parent;
+    }
+}
+
+
+/**
+ * Rebuild the name arena, once more than half of it belongs to freed
+ * containers.
+ */
+void CThreader::compact()
+{
+    if ( m_garbage < 65536 || m_garbage * 2 < m_names.size() )
+        return;
+
+    std::string names;
+    names.reserve( m_names.size() - m_garbage );
+
+    std::vector<TContainer>::iterator it;
+    for (it = m_containers.begin(); it != m_containers.end(); ++it)
+    {
+        if ( ! it->used || it->name_len == 0 )
+            continue;
+
+        uint32_t offset = names.size();
+        names.append( m_names, it->name, it->name_len );
+        it->name = offset;
+    }
+
+    m_names.swap( names );
+    m_garbage = 0;
+}
@@ -0,0 +1,225 @@
+/**
+ * threader.h - Conversation threads for the message index.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _threader_h_
+#define _threader_h_ 1
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "stringref.h"
+
+
+/**
+ * The value we use for "no container", and "no row".
+ */
+#define THREAD_NONE ( (uint32_t) -1 )
+
+
+/**
+ * Messages grouped into conversations, using Jamie Zawinski's algorithm.
+ *
+ * Each message-id seen, whether on a message or in the References of
+ * one, gets a container, and the References of each message link those
+ * containers into trees.  A container without a message stands in for a
+ * message we don't have, such as the start of a thread in another folder.
+ *
+ * The containers are kept between updates: a message arriving links its
+ * own containers in, and one going away empties its container, which is
+ * dropped once nothing hangs from it.  Only flattening the trees into the
+ * order they're shown walks every message.
+ *
+ * Messages are identified by their row in the message table.
+ */
+class CThreader
+{
+
+public:
+
+    /**
+     * Constructor.
+     */
+    CThreader();
+
+    /**
+     * Add the message in the given row, from its headers.
+     */
+    void add( uint32_t row, const std::string &message_id,
+              const std::string &references, const std::string &in_reply_to );
+
+    /**
+     * Remove the message in the given row.
+     */
+    void remove( uint32_t row );
+
+    /**
+     * Forget every message.
+     */
+    void clear();
+
+    /**
+     * Make room for the given number of messages, before adding them.
+     */
+    void reserve( size_t messages );
+
+    /**
+     * The number of messages held.
+     */
+    size_t size() { return( m_messages ); }
+
+    /**
+     * Flatten the threads of the given rows, which are in sorted order,
+     * into the order they're shown, with the depth of each in its thread.
+     *
+     * Threads are ordered by their first message, in the given order, as
+     * are the replies to each message.  A missing message is skipped, and
+     * its replies take its place.  Rows we don't hold are shown on their
+     * own.
+     */
+    void flatten( const std::vector<uint32_t> &order,
+                  std::vector<uint32_t> &rows, std::vector<uint16_t> &depths );
+
+    /**
+     * Draw the tree for each of a list of depths, as produced by flatten,
+     * such as "| `-> ".  The top of each thread gets "".
+     */
+    static void glyphs( const std::vector<uint16_t> &depths, std::vector<std::string> &out );
+
+    /**
+     * Append the message-ids found in the given header to the list.
+     */
+    static void parse_ids( const std::string &text, std::vector<std::string> &ids );
+
+private:
+
+    /**
+     * Find the next message-id in the given text, from *pos.
+     */
+    static bool next_id( const std::string &text, size_t *pos, TStringRef *id );
+
+    /**
+     * A container: the row of its message, if we have it, and its place
+     * in the tree.  Children are a singly-linked list.
+     */
+    struct TContainer
+    {
+        uint32_t row;
+        uint32_t parent;
+        uint32_t child;
+        uint32_t next;
+        uint32_t name;
+        uint16_t name_len;
+        bool used;
+        uint64_t hash;
+    };
+
+    /**
+     * Get the container for the given message-id, creating it if need be.
+     */
+    uint32_t container( const TStringRef &id );
+
+    /**
+     * The hash we index a message-id by.
+     */
+    static uint64_t hash( const TStringRef &id );
+
+    /**
+     * Add the given container to our index, or remove it.
+     */
+    void index( uint32_t c );
+    void unindex( uint32_t c );
+
+    /**
+     * Resize the index to hold at least the given number of ids.
+     */
+    void reindex( size_t ids );
+
+    /**
+     * Rebuild the name arena, dropping the ids of freed containers.
+     */
+    void compact();
+
+    /**
+     * Allocate an empty container.
+     */
+    uint32_t allocate();
+
+    /**
+     * Is a an ancestor of, or the same as, b?
+     */
+    bool ancestor( uint32_t a, uint32_t b );
+
+    /**
+     * Make parent the parent of child, or make child a root.
+     */
+    void link( uint32_t parent, uint32_t child );
+    void unlink( uint32_t child );
+
+    /**
+     * Free empty containers without children, from the given one up.
+     */
+    void prune( uint32_t c );
+
+    /**
+     * The containers, and those free for reuse.
+     */
+    std::vector<TContainer> m_containers;
+    std::vector<uint32_t> m_free;
+
+    /**
+     * Message-id -> container: an open-addressed table of container
+     * numbers, probed linearly, and the number of slots in use.
+     *
+     * Looking an id up needs neither a copy of it nor an allocation, which
+     * matters as every message repeats the ids of those before it.
+     */
+    std::vector<uint32_t> m_index;
+    size_t m_index_used;
+    size_t m_ids;
+
+    /**
+     * The message-ids of all containers, end to end, and the number of
+     * bytes which belong to freed ones.
+     */
+    std::string m_names;
+    size_t m_garbage;
+
+    /**
+     * Row -> container.
+     */
+    std::vector<uint32_t> m_rows;
+
+    /**
+     * The number of messages held.
+     */
+    size_t m_messages;
+
+    /**
+     * Scratch space.
+     */
+    std::vector<uint32_t> m_touched;
+    std::vector<uint32_t> m_first;
+    std::vector<uint32_t> m_head;
+    std::vector<uint32_t> m_tail;
+    std::vector<uint32_t> m_shown;
+    std::vector<uint64_t> m_roots;
+
+};
+
+#endif /* _threader_h_ */
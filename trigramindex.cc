@@ -0,0 +1,138 @@
+/**
+ * trigramindex.cc - An index of the three-character substrings of text.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+#include "trigramindex.h"
+
+
+/**
+ * Constructor.
+ */
+CTrigramIndex::CTrigramIndex()
+{
+    m_added = 0;
+}
+
+
+/**
+ * Index the text of the given row.
+ */
+void CTrigramIndex::add( uint32_t row, const TStringRef &text )
+{
+    m_added += 1;
+
+    if ( text.size < 3 )
+        return;
+
+    m_scratch.clear();
+    for( size_t i = 0; i + 3 <= text.size; i++ )
+        m_scratch.push_back( trigram( text.data + i ) );
+
+    std::sort( m_scratch.begin(), m_scratch.end() );
+    m_scratch.erase( std::unique( m_scratch.begin(), m_scratch.end() ), m_scratch.end() );
+
+    std::vector<uint32_t>::iterator it;
+    for (it = m_scratch.begin(); it != m_scratch.end(); ++it)
+    {
+        TPostings &postings = m_postings[*it];
+        if ( postings.rows.empty() )
+            postings.sorted = true;
+        else if ( postings.rows.back() >= row )
+            postings.sorted = false;
+
+        postings.rows.push_back( row );
+    }
+}
+
+
+/**
+ * Forget everything.
+ */
+void CTrigramIndex::clear()
+{
+    m_postings.clear();
+    m_added = 0;
+}
+
+
+/**
+ * Sort a posting-list, and drop duplicates.
+ */
+void CTrigramIndex::tidy( TPostings &postings )
+{
+    if ( postings.sorted )
+        return;
+
+    std::sort( postings.rows.begin(), postings.rows.end() );
+    postings.rows.erase( std::unique( postings.rows.begin(), postings.rows.end() ), postings.rows.end() );
+    postings.sorted = true;
+}
+
+
+/**
+ * Find the rows which may contain the given substring.
+ *
+ * The shortest posting-list is the starting point, and each of the
+ * others narrows it down.
+ */
+bool CTrigramIndex::candidates( const TStringRef &needle, std::vector<uint32_t> &rows )
+{
+    rows.clear();
+
+    if ( needle.size < 3 )
+        return false;
+
+    std::vector<TPostings *> lists;
+    for( size_t i = 0; i + 3 <= needle.size; i++ )
+    {
+        std::unordered_map<uint32_t, TPostings>::iterator it = m_postings.find( trigram( needle.data + i ) );
+        if ( it == m_postings.end() )
+            return true;
+
+        tidy( it->second );
+        lists.push_back( &it->second );
+    }
+
+    /**
+     * A trigram may repeat within the needle, so equal lists are made
+     * adjacent, and dropped.
+     */
+    std::sort( lists.begin(), lists.end(), []( const TPostings *a, const TPostings *b )
+    {
+        if ( a->rows.size() != b->rows.size() )
+            return( a->rows.size() < b->rows.size() );
+        return( std::less<const TPostings *>()( a, b ) );
+    } );
+    lists.erase( std::unique( lists.begin(), lists.end() ), lists.end() );
+
+    rows = lists[0]->rows;
+
+    std::vector<uint32_t> both;
+    for( size_t i = 1; i < lists.size() && ! rows.empty(); i++ )
+    {
+        both.clear();
+        std::set_intersection( rows.begin(), rows.end(),
+                               lists[i]->rows.begin(), lists[i]->rows.end(),
+                               std::back_inserter( both ) );
+        rows.swap( both );
+    }
+    return true;
+}
@@ -0,0 +1,119 @@
+/**
+ * trigramindex.h - An index of the three-character substrings of text.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _trigramindex_h_
+#define _trigramindex_h_ 1
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "stringref.h"
+
+
+/**
+ * An index from each trigram, i.e. run of three bytes, to the rows whose
+ * text contains it.
+ *
+ * Any text containing a given substring contains each of its trigrams,
+ * so intersecting their posting-lists gives a short list of candidates,
+ * which the caller verifies.  Candidates are therefore allowed to be
+ * wrong, and the index is never updated in place: re-adding a row only
+ * adds its new trigrams, the old ones becoming stale.  clear() and a
+ * rebuild drop them, once there are enough to matter.
+ *
+ * Matching is byte-for-byte, and so case-sensitive, as strstr() is.
+ */
+class CTrigramIndex
+{
+
+public:
+
+    /**
+     * Constructor.
+     */
+    CTrigramIndex();
+
+    /**
+     * Index the text of the given row.
+     */
+    void add( uint32_t row, const TStringRef &text );
+
+    /**
+     * Forget everything.
+     */
+    void clear();
+
+    /**
+     * Find the rows which may contain the given substring, in ascending
+     * order.  Returns false if the substring is too short to look up, in
+     * which case every row is a candidate.
+     */
+    bool candidates( const TStringRef &needle, std::vector<uint32_t> &rows );
+
+    /**
+     * The number of rows added, including those added more than once.
+     */
+    size_t added() { return( m_added ); }
+
+private:
+
+    /**
+     * The rows containing a trigram.  They arrive mostly in order, and
+     * are sorted, and duplicates dropped, when next looked up.
+     */
+    struct TPostings
+    {
+        std::vector<uint32_t> rows;
+        bool sorted;
+    };
+
+    /**
+     * Sort a posting-list, if required.
+     */
+    static void tidy( TPostings &postings );
+
+    /**
+     * The trigram starting at the given position.
+     */
+    static uint32_t trigram( const char *p )
+    {
+        return( ( (uint32_t)(unsigned char)p[0] << 16 ) |
+                ( (uint32_t)(unsigned char)p[1] << 8 ) |
+                  (uint32_t)(unsigned char)p[2] );
+    }
+
+    /**
+     * The posting-list of each trigram.
+     */
+    std::unordered_map<uint32_t, TPostings> m_postings;
+
+    /**
+     * Scratch space for the trigrams of one text.
+     */
+    std::vector<uint32_t> m_scratch;
+
+    /**
+     * The number of calls to add().
+     */
+    size_t m_added;
+
+};
+
+#endif /* _trigramindex_h_ */
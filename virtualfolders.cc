@@ -0,0 +1,460 @@
+/**
+ * virtualfolders.cc - Folders made of the messages matching a saved query.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <algorithm>
+#include <memory>
+#include <string.h>
+
+#include "flags.h"
+#include "format.h"
+#include "headerpool.h"
+#include "virtualfolders.h"
+
+
+/**
+ * Instance-handle.
+ */
+CVirtualFolders *CVirtualFolders::pinstance = NULL;
+
+
+/**
+ * Get access to our singleton-object.
+ */
+CVirtualFolders *CVirtualFolders::Instance()
+{
+    if (!pinstance)
+        pinstance = new CVirtualFolders;
+
+    return pinstance;
+}
+
+
+/**
+ * Constructor - This is private as this class is a singleton.
+ */
+CVirtualFolders::CVirtualFolders()
+{
+    m_version = 0;
+}
+
+
+/**
+ * A folder, which is filled when next refreshed.
+ *
+ * Only the flags come from the path of a message: any other field means
+ * looking up its headers.
+ */
+CVirtualFolders::TVirtualFolder::TVirtualFolder( const std::string &n, const std::string &q )
+    : name( n ), text( q ), query( q ), stale( true ), unread( 0 )
+{
+    headers = query.needs( QUERY_FROM ) || query.needs( QUERY_TO ) ||
+              query.needs( QUERY_SUBJECT ) || query.needs( QUERY_LINE ) ||
+              query.needs( QUERY_DATE ) || query.needs( QUERY_SIZE );
+}
+
+
+/**
+ * Define, or remove, the named folder.
+ */
+std::string CVirtualFolders::define( const std::string &name, const std::string &query )
+{
+    std::vector<TVirtualFolder>::iterator it;
+    for (it = m_folders.begin(); it != m_folders.end(); ++it)
+    {
+        if ( it->name == name )
+            break;
+    }
+
+    if ( query.empty() )
+    {
+        if ( it != m_folders.end() )
+        {
+            m_folders.erase( it );
+            m_version += 1;
+        }
+        return "";
+    }
+
+    TVirtualFolder folder( name, query );
+    if ( ! folder.query.error().empty() )
+        return( folder.query.error() );
+
+    if ( it != m_folders.end() )
+        *it = folder;
+    else
+        m_folders.push_back( folder );
+
+    m_version += 1;
+    return "";
+}
+
+
+/**
+ * The names of the folders.
+ */
+std::vector<std::string> CVirtualFolders::names()
+{
+    std::vector<std::string> result;
+
+    std::vector<TVirtualFolder>::iterator it;
+    for (it = m_folders.begin(); it != m_folders.end(); ++it)
+        result.push_back( it->name );
+
+    return( result );
+}
+
+
+/**
+ * The query of the named folder.
+ */
+std::string CVirtualFolders::query( const std::string &name )
+{
+    TVirtualFolder *folder = find( name );
+    return( folder ? folder->text : "" );
+}
+
+
+/**
+ * Is the given path that of a virtual folder?
+ */
+bool CVirtualFolders::is_virtual( const std::string &path )
+{
+    return( path.compare( 0, strlen( VIRTUAL_FOLDER_PREFIX ), VIRTUAL_FOLDER_PREFIX ) == 0 );
+}
+
+
+/**
+ * The path of the named folder.
+ */
+std::string CVirtualFolders::path_of( const std::string &name )
+{
+    return( VIRTUAL_FOLDER_PREFIX + name );
+}
+
+
+/**
+ * The name of the folder at the given path.
+ */
+std::string CVirtualFolders::name_of( const std::string &path )
+{
+    return( is_virtual( path ) ? path.substr( strlen( VIRTUAL_FOLDER_PREFIX ) ) : "" );
+}
+
+
+/**
+ * Does any folder need filling?
+ */
+bool CVirtualFolders::stale()
+{
+    std::vector<TVirtualFolder>::iterator it;
+    for (it = m_folders.begin(); it != m_folders.end(); ++it)
+    {
+        if ( it->stale )
+            return true;
+    }
+    return false;
+}
+
+
+/**
+ * Set the format of the index.  Folders with bare words in their query
+ * must be filled again if it changes.
+ */
+void CVirtualFolders::set_format( const std::string &format )
+{
+    if ( format == m_format )
+        return;
+
+    m_format = format;
+
+    std::vector<TVirtualFolder>::iterator it;
+    for (it = m_folders.begin(); it != m_folders.end(); ++it)
+    {
+        if ( it->query.needs( QUERY_LINE ) )
+            it->stale = true;
+    }
+}
+
+
+/**
+ * Fill any stale folders.
+ *
+ * The headers are read a batch at a time, on the header-pool if it has
+ * threads, and only if some query needs them.  Messages which can no
+ * longer be found are skipped.
+ */
+void CVirtualFolders::refresh( const std::vector<std::string> &paths )
+{
+    std::vector<TVirtualFolder>::iterator it;
+    std::vector<TVirtualFolder *> stale;
+    bool headers = false;
+    for (it = m_folders.begin(); it != m_folders.end(); ++it)
+    {
+        if ( ! it->stale )
+            continue;
+
+        it->messages.clear();
+        it->unread = 0;
+        headers = headers || it->headers;
+        stale.push_back( &*it );
+    }
+
+    if ( stale.empty() )
+        return;
+
+    CHeaderPool *pool = CHeaderPool::Instance();
+    std::vector<std::shared_ptr<THeaderSlot> > slots;
+    THeaderEntry none = THeaderEntry();
+
+    for( size_t start = 0; start < paths.size(); start += VIRTUAL_FOLDER_BATCH )
+    {
+        size_t end = std::min( paths.size(), start + VIRTUAL_FOLDER_BATCH );
+
+        slots.clear();
+        if ( headers )
+        {
+            for( size_t i = start; i < end; i++ )
+            {
+                slots.push_back( std::make_shared<THeaderSlot>( paths[i] ) );
+                if ( pool->threads() > 0 )
+                    pool->submit( slots.back() );
+                else
+                    CHeaderPool::parse( *slots.back() );
+            }
+            if ( pool->threads() > 0 )
+                pool->wait();
+        }
+
+        for( size_t i = start; i < end; i++ )
+        {
+            const THeaderEntry *entry = &none;
+            if ( headers )
+            {
+                THeaderSlot &slot = *slots[i - start];
+                if ( slot.state.load( std::memory_order_acquire ) != SLOT_READY )
+                    continue;
+                entry = &slot.entry;
+            }
+
+            std::vector<TVirtualFolder *>::iterator sit;
+            for (sit = stale.begin(); sit != stale.end(); ++sit)
+            {
+                if ( matches( **sit, paths[i], *entry ) )
+                    insert( **sit, paths[i] );
+            }
+        }
+    }
+
+    std::vector<TVirtualFolder *>::iterator sit;
+    for (sit = stale.begin(); sit != stale.end(); ++sit)
+        (*sit)->stale = false;
+
+    m_version += 1;
+}
+
+
+/**
+ * The path of a message changed.
+ *
+ * The message is dropped from each folder under its old path, and tested
+ * against each query under its new one, as its flags may have changed.
+ * Its headers are looked up at most once.
+ */
+void CVirtualFolders::changed( const std::string &from, const std::string &to )
+{
+    std::vector<TVirtualFolder>::iterator it;
+
+    if ( from.empty() && to.empty() )
+    {
+        for (it = m_folders.begin(); it != m_folders.end(); ++it)
+            it->stale = true;
+
+        m_version += 1;
+        return;
+    }
+
+    THeaderEntry entry = THeaderEntry();
+    bool read    = false;
+    bool present = true;
+
+    for (it = m_folders.begin(); it != m_folders.end(); ++it)
+    {
+        if ( it->stale )
+            continue;
+
+        bool changed = false;
+        if ( ! from.empty() )
+            changed = erase( *it, from );
+
+        if ( ! to.empty() )
+        {
+            if ( it->headers && ! read )
+            {
+                THeaderSlot slot( to );
+                CHeaderPool::parse( slot );
+
+                present = ( slot.state.load( std::memory_order_acquire ) == SLOT_READY );
+                entry   = slot.entry;
+                read    = true;
+            }
+
+            if ( ( present || ! it->headers ) && matches( *it, to, entry ) )
+                changed = insert( *it, to ) || changed;
+        }
+
+        if ( changed )
+            m_version += 1;
+    }
+}
+
+
+/**
+ * The messages in the named folder.
+ */
+const std::unordered_set<std::string> *CVirtualFolders::messages( const std::string &name )
+{
+    TVirtualFolder *folder = find( name );
+    return( folder ? &folder->messages : NULL );
+}
+
+
+/**
+ * The number of messages in the named folder.
+ */
+size_t CVirtualFolders::count( const std::string &name )
+{
+    TVirtualFolder *folder = find( name );
+    return( folder ? folder->messages.size() : 0 );
+}
+
+
+/**
+ * The number of new messages in the named folder.
+ */
+size_t CVirtualFolders::unread( const std::string &name )
+{
+    TVirtualFolder *folder = find( name );
+    return( folder ? folder->unread : 0 );
+}
+
+
+/**
+ * Find the named folder.
+ */
+CVirtualFolders::TVirtualFolder *CVirtualFolders::find( const std::string &name )
+{
+    std::vector<TVirtualFolder>::iterator it;
+    for (it = m_folders.begin(); it != m_folders.end(); ++it)
+    {
+        if ( it->name == name )
+            return( &*it );
+    }
+    return( NULL );
+}
+
+
+/**
+ * Does the message match the folder?
+ *
+ * A bare word matches the index line, which is expanded from the cached
+ * headers: the fields which need the full Date header parsed, $YEAR,
+ * $MONTH and $DAY, are left empty.
+ */
+bool CVirtualFolders::matches( TVirtualFolder &folder, const std::string &path, const THeaderEntry &entry )
+{
+    return( folder.query.matches(
+        [this, &path, &entry]( TQueryField field ) -> const std::string &
+        {
+            switch( field ) {
+            case QUERY_FROM:    return( entry.from );
+            case QUERY_TO:      return( entry.to );
+            case QUERY_SUBJECT: return( entry.subject );
+            default: break;
+            }
+
+            m_line.clear();
+            CFormat::compiled( m_format )->append( m_line, [&path, &entry]( TFormatField field, std::string &out )
+            {
+                switch( field ) {
+                case FIELD_FLAGS:
+                {
+                    size_t start = out.size();
+                    CFlags::render( flags( path ), out );
+                    if ( out.size() - start < 4 )
+                        out.append( 4 - ( out.size() - start ), ' ' );
+                    break;
+                }
+                case FIELD_FROM:    out += entry.from;    break;
+                case FIELD_TO:      out += entry.to;      break;
+                case FIELD_SUBJECT: out += entry.subject; break;
+                case FIELD_DATE:    out += entry.date;    break;
+                default: break;
+                }
+            } );
+            return( m_line );
+        },
+        [&path, &entry]( TQueryField field ) -> int64_t
+        {
+            switch( field ) {
+            case QUERY_DATE: return( entry.date_epoch ? entry.date_epoch : entry.mtime );
+            case QUERY_SIZE: return( entry.size );
+            default: break;
+            }
+            return( (int64_t)flags( path ) );
+        } ) );
+}
+
+
+/**
+ * Add a message to a folder.
+ */
+bool CVirtualFolders::insert( TVirtualFolder &folder, const std::string &path )
+{
+    if ( ! folder.messages.insert( path ).second )
+        return false;
+
+    if ( flags( path ) & CFlags::bit( 'N' ) )
+        folder.unread += 1;
+    return true;
+}
+
+
+/**
+ * Remove a message from a folder.
+ */
+bool CVirtualFolders::erase( TVirtualFolder &folder, const std::string &path )
+{
+    if ( folder.messages.erase( path ) == 0 )
+        return false;
+
+    if ( flags( path ) & CFlags::bit( 'N' ) )
+        folder.unread -= 1;
+    return true;
+}
+
+
+/**
+ * The flags of the message at the given path.
+ */
+uint64_t CVirtualFolders::flags( const std::string &path )
+{
+    uint64_t result = CFlags::parse( path );
+    if ( CFlags::in_new( path ) )
+        result |= CFlags::bit( 'N' );
+    return( result );
+}
@@ -0,0 +1,206 @@
+/**
+ * virtualfolders.h - Folders made of the messages matching a saved query.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _virtualfolders_h_
+#define _virtualfolders_h_ 1
+
+#include <stdint.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "headercache.h"
+#include "query.h"
+
+
+/**
+ * The prefix which marks the path of a virtual folder.
+ */
+#define VIRTUAL_FOLDER_PREFIX "virtual:"
+
+
+/**
+ * The number of messages whose headers are read at once when a folder
+ * is filled.
+ */
+#define VIRTUAL_FOLDER_BATCH 1024
+
+
+/**
+ * A singleton holding the virtual folders: named queries over the
+ * messages of every maildir.
+ *
+ * Each folder holds the paths of the messages matching its query.  It is
+ * filled once, from a list of every message, and then kept up to date as
+ * messages arrive, change their flags, or go away.  The headers a query
+ * needs come from the header-cache, so neither filling a folder nor
+ * opening one reads a directory.
+ *
+ * Virtual folders appear alongside the maildirs, with a path made of
+ * VIRTUAL_FOLDER_PREFIX and their name.
+ */
+class CVirtualFolders
+{
+
+public:
+
+    /**
+     * Get access to the singleton instance.
+     */
+    static CVirtualFolders *Instance();
+
+    /**
+     * Define the named folder, replacing any previous query, or remove
+     * it if the query is empty.  Returns the reason the query is invalid,
+     * or "".
+     */
+    std::string define( const std::string &name, const std::string &query );
+
+    /**
+     * The names of the folders, in the order they were defined.
+     */
+    std::vector<std::string> names();
+
+    /**
+     * The query of the named folder, or "".
+     */
+    std::string query( const std::string &name );
+
+    /**
+     * Is the given path that of a virtual folder?
+     */
+    static bool is_virtual( const std::string &path );
+
+    /**
+     * The path of the named folder, or the name of the folder at a path.
+     */
+    static std::string path_of( const std::string &name );
+    static std::string name_of( const std::string &path );
+
+    /**
+     * Does any folder need filling?
+     */
+    bool stale();
+
+    /**
+     * Set the format of the index, which bare words in a query match.
+     */
+    void set_format( const std::string &format );
+
+    /**
+     * Fill any stale folders from the given list of every message.
+     */
+    void refresh( const std::vector<std::string> &paths );
+
+    /**
+     * The path of a message changed: from "" if it is new, and to "" if
+     * it has gone.  With both "" every folder is made stale.
+     */
+    void changed( const std::string &from, const std::string &to );
+
+    /**
+     * The messages in the named folder, or NULL.
+     */
+    const std::unordered_set<std::string> *messages( const std::string &name );
+
+    /**
+     * The number of messages in the named folder, and how many are new.
+     */
+    size_t count( const std::string &name );
+    size_t unread( const std::string &name );
+
+    /**
+     * A number which changes whenever any folder does.
+     */
+    unsigned int version() { return( m_version ); }
+
+protected:
+
+    /**
+     * Protected functions to allow our singleton implementation.
+     */
+    CVirtualFolders();
+    CVirtualFolders(const CVirtualFolders &);
+    CVirtualFolders & operator=(const CVirtualFolders &);
+
+private:
+
+    /**
+     * A single folder: its query, whether it needs filling, and the
+     * messages it holds.
+     */
+    struct TVirtualFolder
+    {
+        std::string name;
+        std::string text;
+        CQuery query;
+        bool headers;
+        bool stale;
+        std::unordered_set<std::string> messages;
+        size_t unread;
+
+        TVirtualFolder( const std::string &n, const std::string &q );
+    };
+
+    /**
+     * Find the named folder, or NULL.
+     */
+    TVirtualFolder *find( const std::string &name );
+
+    /**
+     * Does the message at the given path match the folder?  The entry
+     * holds its headers, if the query needs them.
+     */
+    bool matches( TVirtualFolder &folder, const std::string &path, const THeaderEntry &entry );
+
+    /**
+     * Add a message to a folder, or remove one, keeping count of those
+     * which are new.  Returns true if the folder changed.
+     */
+    bool insert( TVirtualFolder &folder, const std::string &path );
+    bool erase( TVirtualFolder &folder, const std::string &path );
+
+    /**
+     * The flags of the message at the given path, with 'N' if it is new.
+     */
+    static uint64_t flags( const std::string &path );
+
+    /**
+     * The folders.
+     */
+    std::vector<TVirtualFolder> m_folders;
+
+    /**
+     * The format of the index, and scratch space to expand it into.
+     */
+    std::string m_format;
+    std::string m_line;
+
+    /**
+     * Bumped whenever any folder changes.
+     */
+    unsigned int m_version;
+
+    /**
+     * The single instance of this class.
+     */
+    static CVirtualFolders *pinstance;
+
+};
+
+#endif /* _virtualfolders_h_ */
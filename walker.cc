@@ -0,0 +1,216 @@
+/**
+ * walker.cc - Parallel directory-tree walker.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <chrono>
+#include <thread>
+
+#include "walker.h"
+
+
+/**
+ * Constructor: start the threads, which wait for a walk.
+ */
+CWalker::CWalker( int threads )
+{
+    if ( threads < 1 )
+        threads = 1;
+    if ( threads > WALKER_MAX_THREADS )
+        threads = WALKER_MAX_THREADS;
+
+    for( int i = 0; i < threads; i++ )
+        m_queues.push_back( new TQueue );
+
+    m_pending = 0;
+    m_walk    = 0;
+    m_busy    = 0;
+    m_stop    = false;
+
+    /**
+     * The calling thread acts as worker zero.
+     */
+    for( int i = 1; i < threads; i++ )
+        m_threads.push_back( std::thread( &CWalker::run, this, i ) );
+}
+
+
+/**
+ * Destructor: stop the threads.
+ */
+CWalker::~CWalker()
+{
+    {
+        std::lock_guard<std::mutex> guard( m_lock );
+        m_stop = true;
+    }
+    m_start.notify_all();
+
+    std::vector<std::thread>::iterator tit;
+    for (tit = m_threads.begin(); tit != m_threads.end(); ++tit)
+        tit->join();
+
+    std::vector<TQueue *>::iterator it;
+    for (it = m_queues.begin(); it != m_queues.end(); ++it)
+        delete( *it );
+}
+
+
+/**
+ * The number of threads, including the caller.
+ */
+int CWalker::threads()
+{
+    return( (int)m_queues.size() );
+}
+
+
+/**
+ * Walk the tree beneath the given root.
+ */
+void CWalker::walk( std::string root, TVisitor visitor )
+{
+    m_visitor = visitor;
+    m_pending = 1;
+    m_queues[0]->items.push_back( root );
+
+    {
+        std::lock_guard<std::mutex> guard( m_lock );
+        m_busy  = m_threads.size();
+        m_walk += 1;
+    }
+    m_start.notify_all();
+
+    worker( 0 );
+
+    /**
+     * Wait for the others to finish with the visitor before we return.
+     */
+    std::unique_lock<std::mutex> lock( m_lock );
+    m_done.wait( lock, [this]() { return( m_busy == 0 ); } );
+    m_visitor = TVisitor();
+}
+
+
+/**
+ * The life of each of our threads: wait for a walk, and take part in it.
+ */
+void CWalker::run( int id )
+{
+    unsigned int seen = 0;
+
+    while( true )
+    {
+        {
+            std::unique_lock<std::mutex> lock( m_lock );
+            m_start.wait( lock, [this, seen]() { return( m_stop || m_walk != seen ); } );
+            if ( m_stop )
+                return;
+            seen = m_walk;
+        }
+
+        worker( id );
+
+        std::lock_guard<std::mutex> guard( m_lock );
+        if ( --m_busy == 0 )
+            m_done.notify_one();
+    }
+}
+
+
+/**
+ * The main-loop of each thread.
+ */
+void CWalker::worker( int id )
+{
+    std::vector<std::string> children;
+    std::string dir;
+    int idle = 0;
+
+    while( m_pending > 0 )
+    {
+        if ( ! pop( id, dir ) )
+        {
+            /**
+             * Nothing to steal: another thread is blocked reading a
+             * directory.  Don't burn a core while we wait for it.
+             */
+            if ( ++idle < 64 )
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+            continue;
+        }
+        idle = 0;
+
+        children.clear();
+        m_visitor( dir, children );
+
+        /**
+         * Account for the children before we retire the parent, so the
+         * count never touches zero while work remains.
+         */
+        if ( ! children.empty() )
+        {
+            m_pending += children.size();
+
+            TQueue *q = m_queues[id];
+            std::lock_guard<std::mutex> guard( q->lock );
+            q->items.insert( q->items.end(), children.begin(), children.end() );
+        }
+
+        m_pending -= 1;
+    }
+}
+
+
+/**
+ * Get the next directory for the given thread, stealing if required.
+ */
+bool CWalker::pop( int id, std::string &dir )
+{
+    /**
+     * Our own queue first, newest entry.
+     */
+    TQueue *own = m_queues[id];
+    {
+        std::lock_guard<std::mutex> guard( own->lock );
+        if ( ! own->items.empty() )
+        {
+            dir = own->items.back();
+            own->items.pop_back();
+            return true;
+        }
+    }
+
+    /**
+     * Otherwise steal the oldest entry from a sibling.
+     */
+    int count = m_queues.size();
+    for( int i = 1; i < count; i++ )
+    {
+        TQueue *victim = m_queues[( id + i ) % count];
+
+        std::lock_guard<std::mutex> guard( victim->lock );
+        if ( ! victim->items.empty() )
+        {
+            dir = victim->items.front();
+            victim->items.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
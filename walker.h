@@ -0,0 +1,143 @@
+/**
+ * walker.h - Parallel directory-tree walker.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _walker_h_
+#define _walker_h_ 1
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * The upper bound on the number of threads we'll run.
+ */
+#define WALKER_MAX_THREADS 64
+
+
+/**
+ * A small work-stealing thread pool for walking directory trees.
+ *
+ * The threads are started once, and sleep between walks, so a walker
+ * may be kept and used for each walk in turn.
+ *
+ * Each thread owns a queue of directories still to be visited.  It pushes
+ * the children it discovers onto the back of its own queue and pops from
+ * there too, so it works depth-first and stays local.  When its queue is
+ * empty it steals from the front of another thread's queue, which is where
+ * the largest unexplored sub-trees tend to be.
+ *
+ * The visitor is called concurrently and must be thread-safe.
+ */
+class CWalker
+{
+
+public:
+
+    /**
+     * The visitor is given a directory, and appends the paths of any
+     * sub-directories which should be visited in turn.
+     */
+    typedef std::function<void( const std::string &dir, std::vector<std::string> &children )> TVisitor;
+
+    /**
+     * Constructor: the number of threads to use, including the caller.
+     */
+    CWalker( int threads );
+
+    /**
+     * Destructor.  Stops the threads.
+     */
+    ~CWalker();
+
+    /**
+     * The number of threads, including the caller.
+     */
+    int threads();
+
+    /**
+     * Walk the tree beneath the given root, returning once every
+     * directory has been visited.
+     */
+    void walk( std::string root, TVisitor visitor );
+
+private:
+
+    /**
+     * Each of our threads waits here for a walk to take part in.
+     */
+    void run( int id );
+
+    /**
+     * The main-loop of each thread, during a walk.
+     */
+    void worker( int id );
+
+    /**
+     * Get the next directory for the given thread, stealing if required.
+     */
+    bool pop( int id, std::string &dir );
+
+    /**
+     * A per-thread queue of pending directories.
+     */
+    struct TQueue
+    {
+        std::mutex lock;
+        std::deque<std::string> items;
+    };
+
+    /**
+     * The queue belonging to each thread.
+     */
+    std::vector<TQueue *> m_queues;
+
+    /**
+     * The number of directories queued, or being visited.
+     */
+    std::atomic<long> m_pending;
+
+    /**
+     * The visitor for the current walk.
+     */
+    TVisitor m_visitor;
+
+    /**
+     * Our threads, other than the caller.
+     */
+    std::vector<std::thread> m_threads;
+
+    /**
+     * Guards the following, which start each walk, and tell the caller
+     * once every thread has finished with it.
+     */
+    std::mutex m_lock;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    unsigned int m_walk;
+    size_t m_busy;
+    bool m_stop;
+
+};
+
+#endif /* _walker_h_ */
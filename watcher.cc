@@ -0,0 +1,360 @@
+/**
+ * watcher.cc - Live maildir updates via inotify.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "debug.h"
+#include "foldercache.h"
+#include "watcher.h"
+
+
+/**
+ * The events we care about, for each kind of directory.
+ */
+#define WATCH_TREE_MASK ( IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR )
+#define WATCH_MAIL_MASK ( IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR )
+
+
+/**
+ * Instance-handle.
+ */
+CWatcher *CWatcher::pinstance = NULL;
+
+
+/**
+ * Get access to our singleton-object.
+ */
+CWatcher *CWatcher::Instance()
+{
+    if (!pinstance)
+        pinstance = new CWatcher;
+
+    return pinstance;
+}
+
+
+/**
+ * Constructor - This is private as this class is a singleton.
+ */
+CWatcher::CWatcher()
+{
+    m_everything = false;
+
+    m_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+    if ( m_fd < 0 )
+        DEBUG_LOG( "inotify is not available, live updates disabled." );
+}
+
+
+/**
+ * The inotify descriptor.
+ */
+int CWatcher::fd()
+{
+    return( m_fd );
+}
+
+
+/**
+ * Set the maildirs, and tree-directories, which should be watched.
+ */
+void CWatcher::watch_folders( std::vector<std::string> maildirs, std::vector<std::string> dirs )
+{
+    m_maildirs = maildirs;
+    m_dirs     = dirs;
+    rebuild();
+}
+
+
+/**
+ * Set the currently selected maildirs.
+ */
+void CWatcher::watch_selected( std::vector<std::string> selected )
+{
+    if ( selected == m_selected )
+        return;
+
+    m_selected = selected;
+    rebuild();
+}
+
+
+/**
+ * Watch the cur/ directory of every maildir, or only those selected.
+ */
+void CWatcher::watch_everything( bool all )
+{
+    if ( all == m_everything )
+        return;
+
+    m_everything = all;
+    rebuild();
+}
+
+
+/**
+ * Set the function which applies each batch of changes.
+ */
+void CWatcher::set_handler( THandlerFunction fn )
+{
+    m_handler = fn;
+}
+
+
+/**
+ * Add/remove watches so that we match our wanted-set.
+ */
+void CWatcher::rebuild()
+{
+    if ( m_fd < 0 )
+        return;
+
+    /**
+     * Build up the set of directories we want to watch.
+     */
+    std::unordered_map<std::string, TWatch> wanted;
+    std::vector<std::string>::iterator it;
+
+    for (it = m_dirs.begin(); it != m_dirs.end(); ++it)
+    {
+        TWatch w = { *it, "", WATCH_TREE };
+        wanted[*it] = w;
+    }
+    for (it = m_maildirs.begin(); it != m_maildirs.end(); ++it)
+    {
+        TWatch w = { *it + "/new", *it, WATCH_NEW };
+        wanted[w.path] = w;
+
+        if ( m_everything )
+        {
+            TWatch c = { *it + "/cur", *it, WATCH_CUR };
+            wanted[c.path] = c;
+        }
+    }
+    for (it = m_selected.begin(); it != m_selected.end(); ++it)
+    {
+        TWatch n = { *it + "/new", *it, WATCH_NEW };
+        TWatch c = { *it + "/cur", *it, WATCH_CUR };
+        wanted[n.path] = n;
+        wanted[c.path] = c;
+    }
+
+    /**
+     * Remove watches we no longer need.
+     */
+    std::unordered_map<std::string, int>::iterator pit;
+    for (pit = m_paths.begin(); pit != m_paths.end(); )
+    {
+        if ( wanted.find( pit->first ) == wanted.end() )
+        {
+            inotify_rm_watch( m_fd, pit->second );
+            m_watches.erase( pit->second );
+            pit = m_paths.erase( pit );
+        }
+        else
+            ++pit;
+    }
+
+    /**
+     * Add those which are new.
+     */
+    std::unordered_map<std::string, TWatch>::iterator wit;
+    for (wit = wanted.begin(); wit != wanted.end(); ++wit)
+    {
+        if ( m_paths.find( wit->first ) != m_paths.end() )
+            continue;
+
+        uint32_t mask = ( wit->second.kind == WATCH_TREE ) ? WATCH_TREE_MASK : WATCH_MAIL_MASK;
+        int wd = inotify_add_watch( m_fd, wit->first.c_str(), mask );
+        if ( wd < 0 )
+            continue;
+
+        m_watches[wd]         = wit->second;
+        m_paths[wit->first] = wd;
+    }
+}
+
+
+/**
+ * Process any pending events, without blocking.
+ */
+bool CWatcher::poll()
+{
+    if ( m_fd < 0 )
+        return false;
+
+    /**
+     * Coalesced results.
+     */
+    TWatchChanges changes;
+    changes.tree_changed = false;
+    changes.overflow     = false;
+
+    /**
+     * Pending "moved from" events, by cookie, so we can pair them up
+     * with the matching "moved to", and whether each came from a
+     * selected folder.
+     */
+    std::unordered_map<uint32_t, std::pair<std::string, bool> > moved;
+
+    /**
+     * The folder of each "moved from" a cur/ directory, by cookie, so
+     * that a message marked as new isn't taken for new mail.
+     */
+    std::unordered_map<uint32_t, std::string> from_cur;
+
+    char buf[16384] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    while( true )
+    {
+        ssize_t len = read( m_fd, buf, sizeof(buf) );
+        if ( len <= 0 )
+            break;
+
+        for( char *ptr = buf; ptr < buf + len; )
+        {
+            const struct inotify_event *ev = (const struct inotify_event *)ptr;
+            ptr += sizeof(struct inotify_event) + ev->len;
+
+            if ( ev->mask & IN_Q_OVERFLOW )
+            {
+                changes.overflow = true;
+                continue;
+            }
+
+            std::unordered_map<int, TWatch>::iterator wit = m_watches.find( ev->wd );
+            if ( wit == m_watches.end() )
+                continue;
+
+            TWatch &w = wit->second;
+
+            /**
+             * The directory itself went away.
+             */
+            if ( ev->mask & IN_IGNORED )
+            {
+                m_paths.erase( w.path );
+                m_watches.erase( wit );
+                changes.tree_changed = true;
+                continue;
+            }
+
+            if ( ev->len == 0 )
+                continue;
+
+            std::string path = w.path + "/" + ev->name;
+
+            if ( w.kind == WATCH_TREE )
+            {
+                if ( ev->mask & IN_ISDIR )
+                {
+                    CFolderCache::Instance()->invalidate( w.path );
+                    changes.tree_changed = true;
+                }
+                continue;
+            }
+
+            if ( ev->mask & IN_ISDIR )
+                continue;
+
+            /**
+             * Mail arriving in new/, other than a message moved back from
+             * cur/ of the same folder, as mark_new() does.
+             */
+            if ( ( w.kind == WATCH_CUR ) && ( ev->mask & IN_MOVED_FROM ) )
+                from_cur[ev->cookie] = w.folder;
+
+            if ( ( w.kind == WATCH_NEW ) && ( ev->mask & ( IN_CREATE | IN_MOVED_TO ) ) )
+            {
+                std::unordered_map<uint32_t, std::string>::iterator cit = from_cur.end();
+                if ( ev->mask & IN_MOVED_TO )
+                    cit = from_cur.find( ev->cookie );
+
+                if ( ( cit == from_cur.end() ) || ( cit->second != w.folder ) )
+                    changes.arrivals[w.folder] += 1;
+            }
+
+            /**
+             * Only the selected folders contribute to the index: the
+             * others matter only if we're watching everything.
+             */
+            bool selected = ( std::find( m_selected.begin(), m_selected.end(), w.folder ) != m_selected.end() );
+            if ( ! selected && ! m_everything )
+                continue;
+
+            if ( ev->mask & IN_MOVED_FROM )
+                moved[ev->cookie] = std::make_pair( path, selected );
+            else if ( ev->mask & IN_MOVED_TO )
+            {
+                std::unordered_map<uint32_t, std::pair<std::string, bool> >::iterator mit = moved.find( ev->cookie );
+                if ( mit != moved.end() )
+                {
+                    /**
+                     * A move out of a selected folder is a removal from
+                     * the messages we hold.
+                     */
+                    if ( selected )
+                        changes.renamed.push_back( std::make_pair( mit->second.first, path ) );
+                    else if ( mit->second.second )
+                    {
+                        changes.removed.push_back( mit->second.first );
+                        changes.other_added.push_back( path );
+                    }
+                    else
+                        changes.other_renamed.push_back( std::make_pair( mit->second.first, path ) );
+                    moved.erase( mit );
+                }
+                else if ( selected )
+                    changes.added.push_back( path );
+                else
+                    changes.other_added.push_back( path );
+            }
+            else if ( ev->mask & IN_CREATE )
+                ( selected ? changes.added : changes.other_added ).push_back( path );
+            else if ( ev->mask & IN_DELETE )
+                ( selected ? changes.removed : changes.other_removed ).push_back( path );
+        }
+    }
+
+    /**
+     * Anything moved out of a watched directory, to somewhere we can't
+     * see, is treated as a removal.
+     */
+    std::unordered_map<uint32_t, std::pair<std::string, bool> >::iterator mit;
+    for (mit = moved.begin(); mit != moved.end(); ++mit)
+        ( mit->second.second ? changes.removed : changes.other_removed ).push_back( mit->second.first );
+
+    /**
+     * Changes to the other folders don't change what we display.
+     */
+    bool changed = changes.tree_changed || changes.overflow ||
+        ! changes.arrivals.empty() ||
+        ! changes.added.empty() || ! changes.removed.empty() || ! changes.renamed.empty();
+
+    bool other = ! changes.other_added.empty() || ! changes.other_removed.empty() ||
+        ! changes.other_renamed.empty();
+
+    if ( ( changed || other ) && m_handler )
+        m_handler( changes );
+
+    return( changed );
+}
@@ -0,0 +1,199 @@
+/**
+ * watcher.h - Live maildir updates via inotify.
+ *
+ * This file is part of lumail: http://lumail.org/
+ *
+ * Copyright (c) 2013 by Steve Kemp.  All rights reserved.
+ *
+ **
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 dated June, 1991, or (at your
+ * option) any later version.
+ *
+ * On Debian GNU/Linux systems, the complete text of version 2 of the GNU
+ * General Public License can be found in `/usr/share/common-licenses/GPL-2'
+ */
+
+#ifndef _watcher_h_
+#define _watcher_h_ 1
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+/**
+ * A singleton which watches the maildir hierarchy with inotify.
+ *
+ * We watch:
+ *
+ *   - Every directory of the folder-tree, to notice folders coming and going.
+ *   - The new/ directory of every maildir, to notice new mail anywhere.
+ *   - The cur/ directory of each selected maildir, to track the index.
+ *   - The cur/ directory of every maildir, if asked, so that the full-text
+ *     index, and the virtual folders built upon it, see flags change.
+ *
+ * Events are drained without blocking, paired up and coalesced per
+ * folder, and then handed to the function set with set_handler(), which
+ * applies them: the loaded messages are updated in place, and the Lua
+ * hook on_new_mail(folder, count) is called once for each folder which
+ * received mail.
+ */
+
+
+/**
+ * What changed, once a batch of events has been coalesced.
+ */
+struct TWatchChanges
+{
+    /**
+     * Did folders come or go?
+     */
+    bool tree_changed;
+
+    /**
+     * Did the kernel drop events, so that we can't be incremental?
+     */
+    bool overflow;
+
+    /**
+     * The number of new messages which arrived, by folder.
+     */
+    std::map<std::string, int> arrivals;
+
+    /**
+     * Changes to the selected folders.
+     */
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    std::vector<std::pair<std::string, std::string> > renamed;
+
+    /**
+     * Changes to the folders which aren't selected, which only the
+     * full-text index needs to hear about.
+     */
+    std::vector<std::string> other_added;
+    std::vector<std::string> other_removed;
+    std::vector<std::pair<std::string, std::string> > other_renamed;
+};
+
+
+class CWatcher
+{
+
+public:
+
+    /**
+     * Get access to the singleton instance.
+     */
+    static CWatcher *Instance();
+
+    /**
+     * The inotify descriptor, or -1 if inotify isn't available.
+     */
+    int fd();
+
+    /**
+     * Set the maildirs, and tree-directories, which should be watched.
+     */
+    void watch_folders( std::vector<std::string> maildirs, std::vector<std::string> dirs );
+
+    /**
+     * Set the currently selected maildirs.
+     */
+    void watch_selected( std::vector<std::string> selected );
+
+    /**
+     * Watch the cur/ directory of every maildir, not just those selected.
+     */
+    void watch_everything( bool all );
+
+    /**
+     * The function which applies each batch of changes.
+     */
+    typedef std::function<void(TWatchChanges &)> THandlerFunction;
+
+    /**
+     * Set the function which applies each batch of changes.
+     */
+    void set_handler( THandlerFunction fn );
+
+    /**
+     * Process any pending events, without blocking, and pass on what
+     * changed.
+     *
+     * Returns true if anything changed.
+     */
+    bool poll();
+
+protected:
+
+    /**
+     * Protected functions to allow our singleton implementation.
+     */
+    CWatcher();
+    CWatcher(const CWatcher &);
+    CWatcher & operator=(const CWatcher &);
+
+private:
+
+    /**
+     * The kinds of directory we watch.
+     */
+    enum TWatchKind { WATCH_TREE, WATCH_NEW, WATCH_CUR };
+
+    /**
+     * A single watched directory.
+     */
+    struct TWatch
+    {
+        std::string path;
+        std::string folder;
+        TWatchKind kind;
+    };
+
+    /**
+     * Add/remove watches so that we match our wanted-set.
+     */
+    void rebuild();
+
+    /**
+     * The single instance of this class.
+     */
+    static CWatcher *pinstance;
+
+    /**
+     * The inotify descriptor.
+     */
+    int m_fd;
+
+    /**
+     * The folders, tree-directories, and selected folders to watch.
+     */
+    std::vector<std::string> m_maildirs;
+    std::vector<std::string> m_dirs;
+    std::vector<std::string> m_selected;
+
+    /**
+     * Are we watching every cur/ directory?
+     */
+    bool m_everything;
+
+    /**
+     * The function which applies our changes.
+     */
+    THandlerFunction m_handler;
+
+    /**
+     * Watch-descriptor -> watch, and path -> watch-descriptor.
+     */
+    std::unordered_map<int, TWatch> m_watches;
+    std::unordered_map<std::string, int> m_paths;
+
+};
+
+#endif /* _watcher_h_ */